@@ -25,7 +25,7 @@
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 #include <wordexp.h>
-#include <sys/timerfd.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include <glib.h>
@@ -44,6 +44,8 @@
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
 #include "src/shared/timeout.h"
+#include "src/shared/iso-tx.h"
+#include "src/shared/iso-rx.h"
 #include "src/shared/bap-debug.h"
 #include "print.h"
 #include "player.h"
@@ -144,6 +146,14 @@ static uint8_t bcast_code[] = BCAST_CODE;
 static bool auto_acquire = false;
 static bool auto_select = false;
 
+struct transport_tx {
+	struct iso_tx *tx;
+	struct io *io;
+	uint32_t interval;
+	uint32_t num;
+	struct queue *transports;
+};
+
 struct transport {
 	GDBusProxy *proxy;
 	int sk;
@@ -153,8 +163,10 @@ struct transport {
 	struct stat stat;
 	struct io *io;
 	uint32_t seq;
-	struct io *timer_io;
-	int num;
+	struct transport_tx *tx;
+	struct iso_rx *rx;
+	struct queue *rx_links;
+	struct transport *rx_owner;
 };
 
 struct transport_select_args {
@@ -4946,11 +4958,69 @@ static void transport_close(struct transport *transport)
 	free(transport->filename);
 }
 
+static void transport_tx_detach(void *data)
+{
+	struct transport *transport = data;
+
+	transport->tx = NULL;
+}
+
+static void transport_tx_free(struct transport_tx *tx)
+{
+	struct iso_tx_stats stats;
+
+	if (iso_tx_get_stats(tx->tx, &stats) && stats.ticks)
+		bt_shell_printf("Sent %" PRIu64 " SDUs in %" PRIu64
+				" intervals: jitter max %u us avg %u us, %"
+				PRIu64 " underruns %" PRIu64 " overruns\n",
+				stats.sdus, stats.ticks, stats.jitter_max,
+				stats.jitter_avg, stats.underruns,
+				stats.overruns);
+
+	queue_destroy(tx->transports, transport_tx_detach);
+	io_destroy(tx->io);
+	iso_tx_free(tx->tx);
+	free(tx);
+}
+
+static void transport_rx_detach(void *data)
+{
+	struct transport *transport = data;
+
+	transport->rx_owner = NULL;
+}
+
+static void transport_rx_unlink(struct transport *transport)
+{
+	struct transport *owner = transport->rx_owner;
+
+	if (owner) {
+		iso_rx_remove_stream(owner->rx, transport->sk);
+		queue_remove(owner->rx_links, transport);
+		transport->rx_owner = NULL;
+	}
+
+	queue_destroy(transport->rx_links, transport_rx_detach);
+	transport->rx_links = NULL;
+
+	iso_rx_free(transport->rx);
+	transport->rx = NULL;
+}
+
 static void transport_free(void *data)
 {
 	struct transport *transport = data;
+	struct transport_tx *tx = transport->tx;
+
+	transport_rx_unlink(transport);
+
+	if (tx) {
+		iso_tx_remove_stream(tx->tx, transport->sk);
+		queue_remove(tx->transports, transport);
+		if (queue_isempty(tx->transports))
+			transport_tx_free(tx);
+	}
 
-	io_destroy(transport->timer_io);
 	io_destroy(transport->io);
 	free(transport);
 }
@@ -4967,36 +5037,153 @@ static bool transport_disconnected(struct io *io, void *user_data)
 	return false;
 }
 
-static bool transport_recv(struct io *io, void *user_data)
+static void transport_rx_frame(uint16_t seq, const struct iovec *iov,
+					unsigned int count, void *user_data)
 {
 	struct transport *transport = user_data;
-	uint8_t buf[1024];
-	int ret, len;
+	size_t len = 0;
+	unsigned int i;
 
-	ret = io_get_fd(io);
-	if (ret < 0) {
-		bt_shell_printf("io_get_fd() returned %d\n", ret);
-		return true;
+	for (i = 0; i < count; i++)
+		len += iov[i].iov_len;
+
+	bt_shell_echo("[seq %u] recv: %zu bytes", seq, len);
+
+	if (transport->filename && writev(transport->fd, iov, count) < 0)
+		bt_shell_printf("Unable to write: %s (%d)\n",
+						strerror(errno), -errno);
+}
+
+static uint32_t transport_get_interval(GDBusProxy *proxy)
+{
+	DBusMessageIter iter, dict;
+
+	if (!g_dbus_proxy_get_property(proxy, "QoS", &iter))
+		return 0;
+
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) ==
+						DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+		uint32_t interval;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (!strcasecmp(key, "Interval") &&
+				dbus_message_iter_get_arg_type(&value) ==
+							DBUS_TYPE_UINT32) {
+			dbus_message_iter_get_basic(&value, &interval);
+			return interval;
+		}
+
+		dbus_message_iter_next(&dict);
 	}
 
-	ret = read(ret, buf, sizeof(buf));
-	if (ret < 0) {
-		bt_shell_printf("Failed to read: %s (%d)\n", strerror(errno),
-								-errno);
-		return true;
+	return 0;
+}
+
+static uint16_t transport_rx_mtu(struct transport *transport)
+{
+	return transport->mtu[0] ? transport->mtu[0] : 1024;
+}
+
+static struct iso_rx *transport_get_rx(struct transport *transport)
+{
+	if (transport->rx_owner)
+		return transport->rx_owner->rx;
+
+	if (transport->rx)
+		return transport->rx;
+
+	transport->rx = iso_rx_new(transport_get_interval(transport->proxy),
+									2);
+	if (iso_rx_add_stream(transport->rx, transport->sk,
+					transport_rx_mtu(transport)) < 0) {
+		iso_rx_free(transport->rx);
+		transport->rx = NULL;
+		return NULL;
 	}
 
-	bt_shell_echo("[seq %d] recv: %u bytes", transport->seq, ret);
+	iso_rx_set_frame_handler(transport->rx, transport_rx_frame,
+							transport, NULL);
 
-	transport->seq++;
+	return transport->rx;
+}
 
-	if (transport->filename) {
-		len = write(transport->fd, buf, ret);
-		if (len < 0)
-			bt_shell_printf("Unable to write: %s (%d)\n",
-						strerror(errno), -errno);
+/* Receive the linked transports together with the transport so their SDUs
+ * are aligned and written as a single interleaved stream.
+ */
+static void transport_rx_link(struct transport *transport)
+{
+	DBusMessageIter iter, array;
+	struct iso_rx *rx;
+
+	if (!g_dbus_proxy_get_property(transport->proxy, "Links", &iter))
+		return;
+
+	rx = transport_get_rx(transport);
+	if (!rx)
+		return;
+
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+				DBUS_TYPE_OBJECT_PATH) {
+		struct transport *link;
+		GDBusProxy *proxy;
+		const char *path;
+
+		dbus_message_iter_get_basic(&array, &path);
+		dbus_message_iter_next(&array);
+
+		proxy = g_dbus_proxy_lookup(transports, NULL, path,
+					BLUEZ_MEDIA_TRANSPORT_INTERFACE);
+		if (!proxy)
+			continue;
+
+		link = find_transport(proxy);
+		if (!link || link == transport || link->sk < 0 ||
+					link->rx_owner == transport)
+			continue;
+
+		transport_rx_unlink(link);
+
+		if (iso_rx_add_stream(rx, link->sk,
+					transport_rx_mtu(link)) < 0)
+			continue;
+
+		if (!transport->rx_links)
+			transport->rx_links = queue_new();
+
+		queue_push_tail(transport->rx_links, link);
+		link->rx_owner = transport;
+
+		bt_shell_printf("Receiving %s linked\n", path);
+	}
+}
+
+static bool transport_recv(struct io *io, void *user_data)
+{
+	struct transport *transport = user_data;
+	struct iso_rx *rx;
+	int ret;
+
+	rx = transport_get_rx(transport);
+	if (!rx) {
+		bt_shell_printf("Unable to receive from transport\n");
+		return false;
 	}
 
+	ret = iso_rx_read(rx, transport->sk);
+	if (ret < 0 && ret != -ENOTCONN)
+		bt_shell_printf("Failed to read: %s (%d)\n", strerror(-ret),
+									ret);
+
 	return true;
 }
 
@@ -5798,98 +5985,137 @@ static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
 	return i;
 }
 
-static bool transport_timer_read(struct io *io, void *user_data)
+static void transport_tx_sent(int sk, uint32_t seq, size_t offset,
+					size_t len, void *user_data)
 {
-	struct transport *transport = user_data;
-	struct bt_iso_qos qos;
-	socklen_t len;
-	int ret, fd;
-	uint64_t exp;
+	int secs = 0, nsecs = 0;
 
-	if (transport->fd < 0)
-		return false;
+	elapsed_time(!seq, &secs, &nsecs);
 
-	fd = io_get_fd(io);
-	if (fd < 0) {
-		bt_shell_printf("io_get_fd() returned %d\n", fd);
-		return false;
-	}
+	bt_shell_echo("[seq %u %d.%03ds] send: %zu/%zu bytes", seq, secs,
+				(nsecs + 500000) / 1000000, offset, len);
+}
 
-	ret = read(fd, &exp, sizeof(exp));
-	if (ret < 0) {
-		bt_shell_printf("Failed to read: %s (%d)\n", strerror(errno),
-								-errno);
-		return false;
-	}
+static bool transport_tx_timer(struct io *io, void *user_data)
+{
+	struct transport_tx *tx = user_data;
+	int ret;
 
-	/* Read QoS if available */
-	memset(&qos, 0, sizeof(qos));
-	len = sizeof(qos);
-	if (getsockopt(transport->sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos,
-							&len) < 0) {
-		bt_shell_printf("Failed to getsockopt(BT_ISO_QOS): %s (%d)\n",
-					strerror(errno), -errno);
-		return false;
+	ret = iso_tx_process(tx->tx);
+	if (ret > 0)
+		return true;
+
+	if (ret < 0)
+		bt_shell_printf("Unable to send: %s (%d)\n", strerror(-ret),
+									ret);
+
+	transport_tx_free(tx);
+
+	return false;
+}
+
+static struct transport_tx *transport_tx_new(uint32_t interval, uint32_t num)
+{
+	struct transport_tx *tx;
+
+	tx = new0(struct transport_tx, 1);
+	tx->tx = iso_tx_new(interval, num);
+	if (!tx->tx) {
+		free(tx);
+		return NULL;
 	}
 
-	ret = transport_send_seq(transport, transport->fd, transport->num);
-	if (ret < 0) {
-		bt_shell_printf("Unable to send: %s (%d)\n",
-					strerror(-ret), ret);
-		return false;
+	tx->interval = interval;
+	tx->num = num;
+	tx->transports = queue_new();
+
+	iso_tx_set_sent_handler(tx->tx, transport_tx_sent, NULL, NULL);
+
+	return tx;
+}
+
+static void transport_tx_start(void *data, void *user_data)
+{
+	struct transport_tx *tx = data;
+	int ret;
+
+	if (queue_isempty(tx->transports)) {
+		transport_tx_free(tx);
+		return;
 	}
 
-	if (!ret) {
-		transport_close(transport);
-		return false;
+	/* One extra packet to buffers immediately */
+	ret = iso_tx_start(tx->tx, 1);
+	if (ret <= 0) {
+		if (ret < 0)
+			bt_shell_printf("Unable to send: %s (%d)\n",
+						strerror(-ret), ret);
+		transport_tx_free(tx);
+		return;
 	}
 
-	return true;
+	tx->io = io_new(iso_tx_get_fd(tx->tx));
+	io_set_read_handler(tx->io, transport_tx_timer, tx, NULL);
+}
+
+static void transport_tx_cancel(void *data, void *user_data)
+{
+	transport_tx_free(data);
+}
+
+static bool match_tx_qos(const void *data, const void *match_data)
+{
+	const struct transport_tx *tx = data;
+	const struct transport_tx *qos = match_data;
+
+	return tx->interval == qos->interval && tx->num == qos->num;
 }
 
 static int transport_send(struct transport *transport, int fd,
-					struct bt_iso_io_qos *qos)
+			struct bt_iso_io_qos *qos, struct queue *txs)
 {
-	struct itimerspec ts;
-	int timer_fd;
+	struct transport_tx *tx, match;
+	int err;
 
 	transport->seq = 0;
 
 	if (!qos)
 		return transport_send_seq(transport, fd, UINT32_MAX);
 
-	if (transport->fd >= 0)
+	if (transport->tx)
 		return -EALREADY;
 
-	timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-	if (timer_fd < 0)
-		return -errno;
-
 	/* Send data in bursts of
 	 * num = ROUND_CLOSEST(Transport_Latency (ms) / SDU_Interval (us))
 	 * with average data rate = 1 packet / SDU_Interval
 	 */
-	transport->num = ROUND_CLOSEST(qos->latency * 1000, qos->interval);
-	if (!transport->num)
-		transport->num = 1;
-
-	memset(&ts, 0, sizeof(ts));
-	ts.it_value.tv_nsec = 1;
-	ts.it_interval.tv_nsec = transport->num * qos->interval * 1000;
+	memset(&match, 0, sizeof(match));
+	match.interval = qos->interval;
+	match.num = ROUND_CLOSEST(qos->latency * 1000, qos->interval);
+	if (!match.num)
+		match.num = 1;
+
+	/* Streams sharing the same timing are driven by the same engine so
+	 * their SDUs go out on the same timer tick.
+	 */
+	tx = queue_find(txs, match_tx_qos, &match);
+	if (!tx) {
+		tx = transport_tx_new(match.interval, match.num);
+		if (!tx)
+			return -ENOMEM;
 
-	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0) {
-		close(timer_fd);
-		return -errno;
+		queue_push_tail(txs, tx);
 	}
 
-	transport->fd = fd;
-	transport->timer_io = io_new(timer_fd);
+	err = iso_tx_add_file(tx->tx, transport->sk, transport->mtu[1], fd,
+									false);
+	if (err < 0)
+		return err;
 
-	io_set_read_handler(transport->timer_io, transport_timer_read,
-						transport, NULL);
+	transport->tx = tx;
+	queue_push_tail(tx->transports, transport);
 
-	/* One extra packet to buffers immediately */
-	return transport_send_seq(transport, fd, 1);
+	return 0;
 }
 
 static void cmd_send_transport(int argc, char *argv[])
@@ -5898,33 +6124,40 @@ static void cmd_send_transport(int argc, char *argv[])
 	struct transport *transport;
 	int fd = -1, err;
 	struct bt_iso_qos qos;
+	struct queue *txs;
 	socklen_t len;
-	int i;
+	int i, status = EXIT_SUCCESS;
+
+	txs = queue_new();
 
 	for (i = 1; i < argc; i++) {
 		proxy = g_dbus_proxy_lookup(transports, NULL, argv[i],
 					BLUEZ_MEDIA_TRANSPORT_INTERFACE);
 		if (!proxy) {
 			bt_shell_printf("Transport %s not found\n", argv[i]);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			status = EXIT_FAILURE;
+			break;
 		}
 
 		transport = find_transport(proxy);
 		if (!transport) {
 			bt_shell_printf("Transport %s not acquired\n", argv[i]);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			status = EXIT_FAILURE;
+			break;
 		}
 
 		if (transport->sk < 0) {
 			bt_shell_printf("No Transport Socked found\n");
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			status = EXIT_FAILURE;
+			break;
 		}
 
 		if (i + 1 < argc) {
 			fd = open_file(argv[++i], O_RDONLY);
-			if (fd < 0)
-				return bt_shell_noninteractive_quit(
-								EXIT_FAILURE);
+			if (fd < 0) {
+				status = EXIT_FAILURE;
+				break;
+			}
 		}
 
 		bt_shell_printf("Sending ...\n");
@@ -5936,7 +6169,7 @@ static void cmd_send_transport(int argc, char *argv[])
 							&len) < 0) {
 			bt_shell_printf("Unable to getsockopt(BT_ISO_QOS): %s",
 							strerror(errno));
-			err = transport_send(transport, fd, NULL);
+			err = transport_send(transport, fd, NULL, txs);
 		} else {
 			struct sockaddr_iso addr;
 			socklen_t optlen = sizeof(addr);
@@ -5946,22 +6179,38 @@ static void cmd_send_transport(int argc, char *argv[])
 			if (!err) {
 				if (!(bacmp(&addr.iso_bdaddr, BDADDR_ANY)))
 					err = transport_send(transport, fd,
-							     &qos.bcast.out);
+							&qos.bcast.out, txs);
 				else
 					err = transport_send(transport, fd,
-							     &qos.ucast.out);
+							&qos.ucast.out, txs);
 			}
 		}
 
+		/* The engine keeps its own copy of the file mapped */
+		if (fd >= 0) {
+			close(fd);
+			fd = -1;
+		}
+
 		if (err < 0) {
 			bt_shell_printf("Unable to send: %s (%d)\n",
 						strerror(-err), -err);
-			close(fd);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			status = EXIT_FAILURE;
+			break;
 		}
 	}
 
-	return bt_shell_noninteractive_quit(EXIT_SUCCESS);
+	/* Streams are only started once every argument has been validated,
+	 * on error the ones already set up are released without sending.
+	 */
+	if (status == EXIT_SUCCESS)
+		queue_foreach(txs, transport_tx_start, NULL);
+	else
+		queue_foreach(txs, transport_tx_cancel, NULL);
+
+	queue_destroy(txs, NULL);
+
+	return bt_shell_noninteractive_quit(status);
 }
 
 
@@ -5998,6 +6247,8 @@ static void cmd_receive_transport(int argc, char *argv[])
 
 	bt_shell_printf("Filename: %s\n", transport->filename);
 
+	transport_rx_link(transport);
+
 	return bt_shell_noninteractive_quit(EXIT_SUCCESS);
 }
 
@@ -6091,6 +6342,44 @@ static void cmd_metadata_transport(int argc, char *argv[])
 	}
 }
 
+static void stats_reply(DBusMessage *message, void *user_data)
+{
+	DBusError error;
+	DBusMessageIter iter;
+
+	dbus_error_init(&error);
+
+	if (dbus_set_error_from_message(&error, message) == TRUE) {
+		bt_shell_printf("Failed to get statistics: %s\n", error.name);
+		dbus_error_free(&error);
+		return bt_shell_noninteractive_quit(EXIT_FAILURE);
+	}
+
+	dbus_message_iter_init(message, &iter);
+
+	print_iter("\t", "Statistics", &iter);
+
+	return bt_shell_noninteractive_quit(EXIT_SUCCESS);
+}
+
+static void cmd_stats_transport(int argc, char *argv[])
+{
+	GDBusProxy *proxy;
+
+	proxy = g_dbus_proxy_lookup(transports, NULL, argv[1],
+					BLUEZ_MEDIA_TRANSPORT_INTERFACE);
+	if (!proxy) {
+		bt_shell_printf("Transport %s not found\n", argv[1]);
+		return bt_shell_noninteractive_quit(EXIT_FAILURE);
+	}
+
+	if (!g_dbus_proxy_method_call(proxy, "GetStatistics", NULL,
+						stats_reply, NULL, NULL)) {
+		bt_shell_printf("Failed to get statistics\n");
+		return bt_shell_noninteractive_quit(EXIT_FAILURE);
+	}
+}
+
 static const struct bt_shell_menu transport_menu = {
 	.name = "transport",
 	.desc = "Media Transport Submenu",
@@ -6126,6 +6415,9 @@ static const struct bt_shell_menu transport_menu = {
 	{ "metadata",    "<transport> [value...]", cmd_metadata_transport,
 						"Get/Set Transport Metadata",
 						transport_generator },
+	{ "stats",       "<transport>", cmd_stats_transport,
+						"Show transport statistics",
+						transport_generator },
 	{} },
 };
 
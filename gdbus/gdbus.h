@@ -94,6 +94,7 @@ enum GDBusPropertyFlags {
 	G_DBUS_PROPERTY_FLAG_DEPRECATED   = (1 << 0),
 	G_DBUS_PROPERTY_FLAG_EXPERIMENTAL = (1 << 1),
 	G_DBUS_PROPERTY_FLAG_TESTING      = (1 << 2),
+	G_DBUS_PROPERTY_FLAG_CACHE        = (1 << 3),
 };
 
 enum GDBusSecurityFlags {
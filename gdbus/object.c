@@ -50,7 +50,7 @@ struct generic_data {
 	GSList *objects;
 	GSList *added;
 	GSList *removed;
-	guint process_id;
+	GList *pending_link;
 	gboolean pending_prop;
 	char *introspect;
 	struct generic_data *parent;
@@ -62,6 +62,7 @@ struct interface_data {
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
 	GSList *pending_prop;
+	DBusMessage **cache;
 	void *user_data;
 	GDBusDestroyFunction destroy;
 };
@@ -85,9 +86,18 @@ struct debug_data {
 	void *data;
 };
 
+/*
+ * Pending object changes are processed in bursts from a single idle source,
+ * each burst bounded both in number of objects and in time so a large number
+ * of changes (e.g. thousands of devices at startup) don't block the mainloop.
+ */
+#define PENDING_BURST_MAX	128
+#define PENDING_BURST_BUDGET	5000	/* usec */
+
 static int global_flags = 0;
 static struct generic_data *root;
-static GSList *pending = NULL;
+static GQueue pending = G_QUEUE_INIT;
+static guint pending_id = 0;
 static struct debug_data debug = { NULL, NULL, NULL };
 
 static gboolean process_changes(gpointer user_data);
@@ -565,6 +575,126 @@ static void append_property(struct interface_data *iface,
 	dbus_message_iter_close_container(dict, &entry);
 }
 
+static void iter_append_iter(DBusMessageIter *base, DBusMessageIter *iter)
+{
+	int type;
+
+	type = dbus_message_iter_get_arg_type(iter);
+
+	if (dbus_type_is_basic(type)) {
+		DBusBasicValue value;
+
+		dbus_message_iter_get_basic(iter, &value);
+		dbus_message_iter_append_basic(base, type, &value);
+	} else if (dbus_type_is_container(type)) {
+		DBusMessageIter iter_sub, base_sub;
+		char *sig;
+
+		dbus_message_iter_recurse(iter, &iter_sub);
+
+		switch (type) {
+		case DBUS_TYPE_ARRAY:
+		case DBUS_TYPE_VARIANT:
+			sig = dbus_message_iter_get_signature(&iter_sub);
+			break;
+		default:
+			sig = NULL;
+			break;
+		}
+
+		dbus_message_iter_open_container(base, type, sig, &base_sub);
+
+		if (sig != NULL)
+			dbus_free(sig);
+
+		while (dbus_message_iter_get_arg_type(&iter_sub) !=
+							DBUS_TYPE_INVALID) {
+			iter_append_iter(&base_sub, &iter_sub);
+			dbus_message_iter_next(&iter_sub);
+		}
+
+		dbus_message_iter_close_container(base, &base_sub);
+	}
+}
+
+static void invalidate_property(struct interface_data *iface,
+						const GDBusPropertyTable *p)
+{
+	DBusMessage **cache;
+
+	if (iface->cache == NULL)
+		return;
+
+	cache = &iface->cache[p - iface->properties];
+	if (*cache == NULL)
+		return;
+
+	dbus_message_unref(*cache);
+	*cache = NULL;
+}
+
+static void invalidate_properties(struct interface_data *iface)
+{
+	const GDBusPropertyTable *p;
+
+	if (iface->cache == NULL)
+		return;
+
+	for (p = iface->properties; p && p->name; p++)
+		invalidate_property(iface, p);
+
+	g_free(iface->cache);
+	iface->cache = NULL;
+}
+
+/*
+ * Properties flagged with G_DBUS_PROPERTY_FLAG_CACHE are only read from the
+ * getter once, the value is kept until the property is signalled as changed
+ * or stops existing. Values carrying file descriptors are never cached.
+ */
+static gboolean append_cached_property(struct interface_data *iface,
+			const GDBusPropertyTable *p, DBusMessageIter *dict)
+{
+	DBusMessage **cache;
+	DBusMessageIter entry, value;
+
+	if (!(p->flags & G_DBUS_PROPERTY_FLAG_CACHE) ||
+				strchr(p->type, DBUS_TYPE_UNIX_FD) != NULL)
+		return FALSE;
+
+	if (iface->cache == NULL) {
+		unsigned int count = 0;
+
+		while (iface->properties[count].name)
+			count++;
+
+		iface->cache = g_new0(DBusMessage *, count);
+	}
+
+	cache = &iface->cache[p - iface->properties];
+
+	if (*cache == NULL) {
+		*cache = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+		if (*cache == NULL)
+			return FALSE;
+
+		dbus_message_iter_init_append(*cache, &entry);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+							p->type, &value);
+		p->get(p, &value, iface->user_data);
+		dbus_message_iter_close_container(&entry, &value);
+	}
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+								&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &p->name);
+	dbus_message_iter_init(*cache, &value);
+	iter_append_iter(&entry, &value);
+	dbus_message_iter_close_container(dict, &entry);
+
+	return TRUE;
+}
+
 static void append_properties(struct interface_data *data,
 							DBusMessageIter *iter)
 {
@@ -588,7 +718,12 @@ static void append_properties(struct interface_data *data,
 		if (p->get == NULL)
 			continue;
 
-		if (p->exists != NULL && !p->exists(p, data->user_data))
+		if (p->exists != NULL && !p->exists(p, data->user_data)) {
+			invalidate_property(data, p);
+			continue;
+		}
+
+		if (append_cached_property(data, p, &dict))
 			continue;
 
 		append_property(data, p, &dict);
@@ -708,22 +843,49 @@ static gboolean g_dbus_args_have_signature(const GDBusArgInfo *args,
 	return TRUE;
 }
 
-static void add_pending(struct generic_data *data)
+static gboolean process_pending(gpointer user_data)
 {
-	guint old_id = data->process_id;
+	struct generic_data *data;
+	gint64 start, now;
+	unsigned int count = 0;
 
-	data->process_id = g_idle_add(process_changes, data);
+	start = g_get_monotonic_time();
+	now = start;
 
-	if (old_id > 0) {
-		/*
-		 * If the element already had an old idler, remove the old one,
-		 * no need to re-add it to the pending list.
-		 */
-		g_source_remove(old_id);
-		return;
+	while ((data = g_queue_peek_head(&pending))) {
+		process_changes(data);
+
+		if (++count == PENDING_BURST_MAX)
+			break;
+
+		now = g_get_monotonic_time();
+		if (now - start >= PENDING_BURST_BUDGET)
+			break;
 	}
 
-	pending = g_slist_append(pending, data);
+	g_dbus_debug("processed %u objects in %" G_GINT64_FORMAT " us "
+			"(%u pending)", count, now - start,
+			g_queue_get_length(&pending));
+
+	if (!g_queue_is_empty(&pending))
+		return TRUE;
+
+	pending_id = 0;
+
+	return FALSE;
+}
+
+static void add_pending(struct generic_data *data)
+{
+	/* Already pending, changes are processed in order of arrival */
+	if (data->pending_link)
+		return;
+
+	g_queue_push_tail(&pending, data);
+	data->pending_link = g_queue_peek_tail_link(&pending);
+
+	if (!pending_id)
+		pending_id = g_idle_add(process_pending, NULL);
 }
 
 static gboolean remove_interface(struct generic_data *data, const char *name)
@@ -735,6 +897,7 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 		return FALSE;
 
 	process_properties_from_interface(data, iface);
+	invalidate_properties(iface);
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
 
@@ -1071,12 +1234,11 @@ static void emit_interfaces_removed(struct generic_data *data)
 
 static void remove_pending(struct generic_data *data)
 {
-	if (data->process_id > 0) {
-		g_source_remove(data->process_id);
-		data->process_id = 0;
-	}
+	if (!data->pending_link)
+		return;
 
-	pending = g_slist_remove(pending, data);
+	g_queue_delete_link(&pending, data->pending_link);
+	data->pending_link = NULL;
 }
 
 static gboolean process_changes(gpointer user_data)
@@ -1095,8 +1257,6 @@ static gboolean process_changes(gpointer user_data)
 	if (data->removed != NULL)
 		emit_interfaces_removed(data);
 
-	data->process_id = 0;
-
 	return FALSE;
 }
 
@@ -1108,11 +1268,8 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 	if (parent != NULL)
 		parent->objects = g_slist_remove(parent->objects, data);
 
-	if (data->process_id > 0) {
-		g_source_remove(data->process_id);
-		data->process_id = 0;
+	if (data->pending_link)
 		process_changes(data);
-	}
 
 	g_slist_foreach(data->objects, reset_parent, data->parent);
 	g_slist_free(data->objects);
@@ -1593,9 +1750,9 @@ DBusMessage *g_dbus_create_reply(DBusMessage *message, int type, ...)
 
 static void g_dbus_flush(DBusConnection *connection)
 {
-	GSList *l;
+	GList *l;
 
-	for (l = pending; l;) {
+	for (l = pending.head; l;) {
 		struct generic_data *data = l->data;
 
 		l = l->next;
@@ -1897,13 +2054,6 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 	if (iface == NULL)
 		return;
 
-	/*
-	 * If ObjectManager is attached, don't emit property changed if
-	 * interface is not yet published
-	 */
-	if (root && g_slist_find(data->added, iface))
-		return;
-
 	property = find_property(iface->properties, name);
 	if (property == NULL) {
 		error("Could not find property %s in %p", name,
@@ -1911,6 +2061,15 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 		return;
 	}
 
+	invalidate_property(iface, property);
+
+	/*
+	 * If ObjectManager is attached, don't emit property changed if
+	 * interface is not yet published
+	 */
+	if (root && g_slist_find(data->added, iface))
+		return;
+
 	if (g_slist_find(iface->pending_prop, (void *) property) != NULL)
 		return;
 
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "src/shared/util.h"
+
+#include "a2dp-adapt.h"
+
+#define A2DP_ADAPT_DOWN		5	/* Congested intervals to lower hint */
+#define A2DP_ADAPT_UP		30	/* Clear intervals to raise hint */
+#define A2DP_HINT_MIN		50
+#define A2DP_HINT_STEP		10
+
+void a2dp_adapt_reset(struct a2dp_adapt *adapt, uint16_t mtu)
+{
+	memset(adapt, 0, sizeof(*adapt));
+	adapt->mtu = mtu;
+	adapt->hint = 100;
+}
+
+/* Returns the send buffer size to use so it holds between
+ * A2DP_ADAPT_MIN_PKTS and A2DP_ADAPT_MAX_PKTS packets.
+ */
+int a2dp_adapt_clamp(struct a2dp_adapt *adapt, int size)
+{
+	if (!adapt->mtu)
+		return size;
+
+	return MAX(MIN(size, A2DP_ADAPT_MAX_PKTS * adapt->mtu),
+					A2DP_ADAPT_MIN_PKTS * adapt->mtu);
+}
+
+/* Updates the bitrate hint with the current send queue usage, in bytes, and
+ * returns the send buffer size that should be used from now on.
+ */
+int a2dp_adapt_update(struct a2dp_adapt *adapt, int queued, int size)
+{
+	int usage, pkts;
+
+	if (!adapt->mtu || size <= 0)
+		return size;
+
+	/* Someone else may have enlarged the buffer, only what fits in the
+	 * range managed here counts as queued.
+	 */
+	size = a2dp_adapt_clamp(adapt, size);
+	usage = MIN(MAX(queued, 0) * 100 / size, 100);
+	adapt->queue_avg = (adapt->queue_avg * 7 + usage) / 8;
+	pkts = size / adapt->mtu;
+
+	/* Grow the buffer when it fills up so short stalls of the link are
+	 * absorbed instead of blocking the encoder.
+	 */
+	if (usage >= 90 && pkts < A2DP_ADAPT_MAX_PKTS)
+		size = (pkts + 1) * adapt->mtu;
+
+	if (adapt->queue_avg > 50) {
+		/* The link does not keep up with the encoder */
+		adapt->clear = 0;
+
+		if (++adapt->congested < A2DP_ADAPT_DOWN)
+			return size;
+
+		adapt->congested = 0;
+
+		if (adapt->hint > A2DP_HINT_MIN)
+			adapt->hint -= A2DP_HINT_STEP;
+	} else if (adapt->queue_avg < 10) {
+		/* The link drains the queue, shrink the buffer to cut latency
+		 * and let the encoder go back up.
+		 */
+		adapt->congested = 0;
+
+		if (++adapt->clear < A2DP_ADAPT_UP)
+			return size;
+
+		adapt->clear = 0;
+
+		if (pkts > A2DP_ADAPT_MIN_PKTS)
+			size = (pkts - 1) * adapt->mtu;
+
+		if (adapt->hint < 100)
+			adapt->hint += A2DP_HINT_STEP;
+	} else {
+		adapt->congested = 0;
+		adapt->clear = 0;
+	}
+
+	return size;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#define A2DP_ADAPT_MIN_PKTS	2
+#define A2DP_ADAPT_MAX_PKTS	8
+
+struct a2dp_adapt {
+	uint16_t mtu;
+	uint8_t hint;
+	uint8_t queue_avg;
+	unsigned int congested;
+	unsigned int clear;
+};
+
+void a2dp_adapt_reset(struct a2dp_adapt *adapt, uint16_t mtu);
+int a2dp_adapt_clamp(struct a2dp_adapt *adapt, int size);
+int a2dp_adapt_update(struct a2dp_adapt *adapt, int queued, int size);
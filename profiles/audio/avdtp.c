@@ -20,6 +20,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <glib.h>
 
@@ -293,7 +296,8 @@ struct in_buf {
 	uint8_t transaction;
 	uint8_t signal_id;
 	uint8_t buf[1024];
-	uint8_t data_size;
+	uint8_t *data;		/* Payload, in buf unless it was not fragmented */
+	uint16_t data_size;
 };
 
 struct pending_req {
@@ -453,19 +457,29 @@ static const char *avdtp_statestr(avdtp_state_t state)
 	}
 }
 
-static gboolean try_send(int sk, void *data, size_t len)
+static gboolean try_send(int sk, struct iovec *iov, int iovcnt)
 {
-	int err;
+	struct msghdr msg;
+	size_t len = 0;
+	ssize_t err;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
 
 	do {
-		err = send(sk, data, len, 0);
+		err = sendmsg(sk, &msg, 0);
 	} while (err < 0 && errno == EINTR);
 
 	if (err < 0) {
 		error("send: %s (%d)", strerror(errno), errno);
 		return FALSE;
 	} else if ((size_t) err != len) {
-		error("try_send: complete buffer not sent (%d/%zu bytes)",
+		error("try_send: complete buffer not sent (%zd/%zu bytes)",
 								err, len);
 		return FALSE;
 	}
@@ -480,6 +494,7 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 	unsigned int cont_fragments, sent;
 	struct avdtp_start_header start;
 	struct avdtp_continue_header cont;
+	struct iovec iov[2];
 	int sock;
 
 	if (session->io == NULL) {
@@ -500,12 +515,12 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 		single.message_type = message_type;
 		single.signal_id = signal_id;
 
-		memcpy(session->buf, &single, sizeof(single));
-
-		if (data)
-			memcpy(session->buf + sizeof(single), data, len);
+		iov[0].iov_base = &single;
+		iov[0].iov_len = sizeof(single);
+		iov[1].iov_base = data;
+		iov[1].iov_len = data ? len : 0;
 
-		return try_send(sock, session->buf, sizeof(single) + len);
+		return try_send(sock, iov, 2);
 	}
 
 	/* Check if there is enough space to start packet */
@@ -528,17 +543,24 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 	start.no_of_packets = cont_fragments + 1;
 	start.signal_id = signal_id;
 
-	memcpy(session->buf, &start, sizeof(start));
-	memcpy(session->buf + sizeof(start), data,
-					session->omtu - sizeof(start));
+	/* Fragments are sent straight from the message, only the header is
+	 * prepended to each of them.
+	 */
+	iov[0].iov_base = &start;
+	iov[0].iov_len = sizeof(start);
+	iov[1].iov_base = data;
+	iov[1].iov_len = session->omtu - sizeof(start);
 
-	if (!try_send(sock, session->buf, session->omtu))
+	if (!try_send(sock, iov, 2))
 		return FALSE;
 
 	DBG("first packet with %zu bytes sent", session->omtu - sizeof(start));
 
 	sent = session->omtu - sizeof(start);
 
+	iov[0].iov_base = &cont;
+	iov[0].iov_len = sizeof(cont);
+
 	/* Send the continue fragments and the end packet */
 	while (sent < len) {
 		int left, to_copy;
@@ -557,10 +579,10 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 		cont.transaction = transaction;
 		cont.message_type = message_type;
 
-		memcpy(session->buf, &cont, sizeof(cont));
-		memcpy(session->buf + sizeof(cont), data + sent, to_copy);
+		iov[1].iov_base = data + sent;
+		iov[1].iov_len = to_copy;
 
-		if (!try_send(sock, session->buf, to_copy + sizeof(cont)))
+		if (!try_send(sock, iov, 2))
 			return FALSE;
 
 		sent += to_copy;
@@ -2124,7 +2146,7 @@ static gboolean avdtp_parse_cmd(struct avdtp *session, uint8_t transaction,
 enum avdtp_parse_result { PARSE_ERROR, PARSE_FRAGMENT, PARSE_SUCCESS };
 
 static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
-							void *buf, size_t size)
+						void *buf, size_t size)
 {
 	struct avdtp_common_header *header = buf;
 	struct avdtp_single_header *single = (void *) session->buf;
@@ -2149,16 +2171,13 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 			return PARSE_ERROR;
 		}
 
-		payload = session->buf + sizeof(*single);
-		payload_size = size - sizeof(*single);
-
-		in->active = TRUE;
-		in->data_size = 0;
-		in->no_of_packets = 1;
+		/* Not fragmented, parse the payload where it was read */
+		in->data = session->buf + sizeof(*single);
+		in->data_size = size - sizeof(*single);
 		in->transaction = header->transaction;
 		in->signal_id = single->signal_id;
 
-		break;
+		return PARSE_SUCCESS;
 	case AVDTP_PKT_TYPE_START:
 		if (size < sizeof(*start)) {
 			error("Received too small start packet (%zu bytes)", size);
@@ -2170,6 +2189,7 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 		}
 
 		in->active = TRUE;
+		in->data = in->buf;
 		in->data_size = 0;
 		in->transaction = header->transaction;
 		in->no_of_packets = start->no_of_packets;
@@ -2236,6 +2256,7 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 	}
 
 	memcpy(in->buf + in->data_size, payload, payload_size);
+
 	in->data_size += payload_size;
 
 	if (in->no_of_packets > 1) {
@@ -2292,7 +2313,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 	if (header->message_type == AVDTP_MSG_TYPE_COMMAND) {
 		if (!avdtp_parse_cmd(session, session->in_cmd.transaction,
 				     session->in_cmd.signal_id,
-				     session->in_cmd.buf,
+				     session->in_cmd.data,
 				     session->in_cmd.data_size)) {
 			error("Unable to handle command. Disconnecting");
 			goto failed;
@@ -2329,7 +2350,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 		if (!avdtp_parse_resp(session, session->req->stream,
 						session->in_resp.transaction,
 						session->in_resp.signal_id,
-						session->in_resp.buf,
+						session->in_resp.data,
 						session->in_resp.data_size)) {
 			error("Unable to parse accept response");
 			goto failed;
@@ -2339,7 +2360,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 		if (!avdtp_parse_rej(session, session->req->stream,
 						session->in_resp.transaction,
 						session->in_resp.signal_id,
-						session->in_resp.buf,
+						session->in_resp.data,
 						session->in_resp.data_size)) {
 			error("Unable to parse reject response");
 			goto failed;
@@ -3324,6 +3345,45 @@ gboolean avdtp_stream_get_transport(struct avdtp_stream *stream, int *sock,
 	return TRUE;
 }
 
+int avdtp_stream_get_send_queue(struct avdtp_stream *stream, int *queued,
+								int *size)
+{
+	int sk, space;
+
+	if (stream->io == NULL)
+		return -ENOTCONN;
+
+	sk = g_io_channel_unix_get_fd(stream->io);
+
+	*size = get_send_buffer_size(sk);
+	if (*size < 0)
+		return *size;
+
+	/* Bluetooth sockets report the free space left in the send buffer,
+	 * which is accounted with the same overhead as SO_SNDBUF.
+	 */
+	if (ioctl(sk, TIOCOUTQ, &space) < 0)
+		return -errno;
+
+	*queued = MAX(*size * 2 - space, 0) / 2;
+
+	return 0;
+}
+
+int avdtp_stream_set_send_buffer(struct avdtp_stream *stream, int size)
+{
+	int sk;
+
+	if (stream->io == NULL)
+		return -ENOTCONN;
+
+	sk = g_io_channel_unix_get_fd(stream->io);
+
+	DBG("sk %d, send buffer size %d", sk, size);
+
+	return set_send_buffer_size(sk, size);
+}
+
 static int process_queue(struct avdtp *session)
 {
 	GSList **queue, *l;
@@ -248,6 +248,9 @@ gboolean avdtp_stream_set_transport(struct avdtp_stream *stream, int fd,
 gboolean avdtp_stream_get_transport(struct avdtp_stream *stream, int *sock,
 					uint16_t *imtu, uint16_t *omtu,
 					GSList **caps);
+int avdtp_stream_get_send_queue(struct avdtp_stream *stream, int *queued,
+								int *size);
+int avdtp_stream_set_send_buffer(struct avdtp_stream *stream, int size);
 struct avdtp_service_capability *avdtp_stream_get_codec(
 						struct avdtp_stream *stream);
 gboolean avdtp_stream_has_capabilities(struct avdtp_stream *stream,
@@ -48,6 +48,9 @@
 #include "src/shared/bap.h"
 #include "src/shared/tmap.h"
 #include "src/shared/gmap.h"
+#include "src/shared/ad.h"
+#include "src/shared/bcast-cache.h"
+#include "src/shared/pa-queue.h"
 
 #include "btio/btio.h"
 #include "src/plugin.h"
@@ -138,6 +141,7 @@ struct bap_data {
 	struct queue *bcast;
 	struct queue *bcast_snks;
 	struct queue *server_streams;
+	struct pa_queue *pa_queue;	/* Adapter only, sources to sync to */
 	GIOChannel *listen_io;
 	unsigned int io_id;
 	unsigned int cig_update_id;
@@ -145,7 +149,18 @@ struct bap_data {
 	bool bap_ready;
 };
 
+/* Short-lived PA syncs each take a controller sync slot, so only a few are
+ * run at a time per adapter and the BASE/BIGInfo they report are cached by
+ * source address, Broadcast ID and SID so sources seen again can be listed
+ * without syncing to them.
+ */
+#define PA_SYNC_MAX		2
+#define PA_SYNC_TIMEOUT		10000	/* ms */
+#define BCAST_CACHE_MAX		64
+#define BCAST_CACHE_TTL		300000	/* ms */
+
 static struct queue *sessions;
+static struct bcast_cache *bcast_cache;
 
 static int setup_config(struct bap_setup *setup, bap_setup_ready_func_t cb,
 							void *user_data);
@@ -154,6 +169,7 @@ static int bap_select_all(struct bap_data *data, bool reconfigure,
 static void setup_create_io(struct bap_data *data, struct bap_setup *setup,
 				struct bt_bap_stream *stream, int defer);
 static void bap_update_cigs(struct bap_data *data);
+static void pa_sync_done(struct bap_data *data);
 
 static void bap_debug(const char *str, void *user_data)
 {
@@ -176,6 +192,8 @@ static void bap_data_free(struct bap_data *data)
 {
 	struct queue *bcast_snks = data->bcast_snks;
 
+	pa_sync_done(data);
+
 	if (data->listen_io) {
 		g_io_channel_shutdown(data->listen_io, TRUE, NULL);
 		g_io_channel_unref(data->listen_io);
@@ -191,6 +209,7 @@ static void bap_data_free(struct bap_data *data)
 	queue_destroy(data->srcs, ep_unregister);
 	queue_destroy(data->bcast, ep_unregister);
 	queue_destroy(data->server_streams, NULL);
+	pa_queue_free(data->pa_queue);
 	data->bcast_snks = NULL;
 	queue_destroy(bcast_snks, setup_free);
 
@@ -1133,69 +1152,6 @@ static void setup_free(void *data)
 	free(setup);
 }
 
-static bool match_io_qos(const struct bt_bap_io_qos *io_qos,
-		const struct bt_bap_io_qos *match)
-{
-	if (io_qos->interval != match->interval)
-		return false;
-
-	if (io_qos->latency != match->latency)
-		return false;
-
-	if (io_qos->sdu != match->sdu)
-		return false;
-
-	if (io_qos->phys != match->phys)
-		return false;
-
-	if (io_qos->rtn != match->rtn)
-		return false;
-
-	return true;
-}
-
-static bool match_bcast_qos(const struct bt_bap_bcast_qos *qos,
-		const struct bt_bap_bcast_qos *match)
-{
-	if (qos->sync_factor != match->sync_factor)
-		return false;
-
-	if (qos->packing != match->packing)
-		return false;
-
-	if (qos->framing != match->framing)
-		return false;
-
-	if (qos->encryption != match->encryption)
-		return false;
-
-	if (qos->encryption && util_iov_memcmp(qos->bcode, match->bcode))
-		return false;
-
-	if (qos->options != match->options)
-		return false;
-
-	if (qos->skip != match->skip)
-		return false;
-
-	if (qos->sync_timeout != match->sync_timeout)
-		return false;
-
-	if (qos->sync_cte_type != match->sync_cte_type)
-		return false;
-
-	if (qos->mse != match->mse)
-		return false;
-
-	if (qos->timeout != match->timeout)
-		return false;
-
-	if (qos->pa_sync != match->pa_sync)
-		return false;
-
-	return match_io_qos(&qos->io_qos, &match->io_qos);
-}
-
 static bool setup_mismatch_qos(const void *data, const void *user_data)
 {
 	const struct bap_setup *setup = data;
@@ -1207,7 +1163,7 @@ static bool setup_mismatch_qos(const void *data, const void *user_data)
 		setup->qos.bcast.big != match->qos.bcast.big)
 		return false;
 
-	return !match_bcast_qos(&setup->qos.bcast, &match->qos.bcast);
+	return !bt_bap_bcast_qos_match(&setup->qos.bcast, &match->qos.bcast);
 }
 
 struct set_configuration_data {
@@ -1289,6 +1245,161 @@ static DBusMessage *set_configuration(DBusConnection *conn, DBusMessage *msg,
 	return NULL;
 }
 
+static void iterate_setup_update_base(void *data, void *user_data);
+
+static bool match_setup_big(const void *data, const void *user_data)
+{
+	const struct bap_setup *setup = data;
+
+	return setup->qos.bcast.big == PTR_TO_UINT(user_data);
+}
+
+static bool bcast_big_in_use(uint8_t big, void *user_data)
+{
+	struct bap_data *data = user_data;
+	const struct queue_entry *entry;
+
+	for (entry = queue_get_entries(data->bcast); entry;
+						entry = entry->next) {
+		struct bap_ep *ep = entry->data;
+
+		if (queue_find(ep->setups, match_setup_big, UINT_TO_PTR(big)))
+			return true;
+	}
+
+	return false;
+}
+
+static void bcast_config_ready(struct bap_setup *setup, int code,
+						uint8_t reason, void *user_data)
+{
+	int *err = user_data;
+
+	if (code)
+		*err = code;
+}
+
+static void setups_free(struct queue *setups)
+{
+	struct bap_setup *setup;
+
+	while ((setup = queue_pop_head(setups)))
+		setup_free(setup);
+
+	queue_destroy(setups, NULL);
+}
+
+/* Configure all the BISes of a BIG at once: every stream and transport is
+ * created before the BASE is generated a single time for the whole group,
+ * instead of one SetConfiguration round trip per BIS.
+ */
+static DBusMessage *set_configurations(DBusConnection *conn, DBusMessage *msg,
+								void *data)
+{
+	struct bap_ep *ep = data;
+	struct bap_setup *setup, *first;
+	struct bt_bap_bcast_qos *qos[ISO_MAX_NUM_BIS];
+	const struct queue_entry *entry;
+	struct queue *setups;
+	DBusMessageIter args, configs, array;
+	DBusMessage *reply;
+	const char *path;
+	size_t num = 0;
+	int err;
+
+	if (bt_bap_pac_get_type(ep->lpac) != BT_BAP_BCAST_SOURCE)
+		return btd_error_not_supported(msg);
+
+	dbus_message_iter_init(msg, &args);
+
+	dbus_message_iter_get_basic(&args, &path);
+	dbus_message_iter_next(&args);
+
+	dbus_message_iter_recurse(&args, &configs);
+	if (dbus_message_iter_get_arg_type(&configs) != DBUS_TYPE_ARRAY)
+		return btd_error_invalid_args(msg);
+
+	setups = queue_new();
+
+	while (dbus_message_iter_get_arg_type(&configs) == DBUS_TYPE_ARRAY) {
+		DBusMessageIter props;
+
+		dbus_message_iter_recurse(&configs, &props);
+
+		setup = setup_new(ep);
+		queue_push_tail(setups, setup);
+
+		if (num >= ISO_MAX_NUM_BIS ||
+				setup_parse_configuration(setup, &props) < 0) {
+			DBG("Unable to parse configuration");
+			goto invalid;
+		}
+
+		qos[num++] = &setup->qos.bcast;
+
+		dbus_message_iter_next(&configs);
+	}
+
+	if (!num)
+		goto invalid;
+
+	first = queue_peek_head(setups);
+
+	/* All the BISes share the same QoS and BIG, picking a BIG not in use
+	 * if none is given.
+	 */
+	err = bt_bap_bcast_qos_group(qos, num, bcast_big_in_use, ep->data);
+	if (err == -EBUSY) {
+		setups_free(setups);
+		return btd_error_not_available(msg);
+	} else if (err < 0)
+		goto invalid;
+
+	/* Check that the configuration matches streams already in the BIG */
+	if (queue_find(ep->setups, setup_mismatch_qos, first))
+		goto invalid;
+
+	for (entry = queue_get_entries(setups); entry; entry = entry->next) {
+		setup = entry->data;
+
+		if (setup_config(setup, bcast_config_ready, &err) || err) {
+			DBG("Unable to config stream");
+			goto invalid;
+		}
+	}
+
+	/* Generate the BASE once all the streams of the BIG exist */
+	first->base = bt_bap_stream_get_base(first->stream);
+	queue_foreach(ep->setups, iterate_setup_update_base, first);
+
+	if (ep->data->service)
+		service_set_connecting(ep->data->service);
+
+	reply = dbus_message_new_method_return(msg);
+	dbus_message_iter_init_append(reply, &args);
+	dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_OBJECT_PATH_AS_STRING,
+					&array);
+
+	for (entry = queue_get_entries(setups); entry; entry = entry->next) {
+		setup = entry->data;
+		path = media_transport_stream_path(setup->stream);
+		if (path)
+			dbus_message_iter_append_basic(&array,
+						DBUS_TYPE_OBJECT_PATH, &path);
+	}
+
+	dbus_message_iter_close_container(&args, &array);
+
+	queue_destroy(setups, NULL);
+
+	return reply;
+
+invalid:
+	setups_free(setups);
+	return btd_error_invalid_args(msg);
+}
+
 struct clear_configuration_data {
 	DBusMessage *msg;
 	bool all;
@@ -1553,6 +1664,92 @@ static void bis_handler(uint8_t sid, uint8_t bis, uint8_t sgrp,
 	create_stream_for_bis(data, lpac, sid, qos, caps, meta, path);
 }
 
+static void bcast_get_bid(void *data, void *user_data)
+{
+	struct bt_ad_service_data *sd = data;
+	uint32_t *bid = user_data;
+	struct iovec iov;
+
+	if (sd->uuid.type != BT_UUID16 || sd->uuid.value.u16 != BCAA_SERVICE)
+		return;
+
+	iov.iov_base = sd->data;
+	iov.iov_len = sd->len;
+
+	util_iov_pull_le24(&iov, bid);
+}
+
+static bool bap_get_bid(struct bap_data *data, uint32_t *bid)
+{
+	*bid = UINT32_MAX;
+
+	btd_device_foreach_service_data(data->device, bcast_get_bid, bid);
+
+	return *bid != UINT32_MAX;
+}
+
+static void bcast_cache_store_base(struct btd_device *device, uint32_t bid,
+				uint8_t sid, const struct iovec *base,
+				const struct bt_iso_qos *qos)
+{
+	if (!bcast_cache)
+		bcast_cache = bcast_cache_new(BCAST_CACHE_MAX,
+							BCAST_CACHE_TTL);
+
+	DBG("Broadcast ID 0x%06x sid %u", bid, sid);
+
+	bcast_cache_store(bcast_cache, device_get_address(device),
+				btd_device_get_bdaddr_type(device), bid, sid,
+				base, qos);
+}
+
+/* The SID is only known once synced to the source, so any is matched */
+static struct bcast_cache_entry *bcast_cache_find(struct btd_device *device,
+								uint32_t bid)
+{
+	return bcast_cache_lookup(bcast_cache, device_get_address(device),
+				btd_device_get_bdaddr_type(device), bid, 0xff);
+}
+
+static void bap_parse_base(struct bap_data *data, uint8_t sid,
+				struct iovec *base, struct bt_iso_qos *qos)
+{
+	struct bt_bap_qos bap_qos = {0};
+
+	/* Create BAP QoS structure */
+	bt_bap_iso_qos_to_bap_qos(qos, &bap_qos);
+
+	/* Analyze received BASE data and create remote media endpoints for each
+	 * BIS matching our capabilities
+	 */
+	bt_bap_parse_base(sid, base, &bap_qos, bap_debug, bis_handler, data);
+
+	util_iov_free(bap_qos.bcast.bcode, 1);
+
+	service_set_connecting(data->service);
+}
+
+static bool match_adapter_data(const void *data, const void *match_data)
+{
+	const struct bap_data *bdata = data;
+
+	return !bdata->device && bdata->adapter == match_data;
+}
+
+/* Sync slots belong to the controller, so they are tracked per adapter */
+static struct bap_data *pa_adapter_data(struct bap_data *data)
+{
+	return queue_find(sessions, match_adapter_data, data->adapter);
+}
+
+static void pa_sync_done(struct bap_data *data)
+{
+	struct bap_data *adapter = pa_adapter_data(data);
+
+	if (adapter)
+		pa_queue_remove(adapter->pa_queue, data);
+}
+
 static gboolean big_info_report_cb(GIOChannel *io, GIOCondition cond,
 							gpointer user_data)
 {
@@ -1561,11 +1758,13 @@ static gboolean big_info_report_cb(GIOChannel *io, GIOCondition cond,
 	struct bt_iso_base base;
 	struct bt_iso_qos qos;
 	struct iovec iov;
-	struct bt_bap_qos bap_qos = {0};
+	uint32_t bid;
 	uint8_t sid;
 
 	DBG("BIG Info received");
 
+	data->io_id = 0;
+
 	bt_io_get(io, &err,
 			BT_IO_OPT_BASE, &base,
 			BT_IO_OPT_QOS, &qos,
@@ -1575,7 +1774,7 @@ static gboolean big_info_report_cb(GIOChannel *io, GIOCondition cond,
 		error("%s", err->message);
 		g_error_free(err);
 		g_io_channel_shutdown(io, TRUE, NULL);
-		data->io_id = 0;
+		pa_sync_done(data);
 		return FALSE;
 	}
 
@@ -1589,22 +1788,15 @@ static gboolean big_info_report_cb(GIOChannel *io, GIOCondition cond,
 	 */
 	g_io_channel_shutdown(io, TRUE, NULL);
 
-	/* Analyze received BASE data and create remote media endpoints for each
-	 * BIS matching our capabilities
-	 */
 	iov.iov_base = base.base;
 	iov.iov_len = base.base_len;
 
-	/* Create BAP QoS structure */
-	bt_bap_iso_qos_to_bap_qos(&qos, &bap_qos);
+	if (bap_get_bid(data, &bid))
+		bcast_cache_store_base(data->device, bid, sid, &iov, &qos);
 
-	bt_bap_parse_base(sid, &iov, &bap_qos, bap_debug, bis_handler, data);
+	bap_parse_base(data, sid, &iov, &qos);
 
-	util_iov_free(bap_qos.bcast.bcode, 1);
-
-	service_set_connecting(data->service);
-
-	data->io_id = 0;
+	pa_sync_done(data);
 
 	return FALSE;
 }
@@ -1633,6 +1825,11 @@ static const GDBusMethodTable ep_methods[] = {
 					GDBUS_ARGS({ "endpoint", "o" },
 						{ "Configuration", "a{sv}" } ),
 					NULL, set_configuration) },
+	{ GDBUS_EXPERIMENTAL_METHOD("SetConfigurations",
+					GDBUS_ARGS({ "endpoint", "o" },
+						{ "Configurations", "aa{sv}" }),
+					GDBUS_ARGS({ "transports", "ao" }),
+					set_configurations) },
 	{ GDBUS_EXPERIMENTAL_ASYNC_METHOD("ClearConfiguration",
 					GDBUS_ARGS({ "transport", "o" }),
 					NULL, clear_configuration) },
@@ -3573,15 +3770,29 @@ static void bap_detached(struct bt_bap *bap, void *user_data)
 	bap_data_remove(data);
 }
 
-static int pa_sync(struct bap_data *data)
+static void pa_sync_timeout(void *source, void *user_data)
 {
-	GError *err = NULL;
-	uint8_t sid = 0xff;
+	struct bap_data *data = source;
+
+	DBG("PA sync timeout");
+
+	if (data->io_id) {
+		g_source_remove(data->io_id);
+		data->io_id = 0;
+	}
 
 	if (data->listen_io) {
-		DBG("Already probed");
-		return -1;
+		g_io_channel_shutdown(data->listen_io, TRUE, NULL);
+		g_io_channel_unref(data->listen_io);
+		data->listen_io = NULL;
 	}
+}
+
+static bool pa_sync_start(void *source, void *user_data)
+{
+	struct bap_data *data = source;
+	GError *err = NULL;
+	uint8_t sid = 0xff;
 
 	DBG("Create PA sync with this source");
 
@@ -3602,8 +3813,69 @@ static int pa_sync(struct bap_data *data)
 	if (!data->listen_io) {
 		error("%s", err->message);
 		g_error_free(err);
+		return false;
+	}
+
+	return true;
+}
+
+static gboolean pa_sync_cached(gpointer user_data)
+{
+	struct bap_data *data = user_data;
+	struct bap_data *adapter;
+	struct bcast_cache_entry *entry;
+	uint32_t bid;
+
+	data->io_id = 0;
+
+	if (bap_get_bid(data, &bid)) {
+		entry = bcast_cache_find(data->device, bid);
+		if (entry) {
+			DBG("Broadcast ID 0x%06x found in cache", bid);
+			bap_parse_base(data, entry->sid, entry->base,
+							&entry->qos);
+			return FALSE;
+		}
+	}
+
+	/* Entry expired or evicted in the meantime */
+	adapter = pa_adapter_data(data);
+	if (!adapter)
+		return FALSE;
+
+	pa_queue_push(adapter->pa_queue, data);
+
+	return FALSE;
+}
+
+static int pa_sync(struct bap_data *data)
+{
+	struct bap_data *adapter = pa_adapter_data(data);
+	uint32_t bid;
+
+	if (!adapter) {
+		error("BAP adapter not found");
+		return -1;
+	}
+
+	if (data->listen_io || data->io_id ||
+				pa_queue_has(adapter->pa_queue, data)) {
+		DBG("Already probed");
+		return -1;
 	}
 
+	/* Sources already known are listed from the cache once probing is
+	 * done, without using a sync slot.
+	 */
+	if (bap_get_bid(data, &bid) && bcast_cache_find(data->device, bid)) {
+		data->io_id = g_idle_add(pa_sync_cached, data);
+		return 0;
+	}
+
+	DBG("Queue PA sync with this source");
+
+	pa_queue_push(adapter->pa_queue, data);
+
 	return 0;
 }
 
@@ -3993,6 +4265,8 @@ static int bap_adapter_probe(struct btd_profile *p, struct btd_adapter *adapter)
 	}
 
 	data->adapter = adapter;
+	data->pa_queue = pa_queue_new(PA_SYNC_MAX, PA_SYNC_TIMEOUT,
+					pa_sync_start, pa_sync_timeout, NULL);
 	data->state_id = bt_bap_state_register(data->bap, bap_state_bcast_src,
 					bap_connecting_bcast, data, NULL);
 	data->pac_id = bt_bap_pac_register(data->bap, pac_added_broadcast,
@@ -4070,6 +4344,9 @@ static void bap_exit(void)
 {
 	btd_profile_unregister(&bap_profile);
 	bt_bap_unregister(bap_id);
+
+	bcast_cache_free(bcast_cache);
+	bcast_cache = NULL;
 }
 
 BLUETOOTH_PLUGIN_DEFINE(bap, VERSION, BLUETOOTH_PLUGIN_PRIORITY_DEFAULT,
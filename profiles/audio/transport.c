@@ -16,6 +16,12 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -41,6 +47,7 @@
 #ifdef HAVE_A2DP
 #include "avdtp.h"
 #include "a2dp.h"
+#include "a2dp-adapt.h"
 #include "sink.h"
 #include "source.h"
 #ifdef HAVE_AVRCP
@@ -58,6 +65,27 @@
 
 #define MEDIA_TRANSPORT_INTERFACE "org.bluez.MediaTransport1"
 
+/* Send buffer and bitrate adaptation of A2DP sources */
+#define A2DP_ADAPT_INTERVAL	100	/* ms */
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
+
+/* Clock page shared read-only with media applications, fields are updated
+ * under a sequence count which is odd while an update is in progress. It
+ * only carries what the daemon knows: QoS, delay reports and state changes,
+ * the ISO data path and its timestamps belong to the application.
+ */
+struct transport_clock {
+	uint32_t seq;
+	uint32_t delay;		/* Presentation delay (us) */
+	uint32_t interval;	/* SDU interval (us), ISO only */
+	uint32_t latency;	/* Transport latency (us), ISO only */
+	uint64_t updated;	/* CLOCK_MONOTONIC time of last update (ns) */
+	uint64_t started;	/* CLOCK_MONOTONIC time of State "active" (ns) */
+};
+
 typedef enum {
 	TRANSPORT_STATE_IDLE,		/* Not acquired and suspended */
 	TRANSPORT_STATE_PENDING,	/* Playing but not acquired */
@@ -99,6 +127,9 @@ struct a2dp_transport {
 	guint			resume_id;
 	gboolean		cancel_resume;
 	guint			cancel_id;
+	guint			adapt_id;
+	struct a2dp_adapt	adapt;
+	uint8_t			bitrate_hint;
 };
 
 struct bap_transport {
@@ -149,6 +180,8 @@ struct media_transport {
 	transport_state_t	state;
 	const struct media_transport_ops *ops;
 	void			*data;
+	int			clock_fd;	/* Clock page memfd */
+	struct transport_clock	*clock;		/* Clock page mapping */
 };
 
 static GSList *transports = NULL;
@@ -211,6 +244,125 @@ find_transport_by_bap_stream(const struct bt_bap_stream *stream)
 	return NULL;
 }
 
+static uint64_t clock_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void clock_write_begin(struct transport_clock *clock)
+{
+	__atomic_store_n(&clock->seq, clock->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void clock_write_end(struct transport_clock *clock)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&clock->seq, clock->seq + 1, __ATOMIC_RELAXED);
+}
+
+static void transport_clock_set_started(struct media_transport *transport)
+{
+	struct transport_clock *clock = transport->clock;
+
+	if (!clock)
+		return;
+
+	clock_write_begin(clock);
+	clock->started = transport->state == TRANSPORT_STATE_ACTIVE ?
+							clock_now() : 0;
+	clock_write_end(clock);
+}
+
+static void transport_clock_refresh(const struct media_transport *transport)
+{
+	struct transport_clock *clock = transport->clock;
+	const char *uuid = media_endpoint_get_uuid(transport->endpoint);
+	struct bt_bap_io_qos *io_qos = NULL;
+	uint32_t delay = 0;
+
+	if (!clock)
+		return;
+
+#ifdef HAVE_A2DP
+	if (!strcasecmp(uuid, A2DP_SOURCE_UUID) ||
+				!strcasecmp(uuid, A2DP_SINK_UUID)) {
+		struct a2dp_transport *a2dp = transport->data;
+
+		/* A2DP delay is in 1/10 ms */
+		delay = a2dp->delay * 100;
+	}
+#endif /* HAVE_A2DP */
+
+	if (!strcasecmp(uuid, PAC_SINK_UUID) ||
+				!strcasecmp(uuid, PAC_SOURCE_UUID)) {
+		struct bap_transport *bap = transport->data;
+
+		delay = bap->qos.ucast.delay;
+		io_qos = &bap->qos.ucast.io_qos;
+	} else if (!strcasecmp(uuid, BCAA_SERVICE_UUID) ||
+				!strcasecmp(uuid, BAA_SERVICE_UUID)) {
+		struct bap_transport *bap = transport->data;
+
+		delay = bap->qos.bcast.delay;
+		io_qos = &bap->qos.bcast.io_qos;
+	}
+
+	clock_write_begin(clock);
+	clock->delay = delay;
+	clock->interval = io_qos ? io_qos->interval : 0;
+	clock->latency = io_qos ? io_qos->latency * 1000 : 0;
+	clock->updated = clock_now();
+	clock_write_end(clock);
+}
+
+static int transport_clock_new(struct media_transport *transport)
+{
+	size_t size = getpagesize();
+	void *clock;
+	int fd;
+
+	fd = memfd_create("bluez-transport-clock",
+					MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, size) < 0)
+		goto fail;
+
+	clock = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (clock == MAP_FAILED)
+		goto fail;
+
+	/* Only the daemon mapping may write, applications have to map the
+	 * page read-only.
+	 */
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		int err = -errno;
+
+		munmap(clock, size);
+		close(fd);
+		return err;
+	}
+
+	transport->clock_fd = fd;
+	transport->clock = clock;
+
+	transport_clock_refresh(transport);
+	transport_clock_set_started(transport);
+
+	return 0;
+
+fail:
+	close(fd);
+	return -errno;
+}
+
 static void transport_set_state(struct media_transport *transport,
 							transport_state_t state)
 {
@@ -233,6 +385,10 @@ static void transport_set_state(struct media_transport *transport,
 						MEDIA_TRANSPORT_INTERFACE,
 						"State");
 
+	if (state == TRANSPORT_STATE_ACTIVE ||
+				old_state == TRANSPORT_STATE_ACTIVE)
+		transport_clock_set_started(transport);
+
 	/* Update transport specific data */
 	if (transport->ops && transport->ops->set_state)
 		transport->ops->set_state(transport, state);
@@ -409,6 +565,99 @@ static void *transport_a2dp_get_stream(struct media_transport *transport)
 	return a2dp_sep_get_stream(sep, a2dp->session);
 }
 
+static void a2dp_set_bitrate_hint(struct media_transport *transport,
+							uint8_t hint)
+{
+	struct a2dp_transport *a2dp = transport->data;
+
+	if (a2dp->bitrate_hint == hint)
+		return;
+
+	DBG("%s: bitrate hint %u%%", transport->path, hint);
+
+	a2dp->bitrate_hint = hint;
+
+	g_dbus_emit_property_changed(btd_get_dbus_connection(),
+					transport->path,
+					MEDIA_TRANSPORT_INTERFACE,
+					"BitrateHint");
+}
+
+static gboolean a2dp_adapt(gpointer user_data)
+{
+	struct media_transport *transport = user_data;
+	struct a2dp_transport *a2dp = transport->data;
+	struct avdtp_stream *stream;
+	int queued, size, new_size;
+
+	stream = transport_a2dp_get_stream(transport);
+	if (!stream)
+		return TRUE;
+
+	if (avdtp_stream_get_send_queue(stream, &queued, &size) < 0 || !size)
+		return TRUE;
+
+	new_size = a2dp_adapt_update(&a2dp->adapt, queued, size);
+	if (new_size != size)
+		avdtp_stream_set_send_buffer(stream, new_size);
+
+	a2dp_set_bitrate_hint(transport, a2dp->adapt.hint);
+
+	return TRUE;
+}
+
+/*
+ * While the transport is active the send buffer of the stream socket is
+ * managed here, any size set by the owner is clamped to the adapted range.
+ */
+static void a2dp_adapt_start(struct media_transport *transport)
+{
+	struct a2dp_transport *a2dp = transport->data;
+	struct avdtp_stream *stream;
+	int queued, size, new_size;
+
+	a2dp_adapt_reset(&a2dp->adapt, transport->omtu);
+
+	stream = transport_a2dp_get_stream(transport);
+	if (!stream)
+		return;
+
+	if (avdtp_stream_get_send_queue(stream, &queued, &size) < 0 || !size)
+		return;
+
+	new_size = a2dp_adapt_clamp(&a2dp->adapt, size);
+	if (new_size != size)
+		avdtp_stream_set_send_buffer(stream, new_size);
+}
+
+static void transport_a2dp_src_set_state(struct media_transport *transport,
+						transport_state_t state)
+{
+	struct a2dp_transport *a2dp = transport->data;
+
+	switch (state) {
+	case TRANSPORT_STATE_ACTIVE:
+		if (a2dp->adapt_id)
+			return;
+
+		a2dp_adapt_start(transport);
+		a2dp->adapt_id = g_timeout_add(A2DP_ADAPT_INTERVAL, a2dp_adapt,
+								transport);
+		return;
+	case TRANSPORT_STATE_SUSPENDING:
+		return;
+	default:
+		break;
+	}
+
+	if (a2dp->adapt_id) {
+		g_source_remove(a2dp->adapt_id);
+		a2dp->adapt_id = 0;
+	}
+
+	a2dp_set_bitrate_hint(transport, 100);
+}
+
 static void a2dp_suspend_complete(struct avdtp *session, int err,
 							void *user_data)
 {
@@ -689,6 +938,7 @@ static int transport_a2dp_snk_set_delay(struct media_transport *transport,
 						transport->path,
 						MEDIA_TRANSPORT_INTERFACE,
 						"Delay");
+		transport_clock_refresh(transport);
 	}
 
 	return avdtp_delay_report(a2dp->session, stream, delay);
@@ -1201,6 +1451,83 @@ static gboolean get_endpoint(const GDBusPropertyTable *property,
 	return TRUE;
 }
 
+static DBusMessage *get_clock(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct media_transport *transport = data;
+	int err;
+
+	if (!transport->clock) {
+		err = transport_clock_new(transport);
+		if (err < 0) {
+			error("Unable to create clock page: %s (%d)",
+						strerror(-err), -err);
+			return btd_error_failed(msg, strerror(-err));
+		}
+	}
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &transport->clock_fd,
+							DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *get_statistics(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct media_transport *transport = data;
+	DBusMessage *reply;
+	DBusMessageIter iter, dict;
+	int sndbuf, outq, inq, flushable;
+	socklen_t len;
+	uint32_t val;
+
+	if (transport->state != TRANSPORT_STATE_ACTIVE || transport->fd < 0)
+		return btd_error_not_available(msg);
+
+	len = sizeof(sndbuf);
+	if (getsockopt(transport->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+							&len) < 0 ||
+			ioctl(transport->fd, TIOCOUTQ, &outq) < 0 ||
+			ioctl(transport->fd, TIOCINQ, &inq) < 0)
+		return btd_error_failed(msg, strerror(errno));
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	val = sndbuf;
+	dict_append_entry(&dict, "SendBuffer", DBUS_TYPE_UINT32, &val);
+
+	/* Bluetooth sockets report the free space left in the send buffer */
+	val = sndbuf > outq ? sndbuf - outq : 0;
+	dict_append_entry(&dict, "Queued", DBUS_TYPE_UINT32, &val);
+
+	val = inq;
+	dict_append_entry(&dict, "Pending", DBUS_TYPE_UINT32, &val);
+
+	/* Only L2CAP channels have a flushable setting */
+	len = sizeof(flushable);
+	if (!getsockopt(transport->fd, SOL_BLUETOOTH, BT_FLUSHABLE,
+							&flushable, &len)) {
+		dbus_bool_t value = flushable ? TRUE : FALSE;
+
+		dict_append_entry(&dict, "Flushable", DBUS_TYPE_BOOLEAN,
+								&value);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static DBusMessage *select_transport(DBusConnection *conn, DBusMessage *msg,
 					void *data);
 
@@ -1223,10 +1550,37 @@ static const GDBusMethodTable transport_methods[] = {
 			NULL, NULL, select_transport) },
 	{ GDBUS_ASYNC_METHOD("Unselect",
 			NULL, NULL, unselect_transport) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			get_statistics) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetClock",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			get_clock) },
 	{ },
 };
 
 #ifdef HAVE_A2DP
+static gboolean bitrate_hint_exists(const GDBusPropertyTable *property,
+							void *data)
+{
+	struct media_transport *transport = data;
+	struct media_endpoint *endpoint = transport->endpoint;
+
+	return !strcmp(media_endpoint_get_uuid(endpoint), A2DP_SOURCE_UUID);
+}
+
+static gboolean get_bitrate_hint(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct media_transport *transport = data;
+	struct a2dp_transport *a2dp = transport->data;
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_BYTE,
+							&a2dp->bitrate_hint);
+
+	return TRUE;
+}
+
 static const GDBusPropertyTable transport_a2dp_properties[] = {
 	{ "Device", "o", get_device },
 	{ "UUID", "s", get_uuid },
@@ -1238,6 +1592,8 @@ static const GDBusPropertyTable transport_a2dp_properties[] = {
 	{ "Volume", "q", get_volume, set_volume, volume_exists },
 	{ "Endpoint", "o", get_endpoint, NULL, endpoint_exists,
 				G_DBUS_PROPERTY_FLAG_EXPERIMENTAL },
+	{ "BitrateHint", "y", get_bitrate_hint, NULL, bitrate_hint_exists,
+				G_DBUS_PROPERTY_FLAG_EXPERIMENTAL },
 	{ }
 };
 #endif /* HAVE_A2DP */
@@ -1665,6 +2021,9 @@ static void transport_a2dp_src_destroy(void *data)
 	if (a2dp->watch)
 		sink_remove_state_cb(a2dp->watch);
 
+	if (a2dp->adapt_id)
+		g_source_remove(a2dp->adapt_id);
+
 	transport_a2dp_destroy(data);
 }
 
@@ -1691,6 +2050,11 @@ static void media_transport_free(void *data)
 	if (transport->ops && transport->ops->destroy)
 		transport->ops->destroy(transport->data);
 
+	if (transport->clock) {
+		munmap(transport->clock, getpagesize());
+		close(transport->clock_fd);
+	}
+
 	g_free(transport->remote_endpoint);
 	g_free(transport->configuration);
 	g_free(transport->path);
@@ -1802,6 +2166,7 @@ static void *transport_a2dp_src_init(struct media_transport *transport,
 
 	a2dp = new0(struct a2dp_transport, 1);
 	a2dp->volume = -1;
+	a2dp->bitrate_hint = 100;
 	a2dp->watch = sink_add_state_cb(service, sink_state_changed, transport);
 
 	return a2dp;
@@ -1958,6 +2323,8 @@ static void bap_update_qos(const struct media_transport *transport)
 	g_dbus_emit_property_changed(btd_get_dbus_connection(),
 			transport->path, MEDIA_TRANSPORT_INTERFACE,
 			"QoS");
+
+	transport_clock_refresh(transport);
 }
 
 static gboolean bap_resume_complete_cb(void *data)
@@ -2007,6 +2374,8 @@ static void bap_update_bcast_qos(const struct media_transport *transport)
 	g_dbus_emit_property_changed(btd_get_dbus_connection(),
 			transport->path, MEDIA_TRANSPORT_INTERFACE,
 			"Configuration");
+
+	transport_clock_refresh(transport);
 }
 
 static guint transport_bap_resume(struct media_transport *transport,
@@ -2554,11 +2923,12 @@ static void *transport_asha_init(struct media_transport *transport, void *data)
 	.destroy = _destroy \
 }
 
-#define A2DP_OPS(_uuid, _init, _set_volume, _set_delay, _destroy) \
+#define A2DP_OPS(_uuid, _init, _set_state, _set_volume, _set_delay, \
+		_destroy) \
 	TRANSPORT_OPS(_uuid, transport_a2dp_properties, NULL, \
 			transport_a2dp_remove_owner, _init,	      \
 			transport_a2dp_resume, transport_a2dp_suspend, \
-			transport_a2dp_cancel, NULL, \
+			transport_a2dp_cancel, _set_state, \
 			transport_a2dp_get_stream, transport_a2dp_get_volume, \
 			_set_volume, _set_delay, NULL, _destroy)
 
@@ -2592,6 +2962,7 @@ static void *transport_asha_init(struct media_transport *transport, void *data)
 static const struct media_transport_ops transport_ops[] = {
 #ifdef HAVE_A2DP
 	A2DP_OPS(A2DP_SOURCE_UUID, transport_a2dp_src_init,
+			transport_a2dp_src_set_state,
 #ifdef HAVE_AVRCP
 			transport_a2dp_src_set_volume,
 #else
@@ -2599,7 +2970,7 @@ static const struct media_transport_ops transport_ops[] = {
 #endif
 			NULL,
 			transport_a2dp_src_destroy),
-	A2DP_OPS(A2DP_SINK_UUID, transport_a2dp_snk_init,
+	A2DP_OPS(A2DP_SINK_UUID, transport_a2dp_snk_init, NULL,
 #ifdef HAVE_AVRCP
 			transport_a2dp_snk_set_volume,
 #else
@@ -2683,6 +3054,7 @@ struct media_transport *media_transport_create(struct btd_device *device,
 	}
 
 	transport->fd = -1;
+	transport->clock_fd = -1;
 
 	ops = media_transport_find_ops(media_endpoint_get_uuid(endpoint));
 	if (!ops)
@@ -2744,6 +3116,8 @@ void media_transport_update_delay(struct media_transport *transport,
 	g_dbus_emit_property_changed(btd_get_dbus_connection(),
 					transport->path,
 					MEDIA_TRANSPORT_INTERFACE, "Delay");
+
+	transport_clock_refresh(transport);
 #endif /* HAVE_A2DP */
 }
 
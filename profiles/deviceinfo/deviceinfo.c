@@ -59,6 +59,15 @@ static void read_pnpid_cb(bool success, uint8_t att_ecode, const uint8_t *value,
 static void handle_pnpid(struct btd_device *device, uint16_t value_handle)
 {
 	struct bt_gatt_client *client = btd_device_get_gatt_client(device);
+	const uint8_t *value;
+	uint16_t length;
+
+	/* PnP ID never changes for a given database so skip the round trip */
+	if (bt_gatt_client_get_cached_value(client, value_handle, &value,
+							&length)) {
+		read_pnpid_cb(true, 0, value, length, device);
+		return;
+	}
 
 	if (!bt_gatt_client_read_value(client, value_handle,
 						read_pnpid_cb, device, NULL))
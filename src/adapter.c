@@ -7162,23 +7162,27 @@ static void confirm_name(struct btd_adapter *adapter, const bdaddr_t *bdaddr,
 
 static void adapter_msd_notify(struct btd_adapter *adapter,
 							struct btd_device *dev,
-							GSList *msd_list)
+							const uint8_t *eir,
+							uint8_t eir_len)
 {
 	GSList *cb_l, *cb_next;
-	GSList *msd_l, *msd_next;
+	struct eir_iter iter;
+	const uint8_t *data;
+	uint8_t type, len;
 
 	for (cb_l = adapter->msd_callbacks; cb_l != NULL; cb_l = cb_next) {
 		btd_msd_cb_t cb = cb_l->data;
 
 		cb_next = g_slist_next(cb_l);
 
-		for (msd_l = msd_list; msd_l != NULL; msd_l = msd_next) {
-			const struct eir_msd *msd = msd_l->data;
+		eir_iter_init(&iter, eir, eir_len);
 
-			msd_next = g_slist_next(msd_l);
+		while (eir_iter_next(&iter, &type, &data, &len)) {
+			if (type != EIR_MANUFACTURER_DATA || len < 2 ||
+						len > 2 + EIR_MSD_MAX_LEN)
+				continue;
 
-			cb(adapter, dev, msd->company, msd->data,
-								msd->data_len);
+			cb(adapter, dev, get_le16(data), data + 2, len - 2);
 		}
 	}
 }
@@ -7249,8 +7253,9 @@ static void filter_duplicate_data(void *data, void *user_data)
 }
 
 static bool device_is_discoverable(struct btd_adapter *adapter,
-					struct eir_data *eir, const char *addr,
-					uint8_t bdaddr_type, bool *auto_connect)
+					const struct eir_view *eir,
+					const char *addr, uint8_t bdaddr_type,
+					bool *auto_connect)
 {
 	GSList *l;
 	bool discoverable;
@@ -7311,8 +7316,10 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 {
 	struct btd_device *dev;
 	struct bt_ad *ad = NULL;
+	struct eir_view view;
 	struct eir_data eir_data;
 	bool name_known, discoverable;
+	bool parsed = false;
 	char addr[18];
 	bool confirm;
 	bool legacy;
@@ -7351,12 +7358,15 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!adapter->discovering && !monitoring)
 		return;
 
-	memset(&eir_data, 0, sizeof(eir_data));
-	eir_parse(&eir_data, data, data_len);
+	/* Most reports are dropped or repeat what is already known about the
+	 * device, so only look at the few fields needed to decide that and
+	 * leave the full parsing for when the device is actually updated.
+	 */
+	eir_parse_view(&view, data, data_len);
 
 	ba2str(bdaddr, addr);
 
-	discoverable = device_is_discoverable(adapter, &eir_data, addr,
+	discoverable = device_is_discoverable(adapter, &view, addr,
 						bdaddr_type, &auto_connect);
 
 	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
@@ -7364,15 +7374,14 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 		/* In case of being just a scan response don't attempt to create
 		 * the device.
 		 */
-		if (scan_rsp) {
-			eir_data_free(&eir_data);
+		if (scan_rsp)
 			return;
-		}
 
 		/* Monitor Devices advertising Broadcast Announcements if the
 		 * adapter is capable of synchronizing to it.
 		 */
-		if (eir_get_service_data(&eir_data, BCAA_SERVICE_UUID) &&
+		if (eir_get_service_data16(data, data_len, BCAA_SERVICE,
+								NULL) &&
 				btd_adapter_has_settings(adapter,
 				MGMT_SETTING_ISO_SYNC_RECEIVER))
 			monitoring = true;
@@ -7382,13 +7391,11 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 		 * their object are needed.
 		 */
 		if (btd_adapter_has_exp_feature(adapter, EXP_FEAT_ISO_SOCKET) &&
-						eir_data.rsi)
+						view.rsi)
 			monitoring = true;
 
-		if (!discoverable && !monitoring) {
-			eir_data_free(&eir_data);
+		if (!discoverable && !monitoring)
 			return;
-		}
 
 		dev = adapter_create_device(adapter, bdaddr, bdaddr_type);
 	}
@@ -7396,7 +7403,6 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!dev) {
 		btd_error(adapter->dev_id,
 			"Unable to create object for found device %s", addr);
-		eir_data_free(&eir_data);
 		return;
 	}
 
@@ -7408,15 +7414,15 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	 * kernels send them merged, so once we know which mgmt version
 	 * supports this we can make the non-zero check conditional.
 	 */
-	if (bdaddr_type != BDADDR_BREDR && eir_data.flags &&
-					!(eir_data.flags & EIR_BREDR_UNSUP)) {
+	if (bdaddr_type != BDADDR_BREDR && view.flags &&
+					!(view.flags & EIR_BREDR_UNSUP)) {
 		device_set_bredr_support(dev);
 		/* Update last seen for BR/EDR in case its flag is set */
 		device_update_last_seen(dev, BDADDR_BREDR, !not_connectable);
 	}
 
-	if (eir_data.name != NULL && eir_data.name_complete)
-		device_store_cached_name(dev, eir_data.name);
+	if (view.name != NULL && view.name_complete)
+		device_store_cached_name(dev, view.name);
 
 	/*
 	 * Only skip devices that are not connected, are temporary, and there
@@ -7424,15 +7430,23 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	 */
 	if (!btd_device_is_connected(dev) &&
 		(device_is_temporary(dev) && !adapter->discovery_list) &&
-		!monitoring) {
-		eir_data_free(&eir_data);
+		!monitoring)
 		return;
+
+	memset(&eir_data, 0, sizeof(eir_data));
+
+	/* Discovery filters match on the service UUIDs so those need the
+	 * report to be fully parsed upfront.
+	 */
+	if (adapter->filtered_discovery) {
+		eir_parse(&eir_data, data, data_len);
+		parsed = true;
 	}
 
 	/* If there is no matched Adv monitors, don't continue if not
 	 * discoverable or if active discovery filter don't match.
 	 */
-	if (!eir_data.rsi && !monitoring && (!discoverable ||
+	if (!view.rsi && !monitoring && (!discoverable ||
 		(adapter->filtered_discovery && !is_filter_match(
 				adapter->discovery_list, &eir_data, rssi)))) {
 		eir_data_free(&eir_data);
@@ -7449,16 +7463,30 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	else
 		device_set_rssi(dev, rssi);
 
-	if (eir_data.tx_power != 127)
-		device_set_tx_power(dev, eir_data.tx_power);
-
-	if (eir_data.appearance != 0)
-		device_set_appearance(dev, eir_data.appearance);
+	if (view.tx_power != 127)
+		device_set_tx_power(dev, view.tx_power);
 
 	/* Report an unknown name to the kernel even if there is a short name
 	 * known, but still update the name with the known short name. */
 	name_known = device_name_known(dev);
 
+	if (adapter->discovery_list)
+		g_slist_foreach(adapter->discovery_list, filter_duplicate_data,
+								&duplicate);
+
+	/* Reports identical to the last one applied carry nothing new unless
+	 * some client asked to be told about duplicates.
+	 */
+	if (!device_update_eir(dev, scan_rsp, data, data_len) && !duplicate &&
+								!parsed)
+		goto notify;
+
+	if (!parsed)
+		eir_parse(&eir_data, data, data_len);
+
+	if (eir_data.appearance != 0)
+		device_set_appearance(dev, eir_data.appearance);
+
 	if (eir_data.name && (eir_data.name_complete || !name_known))
 		btd_device_device_set_name(dev, eir_data.name);
 
@@ -7474,14 +7502,8 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 
 	device_add_eir_uuids(dev, eir_data.services);
 
-	if (adapter->discovery_list)
-		g_slist_foreach(adapter->discovery_list, filter_duplicate_data,
-								&duplicate);
-
-	if (eir_data.msd_list) {
+	if (eir_data.msd_list)
 		device_set_manufacturer_data(dev, eir_data.msd_list, duplicate);
-		adapter_msd_notify(adapter, dev, eir_data.msd_list);
-	}
 
 	if (eir_data.sd_list)
 		device_set_service_data(dev, eir_data.sd_list, duplicate);
@@ -7494,6 +7516,9 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 
 	eir_data_free(&eir_data);
 
+notify:
+	adapter_msd_notify(adapter, dev, data, data_len);
+
 	/* After the device is updated, notify the matched Adv monitors */
 	if (matched_monitors) {
 		btd_adv_monitor_notify_monitors(adapter->adv_monitor_manager,
@@ -9575,8 +9600,8 @@ static void connected_callback(uint16_t index, uint16_t length,
 		btd_device_device_set_name(device, eir_data.name);
 	}
 
-	if (eir_data.msd_list)
-		adapter_msd_notify(adapter, device, eir_data.msd_list);
+	if (eir_len > 0)
+		adapter_msd_notify(adapter, device, ev->eir, eir_len);
 
 	eir_data_free(&eir_data);
 }
@@ -79,7 +79,19 @@
 #define RSSI_THRESHOLD		8
 #define AUTH_FAILURES_THRESHOLD	3
 
+#define GATT_TEMPLATES_MAX	16
+
 static DBusConnection *dbus_conn = NULL;
+
+struct gatt_template {
+	uint8_t hash[16];
+	struct gatt_db *db;
+};
+
+/* Attribute structures of discovered databases keyed by their Database Hash
+ * so identical peers can skip discovery.
+ */
+static struct queue *gatt_templates = NULL;
 static unsigned service_state_cb_id;
 
 struct btd_disconnect_data {
@@ -231,6 +243,8 @@ struct btd_device {
 	uint32_t	current_flags;
 	GSList		*svc_callbacks;
 	GSList		*eir_uuids;
+	uint8_t		*last_eir[2];		/* Last ADV and SCAN_RSP */
+	uint8_t		last_eir_len[2];
 	struct bt_ad	*ad;
 	uint8_t         ad_flags[1];
 	char		name[MAX_NAME_LENGTH + 1];
@@ -953,6 +967,8 @@ static void device_free(gpointer user_data)
 	if (device->eir_uuids)
 		g_slist_free_full(device->eir_uuids, g_free);
 
+	device_reset_eir(device);
+
 	queue_destroy(device->sirks, free);
 
 	btd_bearer_destroy(device->bredr);
@@ -2436,6 +2452,40 @@ unref:
 	dev->connect = NULL;
 }
 
+/*
+ * Record the report about to be applied to the device and return whether it
+ * differs from the previous one of the same PDU type, so callers can skip
+ * parsing and reapplying advertising data that is sent over and over again
+ * unchanged. Advertising and scan response data are tracked apart since
+ * reports alternate between the two during active scanning.
+ */
+bool device_update_eir(struct btd_device *dev, bool scan_rsp,
+					const uint8_t *data, uint8_t len)
+{
+	uint8_t **last = &dev->last_eir[scan_rsp];
+	uint8_t *last_len = &dev->last_eir_len[scan_rsp];
+
+	if (*last && *last_len == len && !memcmp(*last, data, len))
+		return false;
+
+	free(*last);
+	*last = len ? util_memdup(data, len) : NULL;
+	*last_len = len;
+
+	return true;
+}
+
+void device_reset_eir(struct btd_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(dev->last_eir); i++) {
+		free(dev->last_eir[i]);
+		dev->last_eir[i] = NULL;
+		dev->last_eir_len[i] = 0;
+	}
+}
+
 void device_add_eir_uuids(struct btd_device *dev, GSList *uuids)
 {
 	GSList *l;
@@ -3070,6 +3120,8 @@ static void store_gatt_db(struct btd_device *device)
 	create_file(filename, 0600);
 
 	btd_settings_gatt_db_store(device->db, filename);
+
+	bt_gatt_client_clear_cache_dirty(device->client);
 }
 
 static void browse_request_complete(struct browse_req *req, uint8_t type,
@@ -3193,6 +3245,7 @@ static void device_svc_resolved(struct btd_device *dev, uint8_t browse_type,
 
 	g_slist_free_full(dev->eir_uuids, g_free);
 	dev->eir_uuids = NULL;
+	device_reset_eir(dev);
 
 	if (dev->pending_paired) {
 		if (bdaddr_type == BDADDR_BREDR)
@@ -4022,6 +4075,7 @@ void device_remove_connection(struct btd_device *device, uint8_t bdaddr_type,
 
 	g_slist_free_full(device->eir_uuids, g_free);
 	device->eir_uuids = NULL;
+	device_reset_eir(device);
 
 	/*
 	 * Check if device is marked for auto_connect before attempting to limit
@@ -6216,6 +6270,11 @@ static void att_disconnected_cb(int err, void *user_data)
 
 	g_slist_foreach(device->services, disconnect_gatt_service, NULL);
 
+	/* Persist the values and CCC states learned during the connection */
+	if (bt_gatt_client_is_ready(device->client) &&
+			bt_gatt_client_get_cache_dirty(device->client))
+		store_gatt_db(device);
+
 	btd_gatt_client_disconnected(device->client_dbus);
 
 	if (!device_get_auto_connect(device)) {
@@ -6262,6 +6321,77 @@ static void register_gatt_services(struct btd_device *device)
 	device_add_gatt_services(device);
 }
 
+static void gatt_template_free(void *data)
+{
+	struct gatt_template *template = data;
+
+	gatt_db_unref(template->db);
+	free(template);
+}
+
+static bool match_gatt_template(const void *data, const void *match_data)
+{
+	const struct gatt_template *template = data;
+
+	return !memcmp(template->hash, match_data, sizeof(template->hash));
+}
+
+static void gatt_template_store(struct btd_device *device)
+{
+	struct gatt_template *template;
+	const uint8_t *hash;
+
+	if (btd_opts.gatt_cache == BT_GATT_CACHE_NO)
+		return;
+
+	hash = btd_settings_gatt_db_hash(device->db);
+	if (!hash)
+		return;
+
+	if (!gatt_templates)
+		gatt_templates = queue_new();
+
+	/* Keep most recently used templates at the head */
+	template = queue_remove_if(gatt_templates, match_gatt_template,
+								(void *) hash);
+	if (template) {
+		queue_push_head(gatt_templates, template);
+		return;
+	}
+
+	template = new0(struct gatt_template, 1);
+	memcpy(template->hash, hash, sizeof(template->hash));
+
+	/* Only the attribute structure is cloned, values remain per device */
+	template->db = gatt_db_clone(device->db);
+
+	queue_push_head(gatt_templates, template);
+
+	DBG("%s: stored GATT template (%u)", device->path,
+					queue_length(gatt_templates));
+
+	if (queue_length(gatt_templates) > GATT_TEMPLATES_MAX) {
+		template = queue_peek_tail(gatt_templates);
+		queue_remove(gatt_templates, template);
+		gatt_template_free(template);
+	}
+}
+
+static struct gatt_db *gatt_template_lookup(const uint8_t *hash,
+							void *user_data)
+{
+	struct btd_device *device = user_data;
+	struct gatt_template *template;
+
+	template = queue_find(gatt_templates, match_gatt_template, hash);
+	if (!template)
+		return NULL;
+
+	DBG("%s: using GATT template", device->path);
+
+	return template->db;
+}
+
 static void gatt_client_init(struct btd_device *device);
 
 static void gatt_client_ready_cb(bool success, uint8_t att_ecode,
@@ -6284,6 +6414,7 @@ static void gatt_client_ready_cb(bool success, uint8_t att_ecode,
 	device_svc_resolved(device, BROWSE_GATT, device->bdaddr_type, 0);
 
 	store_gatt_db(device);
+	gatt_template_store(device);
 }
 
 static void gatt_client_service_changed(uint16_t start_handle,
@@ -6336,6 +6467,24 @@ static void gatt_client_init(struct btd_device *device)
 	}
 
 	bt_gatt_client_set_debug(device->client, gatt_debug, NULL, NULL);
+
+	/*
+	 * Bonded servers keep the CCC states across connections so the ones
+	 * in the cache can be trusted once the DB Hash confirms it is valid.
+	 */
+	if (device_is_bonded(device, device->bdaddr_type))
+		bt_gatt_client_set_ccc_restore(device->client, true);
+
+	/*
+	 * Probing the DB Hash costs a round trip before discovery so only do
+	 * it when there is a template it could match.
+	 */
+	if (btd_opts.gatt_cache != BT_GATT_CACHE_NO &&
+					!queue_isempty(gatt_templates))
+		bt_gatt_client_set_db_lookup(device->client,
+						gatt_template_lookup, device,
+						NULL);
+
 	g_attrib_attach_client(device->attrib, device->client);
 
 	/*
@@ -8259,6 +8408,8 @@ void btd_device_init(void)
 void btd_device_cleanup(void)
 {
 	btd_service_remove_state_cb(service_state_cb_id);
+	queue_destroy(gatt_templates, gatt_template_free);
+	gatt_templates = NULL;
 }
 
 void btd_device_set_volume(struct btd_device *device, int8_t volume)
@@ -124,16 +124,25 @@ static void eir_parse_uuid128(struct eir_data *eir, const uint8_t *data,
 	}
 }
 
-static char *name2utf8(const uint8_t *name, uint8_t len)
+static void name_to_utf8(char *buf, size_t size, const uint8_t *name,
+								uint8_t len)
 {
-	char utf8_name[HCI_MAX_NAME_LENGTH + 2];
+	if (len > size - 1)
+		len = size - 1;
 
-	memset(utf8_name, 0, sizeof(utf8_name));
-	strncpy(utf8_name, (char *) name, len);
-	strtoutf8(utf8_name, len);
+	memset(buf, 0, size);
+	strncpy(buf, (char *) name, len);
+	strtoutf8(buf, len);
 
 	/* Remove leading and trailing whitespace characters */
-	g_strstrip(utf8_name);
+	g_strstrip(buf);
+}
+
+static char *name2utf8(const uint8_t *name, uint8_t len)
+{
+	char utf8_name[HCI_MAX_NAME_LENGTH + 2];
+
+	name_to_utf8(utf8_name, sizeof(utf8_name), name, len);
 
 	return g_strdup(utf8_name);
 }
@@ -232,36 +241,67 @@ static void eir_parse_data(struct eir_data *eir, uint8_t type,
 		eir->rsi = true;
 }
 
-void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
+void eir_iter_init(struct eir_iter *iter, const uint8_t *eir_data,
+							uint8_t eir_len)
 {
-	uint16_t len = 0;
+	iter->data = eir_data;
+	iter->len = eir_data ? eir_len : 0;
+	iter->offset = 0;
+}
 
-	eir->flags = 0;
-	eir->tx_power = 127;
+bool eir_iter_next(struct eir_iter *iter, uint8_t *type,
+					const uint8_t **data, uint8_t *len)
+{
+	const uint8_t *field;
+	uint8_t field_len;
 
-	/* No EIR data to parse */
-	if (eir_data == NULL)
-		return;
+	if (iter->offset + 1 >= iter->len)
+		return false;
 
-	while (len < eir_len - 1) {
-		uint8_t field_len = eir_data[0];
-		const uint8_t *data;
-		uint8_t data_len;
+	field = &iter->data[iter->offset];
+	field_len = field[0];
 
-		/* Check for the end of EIR */
-		if (field_len == 0)
-			break;
+	/* Check for the end of EIR */
+	if (field_len == 0)
+		return false;
+
+	/* Do not continue EIR Data parsing if got incorrect length */
+	if (iter->offset + field_len + 1 > iter->len) {
+		iter->offset = iter->len;
+		return false;
+	}
 
-		len += field_len + 1;
+	iter->offset += field_len + 1;
 
-		/* Do not continue EIR Data parsing if got incorrect length */
-		if (len > eir_len)
-			break;
+	*type = field[1];
+	*data = &field[2];
+	*len = field_len - 1;
 
-		data = &eir_data[2];
-		data_len = field_len - 1;
+	return true;
+}
+
+static uint8_t name_strip_nul(const uint8_t *data, uint8_t data_len)
+{
+	/* Some vendors put a NUL byte terminator into the name */
+	while (data_len > 0 && data[data_len - 1] == '\0')
+		data_len--;
 
-		switch (eir_data[1]) {
+	return data_len;
+}
+
+void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
+{
+	struct eir_iter iter;
+	const uint8_t *data;
+	uint8_t type, data_len;
+
+	eir->flags = 0;
+	eir->tx_power = 127;
+
+	eir_iter_init(&iter, eir_data, eir_len);
+
+	while (eir_iter_next(&iter, &type, &data, &data_len)) {
+		switch (type) {
 		case EIR_UUID16_SOME:
 		case EIR_UUID16_ALL:
 			eir_parse_uuid16(eir, data, data_len);
@@ -285,15 +325,12 @@ void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
 		case EIR_NAME_SHORT:
 		case EIR_NAME_COMPLETE:
 		case EIR_BC_NAME:
-			/* Some vendors put a NUL byte terminator into
-			 * the name */
-			while (data_len > 0 && data[data_len - 1] == '\0')
-				data_len--;
+			data_len = name_strip_nul(data, data_len);
 
 			g_free(eir->name);
 
 			eir->name = name2utf8(data, data_len);
-			eir->name_complete = eir_data[1] != EIR_NAME_SHORT;
+			eir->name_complete = type != EIR_NAME_SHORT;
 			break;
 
 		case EIR_TX_POWER:
@@ -354,12 +391,87 @@ void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
 			break;
 
 		default:
-			eir_parse_data(eir, eir_data[1], data, data_len);
+			eir_parse_data(eir, type, data, data_len);
 			break;
 		}
+	}
+}
 
-		eir_data += field_len + 1;
+/*
+ * Lightweight variant of eir_parse() for the device found path: only the
+ * fields needed to decide whether a report is of interest are extracted and
+ * nothing is allocated, the name is converted into the view itself.
+ */
+void eir_parse_view(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len)
+{
+	struct eir_iter iter;
+	const uint8_t *data;
+	uint8_t type, data_len;
+
+	view->flags = 0;
+	view->name = NULL;
+	view->name_complete = false;
+	view->rsi = false;
+	view->tx_power = 127;
+
+	eir_iter_init(&iter, eir_data, eir_len);
+
+	while (eir_iter_next(&iter, &type, &data, &data_len)) {
+		switch (type) {
+		case EIR_FLAGS:
+			if (data_len > 0)
+				view->flags = *data;
+			break;
+
+		case EIR_NAME_SHORT:
+		case EIR_NAME_COMPLETE:
+		case EIR_BC_NAME:
+			data_len = name_strip_nul(data, data_len);
+			name_to_utf8(view->name_buf, sizeof(view->name_buf),
+							data, data_len);
+			view->name = view->name_buf;
+			view->name_complete = type != EIR_NAME_SHORT;
+			break;
+
+		case EIR_TX_POWER:
+			if (data_len < 1)
+				break;
+			view->tx_power = (int8_t) data[0];
+			break;
+
+		case EIR_CSIP_RSI:
+			view->rsi = true;
+			break;
+		}
+	}
+}
+
+const uint8_t *eir_get_service_data16(const uint8_t *eir_data,
+					uint8_t eir_len, uint16_t uuid,
+					uint8_t *len)
+{
+	struct eir_iter iter;
+	const uint8_t *data;
+	uint8_t type, data_len;
+
+	eir_iter_init(&iter, eir_data, eir_len);
+
+	while (eir_iter_next(&iter, &type, &data, &data_len)) {
+		if (type != EIR_SVC_DATA16 || data_len < 2 ||
+					data_len > EIR_SD_MAX_LEN)
+			continue;
+
+		if (get_le16(data) != uuid)
+			continue;
+
+		if (len)
+			*len = data_len - 2;
+
+		return data + 2;
 	}
+
+	return NULL;
 }
 
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len)
@@ -93,6 +93,25 @@ struct eir_data {
 	GSList *data_list;
 };
 
+/* Walks the AD structures of a report in place, without allocating */
+struct eir_iter {
+	const uint8_t *data;
+	uint8_t len;
+	uint16_t offset;
+};
+
+#define EIR_NAME_MAX_LEN            248
+
+/* Fields needed to decide whether a report is worth a full eir_parse */
+struct eir_view {
+	unsigned int flags;
+	const char *name;
+	bool name_complete;
+	bool rsi;
+	int8_t tx_power;
+	char name_buf[EIR_NAME_MAX_LEN + 1];
+};
+
 void eir_data_free(struct eir_data *eir);
 void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len);
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len);
@@ -102,3 +121,13 @@ int eir_create_oob(const bdaddr_t *addr, const char *name, uint32_t cod,
 			uint16_t did_version, uint16_t did_source,
 			sdp_list_t *uuids, uint8_t *data);
 struct eir_sd *eir_get_service_data(struct eir_data *eir, const char *uuid);
+
+void eir_iter_init(struct eir_iter *iter, const uint8_t *eir_data,
+							uint8_t eir_len);
+bool eir_iter_next(struct eir_iter *iter, uint8_t *type,
+					const uint8_t **data, uint8_t *len);
+void eir_parse_view(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len);
+const uint8_t *eir_get_service_data16(const uint8_t *eir_data,
+					uint8_t eir_len, uint16_t uuid,
+					uint8_t *len);
@@ -50,6 +50,12 @@
 #define GATT_CHARACTERISTIC_IFACE	"org.bluez.GattCharacteristic1"
 #define GATT_DESCRIPTOR_IFACE		"org.bluez.GattDescriptor1"
 
+/*
+ * Number of Write Commands read from an AcquireWrite socket that can be
+ * waiting in the ATT queue at once.
+ */
+#define WRITE_IO_CREDITS		8
+
 struct btd_gatt_client {
 	struct btd_device *device;
 	uint8_t features;
@@ -86,11 +92,23 @@ struct async_dbus_op {
 	async_dbus_op_complete_t complete;
 };
 
+struct write_credits {
+	int ref_count;
+	struct characteristic *chrc;
+	unsigned int avail;
+	unsigned int stalls;
+	bool paused;
+};
+
 struct sock_io {
 	DBusMessage *msg;
 	struct io *io;
 	void (*destroy)(void *data);
 	void *data;
+	struct write_credits *credits;
+	unsigned int sent;
+	unsigned int dropped;
+	bool congested;
 };
 
 struct characteristic {
@@ -107,7 +125,9 @@ struct characteristic {
 	unsigned int ready_id;
 	unsigned int exchange_id;
 	struct sock_io *write_io;
-	struct sock_io *notify_io;
+	struct queue *notify_ios;
+	unsigned int notify_io_id;
+	bool notify_io_registered;
 
 	struct async_dbus_op *read_op;
 	struct async_dbus_op *write_op;
@@ -655,9 +675,12 @@ static DBusMessage *descriptor_write_value(DBusConnection *conn,
 }
 
 static const GDBusPropertyTable descriptor_properties[] = {
-	{ "Handle", "q", descriptor_get_handle },
-	{ "UUID", "s", descriptor_get_uuid },
-	{ "Characteristic", "o", descriptor_get_characteristic, },
+	{ "Handle", "q", descriptor_get_handle, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "UUID", "s", descriptor_get_uuid, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "Characteristic", "o", descriptor_get_characteristic, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
 	{ "Value", "ay", descriptor_get_value, NULL, descriptor_value_exists },
 	{ }
 };
@@ -890,7 +913,7 @@ characteristic_get_notify_acquired(const GDBusPropertyTable *property,
 					DBusMessageIter *iter, void *data)
 {
 	struct characteristic *chrc = data;
-	dbus_bool_t locked = chrc->notify_io ? TRUE : FALSE;
+	dbus_bool_t locked = queue_isempty(chrc->notify_ios) ? FALSE : TRUE;
 
 	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN, &locked);
 
@@ -1127,6 +1150,72 @@ fail:
 	return btd_error_not_supported(msg);
 }
 
+static struct write_credits *write_credits_ref(struct write_credits *credits)
+{
+	__sync_fetch_and_add(&credits->ref_count, 1);
+
+	return credits;
+}
+
+static void write_credits_unref(struct write_credits *credits)
+{
+	if (__sync_sub_and_fetch(&credits->ref_count, 1))
+		return;
+
+	free(credits);
+}
+
+static bool sock_read(struct io *io, void *user_data);
+
+static void write_io_sent(void *user_data)
+{
+	struct write_credits *credits = user_data;
+	struct characteristic *chrc = credits->chrc;
+
+	credits->avail++;
+
+	/*
+	 * Resume reading only once half of the credits are back so the read
+	 * watch is not toggled for every PDU the bearer takes.
+	 */
+	if (chrc && credits->paused && credits->avail >= WRITE_IO_CREDITS / 2) {
+		credits->paused = false;
+		io_set_read_handler(chrc->write_io->io, sock_read, chrc, NULL);
+	}
+
+	write_credits_unref(credits);
+}
+
+static bool sock_write(struct characteristic *chrc, struct sock_io *sio,
+					const uint8_t *value, uint16_t len)
+{
+	struct bt_gatt_client *gatt = chrc->service->client->gatt;
+	struct write_credits *credits = sio->credits;
+
+	if (!bt_gatt_client_write_without_response_full(gatt,
+					chrc->value_handle,
+					chrc->props & BT_GATT_CHRC_PROP_AUTH,
+					value, len, write_io_sent,
+					write_credits_ref(credits))) {
+		write_credits_unref(credits);
+		return true;
+	}
+
+	sio->sent++;
+
+	if (--credits->avail)
+		return true;
+
+	/*
+	 * Out of credits: stop reading so the application blocks on its own
+	 * socket until the bearer drains the ATT queue.
+	 */
+	credits->paused = true;
+	credits->stalls++;
+
+	return false;
+}
+
 static bool sock_read(struct io *io, void *user_data)
 {
 	struct characteristic *chrc = user_data;
@@ -1158,6 +1247,9 @@ static bool sock_read(struct io *io, void *user_data)
 	if (!gatt || bytes_read == 0)
 		return false;
 
+	if (chrc->write_io && chrc->write_io->io == io)
+		return sock_write(chrc, chrc->write_io, buf, bytes_read);
+
 	bt_gatt_client_write_without_response(gatt, chrc->value_handle,
 					chrc->props & BT_GATT_CHRC_PROP_AUTH,
 					buf, bytes_read);
@@ -1170,6 +1262,14 @@ static void sock_io_destroy(struct sock_io *io)
 	if (io->destroy)
 		io->destroy(io->data);
 
+	if (io->credits) {
+		DBG("io %p sent %u stalled %u times", io->io, io->sent,
+							io->credits->stalls);
+		/* Writes still queued in bt_att may outlive the socket */
+		io->credits->chrc = NULL;
+		write_credits_unref(io->credits);
+	}
+
 	if (io->msg)
 		dbus_message_unref(io->msg);
 
@@ -1177,25 +1277,56 @@ static void sock_io_destroy(struct sock_io *io)
 	free(io);
 }
 
+static void notify_sock_remove(struct characteristic *chrc,
+						struct sock_io *sio)
+{
+	queue_remove(chrc->service->client->ios, sio->io);
+	queue_remove(chrc->notify_ios, sio);
+
+	DBG("%s: io %p sent %u dropped %u", chrc->path, sio->io, sio->sent,
+								sio->dropped);
+
+	sock_io_destroy(sio);
+
+	if (!queue_isempty(chrc->notify_ios))
+		return;
+
+	/* Last session gone, release the shared subscription */
+	bt_gatt_client_unregister_notify(chrc->service->client->gatt,
+							chrc->notify_io_id);
+	chrc->notify_io_id = 0;
+	chrc->notify_io_registered = false;
+
+	g_dbus_emit_property_changed(btd_get_dbus_connection(), chrc->path,
+						GATT_CHARACTERISTIC_IFACE,
+						"NotifyAcquired");
+}
+
+static bool match_sock_io(const void *a, const void *b)
+{
+	const struct sock_io *sio = a;
+
+	return sio->io == b;
+}
+
 static void destroy_sock(struct characteristic *chrc, struct io *io)
 {
-	queue_remove(chrc->service->client->ios, io);
+	struct sock_io *sio;
 
 	if (chrc->write_io && io == chrc->write_io->io) {
+		queue_remove(chrc->service->client->ios, io);
 		sock_io_destroy(chrc->write_io);
 		chrc->write_io = NULL;
 		g_dbus_emit_property_changed(btd_get_dbus_connection(),
 						chrc->path,
 						GATT_CHARACTERISTIC_IFACE,
 						"WriteAcquired");
-	} else if (chrc->notify_io) {
-		sock_io_destroy(chrc->notify_io);
-		chrc->notify_io = NULL;
-		g_dbus_emit_property_changed(btd_get_dbus_connection(),
-						chrc->path,
-						GATT_CHARACTERISTIC_IFACE,
-						"NotifyAcquired");
+		return;
 	}
+
+	sio = queue_find(chrc->notify_ios, match_sock_io, io);
+	if (sio)
+		notify_sock_remove(chrc, sio);
 }
 
 static bool sock_hup(struct io *io, void *user_data)
@@ -1209,7 +1340,8 @@ static bool sock_hup(struct io *io, void *user_data)
 	return false;
 }
 
-static DBusMessage *create_sock(struct characteristic *chrc, DBusMessage *msg)
+static DBusMessage *create_sock(struct characteristic *chrc,
+					struct sock_io *sio, DBusMessage *msg)
 {
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
 	int fds[2];
@@ -1250,14 +1382,14 @@ static DBusMessage *create_sock(struct characteristic *chrc, DBusMessage *msg)
 
 	close(fds[dir]);
 
+	sio->io = io;
+
 	if (dir) {
-		chrc->write_io->io = io;
 		g_dbus_emit_property_changed(btd_get_dbus_connection(),
 						chrc->path,
 						GATT_CHARACTERISTIC_IFACE,
 						"WriteAcquired");
 	} else {
-		chrc->notify_io->io = io;
 		g_dbus_emit_property_changed(btd_get_dbus_connection(),
 						chrc->path,
 						GATT_CHARACTERISTIC_IFACE,
@@ -1280,12 +1412,13 @@ fail:
 static void characteristic_ready(bool success, uint8_t ecode, void *user_data)
 {
 	struct characteristic *chrc = user_data;
+	const struct queue_entry *entry;
 	DBusMessage *reply;
 
 	chrc->ready_id = 0;
 
 	if (chrc->write_io && chrc->write_io->msg) {
-		reply = create_sock(chrc, chrc->write_io->msg);
+		reply = create_sock(chrc, chrc->write_io, chrc->write_io->msg);
 
 		g_dbus_send_message(btd_get_dbus_connection(), reply);
 
@@ -1293,13 +1426,28 @@ static void characteristic_ready(bool success, uint8_t ecode, void *user_data)
 		chrc->write_io->msg = NULL;
 	}
 
-	if (chrc->notify_io && chrc->notify_io->msg) {
-		reply = create_sock(chrc, chrc->notify_io->msg);
+	/* Notify sessions wait for the subscription to be in place */
+	if (!chrc->notify_io_registered)
+		return;
+
+	entry = queue_get_entries(chrc->notify_ios);
+	while (entry) {
+		struct sock_io *sio = entry->data;
+
+		entry = entry->next;
+
+		if (!sio->msg)
+			continue;
+
+		reply = create_sock(chrc, sio, sio->msg);
 
 		g_dbus_send_message(btd_get_dbus_connection(), reply);
 
-		dbus_message_unref(chrc->notify_io->msg);
-		chrc->notify_io->msg = NULL;
+		dbus_message_unref(sio->msg);
+		sio->msg = NULL;
+
+		if (!sio->io)
+			notify_sock_remove(chrc, sio);
 	}
 }
 
@@ -1327,6 +1475,10 @@ static DBusMessage *characteristic_acquire_write(DBusConnection *conn,
 		return btd_error_not_supported(msg);
 
 	chrc->write_io = new0(struct sock_io, 1);
+	chrc->write_io->credits = new0(struct write_credits, 1);
+	chrc->write_io->credits->chrc = chrc;
+	chrc->write_io->credits->avail = WRITE_IO_CREDITS;
+	write_credits_ref(chrc->write_io->credits);
 
 	if (!bt_gatt_client_is_ready(gatt)) {
 		/* GATT not ready, wait until it becomes ready */
@@ -1338,7 +1490,7 @@ static DBusMessage *characteristic_acquire_write(DBusConnection *conn,
 		return NULL;
 	}
 
-	return create_sock(chrc, msg);
+	return create_sock(chrc, chrc->write_io, msg);
 }
 
 struct notify_client {
@@ -1507,19 +1659,44 @@ static void register_notify_cb(uint16_t att_ecode, void *user_data)
 	create_notify_reply(op, true, 0);
 }
 
+static void notify_sock_send(struct characteristic *chrc,
+					struct sock_io *sio, struct msghdr *msg)
+{
+	if (sendmsg(io_get_fd(sio->io), msg, MSG_NOSIGNAL | MSG_DONTWAIT) >= 0) {
+		if (sio->congested) {
+			DBG("%s: io %p resumed, %u dropped", chrc->path,
+						sio->io, sio->dropped);
+			sio->congested = false;
+		}
+
+		sio->sent++;
+		return;
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+		error("sendmsg: %s", strerror(errno));
+		return;
+	}
+
+	/* Drop for a reader that is not keeping up rather than blocking */
+	if (!sio->congested) {
+		DBG("%s: io %p congested, dropping notifications",
+						chrc->path, sio->io);
+		sio->congested = true;
+	}
+
+	sio->dropped++;
+}
+
 static void notify_io_cb(uint16_t value_handle, const uint8_t *value,
 					uint16_t length, void *user_data)
 {
+	struct characteristic *chrc = user_data;
+	const struct queue_entry *entry;
 	struct msghdr msg;
 	struct iovec iov;
-	struct notify_client *client = user_data;
-	struct characteristic *chrc = client->chrc;
-	int err;
-
-	/* Drop notification if the sock is not ready */
-	if (!chrc->notify_io || !chrc->notify_io->io)
-		return;
 
+	/* Every session is sent the value straight from the ATT buffer */
 	iov.iov_base = (void *) value;
 	iov.iov_len = length;
 
@@ -1527,28 +1704,22 @@ static void notify_io_cb(uint16_t value_handle, const uint8_t *value,
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 
-	err = sendmsg(io_get_fd(chrc->notify_io->io), &msg, MSG_NOSIGNAL);
-	if (err < 0)
-		error("sendmsg: %s", strerror(errno));
+	for (entry = queue_get_entries(chrc->notify_ios); entry;
+							entry = entry->next) {
+		struct sock_io *sio = entry->data;
+
+		/* Drop notification if the sock is not ready */
+		if (!sio->io)
+			continue;
+
+		notify_sock_send(chrc, sio, &msg);
+	}
 }
 
-static void register_notify_io_cb(uint16_t att_ecode, void *user_data)
+static void notify_io_ready(struct characteristic *chrc)
 {
-	struct notify_client *client = user_data;
-	struct characteristic *chrc = client->chrc;
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
 
-	if (att_ecode) {
-		DBusMessage *reply =
-			create_gatt_dbus_error(chrc->notify_io->msg, att_ecode);
-
-		g_dbus_send_message(btd_get_dbus_connection(), reply);
-		dbus_message_unref(chrc->notify_io->msg);
-		chrc->notify_io->msg = NULL;
-		destroy_sock(chrc, chrc->notify_io->io);
-		return;
-	}
-
 	if (!bt_gatt_client_is_ready(gatt)) {
 		if (!chrc->ready_id)
 			chrc->ready_id = bt_gatt_client_ready_register(gatt,
@@ -1560,6 +1731,37 @@ static void register_notify_io_cb(uint16_t att_ecode, void *user_data)
 	characteristic_ready(true, 0, chrc);
 }
 
+static void register_notify_io_cb(uint16_t att_ecode, void *user_data)
+{
+	struct characteristic *chrc = user_data;
+	struct sock_io *sio;
+
+	if (att_ecode) {
+		while ((sio = queue_peek_head(chrc->notify_ios))) {
+			DBusMessage *reply = create_gatt_dbus_error(sio->msg,
+								att_ecode);
+
+			g_dbus_send_message(btd_get_dbus_connection(), reply);
+			dbus_message_unref(sio->msg);
+			sio->msg = NULL;
+			notify_sock_remove(chrc, sio);
+		}
+		return;
+	}
+
+	chrc->notify_io_registered = true;
+
+	notify_io_ready(chrc);
+}
+
+static bool match_sock_io_owner(const void *a, const void *b)
+{
+	const struct sock_io *sio = a;
+	const struct notify_client *client = sio->data;
+
+	return !strcmp(client->owner, b);
+}
+
 static void notify_io_destroy(void *data)
 {
 	struct notify_client *client = data;
@@ -1576,15 +1778,20 @@ static DBusMessage *characteristic_acquire_notify(DBusConnection *conn,
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
 	const char *sender = dbus_message_get_sender(msg);
 	struct notify_client *client;
+	struct sock_io *sio;
 
 	if (!gatt)
 		return btd_error_failed(msg, "Not connected");
 
-	if (chrc->notify_io)
-		return btd_error_not_permitted(msg, "Notify acquired");
-
 	/* Each client can only have one active notify session. */
-	if (!queue_isempty(chrc->notify_clients))
+	if (queue_find(chrc->notify_clients, match_notify_sender, sender))
+		return queue_isempty(chrc->notify_ios) ?
+				btd_error_in_progress(msg) :
+				btd_error_not_permitted(msg, "Notify acquired");
+
+	/* Sessions started with StartNotify cannot be mixed with fds */
+	if (queue_isempty(chrc->notify_ios) &&
+				!queue_isempty(chrc->notify_clients))
 		return btd_error_in_progress(msg);
 
 	if (!(chrc->props & (BT_GATT_CHRC_PROP_NOTIFY |
@@ -1595,23 +1802,35 @@ static DBusMessage *characteristic_acquire_notify(DBusConnection *conn,
 	if (!client)
 		return btd_error_failed(msg, "Failed allocate notify session");
 
-	client->notify_id = bt_gatt_client_register_notify(gatt,
+	queue_push_tail(chrc->notify_clients, client);
+
+	sio = new0(struct sock_io, 1);
+	sio->data = notify_client_ref(client);
+	sio->msg = dbus_message_ref(msg);
+	sio->destroy = notify_io_destroy;
+	queue_push_tail(chrc->notify_ios, sio);
+
+	/*
+	 * All sessions share a single subscription, only the first one needs
+	 * to register with the remote.
+	 */
+	if (chrc->notify_io_id) {
+		if (chrc->notify_io_registered)
+			notify_io_ready(chrc);
+		return NULL;
+	}
+
+	chrc->notify_io_id = bt_gatt_client_register_notify(gatt,
 						chrc->value_handle,
 						register_notify_io_cb,
 						notify_io_cb,
-						client, NULL);
-	if (!client->notify_id) {
-		notify_client_unref(client);
+						chrc, NULL);
+	if (!chrc->notify_io_id) {
+		queue_remove(chrc->notify_ios, sio);
+		sock_io_destroy(sio);
 		return btd_error_failed(msg, "Failed to subscribe");
 	}
 
-	queue_push_tail(chrc->notify_clients, client);
-
-	chrc->notify_io = new0(struct sock_io, 1);
-	chrc->notify_io->data = notify_client_ref(client);
-	chrc->notify_io->msg = dbus_message_ref(msg);
-	chrc->notify_io->destroy = notify_io_destroy;
-
 	return NULL;
 }
 
@@ -1630,7 +1849,7 @@ static DBusMessage *characteristic_start_notify(DBusConnection *conn,
 		return btd_error_not_connected(msg);
 	}
 
-	if (chrc->notify_io)
+	if (!queue_isempty(chrc->notify_ios))
 		return btd_error_not_permitted(msg, "Notify acquired");
 
 	if (!(chrc->props & (BT_GATT_CHRC_PROP_NOTIFY |
@@ -1699,9 +1918,23 @@ static DBusMessage *characteristic_stop_notify(DBusConnection *conn,
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
 	const char *sender = dbus_message_get_sender(msg);
 	struct notify_client *client;
+	struct sock_io *sio;
+
+	if (!queue_isempty(chrc->notify_ios)) {
+		sio = queue_find(chrc->notify_ios, match_sock_io_owner,
+								sender);
+		if (!sio)
+			return btd_error_not_permitted(msg, "Notify acquired");
+
+		if (sio->msg) {
+			g_dbus_send_message(btd_get_dbus_connection(),
+					btd_error_failed(sio->msg,
+						"Notify session stopped"));
+			dbus_message_unref(sio->msg);
+			sio->msg = NULL;
+		}
 
-	if (chrc->notify_io) {
-		destroy_sock(chrc, chrc->notify_io->io);
+		notify_sock_remove(chrc, sio);
 		return dbus_message_new_method_return(msg);
 	}
 
@@ -1720,14 +1953,18 @@ static DBusMessage *characteristic_stop_notify(DBusConnection *conn,
 }
 
 static const GDBusPropertyTable characteristic_properties[] = {
-	{ "Handle", "q", characteristic_get_handle },
-	{ "UUID", "s", characteristic_get_uuid, NULL, NULL },
-	{ "Service", "o", characteristic_get_service, NULL, NULL },
+	{ "Handle", "q", characteristic_get_handle, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "UUID", "s", characteristic_get_uuid, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "Service", "o", characteristic_get_service, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
 	{ "Value", "ay", characteristic_get_value, NULL,
 					characteristic_value_exists },
 	{ "Notifying", "b", characteristic_get_notifying, NULL,
 					characteristic_notifying_exists },
-	{ "Flags", "as", characteristic_get_flags, NULL, NULL },
+	{ "Flags", "as", characteristic_get_flags, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
 	{ "WriteAcquired", "b", characteristic_get_write_acquired, NULL,
 				characteristic_write_acquired_exists },
 	{ "NotifyAcquired", "b", characteristic_get_notify_acquired, NULL,
@@ -1775,6 +2012,7 @@ static void characteristic_free(void *data)
 {
 	struct characteristic *chrc = data;
 	struct bt_gatt_client *gatt = chrc->service->client->gatt;
+	struct sock_io *sio;
 	struct bt_att *att;
 
 	/* List should be empty here */
@@ -1785,11 +2023,14 @@ static void characteristic_free(void *data)
 		sock_io_destroy(chrc->write_io);
 	}
 
-	if (chrc->notify_io) {
-		queue_remove(chrc->service->client->ios, chrc->notify_io->io);
-		sock_io_destroy(chrc->notify_io);
+	while ((sio = queue_pop_head(chrc->notify_ios))) {
+		queue_remove(chrc->service->client->ios, sio->io);
+		sock_io_destroy(sio);
 	}
 
+	queue_destroy(chrc->notify_ios, NULL);
+	bt_gatt_client_unregister_notify(gatt, chrc->notify_io_id);
+
 	queue_destroy(chrc->notify_clients, remove_client);
 
 	att = bt_gatt_client_get_att(gatt);
@@ -1820,6 +2061,7 @@ static struct characteristic *characteristic_create(
 	chrc = new0(struct characteristic, 1);
 	chrc->descs = queue_new();
 	chrc->notify_clients = queue_new();
+	chrc->notify_ios = queue_new();
 	chrc->service = service;
 
 	gatt_db_attribute_get_char_data(attr, &chrc->handle,
@@ -1956,10 +2198,14 @@ static gboolean service_get_includes(const GDBusPropertyTable *property,
 }
 
 static const GDBusPropertyTable service_properties[] = {
-	{ "Handle", "q", service_get_handle },
-	{ "UUID", "s", service_get_uuid },
-	{ "Device", "o", service_get_device },
-	{ "Primary", "b", service_get_primary },
+	{ "Handle", "q", service_get_handle, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "UUID", "s", service_get_uuid, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "Device", "o", service_get_device, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "Primary", "b", service_get_primary, NULL, NULL,
+					G_DBUS_PROPERTY_FLAG_CACHE },
 	{ "Includes", "ao", service_get_includes },
 	{ }
 };
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <limits.h>
+#include <sys/socket.h>
 
 #include "bluetooth/bluetooth.h"
 #include "bluetooth/sdp.h"
@@ -31,6 +32,7 @@
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-server.h"
+#include "src/shared/value-cache.h"
 #include "log.h"
 #include "error.h"
 #include "btd.h"
@@ -104,6 +106,16 @@ struct external_service {
 	struct queue *chrcs;
 	struct queue *descs;
 	struct queue *includes;
+	struct read_batch *read_batch;
+	bool no_read_values;
+};
+
+/* Reads queued within a main loop iteration, sent with a single ReadValues */
+struct read_batch {
+	struct external_service *service;
+	struct bt_att *att;
+	struct queue *ops;
+	guint id;
 };
 
 struct external_profile {
@@ -137,6 +149,13 @@ struct external_chrc {
 	unsigned int ntfy_cnt;
 	bool prep_authorized;
 	bool req_prep_authorization;
+	struct io *value_io;	/* Values pushed by the application */
+	bool value_acquiring;
+	bool value_acquire_failed;
+	uint8_t *value;
+	uint16_t value_len;
+	bool value_valid;
+	struct value_cache *cache;	/* Set if CacheTimeout is exposed */
 };
 
 struct external_desc {
@@ -160,9 +179,13 @@ struct pending_op {
 	uint8_t link_type;
 	struct gatt_db_attribute *attrib;
 	struct queue *owner_queue;
+	GDBusProxy *proxy;
 	struct iovec data;
 	bool is_characteristic;
 	bool prep_authorize;
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	unsigned int cache_token;
 };
 
 struct notify {
@@ -172,6 +195,7 @@ struct notify {
 	uint16_t len;
 	bt_gatt_server_conf_func_t conf;
 	void *user_data;
+	struct queue *pdus;	/* PDUs shared by the devices notified */
 };
 
 #define CLI_FEAT_SIZE 1
@@ -474,6 +498,16 @@ static void cancel_pending_write(void *data)
 	op->owner_queue = NULL;
 }
 
+static void pending_op_free(void *data);
+
+static void read_batch_free(void *data)
+{
+	struct read_batch *batch = data;
+
+	queue_destroy(batch->ops, pending_op_free);
+	free(batch);
+}
+
 static void client_io_free(void *data)
 {
 	struct client_io *client = data;
@@ -494,6 +528,10 @@ static void chrc_free(void *data)
 	queue_destroy(chrc->pending_reads, cancel_pending_read);
 	queue_destroy(chrc->pending_writes, cancel_pending_write);
 
+	io_destroy(chrc->value_io);
+	free(chrc->value);
+	value_cache_free(chrc->cache);
+
 	g_free(chrc->path);
 
 	g_dbus_proxy_set_property_watch(chrc->proxy, NULL, NULL);
@@ -502,6 +540,23 @@ static void chrc_free(void *data)
 	free(chrc);
 }
 
+static void chrc_cache_reply(struct pending_op *op, const uint8_t *value,
+								size_t len)
+{
+	struct external_chrc *chrc;
+
+	if (!op->is_characteristic || op->offset)
+		return;
+
+	/*
+	 * ReadValue gets the device as option so the reply is only reused for
+	 * that device, unless a write happened since the read was started.
+	 */
+	chrc = gatt_db_attribute_get_user_data(op->attrib);
+	value_cache_store(chrc->cache, &op->bdaddr, op->bdaddr_type,
+						op->cache_token, value, len);
+}
+
 static void desc_free(void *data)
 {
 	struct external_desc *desc = data;
@@ -530,6 +585,12 @@ static void service_free(void *data)
 	queue_destroy(service->descs, desc_free);
 	queue_destroy(service->includes, inc_free);
 
+	/* Reads still waiting to be sent have been canceled by now */
+	if (service->read_batch) {
+		g_source_remove(service->read_batch->id);
+		read_batch_free(service->read_batch);
+	}
+
 	if (service->attrib)
 		gatt_db_remove_service(service->app->database->db,
 							service->attrib);
@@ -1402,10 +1463,58 @@ static void state_set_pending(struct device_state *state, struct notify *notify)
 	/* Copy notify contents to pending */
 	state->pending = new0(struct notify, 1);
 	memcpy(state->pending, notify, sizeof(*notify));
+	state->pending->pdus = NULL;
 	state->pending->value = malloc(notify->len);
 	memcpy(state->pending->value, notify->value, notify->len);
 }
 
+static void pdu_unref(void *data)
+{
+	bt_att_pdu_unref(data);
+}
+
+static bool match_pdu_length(const void *data, const void *user_data)
+{
+	struct bt_att_pdu *pdu = (void *) data;
+
+	return bt_att_pdu_get_length(pdu) == PTR_TO_UINT(user_data);
+}
+
+static bool send_shared_notification(struct notify *notify,
+					struct device_state *state,
+					struct bt_gatt_server *server)
+{
+	uint8_t buf[2 + BT_ATT_MAX_VALUE_LEN];
+	struct bt_att_pdu *pdu;
+	uint16_t len;
+
+	/* Clients supporting it get notifications coalesced by the server */
+	if (!notify->pdus ||
+			state->cli_feat[0] & BT_GATT_CHRC_CLI_FEAT_NFY_MULTI)
+		return false;
+
+	/*
+	 * The value is truncated to fit the MTU so the PDU is only encoded
+	 * once for all the devices sharing the same truncated length.
+	 */
+	len = MIN(notify->len, bt_gatt_server_get_mtu(server) - 3);
+
+	pdu = queue_find(notify->pdus, match_pdu_length, UINT_TO_PTR(len + 3));
+	if (!pdu) {
+		len = bt_gatt_server_encode_value(server, notify->handle,
+							notify->value,
+							notify->len, buf);
+
+		pdu = bt_att_pdu_new(BT_ATT_OP_HANDLE_NFY, buf, len);
+		if (!pdu)
+			return false;
+
+		queue_push_tail(notify->pdus, pdu);
+	}
+
+	return bt_att_send_pdu(bt_gatt_server_get_att(server), pdu);
+}
+
 static void send_notification_to_device(void *data, void *user_data)
 {
 	struct device_state *device_state = data;
@@ -1452,6 +1561,10 @@ static void send_notification_to_device(void *data, void *user_data)
 	 */
 	if (!(ccc->value & 0x0002)) {
 		DBG("GATT server sending notification");
+
+		if (send_shared_notification(notify, device_state, server))
+			return;
+
 		bt_gatt_server_send_notification(server,
 					notify->handle, notify->value,
 					notify->len, device_state->cli_feat[0] &
@@ -1535,9 +1648,12 @@ static void send_notification_to_devices(struct btd_gatt_database *database,
 	notify.len = len;
 	notify.conf = conf;
 	notify.user_data = user_data;
+	notify.pdus = queue_new();
 
 	queue_foreach(database->device_states, send_notification_to_device,
 								&notify);
+
+	queue_destroy(notify.pdus, pdu_unref);
 }
 
 static void send_service_changed(struct btd_gatt_database *database,
@@ -1892,6 +2008,58 @@ static bool parse_flags(GDBusProxy *proxy, uint8_t *props, uint8_t *ext_props,
 							req_prep_authorization);
 }
 
+static bool chrc_set_cache_timeout(struct external_chrc *chrc,
+						DBusMessageIter *timeout_iter)
+{
+	DBusMessageIter iter, array;
+	uint32_t timeout;
+	uint8_t *value = NULL;
+	int len = 0;
+
+	/* Property removed, stop caching */
+	if (!timeout_iter) {
+		value_cache_free(chrc->cache);
+		chrc->cache = NULL;
+		return true;
+	}
+
+	if (dbus_message_iter_get_arg_type(timeout_iter) != DBUS_TYPE_UINT32)
+		return false;
+
+	dbus_message_iter_get_basic(timeout_iter, &timeout);
+
+	if (chrc->cache) {
+		value_cache_set_timeout(chrc->cache, timeout);
+		return true;
+	}
+
+	chrc->cache = value_cache_new(timeout);
+
+	/* Start with the current value if the application exposes one */
+	if (!g_dbus_proxy_get_property(chrc->proxy, "Value", &iter) ||
+			dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		return true;
+
+	dbus_message_iter_recurse(&iter, &array);
+	dbus_message_iter_get_fixed_array(&array, &value, &len);
+	if (len >= 0)
+		value_cache_set(chrc->cache, value,
+					MIN(BT_ATT_MAX_VALUE_LEN, len));
+
+	return true;
+}
+
+static bool parse_cache(struct external_chrc *chrc)
+{
+	DBusMessageIter iter;
+
+	/* CacheTimeout property is optional, caching is opt-in */
+	if (!g_dbus_proxy_get_property(chrc->proxy, "CacheTimeout", &iter))
+		return true;
+
+	return chrc_set_cache_timeout(chrc, &iter);
+}
+
 static struct external_chrc *chrc_create(struct gatt_app *app,
 							GDBusProxy *proxy,
 							const char *path)
@@ -1943,6 +2111,11 @@ static struct external_chrc *chrc_create(struct gatt_app *app,
 		goto fail;
 	}
 
+	if (!parse_cache(chrc)) {
+		error("Failed to parse \"CacheTimeout\" property");
+		goto fail;
+	}
+
 	if ((chrc->props & BT_GATT_CHRC_PROP_NOTIFY ||
 				chrc->props & BT_GATT_CHRC_PROP_INDICATE) &&
 				!incr_attr_count(chrc->service, 1)) {
@@ -2328,6 +2501,8 @@ static void read_reply_cb(DBusMessage *message, void *user_data)
 	len = MIN(BT_ATT_MAX_VALUE_LEN, len);
 	value = len ? value : NULL;
 
+	chrc_cache_reply(op, value, len);
+
 done:
 	gatt_db_attribute_read_result(op->attrib, op->id, ecode, value, len);
 }
@@ -2430,6 +2605,242 @@ static struct pending_op *send_read(struct bt_att *att,
 	return NULL;
 }
 
+static void read_batch_send_each(struct read_batch *batch)
+{
+	struct pending_op *op;
+
+	while ((op = queue_pop_head(batch->ops))) {
+		if (!op->owner_queue) {
+			pending_op_free(op);
+			continue;
+		}
+
+		if (g_dbus_proxy_method_call(op->proxy, "ReadValue",
+						read_setup_cb, read_reply_cb,
+						op, pending_op_free) == TRUE)
+			continue;
+
+		gatt_db_attribute_read_result(op->attrib, op->id,
+						BT_ATT_ERROR_UNLIKELY, NULL, 0);
+		pending_op_free(op);
+	}
+}
+
+static bool match_op_pending(const void *data, const void *user_data)
+{
+	const struct pending_op *op = data;
+
+	return op->owner_queue;
+}
+
+static void read_batch_result(void *data, void *user_data)
+{
+	struct pending_op *op = data;
+	uint8_t ecode = PTR_TO_UINT(user_data);
+
+	if (op->owner_queue)
+		gatt_db_attribute_read_result(op->attrib, op->id, ecode,
+								NULL, 0);
+}
+
+static void read_values_reply(DBusMessage *message, void *user_data)
+{
+	struct read_batch *batch = user_data;
+	const struct queue_entry *entry;
+	DBusMessageIter iter, array;
+	DBusError err;
+	uint8_t ecode;
+
+	/* Once every read is gone the service may be gone as well */
+	if (!queue_find(batch->ops, match_op_pending, NULL)) {
+		DBG("Pending reads were canceled");
+		return;
+	}
+
+	dbus_error_init(&err);
+
+	if (dbus_set_error_from_message(&err, message) == TRUE) {
+		if (dbus_error_has_name(&err, DBUS_ERROR_UNKNOWN_METHOD)) {
+			DBG("ReadValues not supported by %s",
+						batch->service->path);
+			dbus_error_free(&err);
+			batch->service->no_read_values = true;
+			read_batch_send_each(batch);
+			return;
+		}
+
+		DBG("Failed to read values: %s: %s", err.name, err.message);
+		ecode = dbus_error_to_att_ecode(err.name, err.message,
+					BT_ATT_ERROR_READ_NOT_PERMITTED);
+		dbus_error_free(&err);
+		goto fail;
+	}
+
+	dbus_message_iter_init(message, &iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
+		error("Invalid return value received for \"ReadValues\"");
+		ecode = BT_ATT_ERROR_REQUEST_NOT_SUPPORTED;
+		goto fail;
+	}
+
+	dbus_message_iter_recurse(&iter, &array);
+
+	/* Values are returned in the same order they were requested */
+	for (entry = queue_get_entries(batch->ops); entry;
+						entry = entry->next) {
+		struct pending_op *op = entry->data;
+		DBusMessageIter value_iter;
+		uint8_t *value = NULL;
+		int len = 0;
+
+		ecode = 0;
+
+		if (dbus_message_iter_get_arg_type(&array) != DBUS_TYPE_ARRAY) {
+			ecode = BT_ATT_ERROR_UNLIKELY;
+		} else {
+			dbus_message_iter_recurse(&array, &value_iter);
+			dbus_message_iter_get_fixed_array(&value_iter, &value,
+									&len);
+			dbus_message_iter_next(&array);
+		}
+
+		/* Truncate the value if it's too large */
+		len = MIN(BT_ATT_MAX_VALUE_LEN, MAX(len, 0));
+
+		if (!op->owner_queue)
+			continue;
+
+		if (!ecode)
+			chrc_cache_reply(op, value, len);
+
+		gatt_db_attribute_read_result(op->attrib, op->id, ecode,
+						len ? value : NULL, len);
+	}
+
+	return;
+
+fail:
+	queue_foreach(batch->ops, read_batch_result, UINT_TO_PTR(ecode));
+}
+
+static void read_values_setup(DBusMessageIter *iter, void *user_data)
+{
+	struct read_batch *batch = user_data;
+	const struct queue_entry *entry;
+	DBusMessageIter array, dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_OBJECT_PATH_AS_STRING,
+					&array);
+
+	for (entry = queue_get_entries(batch->ops); entry;
+						entry = entry->next) {
+		struct pending_op *op = entry->data;
+		const char *path = g_dbus_proxy_get_path(op->proxy);
+
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_OBJECT_PATH,
+								&path);
+	}
+
+	dbus_message_iter_close_container(iter, &array);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	/* All the reads come from the same device */
+	append_options(&dict, queue_peek_head(batch->ops));
+
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+static void read_batch_flush(struct read_batch *batch)
+{
+	struct external_service *service = batch->service;
+
+	service->read_batch = NULL;
+
+	if (batch->id) {
+		g_source_remove(batch->id);
+		batch->id = 0;
+	}
+
+	/* Drop the reads canceled in the meantime */
+	while (!queue_isempty(batch->ops)) {
+		struct pending_op *op = queue_peek_head(batch->ops);
+
+		if (op->owner_queue)
+			break;
+
+		queue_pop_head(batch->ops);
+		pending_op_free(op);
+	}
+
+	if (queue_length(batch->ops) > 1 && !service->no_read_values &&
+			g_dbus_proxy_method_call(service->proxy, "ReadValues",
+						read_values_setup,
+						read_values_reply, batch,
+						read_batch_free) == TRUE)
+		return;
+
+	read_batch_send_each(batch);
+	read_batch_free(batch);
+}
+
+static gboolean read_batch_idle(gpointer user_data)
+{
+	struct read_batch *batch = user_data;
+
+	batch->id = 0;
+	read_batch_flush(batch);
+
+	return FALSE;
+}
+
+/*
+ * Reads of several attributes of a service, as issued for a Read Multiple or
+ * Read By Type request, are collected and sent to the application with a
+ * single ReadValues call falling back to one ReadValue each if the
+ * application does not implement it.
+ */
+static struct pending_op *queue_read(struct external_service *service,
+					struct bt_att *att,
+					struct gatt_db_attribute *attrib,
+					GDBusProxy *proxy,
+					struct queue *owner_queue,
+					unsigned int id,
+					uint16_t offset)
+{
+	struct read_batch *batch = service->read_batch;
+	struct pending_op *op;
+
+	/* Reads at an offset are part of a long read which is sequential */
+	if (offset || service->no_read_values)
+		return send_read(att, attrib, proxy, owner_queue, id, offset);
+
+	if (batch && batch->att != att)
+		read_batch_flush(batch);
+
+	if (!service->read_batch) {
+		batch = new0(struct read_batch, 1);
+		batch->service = service;
+		batch->att = att;
+		batch->ops = queue_new();
+		batch->id = g_idle_add(read_batch_idle, batch);
+		service->read_batch = batch;
+	}
+
+	op = pending_read_new(att, owner_queue, attrib, id, offset);
+	op->proxy = proxy;
+	queue_push_tail(service->read_batch->ops, op);
+
+	return op;
+}
+
 static void write_setup_cb(DBusMessageIter *iter, void *user_data)
 {
 	struct pending_op *op = user_data;
@@ -2650,6 +3061,8 @@ static bool sock_io_read(struct io *io, void *user_data)
 
 	memset(&notify, 0, sizeof(notify));
 
+	value_cache_set(chrc->cache, buf, bytes_read);
+
 	notify.database = client->chrc->service->app->database;
 	notify.handle = gatt_db_attribute_get_handle(chrc->attrib);
 	notify.ccc_handle = gatt_db_attribute_get_handle(chrc->ccc);
@@ -3048,6 +3461,12 @@ static void property_changed_cb(GDBusProxy *proxy, const char *name,
 	uint8_t *value = NULL;
 	int len = 0;
 
+	if (!strcmp(name, "CacheTimeout")) {
+		if (!chrc_set_cache_timeout(chrc, iter))
+			DBG("Malformed \"CacheTimeout\" property received");
+		return;
+	}
+
 	if (strcmp(name, "Value"))
 		return;
 
@@ -3070,6 +3489,11 @@ static void property_changed_cb(GDBusProxy *proxy, const char *name,
 	len = MIN(BT_ATT_MAX_VALUE_LEN, len);
 	value = len ? value : NULL;
 
+	value_cache_set(chrc->cache, value, len);
+
+	if (!chrc->ccc)
+		return;
+
 	send_notification_to_devices(chrc->service->app->database,
 				gatt_db_attribute_get_handle(chrc->attrib),
 				value, len,
@@ -3095,12 +3519,6 @@ static bool database_add_ccc(struct external_service *service,
 		return false;
 	}
 
-	if (g_dbus_proxy_set_property_watch(chrc->proxy, property_changed_cb,
-							chrc) == FALSE) {
-		error("Failed to set up property watch for characteristic");
-		return false;
-	}
-
 	DBG("Created CCC entry for characteristic");
 
 	return true;
@@ -3167,8 +3585,8 @@ static void desc_read_cb(struct gatt_db_attribute *attrib,
 		goto fail;
 	}
 
-	if (send_read(att, attrib, desc->proxy, desc->pending_reads, id,
-					offset))
+	if (queue_read(desc->service, att, attrib, desc->proxy,
+					desc->pending_reads, id, offset))
 		return;
 
 fail:
@@ -3272,6 +3690,125 @@ static bool database_add_desc(struct external_service *service,
 	return true;
 }
 
+static bool value_io_read(struct io *io, void *user_data)
+{
+	struct external_chrc *chrc = user_data;
+	uint8_t buf[BT_ATT_MAX_VALUE_LEN];
+	ssize_t bytes_read;
+
+	bytes_read = read(io_get_fd(io), buf, sizeof(buf));
+	if (bytes_read < 0)
+		return errno == EAGAIN || errno == EINTR;
+
+	/* Each message carries the whole current value */
+	free(chrc->value);
+	chrc->value = bytes_read ? util_memdup(buf, bytes_read) : NULL;
+	chrc->value_len = bytes_read;
+	chrc->value_valid = true;
+
+	return true;
+}
+
+static bool value_io_hup(struct io *io, void *user_data)
+{
+	struct external_chrc *chrc = user_data;
+
+	DBG("%s value pipe closed", chrc->path);
+
+	/* Go back to ReadValue, the pipe is acquired again on next read */
+	free(chrc->value);
+	chrc->value = NULL;
+	chrc->value_len = 0;
+	chrc->value_valid = false;
+
+	io_destroy(chrc->value_io);
+	chrc->value_io = NULL;
+
+	return false;
+}
+
+static void acquire_value_reply(DBusMessage *message, void *user_data)
+{
+	struct pending_op *op = user_data;
+	struct external_chrc *chrc;
+	DBusError err;
+	int fd, type;
+	socklen_t len = sizeof(type);
+	uint16_t mtu;
+
+	if (!op->owner_queue) {
+		DBG("Pending acquire was canceled when object got removed");
+		return;
+	}
+
+	chrc = gatt_db_attribute_get_user_data(op->attrib);
+	chrc->value_acquiring = false;
+	dbus_error_init(&err);
+
+	/* On failure keep using ReadValue without trying again */
+	if (dbus_set_error_from_message(&err, message) == TRUE) {
+		error("Failed to acquire value: %s", err.name);
+		dbus_error_free(&err);
+		chrc->value_acquire_failed = true;
+		return;
+	}
+
+	if (dbus_message_get_args(message, NULL, DBUS_TYPE_UNIX_FD, &fd,
+					DBUS_TYPE_UINT16, &mtu,
+					DBUS_TYPE_INVALID) == false) {
+		error("Invalid AcquireValue response");
+		chrc->value_acquire_failed = true;
+		return;
+	}
+
+	/* Each read of the pipe shall return one whole value */
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 ||
+			(type != SOCK_SEQPACKET && type != SOCK_DGRAM)) {
+		error("AcquireValue fd %d is not message oriented", fd);
+		close(fd);
+		chrc->value_acquire_failed = true;
+		return;
+	}
+
+	DBG("AcquireValue success: fd %d MTU %u", fd, mtu);
+
+	chrc->value_io = io_new(fd);
+	io_set_close_on_destroy(chrc->value_io, true);
+	io_set_read_handler(chrc->value_io, value_io_read, chrc, NULL);
+	io_set_disconnect_handler(chrc->value_io, value_io_hup, chrc, NULL);
+}
+
+static void acquire_value(struct external_chrc *chrc, struct bt_att *att)
+{
+	struct pending_op *op;
+	DBusMessageIter iter;
+
+	if (chrc->value_io || chrc->value_acquiring ||
+					chrc->value_acquire_failed)
+		return;
+
+	if (!g_dbus_proxy_get_property(chrc->proxy, "ValueAcquired", &iter))
+		return;
+
+	chrc->value_acquiring = true;
+
+	/*
+	 * Not tied to any read so a canceled one is never answered, nor to
+	 * the connection so the reply is still processed after a disconnect.
+	 */
+	op = pending_read_new(att, chrc->pending_reads, chrc->attrib, 0, 0);
+	bt_att_unregister_disconnect(att, op->disconn_id);
+	op->disconn_id = 0;
+
+	if (g_dbus_proxy_method_call(chrc->proxy, "AcquireValue",
+					read_setup_cb, acquire_value_reply,
+					op, pending_op_free) == TRUE)
+		return;
+
+	pending_op_free(op);
+	chrc->value_acquiring = false;
+}
+
 static void chrc_read_cb(struct gatt_db_attribute *attrib,
 					unsigned int id, uint16_t offset,
 					uint8_t opcode, struct bt_att *att,
@@ -3279,6 +3816,9 @@ static void chrc_read_cb(struct gatt_db_attribute *attrib,
 {
 	struct external_chrc *chrc = user_data;
 	struct btd_device *device;
+	struct pending_op *op;
+	const uint8_t *value;
+	uint16_t len;
 
 	if (chrc->attrib != attrib) {
 		error("Read callback called with incorrect attribute");
@@ -3291,9 +3831,41 @@ static void chrc_read_cb(struct gatt_db_attribute *attrib,
 		goto fail;
 	}
 
-	if (send_read(att, attrib, chrc->proxy, chrc->pending_reads, id,
-	       offset))
+	/*
+	 * Serve the read from the value pipe if the application has one, or
+	 * from the cached value as long as it is fresh.
+	 */
+	if (chrc->value_valid) {
+		value = chrc->value;
+		len = chrc->value_len;
+	} else if (!value_cache_get(chrc->cache, device_get_address(device),
+					btd_device_get_bdaddr_type(device),
+					&value, &len)) {
+		goto forward;
+	}
+
+	if (offset > len) {
+		gatt_db_attribute_read_result(attrib, id,
+					BT_ATT_ERROR_INVALID_OFFSET, NULL, 0);
+		return;
+	}
+
+	gatt_db_attribute_read_result(attrib, id, 0, value + offset,
+								len - offset);
+	return;
+
+forward:
+	acquire_value(chrc, att);
+
+	op = queue_read(chrc->service, att, attrib, chrc->proxy,
+					chrc->pending_reads, id, offset);
+	if (op) {
+		op->is_characteristic = true;
+		bacpy(&op->bdaddr, device_get_address(device));
+		op->bdaddr_type = btd_device_get_bdaddr_type(device);
+		op->cache_token = value_cache_begin(chrc->cache);
 		return;
+	}
 
 fail:
 	gatt_db_attribute_read_result(attrib, id, BT_ATT_ERROR_UNLIKELY,
@@ -3343,6 +3915,12 @@ static void chrc_write_cb(struct gatt_db_attribute *attrib,
 	if (opcode == BT_ATT_OP_EXEC_WRITE_REQ)
 		chrc->prep_authorized = false;
 
+	/*
+	 * Until the application provides it again the value is unknown, this
+	 * also drops the replies of reads started before the write.
+	 */
+	value_cache_invalidate(chrc->cache);
+
 	client = queue_find(chrc->write_ios, match_client_att, att);
 	if (client) {
 		if (sock_io_send(client->io, value, len) < 0) {
@@ -3437,6 +4015,17 @@ static bool database_add_chrc(struct external_service *service,
 	if (!database_add_ccc(service, chrc))
 		return false;
 
+	/*
+	 * Value changes are notified and CacheTimeout changes applied, the
+	 * latter may enable the cache of a characteristic registered without
+	 * one so the watch is always needed.
+	 */
+	if (g_dbus_proxy_set_property_watch(chrc->proxy, property_changed_cb,
+							chrc) == FALSE) {
+		error("Failed to set up property watch for characteristic");
+		return false;
+	}
+
 	if (!database_add_cep(service, chrc))
 		return false;
 
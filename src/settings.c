@@ -11,6 +11,8 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <errno.h>
 
@@ -23,6 +25,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
+#include "src/shared/gatt-client.h"
 #include "settings.h"
 
 #define GATT_PRIM_SVC_UUID_STR "2800"
@@ -306,6 +309,98 @@ static int gatt_db_load(struct gatt_db *db, GKeyFile *key_file, char **keys)
 	return 0;
 }
 
+static void db_hash_read_value_cb(struct gatt_db_attribute *attrib,
+						int err, const uint8_t *value,
+						size_t length, void *user_data);
+
+static void find_db_hash(struct gatt_db_attribute *attrib, void *user_data)
+{
+	struct gatt_db_attribute **hash = user_data;
+
+	if (!*hash)
+		*hash = attrib;
+}
+
+/* Returns the value of the first Database Hash characteristic of db */
+const uint8_t *btd_settings_gatt_db_hash(struct gatt_db *db)
+{
+	struct gatt_db_attribute *attr = NULL;
+	const uint8_t *hash = NULL;
+	bt_uuid_t uuid;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+	gatt_db_find_by_type(db, 0x0001, 0xffff, &uuid, find_db_hash, &attr);
+	if (attr)
+		gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+					db_hash_read_value_cb, &hash);
+
+	return hash;
+}
+
+static void val2str(const uint8_t *val, size_t len, char *str)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sprintf(str + (i * 2), "%2.2x", val[i]);
+}
+
+static void gatt_db_load_values(struct gatt_db *db, GKeyFile *key_file)
+{
+	const uint8_t *hash;
+	char **keys, **handle, *value;
+	char hash_str[33];
+
+	/* Values are only valid for the database they were stored with */
+	hash = btd_settings_gatt_db_hash(db);
+	if (!hash)
+		return;
+
+	value = g_key_file_get_string(key_file, "Values", "Hash", NULL);
+	val2str(hash, 16, hash_str);
+	if (!value || strcmp(value, hash_str)) {
+		g_free(value);
+		return;
+	}
+
+	g_free(value);
+
+	keys = g_key_file_get_keys(key_file, "Values", NULL, NULL);
+	if (!keys)
+		return;
+
+	for (handle = keys; *handle; handle++) {
+		struct gatt_db_attribute *attr;
+		uint8_t val[BT_ATT_MAX_VALUE_LEN];
+		uint16_t handle_int;
+		ssize_t len;
+
+		if (sscanf(*handle, "%04hx", &handle_int) != 1)
+			continue;
+
+		attr = gatt_db_get_attribute(db, handle_int);
+		if (!attr)
+			continue;
+
+		value = g_key_file_get_string(key_file, "Values", *handle,
+									NULL);
+		if (!value)
+			continue;
+
+		len = str2val(value, val, sizeof(val));
+		if (len > 0) {
+			DBG("loading value handle: 0x%04x, length: %zd",
+							handle_int, len);
+			gatt_db_attribute_write(attr, 0, val, len, 0, NULL,
+						load_desc_value, NULL);
+		}
+
+		g_free(value);
+	}
+
+	g_strfreev(keys);
+}
+
 int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename)
 {
 	char **keys;
@@ -328,6 +423,8 @@ int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename)
 	}
 
 	err = gatt_db_load(db, key_file, keys);
+	if (!err)
+		gatt_db_load_values(db, key_file);
 
 	g_strfreev(keys);
 	g_key_file_free(key_file);
@@ -353,13 +450,38 @@ static void db_hash_read_value_cb(struct gatt_db_attribute *attrib,
 	*hash = value;
 }
 
+static void store_value_cb(struct gatt_db_attribute *attrib, int err,
+				const uint8_t *value, size_t length,
+				void *user_data)
+{
+	struct gatt_saver *saver = user_data;
+	char handle[6], *str;
+
+	if (err || !length)
+		return;
+
+	sprintf(handle, "%04hx", gatt_db_attribute_get_handle(attrib));
+
+	str = g_malloc(length * 2 + 1);
+	val2str(value, length, str);
+	g_key_file_set_string(saver->key_file, "Values", handle, str);
+	g_free(str);
+}
+
+static void store_value(struct gatt_saver *saver,
+					struct gatt_db_attribute *attr)
+{
+	gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+						store_value_cb, saver);
+}
+
 static void store_desc(struct gatt_db_attribute *attr, void *user_data)
 {
 	struct gatt_saver *saver = user_data;
 	GKeyFile *key_file = saver->key_file;
 	char handle[6], value[100], uuid_str[MAX_LEN_UUID_STR];
 	const bt_uuid_t *uuid;
-	bt_uuid_t ext_uuid;
+	bt_uuid_t ext_uuid, ccc_uuid;
 	uint16_t handle_num;
 
 	handle_num = gatt_db_attribute_get_handle(attr);
@@ -375,6 +497,11 @@ static void store_desc(struct gatt_db_attribute *attr, void *user_data)
 		sprintf(value, "%s", uuid_str);
 
 	g_key_file_set_string(key_file, "Attributes", handle, value);
+
+	/* Keep track of the CCC state last written to a bonded server */
+	bt_uuid16_create(&ccc_uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	if (!bt_uuid_cmp(uuid, &ccc_uuid))
+		store_value(saver, attr);
 }
 
 static void store_chrc(struct gatt_db_attribute *attr, void *user_data)
@@ -385,6 +512,7 @@ static void store_chrc(struct gatt_db_attribute *attr, void *user_data)
 	uint16_t handle_num, value_handle;
 	uint8_t properties;
 	bt_uuid_t uuid, hash_uuid;
+	struct gatt_db_attribute *value_attr;
 
 	if (!gatt_db_attribute_get_char_data(attr, &handle_num, &value_handle,
 						&properties, &saver->ext_props,
@@ -425,6 +553,10 @@ static void store_chrc(struct gatt_db_attribute *attr, void *user_data)
 
 	g_key_file_set_string(key_file, "Attributes", handle, value);
 
+	value_attr = gatt_db_get_attribute(saver->db, value_handle);
+	if (value_attr && bt_gatt_client_is_static_value(value_attr))
+		store_value(saver, value_attr);
+
 	gatt_db_service_foreach_desc(attr, store_desc, saver);
 }
 
@@ -498,6 +630,7 @@ void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename)
 	char *data;
 	gsize length = 0;
 	struct gatt_saver saver;
+	const uint8_t *hash;
 
 	key_file = g_key_file_new();
 	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
@@ -508,12 +641,23 @@ void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename)
 
 	/* Remove current attributes since it might have changed */
 	g_key_file_remove_group(key_file, "Attributes", NULL);
+	g_key_file_remove_group(key_file, "Values", NULL);
 
 	saver.key_file = key_file;
 	saver.db = db;
 
 	gatt_db_foreach_service(db, NULL, store_service, &saver);
 
+	/* Tag the values with the database they belong to */
+	hash = btd_settings_gatt_db_hash(db);
+	if (hash) {
+		char hash_str[33];
+
+		val2str(hash, 16, hash_str);
+		g_key_file_set_string(key_file, "Values", "Hash", hash_str);
+	} else
+		g_key_file_remove_group(key_file, "Values", NULL);
+
 	data = g_key_file_to_data(key_file, &length, NULL);
 	if (!g_file_set_contents(filename, data, length, &gerr)) {
 		DBG("Unable set contents for %s: (%s)", filename,
@@ -9,3 +9,4 @@
 
 int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename);
 void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename);
+const uint8_t *btd_settings_gatt_db_hash(struct gatt_db *db);
@@ -1479,3 +1479,425 @@ struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 
 	return info.matched_pattern;
 }
+
+/*
+ * Patterns are anchored at a fixed offset of a given AD type, so instead of
+ * testing every pattern of every monitor against each report they are
+ * compiled into one trie per (type, offset) pair. Matching then walks each
+ * AD structure once per distinct offset, collecting all the patterns that
+ * end along the way, which keeps the cost independent of the number of
+ * patterns sharing a prefix.
+ */
+struct ad_trie_node {
+	uint8_t value;
+	uint16_t num_children;
+	struct ad_trie_node **children;		/* Sorted by value */
+	struct queue *entries;			/* Patterns ending here */
+};
+
+struct ad_trie_root {
+	uint8_t offset;
+	struct ad_trie_node node;
+};
+
+struct ad_matcher_entry {
+	void *match_data;
+	struct queue *patterns;
+	unsigned int match_id;
+};
+
+struct bt_ad_matcher {
+	struct queue *roots[UINT8_MAX + 1];	/* Indexed by AD type */
+	struct queue *entries;
+	unsigned int match_id;
+};
+
+static void trie_node_free(struct ad_trie_node *node)
+{
+	uint16_t i;
+
+	for (i = 0; i < node->num_children; i++) {
+		trie_node_free(node->children[i]);
+		free(node->children[i]);
+	}
+
+	free(node->children);
+	queue_destroy(node->entries, NULL);
+}
+
+static void trie_root_free(void *data)
+{
+	struct ad_trie_root *root = data;
+
+	trie_node_free(&root->node);
+	free(root);
+}
+
+static void matcher_entry_free(void *data)
+{
+	struct ad_matcher_entry *entry = data;
+
+	queue_destroy(entry->patterns, free);
+	free(entry);
+}
+
+struct bt_ad_matcher *bt_ad_matcher_new(void)
+{
+	struct bt_ad_matcher *matcher;
+
+	matcher = new0(struct bt_ad_matcher, 1);
+	matcher->entries = queue_new();
+
+	return matcher;
+}
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher)
+{
+	unsigned int i;
+
+	if (!matcher)
+		return;
+
+	for (i = 0; i <= UINT8_MAX; i++)
+		queue_destroy(matcher->roots[i], trie_root_free);
+
+	queue_destroy(matcher->entries, matcher_entry_free);
+	free(matcher);
+}
+
+static int trie_child_index(struct ad_trie_node *node, uint8_t value,
+								bool *found)
+{
+	int low = 0, high = node->num_children - 1;
+
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		uint8_t mid_value = node->children[mid]->value;
+
+		if (mid_value == value) {
+			*found = true;
+			return mid;
+		}
+
+		if (mid_value < value)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	*found = false;
+	return low;
+}
+
+static struct ad_trie_node *trie_child_find(struct ad_trie_node *node,
+								uint8_t value)
+{
+	bool found;
+	int i;
+
+	i = trie_child_index(node, value, &found);
+
+	return found ? node->children[i] : NULL;
+}
+
+static struct ad_trie_node *trie_child_add(struct ad_trie_node *node,
+								uint8_t value)
+{
+	struct ad_trie_node *child;
+	bool found;
+	int i;
+
+	i = trie_child_index(node, value, &found);
+	if (found)
+		return node->children[i];
+
+	child = new0(struct ad_trie_node, 1);
+	child->value = value;
+
+	node->children = realloc(node->children, (node->num_children + 1) *
+						sizeof(*node->children));
+	memmove(&node->children[i + 1], &node->children[i],
+			(node->num_children - i) * sizeof(*node->children));
+	node->children[i] = child;
+	node->num_children++;
+
+	return child;
+}
+
+static bool trie_root_match(const void *data, const void *match_data)
+{
+	const struct ad_trie_root *root = data;
+
+	return root->offset == PTR_TO_UINT(match_data);
+}
+
+static void matcher_insert(struct bt_ad_matcher *matcher,
+					const struct bt_ad_pattern *pattern,
+					struct ad_matcher_entry *entry)
+{
+	struct queue **roots = &matcher->roots[pattern->type];
+	struct ad_trie_root *root;
+	struct ad_trie_node *node;
+	uint8_t i;
+
+	if (!*roots)
+		*roots = queue_new();
+
+	root = queue_find(*roots, trie_root_match,
+					UINT_TO_PTR(pattern->offset));
+	if (!root) {
+		root = new0(struct ad_trie_root, 1);
+		root->offset = pattern->offset;
+		queue_push_tail(*roots, root);
+	}
+
+	node = &root->node;
+
+	for (i = 0; i < pattern->len; i++)
+		node = trie_child_add(node, pattern->data[i]);
+
+	if (!node->entries)
+		node->entries = queue_new();
+
+	queue_push_tail(node->entries, entry);
+}
+
+static bool trie_node_is_empty(struct ad_trie_node *node)
+{
+	return !node->num_children && queue_isempty(node->entries);
+}
+
+/* Removes the entry from the path spelled by data, pruning empty nodes */
+static void trie_node_remove(struct ad_trie_node *node, const uint8_t *data,
+					uint8_t len,
+					struct ad_matcher_entry *entry)
+{
+	struct ad_trie_node *child;
+	bool found;
+	int i;
+
+	if (!len) {
+		queue_remove(node->entries, entry);
+		if (queue_isempty(node->entries)) {
+			queue_destroy(node->entries, NULL);
+			node->entries = NULL;
+		}
+		return;
+	}
+
+	i = trie_child_index(node, data[0], &found);
+	if (!found)
+		return;
+
+	child = node->children[i];
+
+	trie_node_remove(child, data + 1, len - 1, entry);
+
+	if (!trie_node_is_empty(child))
+		return;
+
+	trie_node_free(child);
+	free(child);
+
+	node->num_children--;
+	memmove(&node->children[i], &node->children[i + 1],
+			(node->num_children - i) * sizeof(*node->children));
+}
+
+static void matcher_delete(struct bt_ad_matcher *matcher,
+					const struct bt_ad_pattern *pattern,
+					struct ad_matcher_entry *entry)
+{
+	struct queue **roots = &matcher->roots[pattern->type];
+	struct ad_trie_root *root;
+
+	root = queue_find(*roots, trie_root_match,
+					UINT_TO_PTR(pattern->offset));
+	if (!root)
+		return;
+
+	trie_node_remove(&root->node, pattern->data, pattern->len, entry);
+
+	if (!trie_node_is_empty(&root->node))
+		return;
+
+	queue_remove(*roots, root);
+	trie_root_free(root);
+
+	if (queue_isempty(*roots)) {
+		queue_destroy(*roots, NULL);
+		*roots = NULL;
+	}
+}
+
+static bool matcher_entry_match(const void *data, const void *match_data)
+{
+	const struct ad_matcher_entry *entry = data;
+
+	return entry->match_data == match_data;
+}
+
+/*
+ * Adds a set of OR'ed patterns identified by match_data. The patterns are
+ * copied so the caller keeps ownership of them.
+ */
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data)
+{
+	struct ad_matcher_entry *entry;
+	const struct queue_entry *e;
+
+	if (!matcher || queue_isempty(patterns))
+		return false;
+
+	if (queue_find(matcher->entries, matcher_entry_match, match_data))
+		return false;
+
+	entry = new0(struct ad_matcher_entry, 1);
+	entry->match_data = match_data;
+	entry->patterns = queue_new();
+
+	for (e = queue_get_entries(patterns); e; e = e->next) {
+		struct bt_ad_pattern *pattern;
+
+		pattern = util_memdup(e->data, sizeof(*pattern));
+		queue_push_tail(entry->patterns, pattern);
+		matcher_insert(matcher, pattern, entry);
+	}
+
+	queue_push_tail(matcher->entries, entry);
+
+	return true;
+}
+
+bool bt_ad_matcher_remove(struct bt_ad_matcher *matcher, void *match_data)
+{
+	struct ad_matcher_entry *entry;
+	const struct queue_entry *e;
+
+	if (!matcher)
+		return false;
+
+	entry = queue_remove_if(matcher->entries, matcher_entry_match,
+								match_data);
+	if (!entry)
+		return false;
+
+	for (e = queue_get_entries(entry->patterns); e; e = e->next)
+		matcher_delete(matcher, e->data, entry);
+
+	matcher_entry_free(entry);
+
+	return true;
+}
+
+struct matcher_walk_info {
+	struct bt_ad_matcher *matcher;
+	bt_ad_match_func_t func;
+	void *user_data;
+};
+
+static void matcher_report(void *data, void *user_data)
+{
+	struct ad_matcher_entry *entry = data;
+	struct matcher_walk_info *info = user_data;
+
+	/* Report each set of patterns only once per advertisement */
+	if (entry->match_id == info->matcher->match_id)
+		return;
+
+	entry->match_id = info->matcher->match_id;
+	info->func(entry->match_data, info->user_data);
+}
+
+static void matcher_walk(struct matcher_walk_info *info, uint8_t type,
+					const uint8_t *data, size_t len)
+{
+	const struct queue_entry *e;
+
+	for (e = queue_get_entries(info->matcher->roots[type]); e;
+								e = e->next) {
+		struct ad_trie_root *root = e->data;
+		struct ad_trie_node *node = &root->node;
+		size_t i;
+
+		for (i = root->offset; i < len; i++) {
+			node = trie_child_find(node, data[i]);
+			if (!node)
+				break;
+
+			queue_foreach(node->entries, matcher_report, info);
+		}
+	}
+}
+
+static void matcher_walk_manufacturer(void *data, void *user_data)
+{
+	struct bt_ad_manufacturer_data *manufacturer_data = data;
+	uint8_t all_data[BT_EA_MAX_DATA_LEN];
+	size_t len;
+
+	/* Take the manufacturer ID into account */
+	len = MIN(manufacturer_data->len, sizeof(all_data) - 2);
+
+	memcpy(&all_data[0], &manufacturer_data->manufacturer_id, 2);
+	memcpy(&all_data[2], manufacturer_data->data, len);
+
+	matcher_walk(user_data, BT_AD_MANUFACTURER_DATA, all_data, len + 2);
+}
+
+static void matcher_walk_service(void *data, void *user_data)
+{
+	struct bt_ad_service_data *service_data = data;
+
+	/* Service data patterns apply regardless of the UUID size, just as
+	 * bt_ad_pattern_match() does.
+	 */
+	matcher_walk(user_data, BT_AD_SERVICE_DATA16, service_data->data,
+							service_data->len);
+	matcher_walk(user_data, BT_AD_SERVICE_DATA32, service_data->data,
+							service_data->len);
+	matcher_walk(user_data, BT_AD_SERVICE_DATA128, service_data->data,
+							service_data->len);
+}
+
+static void matcher_walk_data(void *data, void *user_data)
+{
+	struct bt_ad_data *ad_data = data;
+
+	matcher_walk(user_data, ad_data->type, ad_data->data, ad_data->len);
+}
+
+static void matcher_entry_reset(void *data, void *user_data)
+{
+	struct ad_matcher_entry *entry = data;
+
+	entry->match_id = 0;
+}
+
+/*
+ * Calls func once for every set of patterns with at least one pattern
+ * matching the advertisement, equivalent to running bt_ad_pattern_match() on
+ * each of them. The matcher must not be modified from within func.
+ */
+void bt_ad_matcher_match(struct bt_ad_matcher *matcher, struct bt_ad *ad,
+				bt_ad_match_func_t func, void *user_data)
+{
+	struct matcher_walk_info info;
+
+	if (!matcher || !ad || !func || queue_isempty(matcher->entries))
+		return;
+
+	if (!++matcher->match_id) {
+		queue_foreach(matcher->entries, matcher_entry_reset, NULL);
+		matcher->match_id = 1;
+	}
+
+	info.matcher = matcher;
+	info.func = func;
+	info.user_data = user_data;
+
+	queue_foreach(ad->manufacturer_data, matcher_walk_manufacturer, &info);
+	queue_foreach(ad->service_data, matcher_walk_service, &info);
+	queue_foreach(ad->data, matcher_walk_data, &info);
+}
@@ -190,3 +190,19 @@ struct bt_ad_pattern *bt_ad_pattern_new(uint8_t type, size_t offset,
 
 struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 							struct queue *patterns);
+
+typedef void (*bt_ad_match_func_t)(void *match_data, void *user_data);
+
+struct bt_ad_matcher;
+
+struct bt_ad_matcher *bt_ad_matcher_new(void);
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher);
+
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data);
+
+bool bt_ad_matcher_remove(struct bt_ad_matcher *matcher, void *match_data);
+
+void bt_ad_matcher_match(struct bt_ad_matcher *matcher, struct bt_ad *ad,
+				bt_ad_match_func_t func, void *user_data);
@@ -129,6 +129,8 @@ static const struct {
 	{ BT_ATT_OP_READ_BLOB_RSP,		ATT_OP_TYPE_RSP },
 	{ BT_ATT_OP_READ_MULT_REQ,		ATT_OP_TYPE_REQ },
 	{ BT_ATT_OP_READ_MULT_RSP,		ATT_OP_TYPE_RSP },
+	{ BT_ATT_OP_READ_MULT_VL_REQ,		ATT_OP_TYPE_REQ },
+	{ BT_ATT_OP_READ_MULT_VL_RSP,		ATT_OP_TYPE_RSP },
 	{ BT_ATT_OP_READ_BY_GRP_TYPE_REQ,	ATT_OP_TYPE_REQ },
 	{ BT_ATT_OP_READ_BY_GRP_TYPE_RSP,	ATT_OP_TYPE_RSP },
 	{ BT_ATT_OP_WRITE_REQ,			ATT_OP_TYPE_REQ },
@@ -172,6 +174,7 @@ static const struct {
 	{ BT_ATT_OP_READ_REQ,			BT_ATT_OP_READ_RSP },
 	{ BT_ATT_OP_READ_BLOB_REQ,		BT_ATT_OP_READ_BLOB_RSP },
 	{ BT_ATT_OP_READ_MULT_REQ,		BT_ATT_OP_READ_MULT_RSP },
+	{ BT_ATT_OP_READ_MULT_VL_REQ,		BT_ATT_OP_READ_MULT_VL_RSP },
 	{ BT_ATT_OP_READ_BY_GRP_TYPE_REQ,	BT_ATT_OP_READ_BY_GRP_TYPE_RSP },
 	{ BT_ATT_OP_WRITE_REQ,			BT_ATT_OP_WRITE_RSP },
 	{ BT_ATT_OP_PREP_WRITE_REQ,		BT_ATT_OP_PREP_WRITE_RSP },
@@ -191,6 +194,13 @@ static uint8_t get_req_opcode(uint8_t rsp_opcode)
 	return 0;
 }
 
+/* Encoded PDU shared by the operations sending it over several bearers */
+struct bt_att_pdu {
+	int ref_count;
+	uint16_t len;
+	uint8_t data[];
+};
+
 struct att_send_op {
 	unsigned int id;
 	unsigned int timeout_id;
@@ -198,6 +208,7 @@ struct att_send_op {
 	uint8_t opcode;
 	void *pdu;
 	uint16_t len;
+	struct bt_att_pdu *shared;
 	bool retry;
 	bt_att_response_func_t callback;
 	bt_att_destroy_func_t destroy;
@@ -214,7 +225,11 @@ static void destroy_att_send_op(void *data)
 	if (op->destroy)
 		op->destroy(op->user_data);
 
-	free(op->pdu);
+	if (op->shared)
+		bt_att_pdu_unref(op->shared);
+	else
+		free(op->pdu);
+
 	free(op);
 }
 
@@ -1449,6 +1464,27 @@ static void exchange_handler(void *data, void *user_data)
 		exchange->callback(mtu, exchange->user_data);
 }
 
+uint16_t bt_att_get_min_mtu(struct bt_att *att)
+{
+	const struct queue_entry *entry;
+	uint16_t mtu;
+
+	if (!att)
+		return 0;
+
+	mtu = att->mtu;
+
+	for (entry = queue_get_entries(att->chans); entry;
+						entry = entry->next) {
+		struct bt_att_chan *chan = entry->data;
+
+		if (chan->mtu < mtu)
+			mtu = chan->mtu;
+	}
+
+	return mtu;
+}
+
 bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu)
 {
 	struct bt_att_chan *chan;
@@ -1700,6 +1736,92 @@ done:
 	return op->id;
 }
 
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, const void *pdu,
+							uint16_t length)
+{
+	struct bt_att_pdu *shared;
+
+	if (length && !pdu)
+		return NULL;
+
+	/* Only PDUs not eliciting a response can be sent to several peers */
+	if (get_op_type(opcode) != ATT_OP_TYPE_NFY)
+		return NULL;
+
+	shared = malloc(sizeof(*shared) + 1 + length);
+	if (!shared)
+		return NULL;
+
+	shared->ref_count = 1;
+	shared->len = 1 + length;
+	shared->data[0] = opcode;
+	if (length)
+		memcpy(shared->data + 1, pdu, length);
+
+	return shared;
+}
+
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return NULL;
+
+	__sync_fetch_and_add(&pdu->ref_count, 1);
+
+	return pdu;
+}
+
+void bt_att_pdu_unref(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return;
+
+	if (__sync_sub_and_fetch(&pdu->ref_count, 1))
+		return;
+
+	free(pdu);
+}
+
+uint16_t bt_att_pdu_get_length(struct bt_att_pdu *pdu)
+{
+	if (!pdu)
+		return 0;
+
+	return pdu->len;
+}
+
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu)
+{
+	struct att_send_op *op;
+
+	if (!att || !pdu || queue_isempty(att->chans))
+		return 0;
+
+	if (pdu->len > att->mtu)
+		return 0;
+
+	op = new0(struct att_send_op, 1);
+	op->type = ATT_OP_TYPE_NFY;
+	op->opcode = pdu->data[0];
+	op->shared = bt_att_pdu_ref(pdu);
+	op->pdu = pdu->data;
+	op->len = pdu->len;
+
+	if (att->next_send_id < 1)
+		att->next_send_id = 1;
+
+	op->id = att->next_send_id++;
+
+	if (!queue_push_tail(att->write_queue, op)) {
+		destroy_att_send_op(op);
+		return 0;
+	}
+
+	wakeup_writer(att);
+
+	return op->id;
+}
+
 int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 				const void *pdu, uint16_t length,
 				bt_att_response_func_t callback,
@@ -19,6 +19,7 @@
 
 struct bt_att;
 struct bt_att_chan;
+struct bt_att_pdu;
 
 struct bt_att *bt_att_new(int fd, bool ext_signed);
 
@@ -56,6 +57,7 @@ bool bt_att_set_debug(struct bt_att *att, uint8_t level,
 			bt_att_destroy_func_t destroy);
 
 uint16_t bt_att_get_mtu(struct bt_att *att);
+uint16_t bt_att_get_min_mtu(struct bt_att *att);
 bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu);
 uint8_t bt_att_get_link_type(struct bt_att *att);
 
@@ -82,6 +84,12 @@ unsigned int bt_att_chan_send(struct bt_att_chan *chan, uint8_t opcode,
 					bt_att_response_func_t callback,
 					void *user_data,
 					bt_att_destroy_func_t destroy);
+struct bt_att_pdu *bt_att_pdu_new(uint8_t opcode, const void *pdu,
+							uint16_t length);
+struct bt_att_pdu *bt_att_pdu_ref(struct bt_att_pdu *pdu);
+void bt_att_pdu_unref(struct bt_att_pdu *pdu);
+uint16_t bt_att_pdu_get_length(struct bt_att_pdu *pdu);
+unsigned int bt_att_send_pdu(struct bt_att *att, struct bt_att_pdu *pdu);
 #define bt_att_chan_send_rsp(chan, opcode, pdu, len) \
 	bt_att_chan_send(chan, opcode, pdu, len, NULL, NULL, NULL)
 bool bt_att_chan_cancel(struct bt_att_chan *chan, unsigned int id);
@@ -1617,12 +1617,43 @@ static uint16_t bap_req_len(struct bt_bap_req *req)
 	return len;
 }
 
-static bool match_req(const void *data, const void *match_data)
+static bool req_has_stream(struct bt_bap_req *req,
+					struct bt_bap_stream *stream)
 {
-	const struct bt_bap_req *pend = data;
-	const struct bt_bap_req *req = match_data;
+	if (req->stream == stream)
+		return true;
+
+	return queue_find(req->group, match_req_stream, stream);
+}
+
+/* Find a queued request with the same opcode the new one can be appended
+ * to. Requests of the same stream are never reordered, so only requests
+ * queued after the last one of the stream are considered, this allows
+ * Config, QoS and Enable of several streams to be queued at once and still
+ * be sent as one write per opcode.
+ */
+static struct bt_bap_req *bap_find_group(struct bt_bap *bap,
+					struct bt_bap_req *req, uint16_t len,
+					uint16_t mtu)
+{
+	const struct queue_entry *entry;
+	struct bt_bap_req *group = NULL;
+
+	for (entry = queue_get_entries(bap->reqs); entry;
+						entry = entry->next) {
+		struct bt_bap_req *pend = entry->data;
+
+		if (req_has_stream(pend, req->stream)) {
+			group = NULL;
+			continue;
+		}
+
+		if (!group && pend->op == req->op &&
+					bap_req_len(pend) + len < mtu)
+			group = pend;
+	}
 
-	return pend->op == req->op;
+	return group;
 }
 
 static struct bt_ascs *bap_get_ascs(struct bt_bap *bap)
@@ -1738,9 +1769,9 @@ static bool bap_queue_req(struct bt_bap *bap, struct bt_bap_req *req)
 		return false;
 	}
 
-	pend = queue_find(bap->reqs, match_req, req);
 	/* Check if req can be grouped together and it fits in the MTU */
-	if (pend && (bap_req_len(pend) + len < mtu)) {
+	pend = bap_find_group(bap, req, len, mtu);
+	if (pend) {
 		if (!pend->group)
 			pend->group = queue_new();
 		/* Group requests with the same opcode */
@@ -5386,6 +5417,23 @@ static void bap_endpoint_attach(struct bt_bap *bap, struct bt_bap_endpoint *ep)
 						bap_endpoint_notify, ep);
 }
 
+static const struct bt_ascs_ase_rsp *cp_rsp_find(
+					const struct bt_ascs_cp_rsp *rsp,
+					struct bt_bap_req *req)
+{
+	int i;
+
+	if (!req->stream || !req->stream->ep)
+		return NULL;
+
+	for (i = 0; i < rsp->num_ase; i++) {
+		if (rsp->rsp[i].ase == req->stream->ep->id)
+			return &rsp->rsp[i];
+	}
+
+	return NULL;
+}
+
 static void bap_cp_notify(struct bt_bap *bap, uint16_t value_handle,
 				const uint8_t *value, uint16_t length,
 				void *user_data)
@@ -5393,7 +5441,7 @@ static void bap_cp_notify(struct bt_bap *bap, uint16_t value_handle,
 	const struct bt_ascs_cp_rsp *rsp = (void *)value;
 	const struct bt_ascs_ase_rsp *ase_rsp = NULL;
 	struct bt_bap_req *req;
-	int i;
+	struct queue *group;
 
 	if (!bap->req)
 		return;
@@ -5420,16 +5468,28 @@ static void bap_cp_notify(struct bt_bap *bap, uint16_t value_handle,
 		goto done;
 	}
 
-	for (i = 0; i < rsp->num_ase; i++) {
-		if (length < sizeof(*ase_rsp)) {
-			DBG(bap, "Invalid ASE CP notification: length %u < %zu",
-					length, sizeof(*ase_rsp));
-			goto done;
-		}
-
-		ase_rsp = &rsp->rsp[i];
+	if (length < rsp->num_ase * sizeof(*ase_rsp)) {
+		DBG(bap, "Invalid ASE CP notification: length %u < %zu",
+				length, rsp->num_ase * sizeof(*ase_rsp));
+		goto done;
 	}
 
+	/* Complete each request of the group with the response of its own
+	 * ASE, a request without response is completed as unspecified.
+	 */
+	group = req->group;
+	req->group = NULL;
+
+	bap_req_complete(req, cp_rsp_find(rsp, req));
+
+	while ((req = queue_pop_head(group)))
+		bap_req_complete(req, cp_rsp_find(rsp, req));
+
+	queue_destroy(group, NULL);
+	bap_process_queue(bap);
+
+	return;
+
 done:
 	bap_req_complete(req, ase_rsp);
 	bap_process_queue(bap);
@@ -7922,3 +7982,113 @@ void bt_bap_qos_to_iso_qos(struct bt_bap_qos *bap_qos,
 	memcpy(&iso_qos->bcast.out, &bap_qos->bcast.io_qos,
 			sizeof(struct bt_iso_io_qos));
 }
+
+static bool match_io_qos(const struct bt_bap_io_qos *io_qos,
+		const struct bt_bap_io_qos *match)
+{
+	if (io_qos->interval != match->interval)
+		return false;
+
+	if (io_qos->latency != match->latency)
+		return false;
+
+	if (io_qos->sdu != match->sdu)
+		return false;
+
+	if (io_qos->phys != match->phys)
+		return false;
+
+	if (io_qos->rtn != match->rtn)
+		return false;
+
+	return true;
+}
+
+bool bt_bap_bcast_qos_match(const struct bt_bap_bcast_qos *qos,
+				const struct bt_bap_bcast_qos *match)
+{
+	if (qos->sync_factor != match->sync_factor)
+		return false;
+
+	if (qos->packing != match->packing)
+		return false;
+
+	if (qos->framing != match->framing)
+		return false;
+
+	if (qos->encryption != match->encryption)
+		return false;
+
+	if (qos->encryption && util_iov_memcmp(qos->bcode, match->bcode))
+		return false;
+
+	if (qos->options != match->options)
+		return false;
+
+	if (qos->skip != match->skip)
+		return false;
+
+	if (qos->sync_timeout != match->sync_timeout)
+		return false;
+
+	if (qos->sync_cte_type != match->sync_cte_type)
+		return false;
+
+	if (qos->mse != match->mse)
+		return false;
+
+	if (qos->timeout != match->timeout)
+		return false;
+
+	if (qos->pa_sync != match->pa_sync)
+		return false;
+
+	return match_io_qos(&qos->io_qos, &match->io_qos);
+}
+
+/* Group the QoS of the BISes of a single BIG: they shall all match and set
+ * the same BIG handle, if any. When none is set the first handle in_use
+ * reports free is assigned to all of them.
+ *
+ * Returns 0 on success, -EINVAL if the QoS cannot be grouped or -EBUSY if
+ * there is no BIG handle left.
+ */
+int bt_bap_bcast_qos_group(struct bt_bap_bcast_qos **qos, size_t num,
+				bt_bap_big_in_use_func_t in_use,
+				void *user_data)
+{
+	uint8_t big = BT_ISO_QOS_BIG_UNSET;
+	unsigned int handle;
+	size_t i;
+
+	if (!qos || !num)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (i && !bt_bap_bcast_qos_match(qos[i], qos[0]))
+			return -EINVAL;
+
+		if (qos[i]->big == BT_ISO_QOS_BIG_UNSET)
+			continue;
+
+		if (big != BT_ISO_QOS_BIG_UNSET && big != qos[i]->big)
+			return -EINVAL;
+
+		big = qos[i]->big;
+	}
+
+	/* BIG handles range from 0x00 to 0xEF */
+	for (handle = 0x00; big == BT_ISO_QOS_BIG_UNSET && handle <= 0xef;
+								handle++) {
+		if (!in_use || !in_use(handle, user_data))
+			big = handle;
+	}
+
+	if (big == BT_ISO_QOS_BIG_UNSET)
+		return -EBUSY;
+
+	for (i = 0; i < num; i++)
+		qos[i]->big = big;
+
+	return 0;
+}
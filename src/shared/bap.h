@@ -50,6 +50,8 @@ typedef void (*bt_bap_bcode_func_t)(struct bt_bap_stream *stream,
 				bt_bap_bcode_reply_t reply, void *reply_data,
 				void *user_data);
 
+typedef bool (*bt_bap_big_in_use_func_t)(uint8_t big, void *user_data);
+
 extern struct bt_iso_qos bap_sink_pa_qos;
 
 /* Local PAC related functions */
@@ -321,3 +323,9 @@ void bt_bap_iso_qos_to_bap_qos(struct bt_iso_qos *iso_qos,
 				struct bt_bap_qos *bap_qos);
 void bt_bap_qos_to_iso_qos(struct bt_bap_qos *bap_qos,
 				struct bt_iso_qos *iso_qos);
+
+bool bt_bap_bcast_qos_match(const struct bt_bap_bcast_qos *qos,
+				const struct bt_bap_bcast_qos *match);
+int bt_bap_bcast_qos_group(struct bt_bap_bcast_qos **qos, size_t num,
+				bt_bap_big_in_use_func_t in_use,
+				void *user_data);
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bluetooth/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/bcast-cache.h"
+
+struct cache_entry {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	uint32_t bid;
+	struct bcast_cache_entry data;
+	uint64_t time;
+};
+
+struct bcast_cache {
+	unsigned int max;		/* Entries kept before evicting */
+	uint32_t ttl;			/* In ms, 0 if entries never expire */
+	struct queue *entries;		/* Least recently refreshed first */
+};
+
+struct entry_match {
+	const bdaddr_t *bdaddr;
+	uint8_t bdaddr_type;
+	uint32_t bid;
+	uint8_t sid;
+};
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void entry_free(void *data)
+{
+	struct cache_entry *entry = data;
+
+	if (!entry)
+		return;
+
+	util_iov_free(entry->data.base, 1);
+	free(entry);
+}
+
+/* An SID of 0xff matches any, it is only known once synced to the source */
+static bool match_entry(const void *data, const void *user_data)
+{
+	const struct cache_entry *entry = data;
+	const struct entry_match *match = user_data;
+
+	if (entry->bid != match->bid ||
+			entry->bdaddr_type != match->bdaddr_type ||
+			bacmp(&entry->bdaddr, match->bdaddr))
+		return false;
+
+	return match->sid == 0xff || entry->data.sid == match->sid;
+}
+
+struct bcast_cache *bcast_cache_new(unsigned int max, uint32_t ttl)
+{
+	struct bcast_cache *cache;
+
+	if (!max)
+		return NULL;
+
+	cache = new0(struct bcast_cache, 1);
+	cache->max = max;
+	cache->ttl = ttl;
+	cache->entries = queue_new();
+
+	return cache;
+}
+
+void bcast_cache_free(struct bcast_cache *cache)
+{
+	if (!cache)
+		return;
+
+	queue_destroy(cache->entries, entry_free);
+	free(cache);
+}
+
+bool bcast_cache_store(struct bcast_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, uint32_t bid, uint8_t sid,
+				const struct iovec *base,
+				const struct bt_iso_qos *qos)
+{
+	struct entry_match match = { bdaddr, bdaddr_type, bid, sid };
+	struct cache_entry *entry;
+
+	if (!cache || !bdaddr || !base || !qos || sid == 0xff)
+		return false;
+
+	entry = queue_remove_if(cache->entries, match_entry, &match);
+	if (!entry) {
+		/* The source may have restarted its advertising set with
+		 * another SID, the entry with the old one could no longer be
+		 * synced to.
+		 */
+		match.sid = 0xff;
+		queue_remove_all(cache->entries, match_entry, &match,
+								entry_free);
+
+		/* Evict the entry not refreshed for the longest time */
+		if (queue_length(cache->entries) >= cache->max)
+			entry_free(queue_pop_head(cache->entries));
+
+		entry = new0(struct cache_entry, 1);
+		bacpy(&entry->bdaddr, bdaddr);
+		entry->bdaddr_type = bdaddr_type;
+		entry->bid = bid;
+		entry->data.sid = sid;
+	}
+
+	util_iov_free(entry->data.base, 1);
+	entry->data.base = util_iov_dup(base, 1);
+	entry->data.qos = *qos;
+	entry->time = now_ms();
+
+	queue_push_tail(cache->entries, entry);
+
+	return true;
+}
+
+/*
+ * Stale entries are not returned so the caller refreshes them by syncing to
+ * the source again, they are dropped once it is stored again or evicted.
+ */
+struct bcast_cache_entry *bcast_cache_lookup(struct bcast_cache *cache,
+				const bdaddr_t *bdaddr, uint8_t bdaddr_type,
+				uint32_t bid, uint8_t sid)
+{
+	struct entry_match match = { bdaddr, bdaddr_type, bid, sid };
+	struct cache_entry *entry;
+
+	if (!cache || !bdaddr)
+		return NULL;
+
+	entry = queue_find(cache->entries, match_entry, &match);
+	if (!entry)
+		return NULL;
+
+	if (cache->ttl && now_ms() - entry->time >= cache->ttl)
+		return NULL;
+
+	return &entry->data;
+}
+
+unsigned int bcast_cache_get_count(struct bcast_cache *cache)
+{
+	if (!cache)
+		return 0;
+
+	return queue_length(cache->entries);
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "bluetooth/bluetooth.h"
+
+struct bcast_cache;
+
+struct bcast_cache_entry {
+	uint8_t sid;
+	struct iovec *base;
+	struct bt_iso_qos qos;
+};
+
+struct bcast_cache *bcast_cache_new(unsigned int max, uint32_t ttl);
+void bcast_cache_free(struct bcast_cache *cache);
+
+bool bcast_cache_store(struct bcast_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, uint32_t bid, uint8_t sid,
+				const struct iovec *base,
+				const struct bt_iso_qos *qos);
+struct bcast_cache_entry *bcast_cache_lookup(struct bcast_cache *cache,
+				const bdaddr_t *bdaddr, uint8_t bdaddr_type,
+				uint32_t bid, uint8_t sid);
+unsigned int bcast_cache_get_count(struct bcast_cache *cache);
@@ -37,6 +37,8 @@
 
 #define GATT_SVC_UUID	0x1801
 #define SVC_CHNGD_UUID	0x2a05
+#define NOTIFY_INDEX_BITS	8
+#define NOTIFY_INDEX_PAGES	(1 << NOTIFY_INDEX_BITS)
 #define DBG(_client, _format, arg...) \
 	gatt_log(_client, "[%p] %s:%s() " _format, _client, __FILE__, \
 		__func__, ## arg)
@@ -72,6 +74,10 @@ struct bt_gatt_client {
 	bt_gatt_client_destroy_func_t debug_destroy;
 	void *debug_data;
 
+	bt_gatt_client_db_lookup_func_t db_lookup;
+	bt_gatt_client_destroy_func_t db_lookup_destroy;
+	void *db_lookup_data;
+
 	struct gatt_db *db;
 	bool in_init;
 	bool ready;
@@ -88,9 +94,16 @@ struct bt_gatt_client {
 
 	unsigned int reliable_write_session_id;
 
+	/* Short reads waiting to be merged into a single Read Multiple */
+	struct read_batch *read_batch;
+	unsigned int reads_outstanding;
+	struct bt_gatt_client_read_stats read_stats;
+
 	/* List of registered disconnect/notification/indication callbacks */
 	struct queue *notify_list;
 	struct queue *notify_chrcs;
+	/* notify_chrcs indexed by value handle, see notify_index_lookup */
+	struct notify_chrc **notify_index[NOTIFY_INDEX_PAGES];
 	int next_reg_id;
 	unsigned int disc_id, nfy_id, nfy_mult_id, ind_id;
 
@@ -104,6 +117,16 @@ struct bt_gatt_client {
 	struct queue *svc_chngd_queue;  /* Queued service changed events */
 	bool in_svc_chngd;
 
+	/*
+	 * Set when the DB Hash matched the cached database, in which case a
+	 * bonded server is expected to have kept the CCC states stored in it.
+	 */
+	bool db_unchanged;
+	bool ccc_restore;
+
+	/* Set when cached values or CCC states changed since last cleared */
+	bool cache_dirty;
+
 	/*
 	 * List of pending read/write operations. For operations that span
 	 * across multiple PDUs, this list provides a mapping from an operation
@@ -113,6 +136,8 @@ struct bt_gatt_client {
 	unsigned int next_request_id;
 
 	struct bt_gatt_request *discovery_req;
+	/* Requests in flight while discovering over multiple bearers */
+	struct queue *discovery_reqs;
 	unsigned int mtu_req_id;
 
 	/* Pending retry operation for DB out of sync handling */
@@ -120,14 +145,19 @@ struct bt_gatt_client {
 	uint16_t pending_error_handle;
 };
 
+struct read_batch;
+
 struct request {
 	struct bt_gatt_client *client;
+	struct read_batch *batch;
+	bool read_outstanding;
 	bool long_write;
 	bool prep_write;
 	bool removed;
 	int ref_count;
 	unsigned int id;
 	unsigned int att_id;
+	struct queue *blobs;
 	void *data;
 	void (*destroy)(void *);
 };
@@ -197,6 +227,8 @@ static void notify_client_idle(struct bt_gatt_client *client)
 	bt_gatt_client_unref(client);
 }
 
+static void read_batch_flush(struct bt_gatt_client *client);
+
 static void request_unref(void *data)
 {
 	struct request *req = data;
@@ -208,15 +240,87 @@ static void request_unref(void *data)
 	if (req->destroy)
 		req->destroy(req->data);
 
+	/* Send the reads that were queued while this one was in flight */
+	if (req->read_outstanding && !--client->reads_outstanding &&
+							client->read_batch)
+		read_batch_flush(client);
+
 	if (!req->removed) {
 		queue_remove(client->pending_requests, req);
 		if (queue_isempty(client->pending_requests))
 			notify_client_idle(client);
 	}
 
+	queue_destroy(req->blobs, NULL);
 	free(req);
 }
 
+/* Part of a long value read or written concurrently with other parts */
+struct long_blob {
+	struct request *req;
+	unsigned int id;
+	uint16_t offset;
+	uint16_t length;
+};
+
+static void long_blob_free(void *data)
+{
+	struct long_blob *blob = data;
+
+	queue_remove(blob->req->blobs, blob);
+	request_unref(blob->req);
+	free(blob);
+}
+
+static struct long_blob *long_blob_send(struct request *req, uint8_t opcode,
+					const void *pdu, uint16_t length,
+					bt_att_response_func_t callback)
+{
+	struct long_blob *blob;
+
+	blob = new0(struct long_blob, 1);
+	blob->req = request_ref(req);
+	blob->id = bt_att_send(req->client->att, opcode, pdu, length,
+					callback, blob, long_blob_free);
+	if (!blob->id) {
+		request_unref(req);
+		free(blob);
+		return NULL;
+	}
+
+	queue_push_tail(req->blobs, blob);
+
+	return blob;
+}
+
+static void cancel_blobs(struct request *req)
+{
+	struct long_blob *blob;
+
+	while ((blob = queue_pop_head(req->blobs)))
+		bt_att_cancel(req->client->att, blob->id);
+}
+
+/*
+ * Returns how many parts of a long value can be in flight at once, which is
+ * one per bearer, or 0 if splitting the value into parts that fit the bearer
+ * with the smallest MTU would not move more data per round trip than using
+ * the bearer with the largest MTU alone.
+ */
+static int long_blob_window(struct bt_att *att, uint16_t hdr_len)
+{
+	int chans = bt_att_get_channels(att);
+	uint16_t min_mtu = bt_att_get_min_mtu(att);
+
+	if (chans < 2 || min_mtu <= hdr_len)
+		return 0;
+
+	if (chans * (min_mtu - hdr_len) <= bt_att_get_mtu(att) - hdr_len)
+		return 0;
+
+	return chans;
+}
+
 struct notify_chrc {
 	struct bt_gatt_client *client;
 	struct gatt_db_attribute *attr;
@@ -231,6 +335,12 @@ struct notify_chrc {
 	 */
 	struct queue *reg_notify_queue;
 	unsigned int ccc_write_id;
+
+	/* Waiting for the DB Hash check to decide if the CCC is restored */
+	bool ccc_restore;
+
+	/* Registered notify_data for this characteristic */
+	struct queue *notify_list;
 };
 
 struct notify_data {
@@ -266,14 +376,6 @@ static void notify_data_unref(void *data)
 	free(notify_data);
 }
 
-static bool match_notify_chrc(const void *data, const void *user_data)
-{
-	const struct notify_data *notify_data = data;
-	const struct notify_chrc *chrc = user_data;
-
-	return notify_data->chrc == chrc;
-}
-
 static void notify_data_cleanup(void *data)
 {
 	struct notify_data *notify_data = data;
@@ -292,9 +394,53 @@ static void notify_chrc_free(void *data)
 		gatt_db_attribute_unregister(chrc->attr, chrc->notify_id);
 
 	queue_destroy(chrc->reg_notify_queue, notify_data_unref);
+	queue_destroy(chrc->notify_list, NULL);
 	free(chrc);
 }
 
+/*
+ * Notifications are dispatched by value handle, so the characteristics with
+ * registered handlers are indexed in a two level table: the high byte of the
+ * handle selects a page, allocated on first use, and the low byte the slot.
+ */
+static struct notify_chrc *notify_index_lookup(struct bt_gatt_client *client,
+							uint16_t value_handle)
+{
+	struct notify_chrc **page;
+
+	page = client->notify_index[value_handle >> NOTIFY_INDEX_BITS];
+	if (!page)
+		return NULL;
+
+	return page[value_handle & (NOTIFY_INDEX_PAGES - 1)];
+}
+
+static void notify_index_set(struct bt_gatt_client *client,
+				uint16_t value_handle, struct notify_chrc *chrc)
+{
+	struct notify_chrc ***page;
+
+	page = &client->notify_index[value_handle >> NOTIFY_INDEX_BITS];
+	if (!*page) {
+		if (!chrc)
+			return;
+
+		*page = new0(struct notify_chrc *, NOTIFY_INDEX_PAGES);
+	}
+
+	(*page)[value_handle & (NOTIFY_INDEX_PAGES - 1)] = chrc;
+}
+
+static void notify_index_free(struct bt_gatt_client *client)
+{
+	unsigned int i;
+
+	for (i = 0; i < NOTIFY_INDEX_PAGES; i++) {
+		free(client->notify_index[i]);
+		client->notify_index[i] = NULL;
+	}
+}
+
 static void chrc_removed(struct gatt_db_attribute *attr, void *user_data)
 {
 	struct notify_chrc *chrc = user_data;
@@ -303,10 +449,12 @@ static void chrc_removed(struct gatt_db_attribute *attr, void *user_data)
 
 	chrc->notify_id = 0;
 
-	while ((data = queue_remove_if(client->notify_list, match_notify_chrc,
-								chrc)))
+	while ((data = queue_pop_head(chrc->notify_list))) {
+		queue_remove(client->notify_list, data);
 		notify_data_cleanup(data);
+	}
 
+	notify_index_set(client, chrc->value_handle, NULL);
 	queue_remove(client->notify_chrcs, chrc);
 	notify_chrc_free(chrc);
 }
@@ -341,6 +489,8 @@ static struct notify_chrc *notify_chrc_create(struct bt_gatt_client *client,
 		return NULL;
 	}
 
+	chrc->notify_list = queue_new();
+
 	ccc = gatt_db_attribute_get_ccc(attr);
 	if (ccc)
 		chrc->ccc_handle = gatt_db_attribute_get_handle(ccc);
@@ -353,6 +503,7 @@ static struct notify_chrc *notify_chrc_create(struct bt_gatt_client *client,
 									NULL);
 
 	queue_push_tail(client->notify_chrcs, chrc);
+	notify_index_set(client, value_handle, chrc);
 
 	return chrc;
 }
@@ -387,11 +538,18 @@ struct discovery_op {
 	struct gatt_db_attribute *hash;
 	uint8_t server_feat;
 	bool success;
+	bool hash_lookup;
 	uint16_t start;
 	uint16_t end;
 	uint16_t last;
 	uint16_t svc_first;
 	uint16_t svc_last;
+	bool parallel;
+	bool parallel_descs;
+	bool parallel_failed;
+	uint8_t parallel_ecode;
+	unsigned int parallel_pending;
+	struct queue *parallel_svcs;
 	unsigned int db_id;
 	int ref_count;
 	discovery_op_complete_func_t complete_func;
@@ -407,6 +565,7 @@ static void discovery_op_free(struct discovery_op *op)
 	queue_destroy(op->pending_svcs, NULL);
 	queue_destroy(op->pending_chrcs, free);
 	queue_destroy(op->ext_prop_desc, NULL);
+	queue_destroy(op->parallel_svcs, NULL);
 	free(op);
 }
 
@@ -590,10 +749,9 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data);
 
-static void discover_incl_cb(bool success, uint8_t att_ecode,
-				struct bt_gatt_result *result, void *user_data)
+static bool discovery_parse_included(struct discovery_op *op,
+						struct bt_gatt_result *result)
 {
-	struct discovery_op *op = user_data;
 	struct bt_gatt_client *client = op->client;
 	struct bt_gatt_iter iter;
 	struct gatt_db_attribute *attr;
@@ -602,23 +760,13 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 	bt_uuid_t uuid;
 	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int includes_count, i;
-	struct handle_range *range;
-
-	discovery_req_clear(client);
-
-	if (!success) {
-		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND)
-			goto next;
-
-		goto failed;
-	}
 
 	if (!result || !bt_gatt_iter_init(&iter, result))
-		goto failed;
+		return false;
 
 	includes_count = bt_gatt_result_included_count(result);
 	if (includes_count == 0)
-		goto failed;
+		return false;
 
 	DBG(client, "Included services found: %u", includes_count);
 
@@ -647,7 +795,7 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 			DBG(client,
 				"Unable to add include attribute at 0x%04x",
 				handle);
-			goto failed;
+			return false;
 		}
 
 		/*
@@ -660,14 +808,14 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 			DBG(client,
 				"Invalid attribute 0x%04x expect it at 0x%04x",
 				gatt_db_attribute_get_handle(attr), handle);
-			goto failed;
+			return false;
 		}
 
 		if (!gatt_db_attribute_get_service_data(attr, NULL, &end,
 							NULL, NULL)) {
 			DBG(client, "Unable to get service data at 0x%04x",
 								handle);
-			goto failed;
+			return false;
 		}
 
 		/* Skip if there are no attributes */
@@ -675,6 +823,28 @@ static void discover_incl_cb(bool success, uint8_t att_ecode,
 			discover_remove_pending(op, attr);
 	}
 
+	return true;
+}
+
+static void discover_incl_cb(bool success, uint8_t att_ecode,
+				struct bt_gatt_result *result, void *user_data)
+{
+	struct discovery_op *op = user_data;
+	struct bt_gatt_client *client = op->client;
+	struct handle_range *range;
+
+	discovery_req_clear(client);
+
+	if (!success) {
+		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND)
+			goto next;
+
+		goto failed;
+	}
+
+	if (!discovery_parse_included(op, result))
+		goto failed;
+
 next:
 	range = queue_pop_head(op->discov_ranges);
 	if (!range) {
@@ -712,18 +882,91 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data);
 
-static bool discover_descs(struct discovery_op *op, bool *discovering)
+/*
+ * Inserts a discovered characteristic into the database. Returns a negative
+ * value on error, 0 if there is nothing left to discover for it or 1 if its
+ * descriptors remain to be discovered up to its (adjusted) end handle.
+ */
+static int discovery_insert_chrc(struct discovery_op *op,
+					struct gatt_db_attribute *svc,
+					struct chrc *chrc_data)
 {
 	struct bt_gatt_client *client = op->client;
 	struct gatt_db_attribute *attr;
+	uint16_t start, end, desc_start;
+
+	attr = gatt_db_insert_characteristic(client->db,
+						chrc_data->start_handle,
+						chrc_data->value_handle,
+						&chrc_data->uuid, 0,
+						chrc_data->properties,
+						NULL, NULL, NULL);
+	if (!attr) {
+		DBG(client, "Failed to insert characteristic at 0x%04x",
+						chrc_data->value_handle);
+
+		/* Some devices have been seen reporting orphaned
+		 * characteristics.  In order to favor interoperability
+		 * we skip over characteristics in error
+		 */
+		return 0;
+	}
+
+	if (gatt_db_attribute_get_handle(attr) != chrc_data->value_handle)
+		return -1;
+
+	gatt_db_attribute_get_service_handles(svc, &start, &end);
+
+	/*
+	 * Adjust end_handle in case the next chrc is not within the
+	 * same service.
+	 */
+	if (chrc_data->end_handle > end)
+		chrc_data->end_handle = end;
+
+	/*
+	 * check for descriptors presence, before initializing the
+	 * desc_handle and avoid integer overflow during desc_handle
+	 * initialization.
+	 */
+	if (chrc_data->value_handle >= chrc_data->end_handle)
+		return 0;
+
+	desc_start = chrc_data->value_handle + 1;
+
+	if (desc_start == chrc_data->end_handle &&
+		(chrc_data->properties & BT_GATT_CHRC_PROP_NOTIFY ||
+		 chrc_data->properties & BT_GATT_CHRC_PROP_INDICATE)) {
+		bt_uuid_t ccc_uuid;
+
+		/* If there is only one descriptor that must be the CCC
+		 * in case either notify or indicate are supported.
+		 */
+		bt_uuid16_create(&ccc_uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+		attr = gatt_db_insert_descriptor(client->db, desc_start,
+							&ccc_uuid, 0, NULL,
+							NULL, NULL);
+		if (attr)
+			return 0;
+	}
+
+	/* Check if the start range is within characteristic range */
+	if (desc_start > chrc_data->end_handle)
+		return 0;
+
+	return 1;
+}
+
+static bool discover_descs(struct discovery_op *op, bool *discovering)
+{
+	struct bt_gatt_client *client = op->client;
 	struct chrc *chrc_data;
-	uint16_t desc_start;
 
 	*discovering = false;
 
 	while ((chrc_data = queue_pop_head(op->pending_chrcs))) {
 		struct gatt_db_attribute *svc;
-		uint16_t start, end;
+		int ret;
 
 		/* Adjust current service */
 		svc = gatt_db_get_service(client->db, chrc_data->value_handle);
@@ -738,82 +981,22 @@ static bool discover_descs(struct discovery_op *op, bool *discovering)
 			op->cur_svc = svc;
 		}
 
-		attr = gatt_db_insert_characteristic(client->db,
-							chrc_data->start_handle,
-							chrc_data->value_handle,
-							&chrc_data->uuid, 0,
-							chrc_data->properties,
-							NULL, NULL, NULL);
-
-		if (!attr) {
-			DBG(client,
-				"Failed to insert characteristic at 0x%04x",
-				chrc_data->value_handle);
-
-			/* Some devices have been seen reporting orphaned
-			 * characteristics.  In order to favor interoperability
-			 * we skip over characteristics in error
-			 */
-			free(chrc_data);
-			continue;
-		}
-
-		if (gatt_db_attribute_get_handle(attr) !=
-							chrc_data->value_handle)
+		ret = discovery_insert_chrc(op, svc, chrc_data);
+		if (ret < 0)
 			goto failed;
 
-		gatt_db_attribute_get_service_handles(svc, &start, &end);
-
-		/*
-		 * Adjust end_handle in case the next chrc is not within the
-		 * same service.
-		 */
-		if (chrc_data->end_handle > end)
-			chrc_data->end_handle = end;
-
-		/*
-		 * check for descriptors presence, before initializing the
-		 * desc_handle and avoid integer overflow during desc_handle
-		 * initialization.
-		 */
-		if (chrc_data->value_handle >= chrc_data->end_handle) {
-			free(chrc_data);
-			continue;
-		}
-
-		desc_start = chrc_data->value_handle + 1;
-
-		if (desc_start == chrc_data->end_handle &&
-			(chrc_data->properties & BT_GATT_CHRC_PROP_NOTIFY ||
-			 chrc_data->properties & BT_GATT_CHRC_PROP_INDICATE)) {
-			bt_uuid_t ccc_uuid;
-
-			/* If there is only one descriptor that must be the CCC
-			 * in case either notify or indicate are supported.
-			 */
-			bt_uuid16_create(&ccc_uuid,
-					GATT_CLIENT_CHARAC_CFG_UUID);
-			attr = gatt_db_insert_descriptor(client->db, desc_start,
-							&ccc_uuid, 0, NULL,
-							NULL, NULL);
-			if (attr) {
-				free(chrc_data);
-				continue;
-			}
-		}
-
-		/* Check if the start range is within characteristic range */
-		if (desc_start > chrc_data->end_handle) {
+		if (!ret) {
 			free(chrc_data);
 			continue;
 		}
 
 		client->discovery_req = bt_gatt_discover_descriptors(
-							client->att, desc_start,
-							chrc_data->end_handle,
-							discover_descs_cb,
-							discovery_op_ref(op),
-							discovery_op_unref);
+						client->att,
+						chrc_data->value_handle + 1,
+						chrc_data->end_handle,
+						discover_descs_cb,
+						discovery_op_ref(op),
+						discovery_op_unref);
 		if (client->discovery_req) {
 			*discovering = true;
 			goto done;
@@ -872,6 +1055,8 @@ static bool read_ext_prop_desc(struct discovery_op *op)
 	return true;
 }
 
+static void discovery_parallel_complete(struct discovery_op *op);
+
 static void ext_prop_read_cb(bool success, uint8_t att_ecode,
 					const uint8_t *value, uint16_t length,
 					void *user_data)
@@ -898,6 +1083,11 @@ static void ext_prop_read_cb(bool success, uint8_t att_ecode,
 	if (read_ext_prop_desc(op))
 		return;
 
+	if (op->parallel) {
+		discovery_parallel_complete(op);
+		return;
+	}
+
 	if (!discover_descs(op, &discovering))
 			goto failed;
 
@@ -913,11 +1103,9 @@ done:
 	discovery_op_complete(op, success, att_ecode);
 }
 
-static void discover_descs_cb(bool success, uint8_t att_ecode,
-						struct bt_gatt_result *result,
-						void *user_data)
+static bool discovery_parse_descs(struct discovery_op *op,
+						struct bt_gatt_result *result)
 {
-	struct discovery_op *op = user_data;
 	struct bt_gatt_client *client = op->client;
 	struct bt_gatt_iter iter;
 	struct gatt_db_attribute *attr;
@@ -926,26 +1114,14 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 	bt_uuid_t uuid;
 	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int desc_count;
-	bool discovering;
 	bt_uuid_t ext_prop_uuid;
 
-	discovery_req_clear(client);
-
-	if (!success) {
-		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
-			success = true;
-			goto next;
-		}
-
-		goto done;
-	}
-
 	if (!result || !bt_gatt_iter_init(&iter, result))
-		goto failed;
+		return false;
 
 	desc_count = bt_gatt_result_descriptor_count(result);
 	if (desc_count == 0)
-		goto failed;
+		return false;
 
 	DBG(client, "Descriptors found: %u", desc_count);
 
@@ -970,16 +1146,41 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 
 			DBG(client, "Failed to insert descriptor at 0x%04x",
 				handle);
-			goto failed;
+			return false;
 		}
 
 		if (gatt_db_attribute_get_handle(attr) != handle)
-			goto failed;
+			return false;
 
 		if (!bt_uuid_cmp(&ext_prop_uuid, &uuid))
 			queue_push_tail(op->ext_prop_desc, attr);
 	}
 
+	return true;
+}
+
+static void discover_descs_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op = user_data;
+	struct bt_gatt_client *client = op->client;
+	bool discovering;
+
+	discovery_req_clear(client);
+
+	if (!success) {
+		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
+			success = true;
+			goto next;
+		}
+
+		goto done;
+	}
+
+	if (!discovery_parse_descs(op, result))
+		goto failed;
+
 	/* If we got extended prop descriptor, lets read it right away */
 	if (read_ext_prop_desc(op))
 		return;
@@ -1000,11 +1201,9 @@ done:
 	discovery_op_complete(op, success, att_ecode);
 }
 
-static void discover_chrcs_cb(bool success, uint8_t att_ecode,
-						struct bt_gatt_result *result,
-						void *user_data)
+static bool discovery_parse_chrcs(struct discovery_op *op,
+						struct bt_gatt_result *result)
 {
-	struct discovery_op *op = user_data;
 	struct bt_gatt_client *client = op->client;
 	struct bt_gatt_iter iter;
 	struct chrc *chrc_data;
@@ -1014,28 +1213,16 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 	bt_uuid_t uuid;
 	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int chrc_count;
-	bool discovering;
-
-	discovery_req_clear(client);
-
-	if (!success) {
-		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
-			success = true;
-			goto next;
-		}
-
-		goto done;
-	}
 
 	if (!result || !bt_gatt_iter_init(&iter, result))
-		goto failed;
+		return false;
 
 	chrc_count = bt_gatt_result_characteristic_count(result);
 
 	DBG(client, "Characteristics found: %u", chrc_count);
 
 	if (chrc_count == 0)
-		goto failed;
+		return false;
 
 	while (bt_gatt_iter_next_characteristic(&iter, &start, &end, &value,
 						&properties, u128.data)) {
@@ -1058,8 +1245,33 @@ static void discover_chrcs_cb(bool success, uint8_t att_ecode,
 		queue_push_tail(op->pending_chrcs, chrc_data);
 	}
 
-next:
-	/*
+	return true;
+}
+
+static void discover_chrcs_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op = user_data;
+	struct bt_gatt_client *client = op->client;
+	bool discovering;
+
+	discovery_req_clear(client);
+
+	if (!success) {
+		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
+			success = true;
+			goto next;
+		}
+
+		goto done;
+	}
+
+	if (!discovery_parse_chrcs(op, result))
+		goto failed;
+
+next:
+	/*
 	 * Before attempting to process discovered characteristics make sure we
 	 * discovered all missing ranges.
 	 */
@@ -1230,6 +1442,327 @@ static bool discovery_parse_services(struct discovery_op *op, bool primary,
 	return true;
 }
 
+typedef struct bt_gatt_request *(*discovery_send_func_t)(struct bt_att *att,
+					uint16_t start, uint16_t end,
+					bt_gatt_request_callback_t callback,
+					void *user_data,
+					bt_gatt_destroy_func_t destroy);
+
+struct discovery_req {
+	struct discovery_op *op;
+	struct bt_gatt_request *req;
+	uint16_t start;
+	uint16_t end;
+};
+
+static void discovery_req_free(void *data)
+{
+	struct discovery_req *dreq = data;
+
+	discovery_op_unref(dreq->op);
+	free(dreq);
+}
+
+static bool discovery_parallel_send(struct discovery_op *op,
+					discovery_send_func_t send,
+					bt_gatt_request_callback_t callback,
+					uint16_t start, uint16_t end)
+{
+	struct bt_gatt_client *client = op->client;
+	struct discovery_req *dreq;
+
+	dreq = new0(struct discovery_req, 1);
+	dreq->op = discovery_op_ref(op);
+	dreq->start = start;
+	dreq->end = end;
+
+	dreq->req = send(client->att, start, end, callback, dreq,
+							discovery_req_free);
+	if (!dreq->req) {
+		DBG(client, "Failed to start discovery 0x%04x-0x%04x",
+								start, end);
+		discovery_req_free(dreq);
+		return false;
+	}
+
+	queue_push_tail(client->discovery_reqs, dreq->req);
+	op->parallel_pending++;
+
+	return true;
+}
+
+/* Called on every response, returns the operation the request belonged to */
+static struct discovery_op *discovery_parallel_done(struct discovery_req *dreq,
+							bool success,
+							uint8_t att_ecode)
+{
+	struct discovery_op *op = dreq->op;
+	struct bt_gatt_client *client = op->client;
+
+	if (queue_remove(client->discovery_reqs, dreq->req))
+		bt_gatt_request_unref(dreq->req);
+
+	op->parallel_pending--;
+
+	if (!success && !op->parallel_failed) {
+		op->parallel_failed = true;
+		op->parallel_ecode = att_ecode;
+	}
+
+	return op;
+}
+
+static void discovery_parallel_complete(struct discovery_op *op)
+{
+	struct gatt_db_attribute *svc;
+
+	/*
+	 * Services are only activated once all of their attributes are in
+	 * place, in handle order.
+	 */
+	while ((svc = queue_pop_head(op->parallel_svcs))) {
+		if (queue_remove(op->pending_svcs, svc))
+			gatt_db_service_set_active(svc, true);
+	}
+
+	discovery_op_complete(op, true, 0);
+}
+
+static void parallel_descs_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data);
+
+static bool match_chrc_in_service(const void *data, const void *match_data)
+{
+	const struct chrc *chrc_data = data;
+	struct gatt_db_attribute *svc = (void *) match_data;
+	uint16_t start, end;
+
+	gatt_db_attribute_get_service_handles(svc, &start, &end);
+
+	return chrc_data->value_handle > start &&
+					chrc_data->value_handle <= end;
+}
+
+static bool service_has_no_chrcs(const void *data, const void *user_data)
+{
+	const struct discovery_op *op = user_data;
+
+	return !queue_find(op->pending_chrcs, match_chrc_in_service, data);
+}
+
+/*
+ * Inserts all discovered characteristics at once, now that every service
+ * has been walked, and queues the ranges where descriptors may be found.
+ */
+static bool discovery_parallel_chrcs(struct discovery_op *op)
+{
+	struct bt_gatt_client *client = op->client;
+	struct chrc *chrc_data;
+
+	/* Services without characteristics are left pending as before */
+	queue_remove_all(op->parallel_svcs, service_has_no_chrcs, op, NULL);
+
+	while ((chrc_data = queue_pop_head(op->pending_chrcs))) {
+		struct gatt_db_attribute *svc;
+		int ret;
+
+		svc = gatt_db_get_service(client->db, chrc_data->value_handle);
+
+		ret = discovery_insert_chrc(op, svc, chrc_data);
+		if (ret < 0) {
+			free(chrc_data);
+			return false;
+		}
+
+		if (ret)
+			queue_push_tail(op->discov_ranges,
+					range_new(chrc_data->value_handle + 1,
+						chrc_data->end_handle));
+
+		free(chrc_data);
+	}
+
+	op->parallel_descs = true;
+
+	return true;
+}
+
+static void parallel_incl_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data);
+
+static void discovery_parallel_next(struct discovery_op *op)
+{
+	struct bt_gatt_client *client = op->client;
+	unsigned int window = bt_att_get_channels(client->att);
+	struct handle_range *range;
+
+again:
+	/* Keep at most one request per bearer in flight */
+	while (!op->parallel_failed && op->parallel_pending < window) {
+		bool sent;
+
+		range = queue_pop_head(op->discov_ranges);
+		if (!range)
+			break;
+
+		if (op->parallel_descs)
+			sent = discovery_parallel_send(op,
+						bt_gatt_discover_descriptors,
+						parallel_descs_cb,
+						range->start, range->end);
+		else
+			sent = discovery_parallel_send(op,
+					bt_gatt_discover_included_services,
+					parallel_incl_cb,
+					range->start, range->end);
+
+		free(range);
+
+		if (!sent)
+			op->parallel_failed = true;
+	}
+
+	if (op->parallel_pending)
+		return;
+
+	if (op->parallel_failed) {
+		discovery_op_complete(op, false, op->parallel_ecode);
+		return;
+	}
+
+	if (!op->parallel_descs) {
+		if (!discovery_parallel_chrcs(op)) {
+			discovery_op_complete(op, false, 0);
+			return;
+		}
+
+		goto again;
+	}
+
+	/* If we got extended prop descriptors, read them before completing */
+	if (read_ext_prop_desc(op))
+		return;
+
+	discovery_parallel_complete(op);
+}
+
+static void parallel_chrcs_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op;
+
+	if (!success && att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
+		success = true;
+		result = NULL;
+	}
+
+	op = discovery_parallel_done(user_data, success, att_ecode);
+
+	if (result && !discovery_parse_chrcs(op, result))
+		op->parallel_failed = true;
+
+	discovery_parallel_next(op);
+}
+
+static void parallel_incl_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_req *dreq = user_data;
+	struct discovery_op *op;
+
+	if (!success && att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
+		success = true;
+		result = NULL;
+	}
+
+	op = discovery_parallel_done(dreq, success, att_ecode);
+
+	if (result && !discovery_parse_included(op, result))
+		op->parallel_failed = true;
+
+	/* Characteristics of the same service take over the slot */
+	if (!op->parallel_failed &&
+			!discovery_parallel_send(op,
+					bt_gatt_discover_characteristics,
+					parallel_chrcs_cb,
+					dreq->start, dreq->end))
+		op->parallel_failed = true;
+
+	discovery_parallel_next(op);
+}
+
+static void parallel_descs_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op;
+
+	if (!success && att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
+		success = true;
+		result = NULL;
+	}
+
+	op = discovery_parallel_done(user_data, success, att_ecode);
+
+	if (result && !discovery_parse_descs(op, result))
+		op->parallel_failed = true;
+
+	discovery_parallel_next(op);
+}
+
+static bool discover_parallel(struct discovery_op *op)
+{
+	struct queue *ranges;
+	const struct queue_entry *entry;
+
+	ranges = queue_new();
+	op->parallel_svcs = queue_new();
+
+	for (entry = queue_get_entries(op->pending_svcs); entry;
+							entry = entry->next) {
+		struct gatt_db_attribute *svc = entry->data;
+		struct handle_range match_range;
+
+		gatt_db_attribute_get_service_handles(svc, &match_range.start,
+							&match_range.end);
+
+		if (match_range.start == match_range.end)
+			continue;
+
+		/* Only walk services that are still to be discovered */
+		if (!queue_find(op->discov_ranges, match_handle_range,
+								&match_range))
+			continue;
+
+		queue_push_tail(ranges, range_new(match_range.start,
+							match_range.end));
+		queue_push_tail(op->parallel_svcs, svc);
+	}
+
+	if (queue_isempty(ranges)) {
+		queue_destroy(ranges, NULL);
+		queue_destroy(op->parallel_svcs, NULL);
+		op->parallel_svcs = NULL;
+		return false;
+	}
+
+	DBG(op->client, "Discovering %u services over %d channels",
+					queue_length(ranges),
+					bt_att_get_channels(op->client->att));
+
+	queue_destroy(op->discov_ranges, free);
+	op->discov_ranges = ranges;
+	op->parallel = true;
+
+	discovery_parallel_next(op);
+
+	return true;
+}
+
 static void discover_secondary_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data)
@@ -1278,6 +1811,13 @@ next:
 	if (op->svc_last < 0xffff)
 		remove_discov_range(op, op->svc_last + 1, 0xffff);
 
+	/*
+	 * With more than one bearer available (EATT) discover each service
+	 * on its own so the requests can be spread across the channels.
+	 */
+	if (bt_att_get_channels(client->att) > 1 && discover_parallel(op))
+		return;
+
 	range = queue_peek_head(op->discov_ranges);
 
 	if (range)
@@ -1375,6 +1915,38 @@ static void ready_destroy(void *data)
 	free(ready);
 }
 
+static void complete_notify_request(void *data);
+static bool notify_data_write_ccc(struct notify_data *notify_data, bool enable,
+					bt_gatt_client_callback_t callback);
+static void enable_ccc_callback(bool success, uint8_t att_ecode,
+						void *user_data);
+
+static void ccc_restore_complete(void *data, void *user_data)
+{
+	struct notify_chrc *chrc = data;
+	struct bt_gatt_client *client = user_data;
+	struct notify_data *notify_data;
+
+	if (!chrc->ccc_restore)
+		return;
+
+	chrc->ccc_restore = false;
+
+	if (client->db_unchanged) {
+		DBG(client, "CCC 0x%04x restored", chrc->ccc_handle);
+		queue_remove_all(chrc->reg_notify_queue, NULL, NULL,
+						complete_notify_request);
+		return;
+	}
+
+	/* The cache could not be verified, write the CCC after all */
+	while ((notify_data = queue_pop_head(chrc->reg_notify_queue))) {
+		if (notify_data_write_ccc(notify_data, true,
+						enable_ccc_callback))
+			return;
+	}
+}
+
 static void notify_client_ready(struct bt_gatt_client *client, bool success,
 							uint8_t att_ecode)
 {
@@ -1392,6 +1964,8 @@ static void notify_client_ready(struct bt_gatt_client *client, bool success,
 	if (client->parent)
 		client->features = client->parent->features;
 
+	queue_foreach(client->notify_chrcs, ccc_restore_complete, client);
+
 	for (entry = queue_get_entries(client->ready_cbs); entry;
 							entry = entry->next) {
 		struct ready_cb *ready = entry->data;
@@ -1453,35 +2027,152 @@ static void db_hash_read_value_cb(struct gatt_db_attribute *attrib,
 	*hash = value;
 }
 
-static void db_hash_read_cb(bool success, uint8_t att_ecode,
-						struct bt_gatt_result *result,
-						void *user_data)
+/*
+ * Device Information Service characteristics, the only ones defined to be
+ * fixed for the device. Properties can't be used instead: being read-only
+ * says nothing about e.g. sensor readings, and DIS values may be writable
+ * on the peer for provisioning.
+ */
+static const uint16_t static_chrcs[] = {
+	0x2a23,		/* System ID */
+	0x2a24,		/* Model Number String */
+	0x2a25,		/* Serial Number String */
+	0x2a26,		/* Firmware Revision String */
+	0x2a27,		/* Hardware Revision String */
+	0x2a28,		/* Software Revision String */
+	0x2a29,		/* Manufacturer Name String */
+	0x2a2a,		/* IEEE 11073-20601 Regulatory Certification */
+	0x2a50,		/* PnP ID */
+};
+
+bool bt_gatt_client_is_static_value(struct gatt_db_attribute *attr)
 {
-	struct discovery_op *op = user_data;
-	struct bt_gatt_client *client = op->client;
-	const uint8_t *hash = NULL, *value;
-	uint16_t len, handle;
-	struct bt_gatt_iter iter;
+	uint16_t handle;
+	uint8_t properties;
+	bt_uuid_t uuid, static_uuid;
+	size_t i;
 
-	if (!success)
-		goto discover;
+	if (!gatt_db_attribute_get_char_data(attr, NULL, &handle, &properties,
+								NULL, &uuid))
+		return false;
 
-	bt_gatt_iter_init(&iter, result);
-	bt_gatt_iter_next_read_by_type(&iter, &handle, &len, &value);
+	if (handle != gatt_db_attribute_get_handle(attr) ||
+				!(properties & BT_GATT_CHRC_PROP_READ))
+		return false;
 
-	DBG(client, "DB Hash found: handle 0x%04x length 0x%04x",
-							handle, len);
+	/* Discovered UUIDs are stored in their 128-bit form */
+	for (i = 0; i < ARRAY_SIZE(static_chrcs); i++) {
+		bt_uuid16_create(&static_uuid, static_chrcs[i]);
+		if (!bt_uuid_cmp(&uuid, &static_uuid))
+			return true;
+	}
 
-	if (len != 16)
-		goto discover;
+	return false;
+}
 
-	/* Read stored value in the db */
-	gatt_db_attribute_read(op->hash, 0, BT_ATT_OP_READ_REQ, NULL,
-					db_hash_read_value_cb, &hash);
+static struct gatt_db_attribute *static_value_attr(struct gatt_db *db,
+							uint16_t value_handle)
+{
+	struct gatt_db_attribute *attr;
 
-	/* Check if the has has changed since last time */
-	if (hash && !memcmp(hash, value, len)) {
-		DBG(client, "DB Hash match: skipping discovery");
+	attr = gatt_db_get_attribute(db, value_handle);
+	if (!attr || !bt_gatt_client_is_static_value(attr))
+		return NULL;
+
+	return attr;
+}
+
+struct cached_value {
+	const uint8_t *value;
+	uint16_t length;
+};
+
+static void cached_value_cb(struct gatt_db_attribute *attrib, int err,
+				const uint8_t *value, size_t length,
+				void *user_data)
+{
+	struct cached_value *cached = user_data;
+
+	if (err)
+		return;
+
+	cached->value = value;
+	cached->length = length;
+}
+
+static void cache_value(struct bt_gatt_client *client, uint16_t value_handle,
+				const uint8_t *value, uint16_t length)
+{
+	struct gatt_db_attribute *attr;
+	struct cached_value cached = { NULL, 0 };
+
+	if (!length)
+		return;
+
+	attr = static_value_attr(client->db, value_handle);
+	if (!attr)
+		return;
+
+	gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+					cached_value_cb, &cached);
+	if (cached.length == length && !memcmp(cached.value, value, length))
+		return;
+
+	gatt_db_attribute_reset(attr);
+	gatt_db_attribute_write(attr, 0, value, length, 0, NULL, NULL, NULL);
+	client->cache_dirty = true;
+}
+
+static void cached_values_reset_chrc(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct gatt_db *db = user_data;
+	uint16_t value_handle;
+
+	if (!gatt_db_attribute_get_char_data(attr, NULL, &value_handle, NULL,
+								NULL, NULL))
+		return;
+
+	gatt_db_attribute_reset(static_value_attr(db, value_handle));
+}
+
+static void cached_values_reset_svc(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	gatt_db_service_foreach_char(attr, cached_values_reset_chrc,
+								user_data);
+}
+
+static void db_hash_read_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op = user_data;
+	struct bt_gatt_client *client = op->client;
+	const uint8_t *hash = NULL, *value;
+	uint16_t len, handle;
+	struct bt_gatt_iter iter;
+
+	if (!success)
+		goto discover;
+
+	bt_gatt_iter_init(&iter, result);
+	bt_gatt_iter_next_read_by_type(&iter, &handle, &len, &value);
+
+	DBG(client, "DB Hash found: handle 0x%04x length 0x%04x",
+							handle, len);
+
+	if (len != 16)
+		goto discover;
+
+	/* Read stored value in the db */
+	gatt_db_attribute_read(op->hash, 0, BT_ATT_OP_READ_REQ, NULL,
+					db_hash_read_value_cb, &hash);
+
+	/* Check if the has has changed since last time */
+	if (hash && !memcmp(hash, value, len)) {
+		DBG(client, "DB Hash match: skipping discovery");
+		client->db_unchanged = true;
 		queue_remove_all(op->pending_svcs, NULL, NULL, NULL);
 		discovery_op_complete(op, true, 0);
 		return;
@@ -1492,6 +2183,13 @@ static void db_hash_read_cb(bool success, uint8_t att_ecode,
 	util_hexdump(' ', value, len, client->debug_callback,
 						client->debug_data);
 
+	/* Cached values belong to the previous database */
+	if (hash) {
+		gatt_db_foreach_service(client->db, NULL,
+					cached_values_reset_svc, client->db);
+		client->cache_dirty = true;
+	}
+
 	/* Store ithe new hash in the db */
 	gatt_db_attribute_write(op->hash, 0, value, len, 0, NULL,
 					db_hash_write_value_cb, client);
@@ -1516,6 +2214,81 @@ static void get_first_attribute(struct gatt_db_attribute *attrib,
 	*stored = attrib;
 }
 
+static void db_hash_lookup_cb(bool success, uint8_t att_ecode,
+						struct bt_gatt_result *result,
+						void *user_data)
+{
+	struct discovery_op *op = user_data;
+	struct bt_gatt_client *client = op->client;
+	struct gatt_db *template;
+	const uint8_t *value;
+	uint16_t len, handle;
+	struct bt_gatt_iter iter;
+	bt_uuid_t uuid;
+
+	if (!success || !result || !bt_gatt_iter_init(&iter, result))
+		goto discover;
+
+	if (!bt_gatt_iter_next_read_by_type(&iter, &handle, &len, &value) ||
+								len != 16)
+		goto discover;
+
+	DBG(client, "DB Hash found: handle 0x%04x length 0x%04x",
+							handle, len);
+
+	template = client->db_lookup(value, client->db_lookup_data);
+	if (!template || !gatt_db_import(client->db, template))
+		goto discover;
+
+	DBG(client, "DB Hash template match: skipping discovery");
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+	gatt_db_find_by_type(client->db, 0x0001, 0xffff, &uuid,
+						get_first_attribute, &op->hash);
+	if (op->hash)
+		gatt_db_attribute_write(op->hash, 0, value, len, 0, NULL,
+					db_hash_write_value_cb, client);
+
+	/* The template covers the whole range so nothing is left to clear */
+	op->last = UINT16_MAX;
+	queue_remove_all(op->pending_svcs, NULL, NULL, NULL);
+	discovery_op_complete(op, true, 0);
+	return;
+
+discover:
+	if (!op->success) {
+		discover_all(op);
+		return;
+	}
+
+	discovery_op_complete(op, true, 0);
+}
+
+static bool lookup_db_hash(struct discovery_op *op)
+{
+	struct bt_gatt_client *client = op->client;
+	bt_uuid_t uuid;
+
+	/* Templates can only be used when nothing has been discovered yet */
+	if (!client->db_lookup || op->hash_lookup ||
+					!gatt_db_isempty(client->db))
+		return false;
+
+	op->hash_lookup = true;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+
+	if (!bt_gatt_read_by_type(client->att, 0x0001, 0xffff, &uuid,
+							db_hash_lookup_cb,
+							discovery_op_ref(op),
+							discovery_op_unref)) {
+		discovery_op_unref(op);
+		return false;
+	}
+
+	return true;
+}
+
 static bool read_db_hash(struct discovery_op *op)
 {
 	struct bt_gatt_client *client = op->client;
@@ -1531,7 +2304,7 @@ static bool read_db_hash(struct discovery_op *op)
 	gatt_db_find_by_type(client->db, 0x0001, 0xffff, &uuid,
 						get_first_attribute, &op->hash);
 	if (!op->hash)
-		return false;
+		return lookup_db_hash(op);
 
 	if (!bt_gatt_read_by_type(client->att, 0x0001, 0xffff, &uuid,
 							db_hash_read_cb,
@@ -1657,6 +2430,59 @@ static void process_service_changed(struct bt_gatt_client *client,
 static void service_changed_cb(uint16_t value_handle, const uint8_t *value,
 					uint16_t length, void *user_data);
 
+static void ccc_value_cb(struct gatt_db_attribute *attrib, int err,
+				const uint8_t *value, size_t length,
+				void *user_data)
+{
+	uint16_t *ccc = user_data;
+
+	if (!err && length == sizeof(*ccc))
+		*ccc = get_le16(value);
+}
+
+/* Returns the CCC value last written to the server as stored in the db */
+static uint16_t ccc_cached_value(struct notify_chrc *chrc)
+{
+	struct gatt_db_attribute *attr;
+	uint16_t ccc = 0x0000;
+
+	attr = gatt_db_get_attribute(chrc->client->db, chrc->ccc_handle);
+	if (attr)
+		gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+							ccc_value_cb, &ccc);
+
+	return ccc;
+}
+
+static void ccc_cache_store(struct notify_chrc *chrc, uint16_t value)
+{
+	struct gatt_db_attribute *attr;
+	uint8_t pdu[2];
+
+	attr = gatt_db_get_attribute(chrc->client->db, chrc->ccc_handle);
+	if (!attr || ccc_cached_value(chrc) == value)
+		return;
+
+	chrc->client->cache_dirty = true;
+
+	put_le16(value, pdu);
+	gatt_db_attribute_write(attr, 0, pdu, sizeof(pdu), 0, NULL, NULL,
+									NULL);
+}
+
+static uint16_t notify_chrc_ccc_value(struct notify_chrc *chrc)
+{
+	/* Try to enable notifications or indications based on whatever the
+	 * characteristic supports.
+	 */
+	if (chrc->properties & BT_GATT_CHRC_PROP_NOTIFY)
+		return 0x0001;
+	else if (chrc->properties & BT_GATT_CHRC_PROP_INDICATE)
+		return 0x0002;
+
+	return 0x0000;
+}
+
 static void complete_notify_request(void *data)
 {
 	struct notify_data *notify_data = data;
@@ -1673,19 +2499,12 @@ static bool notify_data_write_ccc(struct notify_data *notify_data, bool enable,
 {
 	unsigned int att_id;
 	uint16_t value = 0x0000;
-	uint16_t properties = notify_data->chrc->properties;
 
 	assert(notify_data->chrc->ccc_handle);
 
 	if (enable) {
-		/* Try to enable notifications or indications based on
-		 * whatever the characteristic supports.
-		 */
-		if (properties & BT_GATT_CHRC_PROP_NOTIFY)
-			value = cpu_to_le16(0x0001);
-		else if (properties & BT_GATT_CHRC_PROP_INDICATE)
-			value = cpu_to_le16(0x0002);
-		else
+		value = cpu_to_le16(notify_chrc_ccc_value(notify_data->chrc));
+		if (!value)
 			return false;
 	}
 
@@ -1738,6 +2557,10 @@ static void enable_ccc_callback(bool success, uint8_t att_ecode,
 
 	notify_data->att_ecode = att_ecode;
 
+	if (success)
+		ccc_cache_store(notify_data->chrc,
+				notify_chrc_ccc_value(notify_data->chrc));
+
 	/* Notify for all remaining requests. */
 	complete_notify_request(notify_data);
 	queue_remove_all(notify_data->chrc->reg_notify_queue, notify_set_ecode,
@@ -1747,14 +2570,6 @@ static void enable_ccc_callback(bool success, uint8_t att_ecode,
 	bt_gatt_client_unref(notify_data->client);
 }
 
-static bool match_notify_chrc_value_handle(const void *a, const void *b)
-{
-	const struct notify_chrc *chrc = a;
-	uint16_t value_handle = PTR_TO_UINT(b);
-
-	return chrc->value_handle == value_handle;
-}
-
 static unsigned int register_notify(struct bt_gatt_client *client,
 				uint16_t handle,
 				bt_gatt_client_register_callback_t callback,
@@ -1766,8 +2581,7 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 	struct notify_chrc *chrc = NULL;
 
 	/* Check if a characteristic ref count has been started already */
-	chrc = queue_find(client->notify_chrcs, match_notify_chrc_value_handle,
-						UINT_TO_PTR(handle));
+	chrc = notify_index_lookup(client, handle);
 
 	if (!chrc) {
 		/*
@@ -1797,6 +2611,7 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 
 	/* Add the handler to the bt_gatt_client's general list */
 	queue_push_tail(client->notify_list, notify_data);
+	queue_push_tail(chrc->notify_list, notify_data);
 
 	/* Assign an ID to the handler. */
 	if (client->next_reg_id < 1)
@@ -1811,7 +2626,7 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 	 * If a write to the CCC descriptor is in progress, then queue this
 	 * request.
 	 */
-	if (chrc->ccc_write_id) {
+	if (chrc->ccc_write_id || chrc->ccc_restore) {
 		queue_push_tail(chrc->reg_notify_queue, notify_data);
 		return notify_data->id;
 	}
@@ -1825,9 +2640,29 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 		return notify_data->id;
 	}
 
+	/*
+	 * A bonded server keeps the CCC states across connections, so if the
+	 * state stored in the cache is already the one wanted hold the request
+	 * until the DB Hash tells whether the cache can be trusted.
+	 */
+	if (client->ccc_restore && ccc_cached_value(chrc) &&
+			ccc_cached_value(chrc) == notify_chrc_ccc_value(chrc)) {
+		if (client->ready && client->db_unchanged) {
+			complete_notify_request(notify_data);
+			return notify_data->id;
+		}
+
+		if (!client->ready) {
+			chrc->ccc_restore = true;
+			queue_push_tail(chrc->reg_notify_queue, notify_data);
+			return notify_data->id;
+		}
+	}
+
 	/* Write to the CCC descriptor */
 	if (!notify_data_write_ccc(notify_data, true, enable_ccc_callback)) {
 		queue_remove(client->notify_list, notify_data);
+		queue_remove(chrc->notify_list, notify_data);
 		free(notify_data);
 		return 0;
 	}
@@ -2187,6 +3022,9 @@ static void disable_ccc_callback(bool success, uint8_t att_ecode,
 
 	notify_data->chrc->ccc_write_id = 0;
 
+	if (success)
+		ccc_cache_store(notify_data->chrc, 0x0000);
+
 	/* This is a best effort procedure, so ignore errors and process any
 	 * queued requests.
 	 */
@@ -2227,9 +3065,6 @@ static void notify_handler(void *data, void *user_data)
 	struct notify_data *notify_data = data;
 	struct value_data *value_data = user_data;
 
-	if (notify_data->chrc->value_handle != value_data->handle)
-		return;
-
 	/*
 	 * Even if the notify data has a pending ATT request to write to the
 	 * CCC, there is really no reason not to notify the handlers.
@@ -2239,6 +3074,18 @@ static void notify_handler(void *data, void *user_data)
 				value_data->len, notify_data->user_data);
 }
 
+static void notify_dispatch(struct bt_gatt_client *client,
+						struct value_data *data)
+{
+	struct notify_chrc *chrc;
+
+	chrc = notify_index_lookup(client, data->handle);
+	if (!chrc)
+		return;
+
+	queue_foreach(chrc->notify_list, notify_handler, data);
+}
+
 static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 					const void *pdu, uint16_t length,
 					void *user_data)
@@ -2254,6 +3101,7 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 	memset(&data, 0, sizeof(data));
 
 	if (opcode == BT_ATT_OP_HANDLE_NFY_MULT) {
+		/* Each tuple is handed out in place, straight from the PDU */
 		while (length >= 4) {
 			data.handle = get_le16(pdu);
 			length -= 2;
@@ -2268,13 +3116,12 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 
 			data.data = pdu;
 
-			queue_foreach(client->notify_list, notify_handler,
-								&data);
+			notify_dispatch(client, &data);
 
 			length -= data.len;
 			pdu += data.len;
 		}
-	} else {
+	} else if (length >= 2) {
 		data.handle = get_le16(pdu);
 		length -= 2;
 		pdu += 2;
@@ -2282,7 +3129,7 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 		data.len = length;
 		data.data = pdu;
 
-		queue_foreach(client->notify_list, notify_handler, &data);
+		notify_dispatch(client, &data);
 	}
 
 done:
@@ -2299,6 +3146,7 @@ static void bt_gatt_client_free(struct bt_gatt_client *client)
 
 	queue_destroy(client->notify_chrcs, notify_chrc_free);
 	queue_destroy(client->notify_list, notify_data_cleanup);
+	notify_index_free(client);
 
 	queue_destroy(client->ready_cbs, ready_destroy);
 	queue_destroy(client->idle_cbs, idle_destroy);
@@ -2306,6 +3154,9 @@ static void bt_gatt_client_free(struct bt_gatt_client *client)
 	if (client->debug_destroy)
 		client->debug_destroy(client->debug_data);
 
+	if (client->db_lookup_destroy)
+		client->db_lookup_destroy(client->db_lookup_data);
+
 	if (client->att) {
 		bt_att_unregister_disconnect(client->att, client->disc_id);
 		bt_att_unregister(client->att, client->nfy_id);
@@ -2320,6 +3171,7 @@ static void bt_gatt_client_free(struct bt_gatt_client *client)
 	queue_destroy(client->svc_chngd_queue, free);
 	queue_destroy(client->long_write_queue, request_unref);
 	queue_destroy(client->pending_requests, request_unref);
+	queue_destroy(client->discovery_reqs, NULL);
 
 	if (client->parent) {
 		queue_remove(client->parent->clones, client);
@@ -2516,6 +3368,7 @@ static struct bt_gatt_client *gatt_client_new(struct gatt_db *db,
 	client->notify_list = queue_new();
 	client->notify_chrcs = queue_new();
 	client->pending_requests = queue_new();
+	client->discovery_reqs = queue_new();
 
 	client->nfy_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY,
 						notify_cb, client, NULL);
@@ -2686,6 +3539,24 @@ bool bt_gatt_client_set_debug(struct bt_gatt_client *client,
 	return true;
 }
 
+bool bt_gatt_client_set_db_lookup(struct bt_gatt_client *client,
+				bt_gatt_client_db_lookup_func_t callback,
+				void *user_data,
+				bt_gatt_client_destroy_func_t destroy)
+{
+	if (!client)
+		return false;
+
+	if (client->db_lookup_destroy)
+		client->db_lookup_destroy(client->db_lookup_data);
+
+	client->db_lookup = callback;
+	client->db_lookup_destroy = destroy;
+	client->db_lookup_data = user_data;
+
+	return true;
+}
+
 uint16_t bt_gatt_client_get_mtu(struct bt_gatt_client *client)
 {
 	if (!client || !client->att)
@@ -2778,12 +3649,31 @@ static bool cancel_prep_write_session(struct bt_gatt_client *client,
 							req, request_unref);
 }
 
+static bool read_batch_cancel(struct request *req);
+
 static bool cancel_request(struct request *req)
 {
 	req->removed = true;
 
-	if (req->long_write)
-		return cancel_long_write_req(req->client, req);
+	if (req->batch)
+		return read_batch_cancel(req);
+
+	if (req->long_write) {
+		bool ret;
+
+		/* Cancelling the parts may drop the last reference */
+		request_ref(req);
+		cancel_blobs(req);
+		ret = cancel_long_write_req(req->client, req);
+		request_unref(req);
+
+		return ret;
+	}
+
+	if (req->blobs) {
+		cancel_blobs(req);
+		return true;
+	}
 
 	if (req->prep_write)
 		return cancel_prep_write_session(req->client, req);
@@ -2811,9 +3701,24 @@ static void cancel_pending(void *data)
 	cancel_request(data);
 }
 
+static void cancel_discovery_req(void *data)
+{
+	struct bt_gatt_request *req = data;
+
+	bt_gatt_request_cancel(req);
+	bt_gatt_request_unref(req);
+}
+
+static void read_batch_abort(struct bt_gatt_client *client);
+
 bool bt_gatt_client_cancel_all(struct bt_gatt_client *client)
 {
-	if (!client || !client->att)
+	if (!client)
+		return false;
+
+	read_batch_abort(client);
+
+	if (!client->att)
 		return false;
 
 	queue_remove_all(client->pending_requests, NULL, NULL, cancel_pending);
@@ -2824,6 +3729,9 @@ bool bt_gatt_client_cancel_all(struct bt_gatt_client *client)
 		client->discovery_req = NULL;
 	}
 
+	queue_remove_all(client->discovery_reqs, NULL, NULL,
+						cancel_discovery_req);
+
 	if (client->mtu_req_id)
 		bt_att_cancel(client->att, client->mtu_req_id);
 
@@ -2931,148 +3839,656 @@ unsigned int bt_gatt_client_read_multiple(struct bt_gatt_client *client,
 	if (num_handles < 2)
 		return 0;
 
-	if (num_handles * 2 > bt_att_get_mtu(client->att) - 1)
-		return 0;
+	if (num_handles * 2 > bt_att_get_mtu(client->att) - 1)
+		return 0;
+
+	op = new0(struct read_op, 1);
+
+	req = request_create(client);
+	if (!req) {
+		free(op);
+		return 0;
+	}
+
+	op->callback = callback;
+	op->user_data = user_data;
+	op->destroy = destroy;
+
+	req->data = op;
+	req->destroy = destroy_read_op;
+
+	for (i = 0; i < num_handles; i++)
+		put_le16(handles[i], pdu + (2 * i));
+
+	opcode = bt_gatt_client_get_features(client) &
+		BT_GATT_CHRC_CLI_FEAT_EATT ? BT_ATT_OP_READ_MULT_VL_REQ :
+		BT_ATT_OP_READ_MULT_REQ;
+
+	req->att_id = bt_att_send(client->att, opcode, pdu, num_handles * 2,
+							read_multiple_cb, req,
+							request_unref);
+	if (!req->att_id) {
+		op->destroy = NULL;
+		request_unref(req);
+		return 0;
+	}
+
+	return req->id;
+}
+
+struct read_long_op {
+	struct bt_gatt_client *client;
+	int ref_count;
+	uint16_t value_handle;
+	uint16_t offset;
+	struct iovec iov;
+	uint16_t chunk;
+	uint16_t next;
+	uint16_t end;
+	bool failed;
+	uint8_t att_ecode;
+	bt_gatt_client_read_callback_t callback;
+	void *user_data;
+	bt_gatt_client_destroy_func_t destroy;
+};
+
+static void destroy_read_long_op(void *data)
+{
+	struct read_long_op *op = data;
+
+	if (op->destroy)
+		op->destroy(op->user_data);
+
+	free(op->iov.iov_base);
+	free(op);
+}
+
+static bool append_chunk(struct read_long_op *op, const uint8_t *data,
+								uint16_t len)
+{
+	void *buf;
+
+	/* Truncate if the data would exceed maximum length */
+	if (op->offset + len > BT_ATT_MAX_VALUE_LEN)
+		len = BT_ATT_MAX_VALUE_LEN - op->offset;
+
+	buf = realloc(op->iov.iov_base, op->iov.iov_len + len);
+	if (!buf)
+		return false;
+
+	op->iov.iov_base = buf;
+
+	memcpy(op->iov.iov_base + op->iov.iov_len, data, len);
+
+	op->iov.iov_len += len;
+	op->offset += len;
+
+	return true;
+}
+
+static bool read_blob_send(struct request *req);
+
+static void read_blob_cb(uint8_t opcode, const void *pdu, uint16_t length,
+								void *user_data)
+{
+	struct long_blob *blob = user_data;
+	struct request *req = blob->req;
+	struct read_long_op *op = req->data;
+	uint16_t base = op->offset - op->iov.iov_len;
+	uint16_t len;
+
+	queue_remove(req->blobs, blob);
+
+	if (opcode == BT_ATT_OP_ERROR_RSP) {
+		uint8_t ecode = process_error(pdu, length);
+
+		/* Part past the end of the value */
+		if (ecode == BT_ATT_ERROR_INVALID_OFFSET) {
+			op->end = MIN(op->end, blob->offset);
+			goto next;
+		}
+
+		op->failed = true;
+		op->att_ecode = ecode;
+		goto next;
+	}
+
+	if (opcode != BT_ATT_OP_READ_BLOB_RSP || (!pdu && length)) {
+		op->failed = true;
+		goto next;
+	}
+
+	/* Parts land directly at their offset in the value buffer */
+	len = MIN(length, BT_ATT_MAX_VALUE_LEN - blob->offset);
+	memcpy(op->iov.iov_base + blob->offset - base, pdu, len);
+
+	/* A short part is the last one */
+	if (length < op->chunk)
+		op->end = MIN(op->end, blob->offset + len);
+
+next:
+	if (!op->failed && op->next < op->end)
+		read_blob_send(req);
+
+	if (!queue_isempty(req->blobs))
+		return;
+
+	if (!op->failed) {
+		op->iov.iov_len = op->end - base;
+
+		if (!base)
+			cache_value(op->client, op->value_handle,
+					op->iov.iov_base, op->iov.iov_len);
+	}
+
+	if (op->callback)
+		op->callback(!op->failed, op->att_ecode, op->iov.iov_base,
+					op->iov.iov_len, op->user_data);
+}
+
+static bool read_blob_send(struct request *req)
+{
+	struct read_long_op *op = req->data;
+	struct long_blob *blob;
+	uint8_t pdu[4];
+
+	put_le16(op->value_handle, pdu);
+	put_le16(op->next, pdu + 2);
+
+	blob = long_blob_send(req, BT_ATT_OP_READ_BLOB_REQ, pdu, sizeof(pdu),
+							read_blob_cb);
+	if (!blob)
+		return false;
+
+	blob->offset = op->next;
+	op->next += op->chunk;
+
+	return true;
+}
+
+/*
+ * Reads the rest of a long value with Read Blob requests for consecutive
+ * offsets spread over all bearers, instead of one request per round trip.
+ */
+static bool read_blobs_start(struct request *req)
+{
+	struct read_long_op *op = req->data;
+	struct bt_att *att = op->client->att;
+	int i, window;
+	void *buf;
+
+	window = long_blob_window(att, 1);
+	if (!window)
+		return false;
+
+	buf = realloc(op->iov.iov_base, BT_ATT_MAX_VALUE_LEN);
+	if (!buf)
+		return false;
+
+	op->iov.iov_base = buf;
+	op->chunk = bt_att_get_min_mtu(att) - 1;
+	op->next = op->offset;
+	op->end = BT_ATT_MAX_VALUE_LEN;
+
+	req->blobs = queue_new();
+
+	for (i = 0; i < window && op->next < op->end; i++) {
+		if (!read_blob_send(req))
+			break;
+	}
+
+	if (!queue_isempty(req->blobs))
+		return true;
+
+	queue_destroy(req->blobs, NULL);
+	req->blobs = NULL;
+
+	return false;
+}
+
+static void read_long_cb(uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct request *req = user_data;
+	struct read_long_op *op = req->data;
+	bool success;
+	uint8_t att_ecode = 0;
+
+	if (opcode == BT_ATT_OP_ERROR_RSP) {
+		success = false;
+		att_ecode = process_error(pdu, length);
+		goto done;
+	}
+
+	if ((!op->offset && opcode != BT_ATT_OP_READ_RSP)
+			|| (op->offset && opcode != BT_ATT_OP_READ_BLOB_RSP)
+			|| (!pdu && length)) {
+		success = false;
+		goto done;
+	}
+
+	if (!length)
+		goto success;
+
+	if (!append_chunk(op, pdu, length)) {
+		success = false;
+		goto done;
+	}
+
+	if (op->offset >= BT_ATT_MAX_VALUE_LEN)
+		goto success;
+
+	/*
+	 * The response may have come over the bearer with the smallest MTU so
+	 * that is what tells whether there could be more to read.
+	 */
+	if (length >= bt_att_get_min_mtu(op->client->att) - 1) {
+		uint8_t pdu[4];
+		int err;
+
+		if (read_blobs_start(req))
+			return;
+
+		put_le16(op->value_handle, pdu);
+		put_le16(op->offset, pdu + 2);
+
+		err = bt_att_resend(op->client->att, req->att_id,
+							BT_ATT_OP_READ_BLOB_REQ,
+							pdu, sizeof(pdu),
+							read_long_cb,
+							request_ref(req),
+							request_unref);
+		if (!err)
+			return;
+
+		request_unref(req);
+		success = false;
+		goto done;
+	}
+
+success:
+	success = true;
+
+	/* Only a value read from the start can be cached */
+	if (op->offset == op->iov.iov_len)
+		cache_value(op->client, op->value_handle, op->iov.iov_base,
+							op->iov.iov_len);
+
+done:
+	if (op->callback)
+		op->callback(success, att_ecode, op->iov.iov_base,
+						op->iov.iov_len, op->user_data);
+}
+
+static bool read_long_send(struct request *req)
+{
+	struct read_long_op *op = req->data;
+	uint8_t att_op;
+	uint8_t pdu[4];
+	uint16_t pdu_len;
+
+	put_le16(op->value_handle, pdu);
+	pdu_len = sizeof(op->value_handle);
+
+	/*
+	 * Core v4.2, part F, section 1.3.4.4.5:
+	 * If the attribute value has a fixed length that is less than or equal
+	 * to (ATT_MTU - 3) octets in length, then an Error Response can be sent
+	 * with the error code «Attribute Not Long».
+	 *
+	 * To remove need for caller to handle "Attribute Not Long" error when
+	 * reading characteristics with short values, use Read Request for
+	 * reading first part of characteristics value instead of Read Blob
+	 * Request. Both are allowed in this case.
+	 */
+
+	if (op->offset) {
+		att_op = BT_ATT_OP_READ_BLOB_REQ;
+		pdu_len += sizeof(op->offset);
+
+		put_le16(op->offset, pdu + 2);
+	} else {
+		att_op = BT_ATT_OP_READ_REQ;
+	}
+
+	req->att_id = bt_att_send(op->client->att, att_op, pdu, pdu_len,
+					read_long_cb, req, request_unref);
+
+	return req->att_id != 0;
+}
+
+struct read_batch {
+	struct bt_gatt_client *client;
+	unsigned int att_id;
+	unsigned int len;
+	unsigned int size;
+	struct request **reqs;
+};
+
+static void read_batch_free(void *data)
+{
+	struct read_batch *batch = data;
+	unsigned int i;
+
+	/* Reads still attached were never completed, drop them */
+	for (i = 0; i < batch->len; i++) {
+		struct request *req = batch->reqs[i];
+
+		if (!req)
+			continue;
+
+		req->batch = NULL;
+		request_unref(req);
+	}
+
+	free(batch->reqs);
+	free(batch);
+}
+
+/* Reissues a read that could not be served by the batch on its own */
+static void read_batch_fallback(struct request *req)
+{
+	struct read_long_op *op = req->data;
+
+	req->batch = NULL;
+	op->client->read_stats.fallbacks++;
+
+	if (read_long_send(req))
+		return;
+
+	if (op->callback)
+		op->callback(false, 0, NULL, 0, op->user_data);
+
+	request_unref(req);
+}
+
+static void read_batch_complete(struct request *req, const uint8_t *value,
+							uint16_t length)
+{
+	struct read_long_op *op = req->data;
+
+	req->batch = NULL;
+
+	cache_value(op->client, op->value_handle, value, length);
+
+	if (op->callback)
+		op->callback(true, 0, value, length, op->user_data);
+
+	request_unref(req);
+}
+
+static void read_batch_cb(uint8_t opcode, const void *pdu, uint16_t length,
+								void *user_data)
+{
+	struct read_batch *batch = user_data;
+	unsigned int i;
+
+	/* The request is done, it can no longer be cancelled */
+	batch->att_id = 0;
+
+	if (opcode != BT_ATT_OP_READ_MULT_VL_RSP || (!pdu && length))
+		length = 0;
+
+	for (i = 0; i < batch->len; i++) {
+		struct request *req = batch->reqs[i];
+		uint16_t len = 0;
+		bool complete = false;
+
+		/*
+		 * The Length Value Tuple List may be truncated due to the size
+		 * limits of the current ATT_MTU, in which case the remaining
+		 * values are read one by one, as are all values in case of
+		 * error since the response only reports the first failure.
+		 */
+		if (length >= 2) {
+			len = get_le16(pdu);
+			pdu += 2;
+			length -= 2;
+
+			complete = len <= length;
+		}
+
+		/* Consume the tuple even if the read was cancelled */
+		if (!req) {
+			pdu += MIN(len, length);
+			length -= MIN(len, length);
+			continue;
+		}
+
+		batch->reqs[i] = NULL;
+
+		if (complete)
+			read_batch_complete(req, pdu, len);
+		else
+			read_batch_fallback(req);
+
+		pdu += MIN(len, length);
+		length -= MIN(len, length);
+	}
+}
+
+static void read_batch_flush(struct bt_gatt_client *client)
+{
+	struct read_batch *batch = client->read_batch;
+	uint8_t *pdu;
+	unsigned int i, len;
+
+	client->read_batch = NULL;
+
+	/* Drop the slots of reads cancelled while waiting */
+	for (i = 0, len = 0; i < batch->len; i++) {
+		if (batch->reqs[i])
+			batch->reqs[len++] = batch->reqs[i];
+	}
+
+	batch->len = len;
+
+	for (i = 0; i < batch->len; i++) {
+		batch->reqs[i]->read_outstanding = true;
+		client->reads_outstanding++;
+	}
+
+	if (batch->len > 1) {
+		pdu = newa(uint8_t, batch->len * 2);
+
+		for (i = 0; i < batch->len; i++) {
+			struct read_long_op *op = batch->reqs[i]->data;
+
+			put_le16(op->value_handle, pdu + (2 * i));
+		}
+
+		batch->att_id = bt_att_send(client->att,
+						BT_ATT_OP_READ_MULT_VL_REQ,
+						pdu, batch->len * 2,
+						read_batch_cb, batch,
+						read_batch_free);
+		if (batch->att_id) {
+			DBG(client, "Read Multiple Variable Length: %u values",
+								batch->len);
+
+			client->read_stats.pdus++;
+			client->read_stats.batched += batch->len;
+			return;
+		}
+	}
+
+	/* Send reads individually if there is nothing to merge */
+	for (i = 0; i < batch->len; i++) {
+		struct request *req = batch->reqs[i];
+
+		batch->reqs[i] = NULL;
+		read_batch_fallback(req);
+	}
+
+	read_batch_free(batch);
+}
+
+/* Fails the reads still waiting to be sent */
+static void read_batch_abort(struct bt_gatt_client *client)
+{
+	struct read_batch *batch = client->read_batch;
+	unsigned int i;
+
+	if (!batch)
+		return;
+
+	client->read_batch = NULL;
+
+	for (i = 0; i < batch->len; i++) {
+		struct request *req = batch->reqs[i];
+		struct read_long_op *op;
+
+		if (!req)
+			continue;
+
+		batch->reqs[i] = NULL;
+		req->batch = NULL;
+
+		op = req->data;
+		if (op->callback)
+			op->callback(false, 0, NULL, 0, op->user_data);
+
+		request_unref(req);
+	}
+
+	read_batch_free(batch);
+}
+
+static bool read_batch_add(struct bt_gatt_client *client, struct request *req)
+{
+	struct read_batch *batch = client->read_batch;
+
+	/*
+	 * Read Multiple Variable Length is mandatory for servers supporting
+	 * EATT so only batch once that has been confirmed.
+	 */
+	if (!bt_gatt_client_is_ready(client) ||
+		!(bt_gatt_client_get_features(client) &
+					BT_GATT_CHRC_CLI_FEAT_EATT))
+		return false;
+
+	/*
+	 * Only hold reads back while others are in flight, they are sent
+	 * together once those complete so a lone read is not delayed.
+	 */
+	if (!client->reads_outstanding) {
+		req->read_outstanding = true;
+		client->reads_outstanding++;
+		return false;
+	}
+
+	if (!batch) {
+		batch = new0(struct read_batch, 1);
+		batch->client = client;
+		batch->size = (bt_att_get_mtu(client->att) - 1) / 2;
+		batch->reqs = new0(struct request *, batch->size);
+		client->read_batch = batch;
+	}
+
+	req->batch = batch;
+	batch->reqs[batch->len++] = req;
+	client->read_stats.reads++;
 
-	op = new0(struct read_op, 1);
+	if (batch->len == batch->size)
+		read_batch_flush(client);
 
-	req = request_create(client);
-	if (!req) {
-		free(op);
-		return 0;
-	}
+	return true;
+}
 
-	op->callback = callback;
-	op->user_data = user_data;
-	op->destroy = destroy;
+static bool read_batch_cancel(struct request *req)
+{
+	struct read_batch *batch = req->batch;
+	struct bt_gatt_client *client = batch->client;
+	unsigned int i, pending = 0;
 
-	req->data = op;
-	req->destroy = destroy_read_op;
+	for (i = 0; i < batch->len; i++) {
+		if (batch->reqs[i] == req)
+			batch->reqs[i] = NULL;
+		else if (batch->reqs[i])
+			pending++;
+	}
 
-	for (i = 0; i < num_handles; i++)
-		put_le16(handles[i], pdu + (2 * i));
+	req->batch = NULL;
+	request_unref(req);
 
-	opcode = bt_gatt_client_get_features(client) &
-		BT_GATT_CHRC_CLI_FEAT_EATT ? BT_ATT_OP_READ_MULT_VL_REQ :
-		BT_ATT_OP_READ_MULT_REQ;
+	if (pending)
+		return true;
 
-	req->att_id = bt_att_send(client->att, opcode, pdu, num_handles * 2,
-							read_multiple_cb, req,
-							request_unref);
-	if (!req->att_id) {
-		op->destroy = NULL;
-		request_unref(req);
-		return 0;
+	/* Nothing left to read */
+	if (batch == client->read_batch) {
+		client->read_batch = NULL;
+		read_batch_free(batch);
+	} else if (batch->att_id) {
+		bt_att_cancel(client->att, batch->att_id);
 	}
 
-	return req->id;
+	return true;
 }
 
-struct read_long_op {
-	struct bt_gatt_client *client;
-	int ref_count;
-	uint16_t value_handle;
-	uint16_t offset;
-	struct iovec iov;
-	bt_gatt_client_read_callback_t callback;
-	void *user_data;
-	bt_gatt_client_destroy_func_t destroy;
-};
-
-static void destroy_read_long_op(void *data)
+bool bt_gatt_client_set_ccc_restore(struct bt_gatt_client *client,
+								bool enable)
 {
-	struct read_long_op *op = data;
+	if (!client)
+		return false;
 
-	if (op->destroy)
-		op->destroy(op->user_data);
+	client->ccc_restore = enable;
 
-	free(op->iov.iov_base);
-	free(op);
+	return true;
 }
 
-static bool append_chunk(struct read_long_op *op, const uint8_t *data,
-								uint16_t len)
+bool bt_gatt_client_get_read_stats(struct bt_gatt_client *client,
+				struct bt_gatt_client_read_stats *stats)
 {
-	void *buf;
-
-	/* Truncate if the data would exceed maximum length */
-	if (op->offset + len > BT_ATT_MAX_VALUE_LEN)
-		len = BT_ATT_MAX_VALUE_LEN - op->offset;
-
-	buf = realloc(op->iov.iov_base, op->iov.iov_len + len);
-	if (!buf)
+	if (!client || !stats)
 		return false;
 
-	op->iov.iov_base = buf;
-
-	memcpy(op->iov.iov_base + op->iov.iov_len, data, len);
-
-	op->iov.iov_len += len;
-	op->offset += len;
+	*stats = client->read_stats;
 
 	return true;
 }
 
-static void read_long_cb(uint8_t opcode, const void *pdu,
-					uint16_t length, void *user_data)
+bool bt_gatt_client_get_cache_dirty(struct bt_gatt_client *client)
 {
-	struct request *req = user_data;
-	struct read_long_op *op = req->data;
-	bool success;
-	uint8_t att_ecode = 0;
-
-	if (opcode == BT_ATT_OP_ERROR_RSP) {
-		success = false;
-		att_ecode = process_error(pdu, length);
-		goto done;
-	}
+	if (!client)
+		return false;
 
-	if ((!op->offset && opcode != BT_ATT_OP_READ_RSP)
-			|| (op->offset && opcode != BT_ATT_OP_READ_BLOB_RSP)
-			|| (!pdu && length)) {
-		success = false;
-		goto done;
-	}
+	return client->cache_dirty;
+}
 
-	if (!length)
-		goto success;
+bool bt_gatt_client_clear_cache_dirty(struct bt_gatt_client *client)
+{
+	if (!client)
+		return false;
 
-	if (!append_chunk(op, pdu, length)) {
-		success = false;
-		goto done;
-	}
+	client->cache_dirty = false;
 
-	if (op->offset >= BT_ATT_MAX_VALUE_LEN)
-		goto success;
+	return true;
+}
 
-	if (length >= bt_att_get_mtu(op->client->att) - 1) {
-		uint8_t pdu[4];
-		int err;
+bool bt_gatt_client_get_cached_value(struct bt_gatt_client *client,
+					uint16_t value_handle,
+					const uint8_t **value,
+					uint16_t *length)
+{
+	struct gatt_db_attribute *attr;
+	struct cached_value cached = { NULL, 0 };
 
-		put_le16(op->value_handle, pdu);
-		put_le16(op->offset, pdu + 2);
+	if (!client || !value || !length)
+		return false;
 
-		err = bt_att_resend(op->client->att, req->att_id,
-							BT_ATT_OP_READ_BLOB_REQ,
-							pdu, sizeof(pdu),
-							read_long_cb,
-							request_ref(req),
-							request_unref);
-		if (!err)
-			return;
+	attr = static_value_attr(client->db, value_handle);
+	if (!attr)
+		return false;
 
-		request_unref(req);
-		success = false;
-		goto done;
-	}
+	gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+					cached_value_cb, &cached);
+	if (!cached.length)
+		return false;
 
-success:
-	success = true;
+	*value = cached.value;
+	*length = cached.length;
 
-done:
-	if (op->callback)
-		op->callback(success, att_ecode, op->iov.iov_base,
-						op->iov.iov_len, op->user_data);
+	return true;
 }
 
 unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
@@ -3083,9 +4499,6 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 {
 	struct request *req;
 	struct read_long_op *op;
-	uint8_t att_op;
-	uint8_t pdu[4];
-	uint16_t pdu_len;
 
 	if (!client)
 		return 0;
@@ -3108,34 +4521,10 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 	req->data = op;
 	req->destroy = destroy_read_long_op;
 
-	put_le16(value_handle, pdu);
-	pdu_len = sizeof(value_handle);
-
-	/*
-	 * Core v4.2, part F, section 1.3.4.4.5:
-	 * If the attribute value has a fixed length that is less than or equal
-	 * to (ATT_MTU - 3) octets in length, then an Error Response can be sent
-	 * with the error code «Attribute Not Long».
-	 *
-	 * To remove need for caller to handle "Attribute Not Long" error when
-	 * reading characteristics with short values, use Read Request for
-	 * reading first part of characteristics value instead of Read Blob
-	 * Request. Both are allowed in this case.
-	 */
-
-	if (op->offset) {
-		att_op = BT_ATT_OP_READ_BLOB_REQ;
-		pdu_len += sizeof(op->offset);
-
-		put_le16(op->offset, pdu + 2);
-	} else {
-		att_op = BT_ATT_OP_READ_REQ;
-	}
-
-	req->att_id = bt_att_send(client->att, att_op, pdu, pdu_len,
-					read_long_cb, req, request_unref);
+	if (!offset && read_batch_add(client, req))
+		return req->id;
 
-	if (!req->att_id) {
+	if (!read_long_send(req)) {
 		op->destroy = NULL;
 		request_unref(req);
 		return 0;
@@ -3144,11 +4533,37 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 	return req->id;
 }
 
+struct write_cmd_op {
+	bt_gatt_client_destroy_func_t sent;
+	void *user_data;
+};
+
+static void write_cmd_sent(void *data)
+{
+	struct write_cmd_op *op = data;
+
+	op->sent(op->user_data);
+	free(op);
+}
+
 unsigned int bt_gatt_client_write_without_response(
 					struct bt_gatt_client *client,
 					uint16_t value_handle,
 					bool signed_write,
 					const uint8_t *value, uint16_t length) {
+	return bt_gatt_client_write_without_response_full(client, value_handle,
+							signed_write, value,
+							length, NULL, NULL);
+}
+
+unsigned int bt_gatt_client_write_without_response_full(
+					struct bt_gatt_client *client,
+					uint16_t value_handle,
+					bool signed_write,
+					const uint8_t *value, uint16_t length,
+					bt_gatt_client_destroy_func_t sent,
+					void *user_data)
+{
 	uint8_t *pdu = newa(uint8_t, 2 + length);
 	struct request *req;
 	int security;
@@ -3161,6 +4576,20 @@ unsigned int bt_gatt_client_write_without_response(
 	if (!req)
 		return 0;
 
+	/*
+	 * Commands are freed by bt_att as soon as they have been written to
+	 * the bearer, so the request destroy callback is what tells the caller
+	 * that the PDU has left the queue.
+	 */
+	if (sent) {
+		struct write_cmd_op *cmd = new0(struct write_cmd_op, 1);
+
+		cmd->sent = sent;
+		cmd->user_data = user_data;
+		req->data = cmd;
+		req->destroy = write_cmd_sent;
+	}
+
 	/* Only use signed write if unencrypted */
 	if (signed_write) {
 		security = bt_att_get_security(client->att, NULL);
@@ -3175,6 +4604,9 @@ unsigned int bt_gatt_client_write_without_response(
 	req->att_id = bt_att_send(client->att, op, pdu, 2 + length, NULL, req,
 								request_unref);
 	if (!req->att_id) {
+		/* Don't report a PDU that was never queued as sent */
+		req->destroy = NULL;
+		free(req->data);
 		request_unref(req);
 		return 0;
 	}
@@ -3340,6 +4772,129 @@ done:
 	complete_write_long_op(req, success, 0, false);
 }
 
+static bool prep_blob_send(struct request *req);
+
+static void prep_blob_cb(uint8_t opcode, const void *pdu, uint16_t length,
+								void *user_data)
+{
+	struct long_blob *blob = user_data;
+	struct request *req = blob->req;
+	struct long_write_op *op = req->data;
+
+	queue_remove(req->blobs, blob);
+
+	/* Once a part has failed the rest is only drained */
+	if (!op->success)
+		goto next;
+
+	if (opcode == BT_ATT_OP_ERROR_RSP) {
+		op->success = false;
+		op->att_ecode = process_error(pdu, length);
+		goto next;
+	}
+
+	if (opcode != BT_ATT_OP_PREP_WRITE_RSP) {
+		op->success = false;
+		goto next;
+	}
+
+	if (op->reliable && (!pdu || length != blob->length + 4 ||
+			get_le16(pdu) != op->value_handle ||
+			get_le16(pdu + 2) != op->offset + blob->offset ||
+			memcmp(pdu + 4, op->value + blob->offset,
+							blob->length))) {
+		op->success = false;
+		op->reliable_error = true;
+	}
+
+next:
+	if (op->success && op->index < op->length && !prep_blob_send(req))
+		op->success = false;
+
+	if (!queue_isempty(req->blobs))
+		return;
+
+	/* Execute Write goes out in place of the last Prepare Write */
+	req->att_id = blob->id;
+
+	complete_write_long_op(req, op->success, op->att_ecode,
+							op->reliable_error);
+}
+
+static bool prep_blob_send(struct request *req)
+{
+	struct long_write_op *op = req->data;
+	struct long_blob *blob;
+	uint16_t len;
+	uint8_t *pdu;
+
+	len = MIN(op->length - op->index, op->cur_length);
+
+	pdu = malloc(len + 4);
+	if (!pdu)
+		return false;
+
+	put_le16(op->value_handle, pdu);
+	put_le16(op->offset + op->index, pdu + 2);
+	memcpy(pdu + 4, op->value + op->index, len);
+
+	blob = long_blob_send(req, BT_ATT_OP_PREP_WRITE_REQ, pdu, len + 4,
+							prep_blob_cb);
+	free(pdu);
+
+	if (!blob)
+		return false;
+
+	blob->offset = op->index;
+	blob->length = len;
+	op->index += len;
+
+	return true;
+}
+
+/*
+ * Pipelines the Prepare Write requests of a long write over all bearers,
+ * the server queues them by offset so the order they complete in does not
+ * matter.
+ */
+static bool prep_blobs_start(struct request *req)
+{
+	struct long_write_op *op = req->data;
+	struct bt_att *att = op->client->att;
+	int i, window;
+
+	if (op->length <= bt_att_get_mtu(att) - 5)
+		return false;
+
+	window = long_blob_window(att, 5);
+	if (!window)
+		return false;
+
+	op->cur_length = bt_att_get_min_mtu(att) - 5;
+	op->index = 0;
+	op->success = true;
+
+	req->blobs = queue_new();
+
+	for (i = 0; i < window && op->index < op->length; i++) {
+		if (!prep_blob_send(req))
+			break;
+	}
+
+	if (!queue_isempty(req->blobs)) {
+		struct long_blob *blob = queue_peek_head(req->blobs);
+
+		req->att_id = blob->id;
+		return true;
+	}
+
+	queue_destroy(req->blobs, NULL);
+	req->blobs = NULL;
+	op->cur_length = MIN(op->length, bt_att_get_mtu(att) - 5);
+
+	return false;
+}
+
 static void start_next_long_write(struct bt_gatt_client *client)
 {
 	struct request *req;
@@ -3353,7 +4908,8 @@ static void start_next_long_write(struct bt_gatt_client *client)
 	if (!req)
 		return;
 
-	handle_next_prep_write(req);
+	if (!prep_blobs_start(req))
+		handle_next_prep_write(req);
 
 	/*
 	 * send_next_prep_write adds an extra ref. Unref here to clean up if
@@ -3547,6 +5103,13 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 		return req->id;
 	}
 
+	if (prep_blobs_start(req)) {
+		/* The parts hold their own references */
+		request_unref(req);
+		client->in_long_write = true;
+		return req->id;
+	}
+
 	pdu = malloc(op->cur_length + 4);
 	if (!pdu) {
 		free(op->value);
@@ -3861,6 +5424,7 @@ bool bt_gatt_client_unregister_notify(struct bt_gatt_client *client,
 
 	/* Remove data if it has been queued */
 	queue_remove(notify_data->chrc->reg_notify_queue, notify_data);
+	queue_remove(notify_data->chrc->notify_list, notify_data);
 
 	/* Reset callbacks */
 	notify_data->callback = NULL;
@@ -44,6 +44,9 @@ typedef void (*bt_gatt_client_register_callback_t)(uint16_t att_ecode,
 typedef void (*bt_gatt_client_service_changed_callback_t)(uint16_t start_handle,
 							uint16_t end_handle,
 							void *user_data);
+typedef struct gatt_db *(*bt_gatt_client_db_lookup_func_t)(
+							const uint8_t *hash,
+							void *user_data);
 
 bool bt_gatt_client_is_ready(struct bt_gatt_client *client);
 unsigned int bt_gatt_client_ready_register(struct bt_gatt_client *client,
@@ -60,12 +63,28 @@ bool bt_gatt_client_set_debug(struct bt_gatt_client *client,
 					bt_gatt_client_debug_func_t callback,
 					void *user_data,
 					bt_gatt_client_destroy_func_t destroy);
+bool bt_gatt_client_set_db_lookup(struct bt_gatt_client *client,
+				bt_gatt_client_db_lookup_func_t callback,
+				void *user_data,
+				bt_gatt_client_destroy_func_t destroy);
+bool bt_gatt_client_set_ccc_restore(struct bt_gatt_client *client,
+								bool enable);
 
 uint16_t bt_gatt_client_get_mtu(struct bt_gatt_client *client);
 struct bt_att *bt_gatt_client_get_att(struct bt_gatt_client *client);
 struct gatt_db *bt_gatt_client_get_db(struct bt_gatt_client *client);
 uint8_t bt_gatt_client_get_features(struct bt_gatt_client *client);
 
+struct bt_gatt_client_read_stats {
+	unsigned int reads;	/* Reads queued for batching */
+	unsigned int batched;	/* Reads sent as part of Read Multiple */
+	unsigned int pdus;	/* Read Multiple Variable Length requests */
+	unsigned int fallbacks;	/* Reads sent on their own */
+};
+
+bool bt_gatt_client_get_read_stats(struct bt_gatt_client *client,
+				struct bt_gatt_client_read_stats *stats);
+
 bool bt_gatt_client_cancel(struct bt_gatt_client *client, unsigned int id);
 bool bt_gatt_client_cancel_all(struct bt_gatt_client *client);
 
@@ -74,6 +93,19 @@ unsigned int bt_gatt_client_read_value(struct bt_gatt_client *client,
 					bt_gatt_client_read_callback_t callback,
 					void *user_data,
 					bt_gatt_client_destroy_func_t destroy);
+
+/*
+ * Only Device Information Service values are cached: DIS is the one service
+ * whose characteristics are defined as fixed for the device, other values
+ * can change at any time regardless of their properties.
+ */
+bool bt_gatt_client_get_cached_value(struct bt_gatt_client *client,
+					uint16_t value_handle,
+					const uint8_t **value,
+					uint16_t *length);
+bool bt_gatt_client_is_static_value(struct gatt_db_attribute *attr);
+bool bt_gatt_client_get_cache_dirty(struct bt_gatt_client *client);
+bool bt_gatt_client_clear_cache_dirty(struct bt_gatt_client *client);
 unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 					uint16_t value_handle, uint16_t offset,
 					bt_gatt_client_read_callback_t callback,
@@ -90,6 +122,13 @@ unsigned int bt_gatt_client_write_without_response(
 					uint16_t value_handle,
 					bool signed_write,
 					const uint8_t *value, uint16_t length);
+unsigned int bt_gatt_client_write_without_response_full(
+					struct bt_gatt_client *client,
+					uint16_t value_handle,
+					bool signed_write,
+					const uint8_t *value, uint16_t length,
+					bt_gatt_client_destroy_func_t sent,
+					void *user_data);
 unsigned int bt_gatt_client_write_value(struct bt_gatt_client *client,
 					uint16_t value_handle,
 					const uint8_t *value, uint16_t length,
@@ -281,8 +281,9 @@ static void service_clone(void *data, void *user_data)
 		if (!attr)
 			continue;
 
-		/* Only clone values for characteristics declaration since that
-		 * is considered when calculating the db hash.
+		/* Only clone values for declarations, since they are
+		 * considered when calculating the db hash, and extended
+		 * properties which are part of the characteristic definition.
 		 */
 		if (bt_uuid_len(&attr->uuid) != 2) {
 			clone->attributes[i] = new_attribute(clone,
@@ -300,6 +301,7 @@ static void service_clone(void *data, void *user_data)
 		case GATT_SND_SVC_UUID:
 		case GATT_INCLUDE_UUID:
 		case GATT_CHARAC_UUID:
+		case GATT_CHARAC_EXT_PROPER_UUID:
 			clone->attributes[i] = new_attribute(clone,
 							attr->handle,
 							&attr->uuid,
@@ -330,6 +332,7 @@ struct gatt_db *gatt_db_clone(struct gatt_db *db)
 		return NULL;
 
 	queue_foreach(db->services, service_clone, clone);
+	clone->last_handle = db->last_handle;
 
 	return clone;
 }
@@ -557,6 +560,30 @@ bool gatt_db_isempty(struct gatt_db *db)
 	return queue_isempty(db->services);
 }
 
+bool gatt_db_import(struct gatt_db *db, struct gatt_db *src)
+{
+	const struct queue_entry *entry;
+
+	if (!db || !src || db == src || !gatt_db_isempty(db))
+		return false;
+
+	queue_foreach(src->services, service_clone, db);
+	db->last_handle = src->last_handle;
+
+	/* Services are cloned with their active state so notify the active
+	 * ones as if they had just been added.
+	 */
+	for (entry = queue_get_entries(db->services); entry;
+							entry = entry->next) {
+		struct gatt_db_service *service = entry->data;
+
+		if (service->active)
+			notify_service_changed(db, service, true);
+	}
+
+	return true;
+}
+
 static int uuid_to_le(const bt_uuid_t *uuid, uint8_t *dst)
 {
 	bt_uuid_t uuid128;
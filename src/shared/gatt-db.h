@@ -18,6 +18,7 @@ struct gatt_db *gatt_db_ref(struct gatt_db *db);
 void gatt_db_unref(struct gatt_db *db);
 
 bool gatt_db_isempty(struct gatt_db *db);
+bool gatt_db_import(struct gatt_db *db, struct gatt_db *src);
 
 struct gatt_db_attribute *gatt_db_add_service(struct gatt_db *db,
 						const bt_uuid_t *uuid,
@@ -353,53 +353,6 @@ static void async_read_op_destroy(struct async_read_op *op)
 	free(op);
 }
 
-static void process_read_by_type(struct async_read_op *op);
-
-static void read_by_type_read_complete_cb(struct gatt_db_attribute *attr,
-						int err, const uint8_t *value,
-						size_t len, void *user_data)
-{
-	struct async_read_op *op = user_data;
-	uint16_t handle;
-
-	handle = gatt_db_attribute_get_handle(attr);
-
-	/* Terminate the operation if there was an error */
-	if (err) {
-		bt_att_chan_send_error_rsp(op->chan, BT_ATT_OP_READ_BY_TYPE_REQ,
-								handle, err);
-		async_read_op_destroy(op);
-		return;
-	}
-
-	if (op->pdu_len == 0) {
-		op->value_len = MIN(MIN((unsigned int)op->mtu - 4, 253), len);
-		op->pdu[0] = op->value_len + 2;
-		op->pdu_len++;
-	} else if (len != op->value_len) {
-		op->done = true;
-		goto done;
-	}
-
-	/* Stop if this would surpass the MTU */
-	if (op->pdu_len + op->value_len + 2 > (unsigned int) op->mtu - 1) {
-		op->done = true;
-		goto done;
-	}
-
-	/* Encode the current value */
-	put_le16(handle, op->pdu + op->pdu_len);
-	memcpy(op->pdu + op->pdu_len + 2, value, op->value_len);
-
-	op->pdu_len += op->value_len + 2;
-
-	if (op->pdu_len == (unsigned int) op->mtu - 1)
-		op->done = true;
-
-done:
-	process_read_by_type(op);
-}
-
 static bool check_min_key_size(uint8_t min_size, uint8_t size)
 {
 	if (!min_size || !size)
@@ -461,35 +414,222 @@ static uint8_t check_permissions(struct bt_gatt_server *server,
 	return 0;
 }
 
-static void process_read_by_type(struct async_read_op *op)
-{
-	struct bt_gatt_server *server = op->server;
+/*
+ * Requests covering several attributes issue all the reads at once, so that
+ * attributes backed by the same external application can be served with a
+ * single round trip, and then consume the results in the request order.
+ */
+struct read_set;
+
+typedef void (*read_set_complete_t)(struct read_set *set);
+
+struct read_slot {
+	struct read_set *set;
+	uint16_t handle;
 	uint8_t ecode;
-	struct gatt_db_attribute *attr;
+	uint8_t *value;
+	size_t len;
+};
 
-	attr = queue_pop_head(op->db_data);
+struct read_set {
+	struct bt_gatt_server *server;
+	struct bt_att_chan *chan;
+	uint8_t opcode;
+	uint16_t mtu;
+	size_t count;
+	size_t pending;
+	struct read_slot *slots;
+	read_set_complete_t complete;
+};
 
-	if (op->done || !attr) {
-		bt_att_chan_send_rsp(op->chan, BT_ATT_OP_READ_BY_TYPE_RSP,
-						op->pdu, op->pdu_len);
-		async_read_op_destroy(op);
+static struct read_set *read_set_new(struct bt_gatt_server *server,
+					struct bt_att_chan *chan,
+					uint8_t opcode, uint16_t mtu,
+					size_t count,
+					read_set_complete_t complete)
+{
+	struct read_set *set;
+	size_t i;
+
+	set = new0(struct read_set, 1);
+	set->server = bt_gatt_server_ref(server);
+	set->chan = chan;
+	set->opcode = opcode;
+	set->mtu = mtu;
+	set->count = count;
+	set->complete = complete;
+	set->slots = new0(struct read_slot, count);
+
+	for (i = 0; i < count; i++)
+		set->slots[i].set = set;
+
+	return set;
+}
+
+static void read_set_free(struct read_set *set)
+{
+	size_t i;
+
+	for (i = 0; i < set->count; i++)
+		free(set->slots[i].value);
+
+	bt_gatt_server_unref(set->server);
+	free(set->slots);
+	free(set);
+}
+
+/* The completion callback owns the set once every read is done */
+static void read_set_done(struct read_set *set)
+{
+	if (--set->pending)
 		return;
+
+	set->complete(set);
+}
+
+static void read_set_read_cb(struct gatt_db_attribute *attr, int err,
+					const uint8_t *value, size_t len,
+					void *user_data)
+{
+	struct read_slot *slot = user_data;
+
+	if (err)
+		slot->ecode = err;
+	else if (len) {
+		slot->value = util_memdup(value, len);
+		slot->len = len;
 	}
 
-	ecode = check_permissions(server, attr, BT_ATT_PERM_READ_MASK);
-	if (ecode)
-		goto error;
+	read_set_done(slot->set);
+}
+
+static void read_set_issue(struct read_set *set, size_t first, size_t last)
+{
+	struct bt_gatt_server *server = set->server;
+	size_t i;
+
+	/* Hold the completion until every read has been issued */
+	set->pending = 1;
+
+	for (i = first; i < last; i++) {
+		struct read_slot *slot = &set->slots[i];
+		struct gatt_db_attribute *attr;
+
+		attr = gatt_db_get_attribute(server->db, slot->handle);
+		if (!attr) {
+			slot->ecode = BT_ATT_ERROR_INVALID_HANDLE;
+			break;
+		}
 
-	if (gatt_db_attribute_read(attr, 0, op->opcode, server->att,
-					read_by_type_read_complete_cb, op))
+		slot->ecode = check_permissions(server, attr,
+						BT_ATT_PERM_READ_MASK);
+		if (slot->ecode)
+			break;
+
+		set->pending++;
+
+		if (!gatt_db_attribute_read(attr, 0, set->opcode, server->att,
+						read_set_read_cb, slot)) {
+			set->pending--;
+			slot->ecode = BT_ATT_ERROR_UNLIKELY;
+			break;
+		}
+	}
+
+	/* Nothing past the first failure is going to be used */
+	if (i < last)
+		set->count = i + 1;
+
+	read_set_done(set);
+}
+
+static void read_set_start(struct read_set *set)
+{
+	read_set_issue(set, 0, set->count);
+}
+
+static void read_by_type_complete(struct read_set *set)
+{
+	uint16_t mtu = set->mtu;
+	uint8_t *pdu;
+	size_t pdu_len = 0, value_len = 0;
+	size_t i;
+
+	pdu = malloc(mtu);
+	if (!pdu) {
+		bt_att_chan_send_error_rsp(set->chan,
+					BT_ATT_OP_READ_BY_TYPE_REQ,
+					set->slots[0].handle,
+					BT_ATT_ERROR_INSUFFICIENT_RESOURCES);
+		read_set_free(set);
 		return;
+	}
 
-	ecode = BT_ATT_ERROR_UNLIKELY;
+	for (i = 0; i < set->count; i++) {
+		struct read_slot *slot = &set->slots[i];
 
-error:
-	bt_att_chan_send_error_rsp(op->chan, BT_ATT_OP_READ_BY_TYPE_REQ,
-				gatt_db_attribute_get_handle(attr), ecode);
-	async_read_op_destroy(op);
+		/* Terminate the operation if there was an error */
+		if (slot->ecode) {
+			bt_att_chan_send_error_rsp(set->chan,
+						BT_ATT_OP_READ_BY_TYPE_REQ,
+						slot->handle, slot->ecode);
+			free(pdu);
+			read_set_free(set);
+			return;
+		}
+
+		if (pdu_len == 0) {
+			value_len = MIN(MIN((unsigned int) mtu - 4, 253),
+								slot->len);
+			pdu[0] = value_len + 2;
+			pdu_len++;
+		} else if (slot->len != value_len)
+			break;
+
+		/* Stop if this would surpass the MTU */
+		if (pdu_len + value_len + 2 > (unsigned int) mtu - 1)
+			break;
+
+		/* Encode the current value */
+		put_le16(slot->handle, pdu + pdu_len);
+		if (value_len)
+			memcpy(pdu + pdu_len + 2, slot->value, value_len);
+
+		pdu_len += value_len + 2;
+
+		if (pdu_len == (unsigned int) mtu - 1)
+			break;
+	}
+
+	bt_att_chan_send_rsp(set->chan, BT_ATT_OP_READ_BY_TYPE_RSP, pdu,
+								pdu_len);
+	free(pdu);
+	read_set_free(set);
+}
+
+/*
+ * The length of the first value is the length of every entry of the
+ * response, so only read as many of the other attributes as can fit.
+ */
+static void read_by_type_sized(struct read_set *set)
+{
+	struct read_slot *slot = &set->slots[0];
+	size_t value_len;
+
+	set->complete = read_by_type_complete;
+
+	if (!slot->ecode && set->count > 1) {
+		value_len = MIN(MIN((size_t) set->mtu - 4, 253), slot->len);
+		set->count = MIN(set->count,
+				((size_t) set->mtu - 2) / (value_len + 2));
+
+		if (set->count > 1) {
+			read_set_issue(set, 1, set->count);
+			return;
+		}
+	}
+
+	read_by_type_complete(set);
 }
 
 static void read_by_type_cb(struct bt_att_chan *chan, uint16_t mtu,
@@ -502,7 +642,9 @@ static void read_by_type_cb(struct bt_att_chan *chan, uint16_t mtu,
 	uint16_t ehandle = 0;
 	uint8_t ecode;
 	struct queue *q = NULL;
-	struct async_read_op *op;
+	struct gatt_db_attribute *attr;
+	struct read_set *set;
+	size_t count;
 
 	if (length != 6 && length != 20) {
 		ecode = BT_ATT_ERROR_INVALID_PDU;
@@ -536,21 +678,20 @@ static void read_by_type_cb(struct bt_att_chan *chan, uint16_t mtu,
 		goto error;
 	}
 
-	op = new0(struct async_read_op, 1);
-	op->mtu = mtu;
-	op->pdu = malloc(mtu);
-	if (!op->pdu) {
-		free(op);
-		ecode = BT_ATT_ERROR_INSUFFICIENT_RESOURCES;
-		goto error;
+	/* Every entry takes at least its handle, so no more than this fit */
+	count = MIN(queue_length(q), ((size_t) mtu - 2) / 2);
+
+	set = read_set_new(server, chan, opcode, mtu, count,
+						read_by_type_sized);
+
+	for (count = 0; count < set->count; count++) {
+		attr = queue_pop_head(q);
+		set->slots[count].handle = gatt_db_attribute_get_handle(attr);
 	}
 
-	op->chan = chan;
-	op->opcode = opcode;
-	op->server = bt_gatt_server_ref(server);
-	op->db_data = q;
+	queue_destroy(q, NULL);
 
-	process_read_by_type(op);
+	read_set_issue(set, 0, 1);
 
 	return;
 
@@ -1008,122 +1149,51 @@ static void read_blob_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 	handle_read_req(chan, server, mtu, opcode, handle, offset);
 }
 
-struct read_mult_data {
-	struct bt_att_chan *chan;
-	struct bt_gatt_server *server;
-	uint8_t opcode;
-	uint16_t *handles;
-	size_t cur_handle;
-	size_t num_handles;
-	uint8_t *rsp_data;
-	size_t length;
-	size_t mtu;
-};
-
-static void read_mult_data_free(struct read_mult_data *data)
+static void read_multiple_complete(struct read_set *set)
 {
-	free(data->handles);
-	free(data->rsp_data);
-	free(data);
-}
-
-static void read_multiple_complete_cb(struct gatt_db_attribute *attr, int err,
-					const uint8_t *value, size_t len,
-					void *user_data)
-{
-	struct read_mult_data *data = user_data;
-	struct gatt_db_attribute *next_attr;
-	uint16_t handle = gatt_db_attribute_get_handle(attr);
-	uint8_t ecode;
-	uint16_t length;
+	uint8_t *rsp_data;
+	size_t length = 0, mtu = set->mtu;
+	size_t i;
 
-	if (err != 0) {
-		ecode = err;
-		goto error;
-	}
+	rsp_data = new0(uint8_t, mtu - 1);
 
-	length = data->opcode == BT_ATT_OP_READ_MULT_VL_REQ ?
-			MIN(len, MAX(data->mtu - data->length, 3) - 3) :
-			MIN(len, data->mtu - data->length - 1);
+	for (i = 0; i < set->count; i++) {
+		struct read_slot *slot = &set->slots[i];
+		uint16_t len;
 
-	if (data->opcode == BT_ATT_OP_READ_MULT_VL_REQ) {
-		/* The Length Value Tuple List may be truncated within the first
-		 * two octets of a tuple due to the size limits of the current
-		 * ATT_MTU, but the first two octets cannot be separated.
-		 */
-		if (data->mtu - data->length >= 3) {
-			put_le16(len, data->rsp_data + data->length);
-			data->length += 2;
+		if (slot->ecode) {
+			bt_att_chan_send_error_rsp(set->chan, set->opcode,
+						slot->handle, slot->ecode);
+			free(rsp_data);
+			read_set_free(set);
+			return;
 		}
-	}
-
-	memcpy(data->rsp_data + data->length, value, length);
-	data->length += length;
 
-	data->cur_handle++;
-
-	if (data->cur_handle == data->num_handles) {
-		bt_att_chan_send_rsp(data->chan, data->opcode + 1,
-						data->rsp_data, data->length);
-		read_mult_data_free(data);
-		return;
-	}
-
-	handle = data->handles[data->cur_handle];
-
-	util_debug(data->server->debug_callback, data->server->debug_data,
-				"%s Req - #%zu of %zu: 0x%04x",
-				data->opcode == BT_ATT_OP_READ_MULT_REQ ?
-				"Read Multiple" :
-				"Read Multiple Variable Length",
-				data->cur_handle + 1, data->num_handles,
-				handle);
+		len = set->opcode == BT_ATT_OP_READ_MULT_VL_REQ ?
+				MIN(slot->len, MAX(mtu - length, 3) - 3) :
+				MIN(slot->len, mtu - length - 1);
+
+		if (set->opcode == BT_ATT_OP_READ_MULT_VL_REQ) {
+			/* The Length Value Tuple List may be truncated within
+			 * the first two octets of a tuple due to the size
+			 * limits of the current ATT_MTU, but the first two
+			 * octets cannot be separated.
+			 */
+			if (mtu - length >= 3) {
+				put_le16(slot->len, rsp_data + length);
+				length += 2;
+			}
+		}
 
-	next_attr = gatt_db_get_attribute(data->server->db, handle);
+		if (len)
+			memcpy(rsp_data + length, slot->value, len);
 
-	if (!next_attr) {
-		ecode = BT_ATT_ERROR_INVALID_HANDLE;
-		goto error;
+		length += len;
 	}
 
-	ecode = check_permissions(data->server, next_attr,
-						BT_ATT_PERM_READ_MASK);
-	if (ecode)
-		goto error;
-
-	if (gatt_db_attribute_read(next_attr, 0, data->opcode,
-					data->server->att,
-					read_multiple_complete_cb, data))
-		return;
-
-	ecode = BT_ATT_ERROR_UNLIKELY;
-
-error:
-	bt_att_chan_send_error_rsp(data->chan, data->opcode, handle, ecode);
-	read_mult_data_free(data);
-}
-
-static struct read_mult_data *read_mult_data_new(struct bt_gatt_server *server,
-						struct bt_att_chan *chan,
-						uint16_t mtu,
-						uint8_t opcode,
-						uint16_t num_handles)
-{
-	struct read_mult_data *data;
-
-	data = new0(struct read_mult_data, 1);
-	data->chan = chan;
-	data->opcode = opcode;
-	data->handles = new0(uint16_t, num_handles);
-	data->rsp_data = NULL;
-	data->server = server;
-	data->num_handles = num_handles;
-	data->cur_handle = 0;
-	data->mtu = mtu;
-	data->length = 0;
-	data->rsp_data = new0(uint8_t, data->mtu - 1);
-
-	return data;
+	bt_att_chan_send_rsp(set->chan, set->opcode + 1, rsp_data, length);
+	free(rsp_data);
+	read_set_free(set);
 }
 
 static void read_multiple_cb(struct bt_att_chan *chan, uint16_t mtu,
@@ -1131,51 +1201,27 @@ static void read_multiple_cb(struct bt_att_chan *chan, uint16_t mtu,
 				uint16_t length, void *user_data)
 {
 	struct bt_gatt_server *server = user_data;
-	struct gatt_db_attribute *attr;
-	struct read_mult_data *data = NULL;
-	uint8_t ecode;
-	size_t i = 0;
-	uint16_t handle = 0;
+	struct read_set *set;
+	size_t i;
 
 	if (length < 4) {
-		ecode = BT_ATT_ERROR_INVALID_PDU;
-		goto error;
+		bt_att_chan_send_error_rsp(chan, opcode, 0,
+						BT_ATT_ERROR_INVALID_PDU);
+		return;
 	}
 
-	data = read_mult_data_new(server, chan, mtu, opcode, length / 2);
-
-	for (i = 0; i < data->num_handles; i++)
-		data->handles[i] = get_le16(pdu + i * 2);
+	set = read_set_new(server, chan, opcode, mtu, length / 2,
+						read_multiple_complete);
 
-	handle = data->handles[0];
+	for (i = 0; i < set->count; i++)
+		set->slots[i].handle = get_le16(pdu + i * 2);
 
 	DBG(server, "%s Req - %zu handles, 1st: 0x%04x",
-			data->opcode == BT_ATT_OP_READ_MULT_REQ ?
+			opcode == BT_ATT_OP_READ_MULT_REQ ?
 			"Read Multiple" : "Read Multiple Variable Length",
-			data->num_handles, handle);
-
-	attr = gatt_db_get_attribute(server->db, handle);
+			set->count, set->slots[0].handle);
 
-	if (!attr) {
-		ecode = BT_ATT_ERROR_INVALID_HANDLE;
-		goto error;
-	}
-
-	ecode = check_permissions(data->server, attr, BT_ATT_PERM_READ_MASK);
-	if (ecode)
-		goto error;
-
-	if (gatt_db_attribute_read(attr, 0, opcode, server->att,
-					read_multiple_complete_cb, data))
-		return;
-
-	ecode = BT_ATT_ERROR_UNLIKELY;
-
-error:
-	if (data)
-		read_mult_data_free(data);
-
-	bt_att_chan_send_error_rsp(chan, opcode, handle, ecode);
+	read_set_start(set);
 }
 
 static bool append_prep_data(struct prep_write_data *prep_data, uint16_t handle,
@@ -1767,27 +1813,64 @@ static bool notify_append_le16(struct nfy_mult_data *data, uint16_t value)
 	return true;
 }
 
+/*
+ * Encodes the parameters of a Handle Value Notification or Indication, the
+ * value being truncated to what fits the MTU. pdu shall have room for the
+ * smaller of length + 2 and the MTU - 1, the encoded length is returned.
+ */
+uint16_t bt_gatt_server_encode_value(struct bt_gatt_server *server,
+					uint16_t handle, const uint8_t *value,
+					uint16_t length, uint8_t *pdu)
+{
+	if (!server || !pdu)
+		return 0;
+
+	length = MIN(bt_att_get_mtu(server->att) - 3, length);
+
+	put_le16(handle, pdu);
+
+	if (length)
+		memcpy(pdu + 2, value, length);
+
+	return length + 2;
+}
+
 bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length, bool multiple)
 {
-	struct nfy_mult_data *data = NULL;
+	struct nfy_mult_data *data;
+	uint16_t pdu_len;
+	uint8_t *pdu;
 	bool result;
 
 	if (!server || (length && !value))
 		return false;
 
-	if (multiple) {
-		data = server->nfy_mult;
+	if (!multiple) {
+		pdu = malloc(MIN(bt_att_get_mtu(server->att) - 1, length + 2));
+		if (!pdu)
+			return false;
+
+		pdu_len = bt_gatt_server_encode_value(server, handle, value,
+								length, pdu);
 
-		/* flush buffered data if this request hits buffer size limit */
-		if (data && data->offset > 0 &&
-				data->len - data->offset < 4 + length) {
-			notify_multiple_timeout_remove(server);
-			notify_multiple(server);
-			/* data has been freed by notify_multiple */
-			data = NULL;
-		}
+		result = !!bt_att_send(server->att, BT_ATT_OP_HANDLE_NFY,
+					pdu, pdu_len, NULL, NULL, NULL);
+		free(pdu);
+
+		return result;
+	}
+
+	data = server->nfy_mult;
+
+	/* flush buffered data if this request hits buffer size limit */
+	if (data && data->offset > 0 &&
+			data->len - data->offset < 4 + length) {
+		notify_multiple_timeout_remove(server);
+		notify_multiple(server);
+		/* data has been freed by notify_multiple */
+		data = NULL;
 	}
 
 	if (!data) {
@@ -1799,40 +1882,27 @@ bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 	if (!notify_append_le16(data, handle))
 		goto error;
 
-	if (multiple) {
-		length = MIN(data->len - data->offset - 2, length);
-		if (!notify_append_le16(data, length))
-			goto error;
-	} else {
-		length = MIN(data->len - data->offset, length);
-	}
+	length = MIN(data->len - data->offset - 2, length);
+	if (!notify_append_le16(data, length))
+		goto error;
 
 	if (value)
 		memcpy(data->pdu + data->offset, value, length);
 
 	data->offset += length;
 
-	if (multiple) {
-		if (!server->nfy_mult)
-			server->nfy_mult = data;
+	if (!server->nfy_mult)
+		server->nfy_mult = data;
 
-		if (!server->nfy_mult->id)
-			server->nfy_mult->id = timeout_add(NFY_MULT_TIMEOUT,
+	if (!server->nfy_mult->id)
+		server->nfy_mult->id = timeout_add(NFY_MULT_TIMEOUT,
 						   notify_multiple, server,
 						   NULL);
 
-		return true;
-	}
-
-	result = !!bt_att_send(server->att, BT_ATT_OP_HANDLE_NFY,
-				data->pdu, data->offset, NULL, NULL, NULL);
-	free(data->pdu);
-	free(data);
-
-	return result;
+	return true;
 
 error:
-	if (data) {
+	if (data != server->nfy_mult) {
 		free(data->pdu);
 		free(data);
 	}
@@ -1880,8 +1950,7 @@ bool bt_gatt_server_send_indication(struct bt_gatt_server *server,
 	if (!server || (length && !value))
 		return false;
 
-	pdu_len = MIN(bt_att_get_mtu(server->att) - 1, length + 2);
-	pdu = malloc(pdu_len);
+	pdu = malloc(MIN(bt_att_get_mtu(server->att) - 1, length + 2));
 	if (!pdu)
 		return false;
 
@@ -1891,8 +1960,8 @@ bool bt_gatt_server_send_indication(struct bt_gatt_server *server,
 	data->destroy = destroy;
 	data->user_data = user_data;
 
-	put_le16(handle, pdu);
-	memcpy(pdu + 2, value, pdu_len - 2);
+	pdu_len = bt_gatt_server_encode_value(server, handle, value, length,
+									pdu);
 
 	result = !!bt_att_send(server->att, BT_ATT_OP_HANDLE_IND, pdu,
 							pdu_len, conf_cb,
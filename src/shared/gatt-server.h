@@ -39,6 +39,10 @@ bool bt_gatt_server_set_authorize(struct bt_gatt_server *server,
 					bt_gatt_server_authorize_cb_t cb,
 					void *user_data);
 
+uint16_t bt_gatt_server_encode_value(struct bt_gatt_server *server,
+					uint16_t handle, const uint8_t *value,
+					uint16_t length, uint8_t *pdu);
+
 bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length, bool multiple);
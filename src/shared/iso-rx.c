@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "bluetooth/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/iso-rx.h"
+
+/* Number of SDUs buffered per stream while waiting for the other streams,
+ * must be a power of two.
+ */
+#define ISO_RX_WINDOW		16
+
+/* Maximum number of SDUs read by a single recvmmsg call */
+#define ISO_RX_BATCH		8
+
+#define ISO_RX_CMSG_SIZE	(CMSG_SPACE(sizeof(uint8_t)) + \
+				CMSG_SPACE(sizeof(uint16_t)) + \
+				CMSG_SPACE(sizeof(struct timeval)))
+
+struct iso_rx_slot {
+	bool valid;
+	uint16_t seq;
+	uint16_t len;
+	uint8_t *data;
+};
+
+struct iso_rx_stream {
+	int sk;
+	uint16_t sdu;
+	uint8_t *buf;
+	uint8_t *scratch;
+	struct iso_rx_slot slots[ISO_RX_WINDOW];
+	bool started;
+	int16_t offset;
+	uint16_t count;
+	uint64_t last_ts;
+	uint16_t newest;
+	uint16_t last_len;
+	struct iso_rx_stats stats;
+};
+
+struct iso_rx {
+	uint32_t interval;
+	unsigned int depth;
+	struct queue *streams;
+	bool started;
+	uint16_t next_seq;
+	bool have_ref;
+	uint64_t ref_ts;
+	uint16_t ref_seq;
+	uint8_t *zero;
+	uint16_t zero_len;
+	struct iovec *iov;
+	iso_rx_frame_func_t frame_func;
+	iso_rx_destroy_func_t frame_destroy;
+	void *frame_data;
+};
+
+static void stream_free(void *data)
+{
+	struct iso_rx_stream *stream = data;
+
+	free(stream->buf);
+	free(stream->scratch);
+	free(stream);
+}
+
+struct iso_rx *iso_rx_new(uint32_t interval, unsigned int depth)
+{
+	struct iso_rx *rx;
+
+	rx = new0(struct iso_rx, 1);
+	rx->interval = interval;
+	rx->depth = MIN(MAX(depth, 1), ISO_RX_WINDOW - 1);
+	rx->streams = queue_new();
+
+	return rx;
+}
+
+void iso_rx_free(struct iso_rx *rx)
+{
+	if (!rx)
+		return;
+
+	if (rx->frame_destroy)
+		rx->frame_destroy(rx->frame_data);
+
+	queue_destroy(rx->streams, stream_free);
+	free(rx->zero);
+	free(rx->iov);
+	free(rx);
+}
+
+static bool match_stream_sk(const void *data, const void *match_data)
+{
+	const struct iso_rx_stream *stream = data;
+
+	return stream->sk == PTR_TO_INT(match_data);
+}
+
+int iso_rx_add_stream(struct iso_rx *rx, int sk, uint16_t sdu)
+{
+	struct iso_rx_stream *stream;
+	int opt = 1;
+	unsigned int i;
+
+	if (!rx || sk < 0 || !sdu)
+		return -EINVAL;
+
+	if (queue_find(rx->streams, match_stream_sk, INT_TO_PTR(sk)))
+		return -EALREADY;
+
+	/* Packet status and sequence numbers are only available on recent
+	 * kernels, without them SDUs are aligned by their arrival time.
+	 */
+	setsockopt(sk, SOL_BLUETOOTH, BT_PKT_STATUS, &opt, sizeof(opt));
+	setsockopt(sk, SOL_BLUETOOTH, BT_PKT_SEQNUM, &opt, sizeof(opt));
+	setsockopt(sk, SOL_SOCKET, SO_TIMESTAMP, &opt, sizeof(opt));
+
+	stream = new0(struct iso_rx_stream, 1);
+	stream->sk = sk;
+	stream->sdu = sdu;
+	stream->last_len = sdu;
+	stream->buf = malloc(ISO_RX_WINDOW * sdu);
+	stream->scratch = malloc(ISO_RX_BATCH * sdu);
+	if (!stream->buf || !stream->scratch) {
+		stream_free(stream);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ISO_RX_WINDOW; i++)
+		stream->slots[i].data = stream->buf + i * sdu;
+
+	if (sdu > rx->zero_len) {
+		free(rx->zero);
+		rx->zero = calloc(1, sdu);
+		rx->zero_len = sdu;
+	}
+
+	free(rx->iov);
+	rx->iov = new0(struct iovec, queue_length(rx->streams) + 1);
+
+	queue_push_tail(rx->streams, stream);
+
+	return 0;
+}
+
+bool iso_rx_remove_stream(struct iso_rx *rx, int sk)
+{
+	struct iso_rx_stream *stream;
+
+	if (!rx)
+		return false;
+
+	stream = queue_remove_if(rx->streams, match_stream_sk,
+							INT_TO_PTR(sk));
+	if (!stream)
+		return false;
+
+	stream_free(stream);
+
+	return true;
+}
+
+bool iso_rx_set_frame_handler(struct iso_rx *rx, iso_rx_frame_func_t func,
+				void *user_data, iso_rx_destroy_func_t destroy)
+{
+	if (!rx)
+		return false;
+
+	if (rx->frame_destroy)
+		rx->frame_destroy(rx->frame_data);
+
+	rx->frame_func = func;
+	rx->frame_destroy = destroy;
+	rx->frame_data = user_data;
+
+	return true;
+}
+
+static int16_t seq_diff(uint16_t a, uint16_t b)
+{
+	return (int16_t) (a - b);
+}
+
+/* Output the frame for next_seq, streams missing their SDU are filled with
+ * silence of the size of their last SDU, or of the stream SDU size until
+ * they deliver one, so the output layout is kept.
+ */
+static void emit_frame(struct iso_rx *rx)
+{
+	const struct queue_entry *entry;
+	unsigned int i = 0;
+
+	for (entry = queue_get_entries(rx->streams); entry;
+						entry = entry->next, i++) {
+		struct iso_rx_stream *stream = entry->data;
+		struct iso_rx_slot *slot;
+
+		slot = &stream->slots[rx->next_seq & (ISO_RX_WINDOW - 1)];
+		if (slot->valid && slot->seq == rx->next_seq) {
+			rx->iov[i].iov_base = slot->data;
+			rx->iov[i].iov_len = slot->len;
+			stream->last_len = slot->len;
+			slot->valid = false;
+			continue;
+		}
+
+		if (stream->started)
+			stream->stats.lost++;
+
+		rx->iov[i].iov_base = rx->zero;
+		rx->iov[i].iov_len = stream->last_len;
+	}
+
+	if (rx->frame_func)
+		rx->frame_func(rx->next_seq, rx->iov, i, rx->frame_data);
+
+	rx->next_seq++;
+}
+
+/* A frame is complete once every stream has its SDU, or once any stream
+ * got depth SDUs ahead in which case the missing SDUs are considered lost.
+ */
+static bool frame_ready(struct iso_rx *rx)
+{
+	const struct queue_entry *entry;
+	bool complete = true;
+
+	if (!rx->started)
+		return false;
+
+	for (entry = queue_get_entries(rx->streams); entry;
+						entry = entry->next) {
+		struct iso_rx_stream *stream = entry->data;
+		struct iso_rx_slot *slot;
+
+		if (stream->started &&
+			seq_diff(stream->newest, rx->next_seq) >=
+							(int) rx->depth)
+			return true;
+
+		slot = &stream->slots[rx->next_seq & (ISO_RX_WINDOW - 1)];
+		if (!slot->valid || slot->seq != rx->next_seq)
+			complete = false;
+	}
+
+	return complete;
+}
+
+static uint64_t timeval_to_us(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+static uint16_t ts_to_seq(struct iso_rx *rx, uint64_t ts)
+{
+	if (ts >= rx->ref_ts)
+		return rx->ref_seq + (ts - rx->ref_ts + rx->interval / 2) /
+								rx->interval;
+
+	return rx->ref_seq - (rx->ref_ts - ts + rx->interval / 2) /
+								rx->interval;
+}
+
+/* Map the SDU into the sequence space shared by all the streams */
+static uint16_t stream_seq(struct iso_rx *rx, struct iso_rx_stream *stream,
+				bool has_seqnum, uint16_t seq,
+				const struct timeval *tv)
+{
+	uint64_t ts = tv ? timeval_to_us(tv) : 0;
+
+	/* Without sequence numbers count the intervals elapsed since the
+	 * previous SDU so gaps are still detected.
+	 */
+	if (!has_seqnum) {
+		seq = stream->count;
+
+		if (stream->started && tv && rx->interval &&
+						ts > stream->last_ts)
+			seq += MAX((ts - stream->last_ts + rx->interval / 2) /
+						rx->interval, 1) - 1;
+	}
+
+	stream->count = seq + 1;
+
+	if (!tv || !rx->interval)
+		return seq + stream->offset;
+
+	stream->last_ts = ts;
+
+	if (!rx->have_ref) {
+		rx->have_ref = true;
+		rx->ref_ts = ts;
+		rx->ref_seq = seq;
+		return seq + stream->offset;
+	}
+
+	/* Streams started at different times have unrelated sequence
+	 * numbers, line them up using the timestamp of their first SDU.
+	 */
+	if (!stream->started)
+		stream->offset = ts_to_seq(rx, ts) - seq;
+
+	return seq + stream->offset;
+}
+
+static void stream_push(struct iso_rx *rx, struct iso_rx_stream *stream,
+				uint16_t seq, const uint8_t *data, size_t len)
+{
+	struct iso_rx_slot *slot;
+
+	if (!rx->started) {
+		rx->started = true;
+		rx->next_seq = seq;
+	}
+
+	if (seq_diff(seq, rx->next_seq) < 0) {
+		stream->stats.late++;
+		return;
+	}
+
+	/* Make room by forcing out the oldest frames */
+	while (seq_diff(seq, rx->next_seq) >= ISO_RX_WINDOW)
+		emit_frame(rx);
+
+	slot = &stream->slots[seq & (ISO_RX_WINDOW - 1)];
+	slot->valid = true;
+	slot->seq = seq;
+	slot->len = MIN(len, stream->sdu);
+	memcpy(slot->data, data, slot->len);
+
+	if (!stream->started || seq_diff(seq, stream->newest) > 0)
+		stream->newest = seq;
+
+	stream->started = true;
+}
+
+int iso_rx_read(struct iso_rx *rx, int sk)
+{
+	struct iso_rx_stream *stream;
+	struct mmsghdr msgs[ISO_RX_BATCH];
+	struct iovec iov[ISO_RX_BATCH];
+	uint8_t control[ISO_RX_BATCH][ISO_RX_CMSG_SIZE];
+	int i, ret;
+
+	if (!rx)
+		return -EINVAL;
+
+	stream = queue_find(rx->streams, match_stream_sk, INT_TO_PTR(sk));
+	if (!stream)
+		return -ENOENT;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < ISO_RX_BATCH; i++) {
+		iov[i].iov_base = stream->scratch + i * stream->sdu;
+		iov[i].iov_len = stream->sdu;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = control[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+	}
+
+	ret = recvmmsg(sk, msgs, ISO_RX_BATCH, MSG_DONTWAIT, NULL);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		return -errno;
+	}
+
+	for (i = 0; i < ret; i++) {
+		struct msghdr *msg = &msgs[i].msg_hdr;
+		struct cmsghdr *cmsg;
+		struct timeval *tv = NULL;
+		bool has_seqnum = false;
+		uint16_t seq = 0;
+		uint8_t status = 0;
+
+		/* Empty message without ancillary data means end of stream */
+		if (!msgs[i].msg_len && !msg->msg_controllen) {
+			ret = i ? i : -ENOTCONN;
+			break;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(msg); cmsg;
+					cmsg = CMSG_NXTHDR(msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+					cmsg->cmsg_type == SCM_TIMESTAMP) {
+				tv = (struct timeval *) CMSG_DATA(cmsg);
+				continue;
+			}
+
+			if (cmsg->cmsg_level != SOL_BLUETOOTH)
+				continue;
+
+			if (cmsg->cmsg_type == BT_SCM_PKT_STATUS)
+				memcpy(&status, CMSG_DATA(cmsg),
+							sizeof(status));
+			else if (cmsg->cmsg_type == BT_SCM_PKT_SEQNUM) {
+				memcpy(&seq, CMSG_DATA(cmsg), sizeof(seq));
+				has_seqnum = true;
+			}
+		}
+
+		stream->stats.sdus++;
+
+		if (status)
+			stream->stats.errors++;
+
+		seq = stream_seq(rx, stream, has_seqnum, seq, tv);
+		stream_push(rx, stream, seq, iov[i].iov_base,
+							msgs[i].msg_len);
+	}
+
+	while (frame_ready(rx))
+		emit_frame(rx);
+
+	return ret;
+}
+
+void iso_rx_flush(struct iso_rx *rx)
+{
+	const struct queue_entry *entry;
+	unsigned int i;
+
+	if (!rx || !rx->started)
+		return;
+
+	for (i = 0; i < ISO_RX_WINDOW; i++) {
+		bool pending = false;
+
+		for (entry = queue_get_entries(rx->streams); entry;
+							entry = entry->next) {
+			struct iso_rx_stream *stream = entry->data;
+
+			if (stream->started &&
+				seq_diff(stream->newest, rx->next_seq) >= 0)
+				pending = true;
+		}
+
+		if (!pending)
+			break;
+
+		emit_frame(rx);
+	}
+}
+
+bool iso_rx_get_stats(struct iso_rx *rx, int sk, struct iso_rx_stats *stats)
+{
+	struct iso_rx_stream *stream;
+
+	if (!rx || !stats)
+		return false;
+
+	stream = queue_find(rx->streams, match_stream_sk, INT_TO_PTR(sk));
+	if (!stream)
+		return false;
+
+	memcpy(stats, &stream->stats, sizeof(*stats));
+
+	return true;
+}
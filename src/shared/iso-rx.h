@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct iso_rx;
+
+struct iso_rx_stats {
+	uint64_t sdus;		/* SDUs received */
+	uint64_t lost;		/* SDUs missing when their frame was output */
+	uint64_t late;		/* SDUs received after their frame was output */
+	uint64_t errors;	/* SDUs received with a non-zero packet status */
+};
+
+typedef void (*iso_rx_frame_func_t)(uint16_t seq, const struct iovec *iov,
+					unsigned int count, void *user_data);
+typedef void (*iso_rx_destroy_func_t)(void *user_data);
+
+struct iso_rx *iso_rx_new(uint32_t interval, unsigned int depth);
+void iso_rx_free(struct iso_rx *rx);
+
+int iso_rx_add_stream(struct iso_rx *rx, int sk, uint16_t sdu);
+bool iso_rx_remove_stream(struct iso_rx *rx, int sk);
+
+bool iso_rx_set_frame_handler(struct iso_rx *rx, iso_rx_frame_func_t func,
+				void *user_data, iso_rx_destroy_func_t destroy);
+
+int iso_rx_read(struct iso_rx *rx, int sk);
+void iso_rx_flush(struct iso_rx *rx);
+
+bool iso_rx_get_stats(struct iso_rx *rx, int sk, struct iso_rx_stats *stats);
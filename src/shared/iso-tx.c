@@ -0,0 +1,623 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/iso-tx.h"
+
+/* Maximum number of SDUs handed to a single sendmmsg call */
+#define ISO_TX_MAX_BATCH	16
+
+struct iso_tx_stream {
+	int sk;
+	uint16_t sdu;
+	uint8_t *data;
+	size_t len;
+	size_t offset;
+	bool mapped;
+	bool repeat;
+	uint32_t seq;
+	iso_tx_pull_func_t pull;
+	void *pull_data;
+	uint16_t staged_len[ISO_TX_MAX_BATCH];
+	unsigned int staged;
+	bool eof;
+};
+
+struct iso_tx {
+	int timer_fd;
+	uint32_t interval;
+	unsigned int burst;
+	struct timespec start;
+	struct queue *streams;
+	int send_flags;
+	struct iso_tx_stats stats;
+	uint64_t wakeups;
+	uint64_t jitter_sum;
+	iso_tx_sent_func_t sent_func;
+	iso_tx_destroy_func_t sent_destroy;
+	void *sent_data;
+};
+
+static void stream_free(void *data)
+{
+	struct iso_tx_stream *stream = data;
+
+	if (stream->mapped)
+		munmap(stream->data, stream->len);
+	else
+		free(stream->data);
+
+	free(stream);
+}
+
+struct iso_tx *iso_tx_new(uint32_t interval, unsigned int burst)
+{
+	struct iso_tx *tx;
+
+	if (!interval)
+		return NULL;
+
+	tx = new0(struct iso_tx, 1);
+	tx->interval = interval;
+	tx->burst = burst ? burst : 1;
+	tx->streams = queue_new();
+	tx->send_flags = MSG_DONTWAIT;
+
+	tx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tx->timer_fd < 0) {
+		queue_destroy(tx->streams, NULL);
+		free(tx);
+		return NULL;
+	}
+
+	return tx;
+}
+
+void iso_tx_free(struct iso_tx *tx)
+{
+	if (!tx)
+		return;
+
+	if (tx->sent_destroy)
+		tx->sent_destroy(tx->sent_data);
+
+	queue_destroy(tx->streams, stream_free);
+	close(tx->timer_fd);
+	free(tx);
+}
+
+static bool match_stream_sk(const void *data, const void *match_data)
+{
+	const struct iso_tx_stream *stream = data;
+
+	return stream->sk == PTR_TO_INT(match_data);
+}
+
+static struct iso_tx_stream *stream_new(struct iso_tx *tx, int sk,
+						uint16_t sdu, bool repeat)
+{
+	struct iso_tx_stream *stream;
+
+	if (!tx || sk < 0 || !sdu)
+		return NULL;
+
+	if (queue_find(tx->streams, match_stream_sk, INT_TO_PTR(sk)))
+		return NULL;
+
+	stream = new0(struct iso_tx_stream, 1);
+	stream->sk = sk;
+	stream->sdu = sdu;
+	stream->repeat = repeat;
+
+	return stream;
+}
+
+static int load_file(struct iso_tx_stream *stream, int fd)
+{
+	struct stat st;
+	size_t len = 0;
+	void *data;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (!S_ISREG(st.st_mode) || !st.st_size)
+		return -EINVAL;
+
+	/* Map the whole file so SDUs can be sent straight out of the page
+	 * cache, the mapping is populated upfront so no page fault happens
+	 * while streaming.
+	 */
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+								fd, 0);
+	if (data != MAP_FAILED) {
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		stream->data = data;
+		stream->len = st.st_size;
+		stream->mapped = true;
+		return 0;
+	}
+
+	/* Fallback to preloading the file into memory */
+	stream->data = malloc(st.st_size);
+	if (!stream->data)
+		return -ENOMEM;
+
+	while (len < (size_t) st.st_size) {
+		ssize_t ret;
+
+		ret = pread(fd, stream->data + len, st.st_size - len, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (!ret)
+			break;
+
+		len += ret;
+	}
+
+	stream->len = len;
+
+	return 0;
+}
+
+int iso_tx_add_file(struct iso_tx *tx, int sk, uint16_t sdu, int fd,
+							bool repeat)
+{
+	struct iso_tx_stream *stream;
+	int err;
+
+	if (fd < 0)
+		return -EINVAL;
+
+	stream = stream_new(tx, sk, sdu, repeat);
+	if (!stream)
+		return -EINVAL;
+
+	err = load_file(stream, fd);
+	if (err < 0) {
+		stream_free(stream);
+		return err;
+	}
+
+	queue_push_tail(tx->streams, stream);
+
+	return 0;
+}
+
+int iso_tx_add_pull(struct iso_tx *tx, int sk, uint16_t sdu,
+				iso_tx_pull_func_t func, void *user_data)
+{
+	struct iso_tx_stream *stream;
+
+	if (!func)
+		return -EINVAL;
+
+	stream = stream_new(tx, sk, sdu, false);
+	if (!stream)
+		return -EINVAL;
+
+	/* Pulled SDUs are staged until the socket accepts them */
+	stream->data = malloc(ISO_TX_MAX_BATCH * sdu);
+	if (!stream->data) {
+		stream_free(stream);
+		return -ENOMEM;
+	}
+
+	stream->pull = func;
+	stream->pull_data = user_data;
+
+	queue_push_tail(tx->streams, stream);
+
+	return 0;
+}
+
+int iso_tx_add_buffer(struct iso_tx *tx, int sk, uint16_t sdu,
+				const void *data, size_t len, bool repeat)
+{
+	struct iso_tx_stream *stream;
+
+	if (!data || !len)
+		return -EINVAL;
+
+	stream = stream_new(tx, sk, sdu, repeat);
+	if (!stream)
+		return -EINVAL;
+
+	stream->data = util_memdup(data, len);
+	stream->len = len;
+
+	queue_push_tail(tx->streams, stream);
+
+	return 0;
+}
+
+bool iso_tx_remove_stream(struct iso_tx *tx, int sk)
+{
+	struct iso_tx_stream *stream;
+
+	if (!tx)
+		return false;
+
+	stream = queue_remove_if(tx->streams, match_stream_sk,
+							INT_TO_PTR(sk));
+	if (!stream)
+		return false;
+
+	stream_free(stream);
+
+	return true;
+}
+
+unsigned int iso_tx_get_stream_count(struct iso_tx *tx)
+{
+	if (!tx)
+		return 0;
+
+	return queue_length(tx->streams);
+}
+
+/* By default a full socket buffer counts as an overrun right away, blocking
+ * sends wait for room instead, bounded by the socket SO_SNDTIMEO if set.
+ */
+bool iso_tx_set_blocking(struct iso_tx *tx, bool blocking)
+{
+	if (!tx)
+		return false;
+
+	tx->send_flags = blocking ? 0 : MSG_DONTWAIT;
+
+	return true;
+}
+
+bool iso_tx_set_sent_handler(struct iso_tx *tx, iso_tx_sent_func_t func,
+				void *user_data, iso_tx_destroy_func_t destroy)
+{
+	if (!tx)
+		return false;
+
+	if (tx->sent_destroy)
+		tx->sent_destroy(tx->sent_data);
+
+	tx->sent_func = func;
+	tx->sent_destroy = destroy;
+	tx->sent_data = user_data;
+
+	return true;
+}
+
+/* Send up to num SDUs of the stream, returns 0 once the stream has been
+ * exhausted, a negative errno on failure and a positive value otherwise.
+ */
+static int stream_send(struct iso_tx *tx, struct iso_tx_stream *stream,
+							unsigned int num)
+{
+	struct mmsghdr msgs[ISO_TX_MAX_BATCH];
+	struct iovec iov[ISO_TX_MAX_BATCH];
+	unsigned int count = 0, sent = 0;
+
+	while (sent < num) {
+		size_t offset = stream->offset;
+		int i, ret;
+
+		memset(msgs, 0, sizeof(msgs));
+
+		/* Slice the next SDUs directly out of the source buffer */
+		for (count = 0; count < MIN(num - sent, ISO_TX_MAX_BATCH);
+								count++) {
+			if (offset >= stream->len) {
+				if (!stream->repeat)
+					break;
+				offset = 0;
+			}
+
+			iov[count].iov_base = stream->data + offset;
+			iov[count].iov_len = MIN(stream->sdu,
+						stream->len - offset);
+			msgs[count].msg_hdr.msg_iov = &iov[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+
+			offset += iov[count].iov_len;
+		}
+
+		if (!count)
+			break;
+
+		ret = sendmmsg(stream->sk, msgs, count, tx->send_flags);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != ENOBUFS)
+				return -errno;
+
+			/* Socket buffer is full, retry on the next interval */
+			tx->stats.overruns += num - sent;
+			return sent ? sent : 1;
+		}
+
+		for (i = 0; i < ret; i++, stream->seq++) {
+			offset = (uint8_t *) iov[i].iov_base - stream->data +
+							iov[i].iov_len;
+
+			if (tx->sent_func)
+				tx->sent_func(stream->sk, stream->seq, offset,
+						stream->len, tx->sent_data);
+		}
+
+		if (ret)
+			stream->offset = offset;
+
+		sent += ret;
+		tx->stats.sdus += ret;
+
+		if ((unsigned int) ret < count) {
+			tx->stats.overruns += num - sent;
+			return sent ? sent : 1;
+		}
+	}
+
+	return sent;
+}
+
+/* Same as stream_send but for streams whose SDUs are produced on demand,
+ * SDUs not ready in time are accounted as starved.
+ */
+static int stream_send_pull(struct iso_tx *tx, struct iso_tx_stream *stream,
+							unsigned int num)
+{
+	struct mmsghdr msgs[ISO_TX_MAX_BATCH];
+	struct iovec iov[ISO_TX_MAX_BATCH];
+	unsigned int i, n, sent = 0;
+	int ret;
+
+	while (sent < num) {
+		unsigned int count = MIN(num - sent, ISO_TX_MAX_BATCH);
+
+		while (!stream->eof && stream->staged < count) {
+			ssize_t len;
+
+			len = stream->pull(stream->data +
+					stream->staged * stream->sdu,
+					stream->sdu, stream->pull_data);
+			if (len == -EAGAIN) {
+				tx->stats.starved += count - stream->staged;
+				break;
+			}
+
+			if (len <= 0) {
+				stream->eof = true;
+				break;
+			}
+
+			stream->staged_len[stream->staged++] = len;
+		}
+
+		if (!stream->staged)
+			return sent || !stream->eof ? 1 : 0;
+
+		/* SDUs left over from a larger prefill stay staged, only
+		 * count of them go out on this interval.
+		 */
+		n = MIN(stream->staged, count);
+
+		memset(msgs, 0, sizeof(msgs));
+
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = stream->data + i * stream->sdu;
+			iov[i].iov_len = stream->staged_len[i];
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = sendmmsg(stream->sk, msgs, n, tx->send_flags);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN && errno != ENOBUFS)
+				return -errno;
+
+			tx->stats.overruns += n;
+			return 1;
+		}
+
+		for (i = 0; i < (unsigned int) ret; i++, stream->seq++) {
+			stream->offset += iov[i].iov_len;
+
+			if (tx->sent_func)
+				tx->sent_func(stream->sk, stream->seq,
+						stream->offset, 0,
+						tx->sent_data);
+		}
+
+		/* Keep what the socket did not take for the next interval */
+		stream->staged -= ret;
+		memmove(stream->data, stream->data + ret * stream->sdu,
+					stream->staged * stream->sdu);
+		memmove(stream->staged_len, stream->staged_len + ret,
+				stream->staged * sizeof(*stream->staged_len));
+
+		sent += ret;
+		tx->stats.sdus += ret;
+
+		if ((unsigned int) ret < n) {
+			tx->stats.overruns += n - ret;
+			return 1;
+		}
+
+		if ((unsigned int) ret < count)
+			break;
+	}
+
+	return 1;
+}
+
+/* Send num SDUs on every stream, streams that have been exhausted are
+ * dropped. Returns the number of streams still active.
+ */
+static int send_burst(struct iso_tx *tx, unsigned int num)
+{
+	const struct queue_entry *entry;
+	int err = 0;
+
+	entry = queue_get_entries(tx->streams);
+	while (entry) {
+		struct iso_tx_stream *stream = entry->data;
+		int ret;
+
+		entry = entry->next;
+
+		if (stream->pull)
+			ret = stream_send_pull(tx, stream, num);
+		else
+			ret = stream_send(tx, stream, num);
+		if (ret < 0)
+			err = ret;
+
+		if (ret <= 0) {
+			queue_remove(tx->streams, stream);
+			stream_free(stream);
+		}
+	}
+
+	if (err < 0 && queue_isempty(tx->streams))
+		return err;
+
+	return queue_length(tx->streams);
+}
+
+static uint64_t timespec_to_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000ULL + ts->tv_nsec / 1000;
+}
+
+int iso_tx_start(struct iso_tx *tx, unsigned int prefill)
+{
+	struct itimerspec ts;
+	uint64_t period;
+
+	if (!tx || queue_isempty(tx->streams))
+		return -EINVAL;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tx->start) < 0)
+		return -errno;
+
+	memset(&tx->stats, 0, sizeof(tx->stats));
+	tx->wakeups = 0;
+	tx->jitter_sum = 0;
+
+	/* The timer is armed in absolute time so the schedule never drifts
+	 * regardless of how long each burst takes to be sent.
+	 */
+	period = (uint64_t) tx->interval * tx->burst * 1000;
+
+	memset(&ts, 0, sizeof(ts));
+	ts.it_value.tv_sec = tx->start.tv_sec + (tx->start.tv_nsec + period) /
+								1000000000;
+	ts.it_value.tv_nsec = (tx->start.tv_nsec + period) % 1000000000;
+	ts.it_interval.tv_sec = period / 1000000000;
+	ts.it_interval.tv_nsec = period % 1000000000;
+
+	if (timerfd_settime(tx->timer_fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0)
+		return -errno;
+
+	if (!prefill)
+		return queue_length(tx->streams);
+
+	return send_burst(tx, prefill);
+}
+
+int iso_tx_get_fd(struct iso_tx *tx)
+{
+	if (!tx)
+		return -EINVAL;
+
+	return tx->timer_fd;
+}
+
+int iso_tx_process(struct iso_tx *tx)
+{
+	struct timespec now;
+	uint64_t exp, expected, now_us, delay;
+
+	if (!tx)
+		return -EINVAL;
+
+	if (read(tx->timer_fd, &exp, sizeof(exp)) != sizeof(exp)) {
+		if (errno == EAGAIN || errno == EINTR)
+			return queue_length(tx->streams);
+		return -errno;
+	}
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+		return -errno;
+
+	/* Expirations beyond the first one are intervals the sender slept
+	 * through, those are accounted as underruns and not caught up since
+	 * the controller would have flushed them already.
+	 */
+	tx->stats.ticks += exp;
+	tx->stats.underruns += exp - 1;
+
+	expected = timespec_to_us(&tx->start) +
+			tx->stats.ticks * tx->interval * tx->burst;
+	now_us = timespec_to_us(&now);
+	delay = now_us > expected ? now_us - expected : 0;
+
+	tx->wakeups++;
+	tx->jitter_sum += delay;
+	tx->stats.jitter_max = MAX(tx->stats.jitter_max, delay);
+	tx->stats.jitter_avg = tx->jitter_sum / tx->wakeups;
+
+	return send_burst(tx, tx->burst);
+}
+
+bool iso_tx_get_stats(struct iso_tx *tx, struct iso_tx_stats *stats)
+{
+	if (!tx || !stats)
+		return false;
+
+	memcpy(stats, &tx->stats, sizeof(*stats));
+
+	return true;
+}
+
+int iso_tx_set_realtime(int priority)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+		return -errno;
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct iso_tx;
+
+struct iso_tx_stats {
+	uint64_t ticks;		/* Timer intervals elapsed */
+	uint64_t sdus;		/* SDUs accepted by the sockets */
+	uint64_t underruns;	/* Intervals missed by the sender */
+	uint64_t overruns;	/* SDUs the sockets could not queue */
+	uint64_t starved;	/* SDUs the source had not ready in time */
+	uint32_t jitter_max;	/* Worst wakeup delay (us) */
+	uint32_t jitter_avg;	/* Average wakeup delay (us) */
+};
+
+typedef void (*iso_tx_sent_func_t)(int sk, uint32_t seq, size_t offset,
+					size_t len, void *user_data);
+typedef void (*iso_tx_destroy_func_t)(void *user_data);
+typedef ssize_t (*iso_tx_pull_func_t)(void *buf, size_t len,
+							void *user_data);
+
+struct iso_tx *iso_tx_new(uint32_t interval, unsigned int burst);
+void iso_tx_free(struct iso_tx *tx);
+
+int iso_tx_add_file(struct iso_tx *tx, int sk, uint16_t sdu, int fd,
+							bool repeat);
+int iso_tx_add_buffer(struct iso_tx *tx, int sk, uint16_t sdu,
+				const void *data, size_t len, bool repeat);
+int iso_tx_add_pull(struct iso_tx *tx, int sk, uint16_t sdu,
+				iso_tx_pull_func_t func, void *user_data);
+bool iso_tx_remove_stream(struct iso_tx *tx, int sk);
+unsigned int iso_tx_get_stream_count(struct iso_tx *tx);
+bool iso_tx_set_blocking(struct iso_tx *tx, bool blocking);
+
+bool iso_tx_set_sent_handler(struct iso_tx *tx, iso_tx_sent_func_t func,
+				void *user_data, iso_tx_destroy_func_t destroy);
+
+int iso_tx_start(struct iso_tx *tx, unsigned int prefill);
+int iso_tx_get_fd(struct iso_tx *tx);
+int iso_tx_process(struct iso_tx *tx);
+
+bool iso_tx_get_stats(struct iso_tx *tx, struct iso_tx_stats *stats);
+
+int iso_tx_set_realtime(int priority);
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/timeout.h"
+#include "src/shared/pa-queue.h"
+
+struct pa_sync {
+	struct pa_queue *queue;
+	void *data;
+	unsigned int timeout_id;
+};
+
+/* Periodic Advertising syncs each take one of the few sync slots of the
+ * controller, so only max of them run at a time and each is given up after
+ * timeout so the next one pending gets a slot.
+ */
+struct pa_queue {
+	unsigned int max;
+	unsigned int timeout;		/* In ms, 0 if syncs never expire */
+	struct queue *pending;		/* Waiting for a slot */
+	struct queue *active;		/* struct pa_sync holding a slot */
+	pa_queue_start_func_t start;
+	pa_queue_expired_func_t expired;
+	void *user_data;
+};
+
+static void sync_free(void *data)
+{
+	struct pa_sync *sync = data;
+
+	timeout_remove(sync->timeout_id);
+	free(sync);
+}
+
+static bool match_sync_data(const void *data, const void *match_data)
+{
+	const struct pa_sync *sync = data;
+
+	return sync->data == match_data;
+}
+
+static void queue_next(struct pa_queue *queue);
+
+static bool sync_expired(void *user_data)
+{
+	struct pa_sync *sync = user_data;
+	struct pa_queue *queue = sync->queue;
+	void *data = sync->data;
+
+	sync->timeout_id = 0;
+
+	queue_remove(queue->active, sync);
+	sync_free(sync);
+
+	if (queue->expired)
+		queue->expired(data, queue->user_data);
+
+	queue_next(queue);
+
+	return false;
+}
+
+static void queue_next(struct pa_queue *queue)
+{
+	while (queue_length(queue->active) < queue->max) {
+		struct pa_sync *sync;
+		void *data;
+
+		data = queue_pop_head(queue->pending);
+		if (!data)
+			return;
+
+		/* Sources that could not be synced to do not take a slot */
+		if (!queue->start(data, queue->user_data))
+			continue;
+
+		sync = new0(struct pa_sync, 1);
+		sync->queue = queue;
+		sync->data = data;
+
+		if (queue->timeout)
+			sync->timeout_id = timeout_add(queue->timeout,
+							sync_expired, sync,
+							NULL);
+
+		queue_push_tail(queue->active, sync);
+	}
+}
+
+struct pa_queue *pa_queue_new(unsigned int max, unsigned int timeout,
+				pa_queue_start_func_t start,
+				pa_queue_expired_func_t expired,
+				void *user_data)
+{
+	struct pa_queue *queue;
+
+	if (!max || !start)
+		return NULL;
+
+	queue = new0(struct pa_queue, 1);
+	queue->max = max;
+	queue->timeout = timeout;
+	queue->pending = queue_new();
+	queue->active = queue_new();
+	queue->start = start;
+	queue->expired = expired;
+	queue->user_data = user_data;
+
+	return queue;
+}
+
+void pa_queue_free(struct pa_queue *queue)
+{
+	if (!queue)
+		return;
+
+	queue_destroy(queue->pending, NULL);
+	queue_destroy(queue->active, sync_free);
+	free(queue);
+}
+
+/* Starts syncing to data right away if a slot is free, otherwise once one
+ * is released.
+ */
+bool pa_queue_push(struct pa_queue *queue, void *data)
+{
+	if (!queue || pa_queue_has(queue, data))
+		return false;
+
+	queue_push_tail(queue->pending, data);
+	queue_next(queue);
+
+	return true;
+}
+
+/* Called once data is no longer syncing, or syncing to it is no longer
+ * needed, its slot is then given to the next one pending.
+ */
+bool pa_queue_remove(struct pa_queue *queue, void *data)
+{
+	struct pa_sync *sync;
+
+	if (!queue)
+		return false;
+
+	if (queue_remove(queue->pending, data))
+		return true;
+
+	sync = queue_remove_if(queue->active, match_sync_data, data);
+	if (!sync)
+		return false;
+
+	sync_free(sync);
+	queue_next(queue);
+
+	return true;
+}
+
+bool pa_queue_has(struct pa_queue *queue, void *data)
+{
+	if (!queue)
+		return false;
+
+	return queue_find(queue->pending, NULL, data) ||
+			queue_find(queue->active, match_sync_data, data);
+}
+
+unsigned int pa_queue_get_active(struct pa_queue *queue)
+{
+	if (!queue)
+		return 0;
+
+	return queue_length(queue->active);
+}
+
+unsigned int pa_queue_get_pending(struct pa_queue *queue)
+{
+	if (!queue)
+		return 0;
+
+	return queue_length(queue->pending);
+}
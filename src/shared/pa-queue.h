@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+
+struct pa_queue;
+
+typedef bool (*pa_queue_start_func_t)(void *data, void *user_data);
+typedef void (*pa_queue_expired_func_t)(void *data, void *user_data);
+
+struct pa_queue *pa_queue_new(unsigned int max, unsigned int timeout,
+				pa_queue_start_func_t start,
+				pa_queue_expired_func_t expired,
+				void *user_data);
+void pa_queue_free(struct pa_queue *queue);
+
+bool pa_queue_push(struct pa_queue *queue, void *data);
+bool pa_queue_remove(struct pa_queue *queue, void *data);
+bool pa_queue_has(struct pa_queue *queue, void *data);
+
+unsigned int pa_queue_get_active(struct pa_queue *queue);
+unsigned int pa_queue_get_pending(struct pa_queue *queue);
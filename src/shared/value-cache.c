@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bluetooth/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/value-cache.h"
+
+/* Number of remote devices a value is remembered for */
+#define VALUE_CACHE_MAX_PEERS	32
+
+struct cache_entry {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	uint8_t *value;
+	uint16_t len;
+	uint64_t time;
+};
+
+struct value_cache {
+	uint32_t timeout;		/* In ms, 0 if values never expire */
+	unsigned int gen;		/* Bumped whenever the value changes */
+	struct cache_entry *common;	/* Value shared by all devices */
+	struct queue *peers;		/* Values read for a device */
+};
+
+struct entry_match {
+	const bdaddr_t *bdaddr;
+	uint8_t bdaddr_type;
+};
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static struct cache_entry *entry_new(const uint8_t *value, uint16_t len)
+{
+	struct cache_entry *entry;
+
+	entry = new0(struct cache_entry, 1);
+	entry->value = len ? util_memdup(value, len) : NULL;
+	entry->len = len;
+	entry->time = now_ms();
+
+	return entry;
+}
+
+static void entry_free(void *data)
+{
+	struct cache_entry *entry = data;
+
+	if (!entry)
+		return;
+
+	free(entry->value);
+	free(entry);
+}
+
+static bool match_entry(const void *data, const void *user_data)
+{
+	const struct cache_entry *entry = data;
+	const struct entry_match *match = user_data;
+
+	return entry->bdaddr_type == match->bdaddr_type &&
+				!bacmp(&entry->bdaddr, match->bdaddr);
+}
+
+static bool entry_fresh(struct value_cache *cache, struct cache_entry *entry)
+{
+	if (!cache->timeout)
+		return true;
+
+	return now_ms() - entry->time < cache->timeout;
+}
+
+struct value_cache *value_cache_new(uint32_t timeout)
+{
+	struct value_cache *cache;
+
+	cache = new0(struct value_cache, 1);
+	cache->timeout = timeout;
+	cache->gen = 1;
+	cache->peers = queue_new();
+
+	return cache;
+}
+
+void value_cache_free(struct value_cache *cache)
+{
+	if (!cache)
+		return;
+
+	entry_free(cache->common);
+	queue_destroy(cache->peers, entry_free);
+	free(cache);
+}
+
+void value_cache_set_timeout(struct value_cache *cache, uint32_t timeout)
+{
+	if (!cache)
+		return;
+
+	cache->timeout = timeout;
+}
+
+/*
+ * Returns the token to store the result of a read started now with, values
+ * read before the last change are then dropped instead of being cached.
+ */
+unsigned int value_cache_begin(struct value_cache *cache)
+{
+	if (!cache)
+		return 0;
+
+	return cache->gen;
+}
+
+bool value_cache_store(struct value_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, unsigned int token,
+				const uint8_t *value, uint16_t len)
+{
+	struct entry_match match = { bdaddr, bdaddr_type };
+	struct cache_entry *entry;
+
+	if (!cache || !bdaddr || !token || token != cache->gen)
+		return false;
+
+	entry_free(queue_remove_if(cache->peers, match_entry, &match));
+
+	if (queue_length(cache->peers) >= VALUE_CACHE_MAX_PEERS)
+		entry_free(queue_pop_head(cache->peers));
+
+	entry = entry_new(value, len);
+	bacpy(&entry->bdaddr, bdaddr);
+	entry->bdaddr_type = bdaddr_type;
+	queue_push_tail(cache->peers, entry);
+
+	return true;
+}
+
+static void cache_clear(struct value_cache *cache)
+{
+	/* Never hand out 0 so it can stand for no token */
+	if (!++cache->gen)
+		cache->gen = 1;
+
+	entry_free(cache->common);
+	cache->common = NULL;
+	queue_remove_all(cache->peers, NULL, NULL, entry_free);
+}
+
+/* Sets a value that is the same for every device, e.g. the Value property */
+void value_cache_set(struct value_cache *cache, const uint8_t *value,
+								uint16_t len)
+{
+	if (!cache)
+		return;
+
+	cache_clear(cache);
+	cache->common = entry_new(value, len);
+}
+
+void value_cache_invalidate(struct value_cache *cache)
+{
+	if (!cache)
+		return;
+
+	cache_clear(cache);
+}
+
+bool value_cache_get(struct value_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, const uint8_t **value,
+				uint16_t *len)
+{
+	struct entry_match match = { bdaddr, bdaddr_type };
+	struct cache_entry *entry;
+
+	if (!cache)
+		return false;
+
+	entry = bdaddr ? queue_find(cache->peers, match_entry, &match) : NULL;
+	if (entry && !entry_fresh(cache, entry)) {
+		queue_remove(cache->peers, entry);
+		entry_free(entry);
+		entry = NULL;
+	}
+
+	if (!entry && cache->common) {
+		if (entry_fresh(cache, cache->common)) {
+			entry = cache->common;
+		} else {
+			entry_free(cache->common);
+			cache->common = NULL;
+		}
+	}
+
+	if (!entry)
+		return false;
+
+	*value = entry->value;
+	*len = entry->len;
+
+	return true;
+}
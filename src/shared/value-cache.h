@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bluetooth/bluetooth.h"
+
+struct value_cache;
+
+struct value_cache *value_cache_new(uint32_t timeout);
+void value_cache_free(struct value_cache *cache);
+
+void value_cache_set_timeout(struct value_cache *cache, uint32_t timeout);
+
+unsigned int value_cache_begin(struct value_cache *cache);
+bool value_cache_store(struct value_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, unsigned int token,
+				const uint8_t *value, uint16_t len);
+void value_cache_set(struct value_cache *cache, const uint8_t *value,
+								uint16_t len);
+void value_cache_invalidate(struct value_cache *cache);
+
+bool value_cache_get(struct value_cache *cache, const bdaddr_t *bdaddr,
+				uint8_t bdaddr_type, const uint8_t **value,
+				uint16_t *len);
@@ -42,6 +42,11 @@
 #include "bluetooth/iso.h"
 
 #include "src/shared/util.h"
+#include "src/shared/iso-tx.h"
+#include "src/shared/iso-rx.h"
+#ifdef HAVE_LC3
+#include "lc3-pipe.h"
+#endif
 
 #define NSEC_USEC(_t) (_t / 1000L)
 #define SEC_USEC(_t)  (_t  * 1000000L)
@@ -76,6 +81,8 @@ static int defer_setup;
 static int sndbuf;
 static struct timeval sndto;
 static bool quiet;
+static int rt_priority;
+static uint32_t lc3_rate;
 
 struct bt_iso_qos *iso_qos;
 static bool inout;
@@ -482,6 +489,192 @@ static int accept_conn(int sk, struct sockaddr_iso *addr, char *peer)
 	return nsk;
 }
 
+static bool send_is_stream(int fd)
+{
+	struct stat st;
+
+	if (fd < 0)
+		return false;
+
+	return fstat(fd, &st) < 0 || !S_ISREG(st.st_mode);
+}
+
+static void recv_frame(uint16_t seq, const struct iovec *iov,
+				unsigned int count, void *user_data)
+{
+	int fd = PTR_TO_INT(user_data);
+
+	if (fd >= 0) {
+		if (writev(fd, iov, count) < 0)
+			syslog(LOG_ERR, "Write failed: %s (%d)",
+						strerror(errno), errno);
+	} else if (!quiet)
+		syslog(LOG_INFO, "[seq %u] %u streams", seq, count);
+}
+
+#ifdef HAVE_LC3
+static void lc3_stats(struct lc3_pipe *pipe, int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct lc3_pipe_stats stats;
+
+		if (!lc3_pipe_get_stats(pipe, i, &stats))
+			continue;
+
+		syslog(LOG_INFO, "[stream %d] LC3 %" PRIu64 " frames, CPU %"
+				PRIu64 " us load %u%%, %" PRIu64 " starved, %"
+				PRIu64 " dropped", i, stats.frames,
+				stats.cpu_time, stats.load, stats.starved,
+				stats.dropped);
+	}
+}
+
+static void recv_frame_lc3(uint16_t seq, const struct iovec *iov,
+				unsigned int count, void *user_data)
+{
+	struct lc3_pipe *pipe = user_data;
+
+	if (lc3_pipe_push(pipe, iov, count) < 0 && !quiet)
+		syslog(LOG_ERR, "[seq %u] LC3 decoder overrun", seq);
+}
+#endif
+
+static void recv_stats(struct iso_rx *rx, int *sk, int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct iso_rx_stats stats;
+
+		if (!iso_rx_get_stats(rx, sk[i], &stats))
+			continue;
+
+		syslog(LOG_INFO, "[stream %d] %" PRIu64 " SDUs, %" PRIu64
+				" lost, %" PRIu64 " late, %" PRIu64 " errors",
+				i, stats.sdus, stats.lost, stats.late,
+				stats.errors);
+	}
+}
+
+/* Receive all the streams of a BIG or of a set of CISes from a single
+ * process, SDUs are aligned by sequence number and timestamp and each
+ * frame is written as the SDUs of every stream in order.
+ */
+static void recv_streams(int fd, int *sk, int count, char *peer)
+{
+	struct iso_rx *rx = NULL;
+#ifdef HAVE_LC3
+	struct lc3_pipe *lc3 = NULL;
+#endif
+	struct pollfd *fds;
+	struct timespec t_last, t_now;
+	int active = count;
+
+	fds = calloc(count, sizeof(*fds));
+	if (!fds) {
+		syslog(LOG_ERR, "Can't allocate poll array");
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct bt_iso_io_qos *in;
+		struct bt_iso_qos qos;
+		socklen_t len;
+		uint16_t sdu;
+
+		memset(&qos, 0, sizeof(qos));
+		len = sizeof(qos);
+		if (getsockopt(sk[i], SOL_BLUETOOTH, BT_ISO_QOS, &qos,
+								&len) < 0)
+			syslog(LOG_ERR, "Can't get QoS socket option: %s (%d)",
+						strerror(errno), errno);
+
+		in = peer ? &qos.bcast.in : &qos.ucast.in;
+		sdu = in->sdu ? in->sdu : data_size;
+
+		if (!rx) {
+			rx = iso_rx_new(in->interval, 2);
+#ifdef HAVE_LC3
+			/* Decode to WAV when writing to a regular file */
+			if (lc3_rate && fd >= 0) {
+				lc3 = lc3_pipe_decoder_new(fd, count, lc3_rate,
+						in->interval, !send_is_stream(fd));
+				if (!lc3) {
+					syslog(LOG_ERR, "Unable to create LC3 "
+								"decoder");
+					goto done;
+				}
+			}
+#endif
+		}
+
+		if (iso_rx_add_stream(rx, sk[i], sdu) < 0) {
+			syslog(LOG_ERR, "Unable to add stream %d", i);
+			goto done;
+		}
+
+		fds[i].fd = sk[i];
+		fds[i].events = POLLIN;
+	}
+
+#ifdef HAVE_LC3
+	if (lc3)
+		iso_rx_set_frame_handler(rx, recv_frame_lc3, lc3, NULL);
+	else
+#endif
+		iso_rx_set_frame_handler(rx, recv_frame, INT_TO_PTR(fd), NULL);
+
+	syslog(LOG_INFO, "Receiving %d streams ...", count);
+
+	clock_gettime(CLOCK_MONOTONIC, &t_last);
+
+	while (active) {
+		if (poll(fds, count, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			int ret = 0;
+
+			if (fds[i].revents & POLLIN)
+				ret = iso_rx_read(rx, sk[i]);
+			else if (fds[i].revents)
+				ret = -ENOTCONN;
+
+			if (ret < 0) {
+				syslog(LOG_INFO, "Stream %d disconnected", i);
+				fds[i].fd = -1;
+				active--;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t_now);
+		if (t_now.tv_sec > t_last.tv_sec) {
+			recv_stats(rx, sk, count);
+#ifdef HAVE_LC3
+			if (lc3)
+				lc3_stats(lc3, count);
+#endif
+			t_last = t_now;
+		}
+	}
+
+	iso_rx_flush(rx);
+	recv_stats(rx, sk, count);
+
+done:
+#ifdef HAVE_LC3
+	if (lc3) {
+		lc3_stats(lc3, count);
+		lc3_pipe_free(lc3);
+	}
+#endif
+	iso_rx_free(rx);
+	free(fds);
+}
+
+static void recv_mode(int fd, int sk, char *peer);
+
 static void do_listen(char *filename,
 		void (*handler)(int fd, int sk, char *peer),
 		char *peer)
@@ -583,6 +776,38 @@ static void do_listen(char *filename,
 			syslog(LOG_INFO, "Initial bytes %d", read_len);
 	}
 
+	/* Streams are only grouped when receiving, dumping is per socket */
+	while (handler == recv_mode && (num_bis > 1 || lc3_rate)) {
+		int nsk_arr[ISO_MAX_NUM_BIS];
+		int count = 0;
+
+		/* Group the connections of all the streams */
+		while (count < MIN(num_bis, ISO_MAX_NUM_BIS)) {
+			nsk = accept_conn(sk, addr, peer);
+			if (nsk < 0)
+				continue;
+
+			ba2str(&addr->iso_bdaddr, ba);
+			syslog(LOG_INFO, "Connected [%s] stream %d", ba, count);
+
+			nsk_arr[count++] = nsk;
+		}
+
+		if (fork()) {
+			/* Parent */
+			for (int i = 0; i < count; i++)
+				close(nsk_arr[i]);
+			continue;
+		}
+		/* Child */
+		close(sk);
+
+		recv_streams(fd, nsk_arr, count, peer);
+
+		syslog(LOG_INFO, "Disconnect");
+		exit(0);
+	}
+
 	while (1) {
 		nsk = accept_conn(sk, addr, peer);
 		if (nsk < 0)
@@ -810,32 +1035,27 @@ static int read_file(int fd, ssize_t count, bool rewind)
 	return len;
 }
 
-static void do_send(int sk, int fd, char *peer, bool repeat)
+static uint32_t send_setup(int sk, char *peer, struct bt_iso_io_qos *out)
 {
-	uint32_t seq;
-	struct timespec t_start;
-	int send_len, used;
 	socklen_t len;
 	struct bt_iso_qos qos;
 	uint32_t num;
-	struct bt_iso_io_qos *out;
-
-	syslog(LOG_INFO, "Sending ...");
 
 	/* Read QoS */
-	if (!strcmp(peer, "00:00:00:00:00:00"))
-		out = &qos.bcast.out;
-	else
-		out = &qos.ucast.out;
-
 	memset(&qos, 0, sizeof(qos));
 	len = sizeof(qos);
 	if (getsockopt(sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos, &len) < 0) {
 		syslog(LOG_ERR, "Can't get Output QoS socket option: %s (%d)",
 				strerror(errno), errno);
-		out->sdu = ISO_DEFAULT_MTU;
+		qos.ucast.out.sdu = ISO_DEFAULT_MTU;
+		qos.bcast.out.sdu = ISO_DEFAULT_MTU;
 	}
 
+	if (!strcmp(peer, "00:00:00:00:00:00"))
+		*out = qos.bcast.out;
+	else
+		*out = qos.ucast.out;
+
 	/* num of packets = latency (ms) / interval (us) */
 	num = ROUND_CLOSEST(out->latency * 1000, out->interval);
 	if (!num)
@@ -869,6 +1089,21 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 		}
 	}
 
+	return num;
+}
+
+static void do_send(int sk, int fd, char *peer, bool repeat)
+{
+	uint32_t seq;
+	struct timespec t_start;
+	int send_len, used;
+	uint32_t num;
+	struct bt_iso_io_qos qos, *out = &qos;
+
+	syslog(LOG_INFO, "Sending ...");
+
+	num = send_setup(sk, peer, out);
+
 	for (int i = 6; i < out->sdu; i++)
 		buf[i] = 0x7f;
 
@@ -907,6 +1142,181 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 	}
 }
 
+static void send_sent(int sk, uint32_t seq, size_t offset, size_t len,
+							void *user_data)
+{
+	int used;
+
+	if (quiet)
+		return;
+
+	ioctl(sk, TIOCOUTQ, &used);
+
+	syslog(LOG_INFO, "[sk %d seq %u] %zu/%zu bytes buffered %d bytes",
+						sk, seq, offset, len, used);
+}
+
+static void send_stats(struct iso_tx *tx)
+{
+	struct iso_tx_stats stats;
+
+	if (!iso_tx_get_stats(tx, &stats))
+		return;
+
+	syslog(LOG_INFO, "Sent %" PRIu64 " SDUs in %" PRIu64 " intervals: "
+			"jitter max %u us avg %u us, %" PRIu64 " underruns, %"
+			PRIu64 " overruns", stats.sdus, stats.ticks,
+			stats.jitter_max, stats.jitter_avg, stats.underruns,
+			stats.overruns);
+}
+
+#ifdef HAVE_LC3
+struct send_lc3 {
+	struct lc3_pipe *pipe;
+	unsigned int index;
+};
+
+static ssize_t send_pull(void *buf, size_t len, void *user_data)
+{
+	struct send_lc3 *data = user_data;
+
+	return lc3_pipe_pull(data->pipe, data->index, buf, len);
+}
+#endif
+
+/* Send on all the sockets from a single process: SDUs of every stream are
+ * sliced from memory and handed to the sockets in batches on each interval
+ * of an absolute timer, so the streams stay aligned and the schedule does
+ * not drift.
+ */
+static void do_send_tx(int *sk, int count, int fd, char *peer, bool repeat)
+{
+	struct iso_tx *tx = NULL;
+	struct bt_iso_io_qos out;
+#ifdef HAVE_LC3
+	struct lc3_pipe *lc3 = NULL;
+	struct send_lc3 *pulls = NULL;
+#endif
+	uint64_t reported = 0, period;
+	uint32_t num = 0;
+	int ret;
+
+	syslog(LOG_INFO, "Sending ...");
+
+	for (int i = 0; i < count; i++) {
+		uint32_t n = send_setup(sk[i], peer, &out);
+
+		if (!tx) {
+			num = n;
+			tx = iso_tx_new(out.interval, num);
+			if (!tx) {
+				syslog(LOG_ERR, "Unable to create ISO sender");
+				exit(1);
+			}
+
+#ifdef HAVE_LC3
+			/* Encode one frame per SDU interval, PCM is read from
+			 * a WAV or raw file by the codec thread.
+			 */
+			if (lc3_rate && fd >= 0) {
+				lc3 = lc3_pipe_encoder_new(fd, count, lc3_rate,
+							out.interval, out.sdu);
+				pulls = calloc(count, sizeof(*pulls));
+				if (!lc3 || !pulls) {
+					syslog(LOG_ERR, "Unable to create LC3 "
+								"encoder");
+					exit(1);
+				}
+			}
+#endif
+		}
+
+#ifdef HAVE_LC3
+		if (lc3) {
+			pulls[i].pipe = lc3;
+			pulls[i].index = i;
+			ret = iso_tx_add_pull(tx, sk[i], out.sdu, send_pull,
+								&pulls[i]);
+		} else
+#endif
+		if (fd >= 0) {
+			ret = iso_tx_add_file(tx, sk[i], out.sdu, fd, repeat);
+		} else {
+			uint8_t *data;
+
+			data = malloc(out.sdu);
+			if (!data) {
+				perror("Can't allocate data buffer");
+				exit(1);
+			}
+
+			memset(data, 0x7f, out.sdu);
+			memset(data, 0, MIN(out.sdu, 6));
+
+			ret = iso_tx_add_buffer(tx, sk[i], out.sdu, data,
+							out.sdu, true);
+			free(data);
+		}
+
+		if (ret < 0) {
+			syslog(LOG_ERR, "Unable to add stream: %s (%d)",
+							strerror(-ret), -ret);
+			exit(1);
+		}
+	}
+
+	iso_tx_set_sent_handler(tx, send_sent, NULL, NULL);
+
+	/* Honor the send timeout of -t, it only applies to blocking sends */
+	if (sndto.tv_usec)
+		iso_tx_set_blocking(tx, true);
+
+	if (rt_priority) {
+		ret = iso_tx_set_realtime(rt_priority);
+		if (ret < 0)
+			syslog(LOG_ERR, "Can't set SCHED_FIFO priority %d: "
+				"%s (%d)", rt_priority, strerror(-ret), -ret);
+	}
+
+	ret = iso_tx_start(tx, 0);
+
+	/* Report statistics about once a second */
+	period = MAX(1000000 / ((uint64_t) out.interval * num), 1);
+
+	while (ret > 0) {
+		struct iso_tx_stats stats;
+
+		ret = iso_tx_process(tx);
+
+		if (iso_tx_get_stats(tx, &stats) &&
+					stats.ticks - reported >= period) {
+			send_stats(tx);
+#ifdef HAVE_LC3
+			if (lc3)
+				lc3_stats(lc3, count);
+#endif
+			reported = stats.ticks;
+		}
+	}
+
+	if (ret < 0)
+		syslog(LOG_ERR, "send failed: %s (%d)", strerror(-ret), -ret);
+
+	send_stats(tx);
+	iso_tx_free(tx);
+
+#ifdef HAVE_LC3
+	if (lc3) {
+		lc3_stats(lc3, count);
+		lc3_pipe_free(lc3);
+		free(pulls);
+	}
+#endif
+
+	if (ret < 0)
+		exit(1);
+}
+
 static void send_mode(char *filename, char *peer, int i, bool repeat)
 {
 	int sk, fd = -1;
@@ -935,6 +1345,11 @@ static void send_mode(char *filename, char *peer, int i, bool repeat)
 		if (!sk_arr)
 			exit(1);
 
+		if (lc3_rate || !send_is_stream(fd)) {
+			do_send_tx(sk_arr, nconn, fd, peer, repeat);
+			goto done;
+		}
+
 		for (int i = 0; i < nconn; i++) {
 			if (fork()) {
 				/* Parent */
@@ -950,6 +1365,8 @@ static void send_mode(char *filename, char *peer, int i, bool repeat)
 		while (wait(NULL) > 0)
 			;
 
+done:
+
 		for (int i = 0; i < nconn; i++)
 			close(sk_arr[i]);
 
@@ -972,7 +1389,10 @@ static void send_mode(char *filename, char *peer, int i, bool repeat)
 		sleep(abs(defer_setup) - 1);
 	}
 
-	do_send(sk, fd, peer, repeat);
+	if (!lc3_rate && send_is_stream(fd))
+		do_send(sk, fd, peer, repeat);
+	else
+		do_send_tx(&sk, 1, fd, peer, repeat);
 }
 
 static void reconnect_mode(char *peer)
@@ -1132,6 +1552,8 @@ static void usage(void)
 		"\t[-h, --help]\n"
 		"\t[-q, --quiet             disable packet logging]\n"
 		"\t[-t, --timeout <usec>    send timeout]\n"
+		"\t[-x, --realtime <prio>   send with SCHED_FIFO priority]\n"
+		"\t[-A, --lc3 <rate>        LC3 encode/decode PCM (Hz)]\n"
 		"\t[-C, --continue]\n"
 		"\t[-W, --defer <seconds>]  enable deferred setup\n"
 		"\t[-M, --mtu <value>]\n"
@@ -1162,6 +1584,8 @@ static const struct option main_options[] = {
 	{ "help",      no_argument,       NULL, 'h'},
 	{ "quiet",     no_argument,       NULL, 'q'},
 	{ "timeout",   required_argument, NULL, 't'},
+	{ "realtime",  required_argument, NULL, 'x'},
+	{ "lc3",       required_argument, NULL, 'A'},
 	{ "continue",  no_argument,       NULL, 'C'},
 	{ "defer",     required_argument, NULL, 'W'},
 	{ "mtu",       required_argument, NULL, 'M'},
@@ -1218,7 +1642,7 @@ int main(int argc, char *argv[])
 		int opt;
 
 		opt = getopt_long(argc, argv,
-			"d::cmr::s::nb:i:j:hqt:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:",
+			"d::cmr::s::nb:i:j:hqt:x:A:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:",
 			main_options, NULL);
 		if (opt < 0)
 			break;
@@ -1284,6 +1708,21 @@ int main(int argc, char *argv[])
 				sndto.tv_usec = atoi(optarg);
 			break;
 
+		case 'x':
+			if (optarg)
+				rt_priority = atoi(optarg);
+			break;
+
+		case 'A':
+#ifdef HAVE_LC3
+			if (optarg)
+				lc3_rate = atoi(optarg);
+			break;
+#else
+			fprintf(stderr, "LC3 support is not enabled\n");
+			exit(1);
+#endif
+
 		case 'C':
 			repeat = true;
 			break;
@@ -0,0 +1,659 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include <lc3.h>
+
+#include "src/shared/util.h"
+#include "lc3-pipe.h"
+
+/* Number of frames queued between the codec thread and the ISO sockets,
+ * must be a power of two.
+ */
+#define LC3_PIPE_FRAMES		16
+
+#define LC3_PIPE_MAX_FRAME	400
+
+struct wav_header {
+	uint8_t  riff[4];
+	uint32_t riff_len;
+	uint8_t  wave[4];
+	uint8_t  fmt[4];
+	uint32_t fmt_len;
+	uint16_t format;
+	uint16_t channels;
+	uint32_t rate;
+	uint32_t byte_rate;
+	uint16_t block_align;
+	uint16_t bits;
+	uint8_t  data[4];
+	uint32_t data_len;
+} __attribute__ ((packed));
+
+struct lc3_pipe_stream {
+	void *codec;
+	lc3_encoder_t encoder;
+	lc3_decoder_t decoder;
+	unsigned int head;
+	uint64_t frames;
+	uint64_t cpu_time;
+	uint64_t dropped;
+	uint64_t starved;
+};
+
+struct lc3_pipe {
+	bool encode;
+	int fd;
+	bool wav;
+	uint32_t data_len;
+	uint32_t rate;
+	unsigned int streams;
+	unsigned int channels;
+	uint32_t duration;
+	unsigned int samples;
+	uint16_t sdu;
+	struct lc3_pipe_stream *stream;
+	uint8_t *slots;
+	uint16_t *lens;
+	int16_t *pcm;
+	uint8_t pcm_start[12];
+	size_t pcm_start_len;
+	unsigned int head;
+	unsigned int tail;
+	bool eof;
+	bool quit;
+	int quit_fd;
+	sem_t items;
+	pthread_t thread;
+	bool running;
+};
+
+static uint64_t thread_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint8_t *slot_data(struct lc3_pipe *pipe, unsigned int index,
+							unsigned int stream)
+{
+	unsigned int slot = index & (LC3_PIPE_FRAMES - 1);
+
+	return pipe->slots + (slot * pipe->streams + stream) * pipe->sdu;
+}
+
+static uint16_t *slot_len(struct lc3_pipe *pipe, unsigned int index,
+							unsigned int stream)
+{
+	unsigned int slot = index & (LC3_PIPE_FRAMES - 1);
+
+	return &pipe->lens[slot * pipe->streams + stream];
+}
+
+static void pipe_free(struct lc3_pipe *pipe)
+{
+	unsigned int i;
+
+	for (i = 0; pipe->stream && i < pipe->streams; i++)
+		free(pipe->stream[i].codec);
+
+	if (pipe->quit_fd >= 0)
+		close(pipe->quit_fd);
+
+	sem_destroy(&pipe->items);
+	free(pipe->stream);
+	free(pipe->slots);
+	free(pipe->lens);
+	free(pipe->pcm);
+	free(pipe);
+}
+
+static struct lc3_pipe *pipe_new(int fd, unsigned int streams,
+					unsigned int channels, uint32_t rate,
+					uint32_t duration, uint16_t sdu,
+					bool encode)
+{
+	struct lc3_pipe *pipe;
+	unsigned int i;
+	int samples;
+
+	samples = lc3_frame_samples(duration, rate);
+	if (samples <= 0 || !streams || !channels || !sdu)
+		return NULL;
+
+	pipe = new0(struct lc3_pipe, 1);
+	pipe->encode = encode;
+	pipe->fd = fd;
+	pipe->streams = streams;
+	pipe->channels = channels;
+	pipe->duration = duration;
+	pipe->samples = samples;
+	pipe->sdu = sdu;
+	pipe->quit_fd = -1;
+	sem_init(&pipe->items, 0, 0);
+
+	pipe->stream = new0(struct lc3_pipe_stream, streams);
+	pipe->slots = malloc(LC3_PIPE_FRAMES * streams * sdu);
+	pipe->lens = new0(uint16_t, LC3_PIPE_FRAMES * streams);
+	pipe->pcm = new0(int16_t, samples * channels);
+	if (!pipe->slots)
+		goto fail;
+
+	for (i = 0; i < streams; i++) {
+		struct lc3_pipe_stream *stream = &pipe->stream[i];
+
+		if (encode) {
+			stream->codec = malloc(lc3_encoder_size(duration,
+								rate));
+			if (!stream->codec)
+				goto fail;
+
+			stream->encoder = lc3_setup_encoder(duration, rate, 0,
+								stream->codec);
+			if (!stream->encoder)
+				goto fail;
+		} else {
+			stream->codec = malloc(lc3_decoder_size(duration,
+								rate));
+			if (!stream->codec)
+				goto fail;
+
+			stream->decoder = lc3_setup_decoder(duration, rate, 0,
+								stream->codec);
+			if (!stream->decoder)
+				goto fail;
+		}
+	}
+
+	return pipe;
+
+fail:
+	pipe_free(pipe);
+	return NULL;
+}
+
+/* Reads until len bytes, end of input or quit_fd becoming readable */
+static ssize_t read_full(int fd, void *buf, size_t len, int quit_fd)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		struct pollfd pfd[2];
+		ssize_t ret;
+
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = quit_fd;
+		pfd[1].events = POLLIN;
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (pfd[1].revents)
+			return -ECANCELED;
+
+		ret = read(fd, (uint8_t *) buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (!ret)
+			break;
+
+		done += ret;
+	}
+
+	return done;
+}
+
+static ssize_t write_full(int fd, const void *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t ret;
+
+		ret = write(fd, (const uint8_t *) buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		done += ret;
+	}
+
+	return done;
+}
+
+/* Skips input by reading it so that pipes and sockets work too */
+static int skip_full(int fd, size_t len)
+{
+	uint8_t buf[256];
+
+	while (len) {
+		ssize_t ret = read_full(fd, buf, MIN(len, sizeof(buf)), -1);
+
+		if (ret <= 0)
+			return ret < 0 ? ret : -EINVAL;
+
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/* Parse the RIFF header if there is one, otherwise the input is taken as
+ * raw 16 bit PCM with one channel per stream. As the input may not be
+ * seekable, the bytes read looking for the header are then returned in
+ * pcm_start to be used as the first PCM samples.
+ */
+static int parse_wav(int fd, uint32_t rate, unsigned int *channels,
+				uint8_t pcm_start[12], size_t *pcm_start_len)
+{
+	struct {
+		uint8_t id[4];
+		uint32_t len;
+	} __attribute__ ((packed)) chunk;
+	uint16_t fmt[8];
+	bool has_fmt = false;
+	ssize_t ret;
+	int err;
+
+	*pcm_start_len = 0;
+
+	ret = read_full(fd, pcm_start, 12, -1);
+	if (ret < 0)
+		return ret;
+
+	if (ret < 12 || memcmp(pcm_start, "RIFF", 4) ||
+					memcmp(pcm_start + 8, "WAVE", 4)) {
+		*pcm_start_len = ret;
+		return 0;
+	}
+
+	while (read_full(fd, &chunk, sizeof(chunk), -1) == sizeof(chunk)) {
+		uint32_t len = le32toh(chunk.len);
+
+		if (!memcmp(chunk.id, "data", 4))
+			return has_fmt ? 0 : -EINVAL;
+
+		if (memcmp(chunk.id, "fmt ", 4) || len < sizeof(fmt)) {
+			err = skip_full(fd, len + (len & 1));
+			if (err < 0)
+				return err;
+			continue;
+		}
+
+		if (read_full(fd, fmt, sizeof(fmt), -1) != sizeof(fmt))
+			return -EINVAL;
+
+		/* Only 16 bit integer PCM at the codec rate is supported */
+		if (le16toh(fmt[0]) != 1 || le16toh(fmt[7]) != 16 ||
+				get_le32(&fmt[2]) != rate || !le16toh(fmt[1]))
+			return -EINVAL;
+
+		*channels = le16toh(fmt[1]);
+		has_fmt = true;
+
+		err = skip_full(fd, len - sizeof(fmt) + (len & 1));
+		if (err < 0)
+			return err;
+	}
+
+	return -EINVAL;
+}
+
+static void *encode_thread(void *user_data)
+{
+	struct lc3_pipe *pipe = user_data;
+	size_t len = pipe->samples * pipe->channels * sizeof(int16_t);
+	struct timespec wait;
+
+	wait.tv_sec = 0;
+	wait.tv_nsec = pipe->duration * 1000 / 4;
+
+	while (!__atomic_load_n(&pipe->quit, __ATOMIC_RELAXED)) {
+		unsigned int tail = pipe->tail;
+		size_t pcm_start;
+		unsigned int i;
+		ssize_t ret;
+
+		/* Wait for every stream to consume the oldest frame */
+		for (i = 0; i < pipe->streams; i++) {
+			if (tail - __atomic_load_n(&pipe->stream[i].head,
+					__ATOMIC_ACQUIRE) >= LC3_PIPE_FRAMES)
+				break;
+		}
+
+		if (i < pipe->streams) {
+			nanosleep(&wait, NULL);
+			continue;
+		}
+
+		/* Bytes read looking for a RIFF header come first */
+		pcm_start = pipe->pcm_start_len;
+		memcpy(pipe->pcm, pipe->pcm_start, pcm_start);
+		pipe->pcm_start_len = 0;
+
+		ret = read_full(pipe->fd, (uint8_t *) pipe->pcm + pcm_start,
+						len - pcm_start, pipe->quit_fd);
+		if (ret < 0)
+			break;
+
+		ret += pcm_start;
+		if (!ret)
+			break;
+
+		if ((size_t) ret < len)
+			memset((uint8_t *) pipe->pcm + ret, 0, len - ret);
+
+		for (i = 0; i < pipe->streams; i++) {
+			struct lc3_pipe_stream *stream = &pipe->stream[i];
+			uint64_t start = thread_time();
+
+			lc3_encode(stream->encoder, LC3_PCM_FORMAT_S16,
+					pipe->pcm + i % pipe->channels,
+					pipe->channels, pipe->sdu,
+					slot_data(pipe, tail, i));
+			*slot_len(pipe, tail, i) = pipe->sdu;
+
+			__atomic_store_n(&stream->cpu_time, stream->cpu_time +
+					thread_time() - start,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&stream->frames, stream->frames + 1,
+					__ATOMIC_RELAXED);
+		}
+
+		__atomic_store_n(&pipe->tail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&pipe->eof, true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void write_wav_header(struct lc3_pipe *pipe)
+{
+	uint32_t rate = pipe->rate;
+	struct wav_header hdr;
+
+	memcpy(hdr.riff, "RIFF", 4);
+	hdr.riff_len = htole32(sizeof(hdr) - 8 + pipe->data_len);
+	memcpy(hdr.wave, "WAVE", 4);
+	memcpy(hdr.fmt, "fmt ", 4);
+	hdr.fmt_len = htole32(16);
+	hdr.format = htole16(1);
+	hdr.channels = htole16(pipe->streams);
+	hdr.rate = htole32(rate);
+	hdr.byte_rate = htole32(rate * pipe->streams * sizeof(int16_t));
+	hdr.block_align = htole16(pipe->streams * sizeof(int16_t));
+	hdr.bits = htole16(16);
+	memcpy(hdr.data, "data", 4);
+	hdr.data_len = htole32(pipe->data_len);
+
+	if (pwrite(pipe->fd, &hdr, sizeof(hdr), 0) < 0)
+		pipe->wav = false;
+}
+
+static void *decode_thread(void *user_data)
+{
+	struct lc3_pipe *pipe = user_data;
+	size_t len = pipe->samples * pipe->streams * sizeof(int16_t);
+
+	while (1) {
+		unsigned int head = pipe->head;
+		unsigned int i;
+
+		while (sem_wait(&pipe->items) < 0 && errno == EINTR)
+			;
+
+		if (head == __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE)) {
+			if (__atomic_load_n(&pipe->quit, __ATOMIC_RELAXED))
+				break;
+			continue;
+		}
+
+		for (i = 0; i < pipe->streams; i++) {
+			struct lc3_pipe_stream *stream = &pipe->stream[i];
+			uint16_t sdu = *slot_len(pipe, head, i);
+			uint64_t start = thread_time();
+
+			/* Lost frames are concealed by the decoder */
+			lc3_decode(stream->decoder,
+					sdu ? slot_data(pipe, head, i) : NULL,
+					sdu, LC3_PCM_FORMAT_S16,
+					pipe->pcm + i, pipe->streams);
+
+			__atomic_store_n(&stream->cpu_time, stream->cpu_time +
+					thread_time() - start,
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&stream->frames, stream->frames + 1,
+					__ATOMIC_RELAXED);
+		}
+
+		__atomic_store_n(&pipe->head, head + 1, __ATOMIC_RELEASE);
+
+		if (write_full(pipe->fd, pipe->pcm, len) < 0)
+			continue;
+
+		pipe->data_len += len;
+	}
+
+	return NULL;
+}
+
+struct lc3_pipe *lc3_pipe_encoder_new(int fd, unsigned int streams,
+					uint32_t rate, uint32_t duration,
+					uint16_t sdu)
+{
+	struct lc3_pipe *pipe;
+	unsigned int channels = streams;
+	uint8_t pcm_start[12];
+	size_t pcm_start_len;
+
+	if (fd < 0 || parse_wav(fd, rate, &channels, pcm_start,
+							&pcm_start_len) < 0)
+		return NULL;
+
+	pipe = pipe_new(fd, streams, channels, rate, duration, sdu, true);
+	if (!pipe)
+		return NULL;
+
+	memcpy(pipe->pcm_start, pcm_start, pcm_start_len);
+	pipe->pcm_start_len = pcm_start_len;
+
+	/* Wakes the thread up when blocked reading a pipe or socket */
+	pipe->quit_fd = eventfd(0, EFD_CLOEXEC);
+	if (pipe->quit_fd < 0) {
+		pipe_free(pipe);
+		return NULL;
+	}
+
+	if (pthread_create(&pipe->thread, NULL, encode_thread, pipe)) {
+		pipe_free(pipe);
+		return NULL;
+	}
+
+	pipe->running = true;
+
+	return pipe;
+}
+
+struct lc3_pipe *lc3_pipe_decoder_new(int fd, unsigned int streams,
+					uint32_t rate, uint32_t duration,
+					bool wav)
+{
+	struct lc3_pipe *pipe;
+
+	if (fd < 0)
+		return NULL;
+
+	pipe = pipe_new(fd, streams, streams, rate, duration,
+					LC3_PIPE_MAX_FRAME, false);
+	if (!pipe)
+		return NULL;
+
+	/* Reserve room for the header, sizes are filled once done */
+	if (wav) {
+		pipe->wav = true;
+		pipe->rate = rate;
+		write_wav_header(pipe);
+		if (!pipe->wav ||
+			lseek(fd, sizeof(struct wav_header), SEEK_SET) < 0) {
+			pipe_free(pipe);
+			return NULL;
+		}
+	}
+
+	if (pthread_create(&pipe->thread, NULL, decode_thread, pipe)) {
+		pipe_free(pipe);
+		return NULL;
+	}
+
+	pipe->running = true;
+
+	return pipe;
+}
+
+void lc3_pipe_free(struct lc3_pipe *pipe)
+{
+	if (!pipe)
+		return;
+
+	if (pipe->running) {
+		__atomic_store_n(&pipe->quit, true, __ATOMIC_RELAXED);
+		sem_post(&pipe->items);
+
+		if (pipe->quit_fd >= 0)
+			eventfd_write(pipe->quit_fd, 1);
+
+		pthread_join(pipe->thread, NULL);
+	}
+
+	if (pipe->wav)
+		write_wav_header(pipe);
+
+	pipe_free(pipe);
+}
+
+ssize_t lc3_pipe_pull(struct lc3_pipe *pipe, unsigned int index,
+						void *buf, size_t len)
+{
+	struct lc3_pipe_stream *stream;
+	unsigned int tail;
+	bool eof;
+	uint16_t sdu;
+
+	if (!pipe || !pipe->encode || index >= pipe->streams)
+		return -EINVAL;
+
+	stream = &pipe->stream[index];
+
+	/* Check for end of input first, the last frame is published before
+	 * the flag is set.
+	 */
+	eof = __atomic_load_n(&pipe->eof, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE);
+
+	if (stream->head == tail) {
+		if (eof)
+			return 0;
+
+		stream->starved++;
+		return -EAGAIN;
+	}
+
+	sdu = MIN(*slot_len(pipe, stream->head, index), len);
+	memcpy(buf, slot_data(pipe, stream->head, index), sdu);
+
+	__atomic_store_n(&stream->head, stream->head + 1, __ATOMIC_RELEASE);
+
+	return sdu;
+}
+
+int lc3_pipe_push(struct lc3_pipe *pipe, const struct iovec *iov,
+						unsigned int count)
+{
+	unsigned int tail, i;
+
+	if (!pipe || pipe->encode)
+		return -EINVAL;
+
+	tail = pipe->tail;
+
+	if (tail - __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) >=
+							LC3_PIPE_FRAMES) {
+		for (i = 0; i < pipe->streams; i++)
+			pipe->stream[i].dropped++;
+		return -ENOBUFS;
+	}
+
+	for (i = 0; i < pipe->streams; i++) {
+		uint16_t len = 0;
+
+		if (i < count)
+			len = MIN(iov[i].iov_len, pipe->sdu);
+
+		if (len)
+			memcpy(slot_data(pipe, tail, i), iov[i].iov_base, len);
+
+		*slot_len(pipe, tail, i) = len;
+	}
+
+	__atomic_store_n(&pipe->tail, tail + 1, __ATOMIC_RELEASE);
+	sem_post(&pipe->items);
+
+	return 0;
+}
+
+bool lc3_pipe_get_stats(struct lc3_pipe *pipe, unsigned int index,
+					struct lc3_pipe_stats *stats)
+{
+	struct lc3_pipe_stream *stream;
+
+	if (!pipe || !stats || index >= pipe->streams)
+		return false;
+
+	stream = &pipe->stream[index];
+
+	memset(stats, 0, sizeof(*stats));
+	stats->frames = __atomic_load_n(&stream->frames, __ATOMIC_RELAXED);
+	stats->cpu_time = __atomic_load_n(&stream->cpu_time,
+							__ATOMIC_RELAXED);
+	stats->dropped = stream->dropped;
+	stats->starved = stream->starved;
+
+	if (stats->frames)
+		stats->load = stats->cpu_time * 100 /
+				(stats->frames * pipe->duration);
+
+	return true;
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct lc3_pipe;
+
+struct lc3_pipe_stats {
+	uint64_t frames;	/* Frames encoded or decoded */
+	uint64_t dropped;	/* Frames dropped since the queue was full */
+	uint64_t starved;	/* Frames requested while the queue was empty */
+	uint64_t cpu_time;	/* Codec CPU time (us) */
+	unsigned int load;	/* Codec CPU time per frame duration (%) */
+};
+
+struct lc3_pipe *lc3_pipe_encoder_new(int fd, unsigned int streams,
+					uint32_t rate, uint32_t duration,
+					uint16_t sdu);
+struct lc3_pipe *lc3_pipe_decoder_new(int fd, unsigned int streams,
+					uint32_t rate, uint32_t duration,
+					bool wav);
+void lc3_pipe_free(struct lc3_pipe *pipe);
+
+ssize_t lc3_pipe_pull(struct lc3_pipe *pipe, unsigned int stream,
+						void *buf, size_t len);
+int lc3_pipe_push(struct lc3_pipe *pipe, const struct iovec *iov,
+						unsigned int count);
+
+bool lc3_pipe_get_stats(struct lc3_pipe *pipe, unsigned int stream,
+					struct lc3_pipe_stats *stats);
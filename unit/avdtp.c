@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 
 #include <glib.h>
@@ -279,7 +280,8 @@ struct in_buf {
 	uint8_t message_type;
 	uint8_t signal_id;
 	uint8_t buf[1024];
-	uint8_t data_size;
+	uint8_t *data;		/* Payload, in buf unless it was not fragmented */
+	uint16_t data_size;
 };
 
 struct pending_req {
@@ -429,19 +431,29 @@ static const char *avdtp_statestr(avdtp_state_t state)
 	}
 }
 
-static gboolean try_send(int sk, void *data, size_t len)
+static gboolean try_send(int sk, struct iovec *iov, int iovcnt)
 {
-	int err;
+	struct msghdr msg;
+	size_t len = 0;
+	ssize_t err;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
 
 	do {
-		err = send(sk, data, len, 0);
+		err = sendmsg(sk, &msg, 0);
 	} while (err < 0 && errno == EINTR);
 
 	if (err < 0) {
 		error("send: %s (%d)", strerror(errno), errno);
 		return FALSE;
 	} else if ((size_t) err != len) {
-		error("try_send: complete buffer not sent (%d/%zu bytes)",
+		error("try_send: complete buffer not sent (%zd/%zu bytes)",
 								err, len);
 		return FALSE;
 	}
@@ -456,6 +468,7 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 	unsigned int cont_fragments, sent;
 	struct avdtp_start_header start;
 	struct avdtp_continue_header cont;
+	struct iovec iov[2];
 	int sock;
 
 	if (session->io == NULL) {
@@ -476,10 +489,12 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 		single.message_type = message_type;
 		single.signal_id = signal_id;
 
-		memcpy(session->buf, &single, sizeof(single));
-		memcpy(session->buf + sizeof(single), data, len);
+		iov[0].iov_base = &single;
+		iov[0].iov_len = sizeof(single);
+		iov[1].iov_base = data;
+		iov[1].iov_len = data ? len : 0;
 
-		return try_send(sock, session->buf, sizeof(single) + len);
+		return try_send(sock, iov, 2);
 	}
 
 	/* Check if there is enough space to start packet */
@@ -502,17 +517,24 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 	start.no_of_packets = cont_fragments + 1;
 	start.signal_id = signal_id;
 
-	memcpy(session->buf, &start, sizeof(start));
-	memcpy(session->buf + sizeof(start), data,
-					session->omtu - sizeof(start));
+	/* Fragments are sent straight from the message, only the header is
+	 * prepended to each of them.
+	 */
+	iov[0].iov_base = &start;
+	iov[0].iov_len = sizeof(start);
+	iov[1].iov_base = data;
+	iov[1].iov_len = session->omtu - sizeof(start);
 
-	if (!try_send(sock, session->buf, session->omtu))
+	if (!try_send(sock, iov, 2))
 		return FALSE;
 
 	DBG("first packet with %zu bytes sent", session->omtu - sizeof(start));
 
 	sent = session->omtu - sizeof(start);
 
+	iov[0].iov_base = &cont;
+	iov[0].iov_len = sizeof(cont);
+
 	/* Send the continue fragments and the end packet */
 	while (sent < len) {
 		int left, to_copy;
@@ -531,10 +553,10 @@ static gboolean avdtp_send(struct avdtp *session, uint8_t transaction,
 		cont.transaction = transaction;
 		cont.message_type = message_type;
 
-		memcpy(session->buf, &cont, sizeof(cont));
-		memcpy(session->buf + sizeof(cont), data + sent, to_copy);
+		iov[1].iov_base = data + sent;
+		iov[1].iov_len = to_copy;
 
-		if (!try_send(sock, session->buf, to_copy + sizeof(cont)))
+		if (!try_send(sock, iov, 2))
 			return FALSE;
 
 		sent += to_copy;
@@ -1843,7 +1865,7 @@ static gboolean avdtp_parse_cmd(struct avdtp *session, uint8_t transaction,
 enum avdtp_parse_result { PARSE_ERROR, PARSE_FRAGMENT, PARSE_SUCCESS };
 
 static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
-							void *buf, size_t size)
+						void *buf, size_t size)
 {
 	struct avdtp_common_header *header = buf;
 	struct avdtp_single_header *single = (void *) session->buf;
@@ -1863,17 +1885,14 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 			return PARSE_ERROR;
 		}
 
-		payload = session->buf + sizeof(*single);
-		payload_size = size - sizeof(*single);
-
-		session->in.active = TRUE;
-		session->in.data_size = 0;
-		session->in.no_of_packets = 1;
+		/* Not fragmented, parse the payload where it was read */
+		session->in.data = session->buf + sizeof(*single);
+		session->in.data_size = size - sizeof(*single);
 		session->in.transaction = header->transaction;
 		session->in.message_type = header->message_type;
 		session->in.signal_id = single->signal_id;
 
-		break;
+		return PARSE_SUCCESS;
 	case AVDTP_PKT_TYPE_START:
 		if (size < sizeof(*start)) {
 			error("Received too small start packet (%zu bytes)",
@@ -1886,6 +1905,7 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 		}
 
 		session->in.active = TRUE;
+		session->in.data = session->in.buf;
 		session->in.data_size = 0;
 		session->in.transaction = header->transaction;
 		session->in.message_type = header->message_type;
@@ -1954,6 +1974,7 @@ static enum avdtp_parse_result avdtp_parse_data(struct avdtp *session,
 	}
 
 	memcpy(session->in.buf + session->in.data_size, payload, payload_size);
+
 	session->in.data_size += payload_size;
 
 	if (session->in.no_of_packets > 1) {
@@ -2016,7 +2037,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 	if (session->in.message_type == AVDTP_MSG_TYPE_COMMAND) {
 		if (!avdtp_parse_cmd(session, session->in.transaction,
 					session->in.signal_id,
-					session->in.buf,
+					session->in.data,
 					session->in.data_size)) {
 			error("Unable to handle command. Disconnecting");
 			goto failed;
@@ -2057,7 +2078,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 		if (!avdtp_parse_resp(session, session->req->stream,
 						session->in.transaction,
 						session->in.signal_id,
-						session->in.buf,
+						session->in.data,
 						session->in.data_size)) {
 			error("Unable to parse accept response");
 			goto failed;
@@ -2067,7 +2088,7 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 		if (!avdtp_parse_rej(session, session->req->stream,
 						session->in.transaction,
 						session->in.signal_id,
-						session->in.buf,
+						session->in.data,
 						session->in.data_size)) {
 			error("Unable to parse reject response");
 			goto failed;
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "src/shared/tester.h"
+#include "profiles/audio/a2dp-adapt.h"
+
+#define MTU		895
+#define INTERVALS	1000
+
+static void test_clamp(const void *data)
+{
+	struct a2dp_adapt adapt;
+
+	a2dp_adapt_reset(&adapt, MTU);
+
+	/* Kernel default is way above what the stream needs */
+	g_assert_cmpint(a2dp_adapt_clamp(&adapt, 106496), ==,
+					A2DP_ADAPT_MAX_PKTS * MTU);
+	g_assert_cmpint(a2dp_adapt_clamp(&adapt, MTU), ==,
+					A2DP_ADAPT_MIN_PKTS * MTU);
+	g_assert_cmpint(a2dp_adapt_clamp(&adapt, 4 * MTU), ==, 4 * MTU);
+
+	tester_test_passed();
+}
+
+static void test_congested(const void *data)
+{
+	struct a2dp_adapt adapt;
+	int size = A2DP_ADAPT_MIN_PKTS * MTU;
+	uint8_t hint;
+	int i;
+
+	a2dp_adapt_reset(&adapt, MTU);
+
+	/* A link that never drains grows the buffer to the maximum and lowers
+	 * the hint down to its floor.
+	 */
+	for (i = 0, hint = adapt.hint; i < INTERVALS; i++) {
+		int new_size = a2dp_adapt_update(&adapt, size, size);
+
+		g_assert_cmpint(new_size, >=, size);
+		g_assert_cmpint(adapt.hint, <=, hint);
+
+		size = new_size;
+		hint = adapt.hint;
+	}
+
+	tester_debug("size %d hint %u", size, adapt.hint);
+
+	g_assert_cmpint(size, ==, A2DP_ADAPT_MAX_PKTS * MTU);
+	g_assert_cmpint(adapt.hint, ==, 50);
+
+	/* Once drained the hint and the buffer go back to their defaults */
+	for (i = 0, hint = adapt.hint; i < INTERVALS; i++) {
+		int new_size = a2dp_adapt_update(&adapt, 0, size);
+
+		g_assert_cmpint(new_size, <=, size);
+		g_assert_cmpint(adapt.hint, >=, hint);
+
+		size = new_size;
+		hint = adapt.hint;
+	}
+
+	tester_debug("size %d hint %u", size, adapt.hint);
+
+	g_assert_cmpint(size, ==, A2DP_ADAPT_MIN_PKTS * MTU);
+	g_assert_cmpint(adapt.hint, ==, 100);
+
+	tester_test_passed();
+}
+
+static void test_oversized(const void *data)
+{
+	struct a2dp_adapt adapt;
+	int size = 106496;
+	int i;
+
+	a2dp_adapt_reset(&adapt, MTU);
+
+	/* A buffer enlarged by its owner shall neither hide the congestion
+	 * nor be kept above the managed range.
+	 */
+	for (i = 0; i < INTERVALS; i++)
+		size = a2dp_adapt_update(&adapt, A2DP_ADAPT_MAX_PKTS * MTU,
+									size);
+
+	tester_debug("size %d hint %u", size, adapt.hint);
+
+	g_assert_cmpint(size, ==, A2DP_ADAPT_MAX_PKTS * MTU);
+	g_assert_cmpint(adapt.hint, ==, 50);
+
+	tester_test_passed();
+}
+
+static void test_idle(const void *data)
+{
+	struct a2dp_adapt adapt;
+	int size = 4 * MTU;
+	int i;
+
+	a2dp_adapt_reset(&adapt, MTU);
+
+	/* A queue kept partly full is neither congested nor clear */
+	for (i = 0; i < INTERVALS; i++)
+		size = a2dp_adapt_update(&adapt, size * 3 / 10, size);
+
+	g_assert_cmpint(size, ==, 4 * MTU);
+	g_assert_cmpint(adapt.hint, ==, 100);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/a2dp-adapt/clamp", NULL, NULL, test_clamp, NULL);
+	tester_add("/a2dp-adapt/congested", NULL, NULL, test_congested, NULL);
+	tester_add("/a2dp-adapt/oversized", NULL, NULL, test_oversized, NULL);
+	tester_add("/a2dp-adapt/idle", NULL, NULL, test_idle, NULL);
+
+	return tester_run();
+}
@@ -31,6 +31,8 @@
 
 #define MAX_SEID 0x3E
 
+#define MANY_SEPS 20
+
 struct test_pdu {
 	bool valid;
 	bool fragmented;
@@ -763,6 +765,160 @@ static void test_client_frg(gconstpointer data)
 	avdtp_discover(context->session, discover_cb, context);
 }
 
+struct many_seps {
+	struct queue *lseps;
+	struct queue *rseps;
+	struct avdtp *session;
+	struct avdtp *remote;
+	struct avdtp_local_sep *sep;
+	unsigned int configured;
+};
+
+static gboolean many_seps_setconf_ind(struct avdtp *session,
+						struct avdtp_local_sep *sep,
+						struct avdtp_stream *stream,
+						GSList *caps,
+						avdtp_set_configuration_cb cb,
+						void *user_data)
+{
+	struct many_seps *test = user_data;
+
+	/* Media Transport and Media Codec as sent by the initiator, plus
+	 * Delay Reporting added since both sides are AVDTP 1.3.
+	 */
+	g_assert_cmpint(g_slist_length(caps), ==, 3);
+
+	test->configured++;
+
+	cb(session, stream, NULL);
+
+	return TRUE;
+}
+
+static struct avdtp_sep_ind many_seps_ind = {
+	.get_capability		= sep_getcap_ind_frg,
+	.set_configuration	= many_seps_setconf_ind,
+};
+
+static gboolean many_seps_done(gpointer user_data)
+{
+	struct many_seps *test = user_data;
+
+	/* Only the selected remote SEP was configured */
+	g_assert_cmpint(test->configured, ==, 1);
+
+	avdtp_unref(test->session);
+	avdtp_unref(test->remote);
+
+	queue_destroy(test->lseps, unregister_sep);
+	queue_destroy(test->rseps, unregister_sep);
+	g_free(test);
+
+	tester_test_passed();
+
+	return FALSE;
+}
+
+static void many_seps_setconf_cfm(struct avdtp *session,
+				struct avdtp_local_sep *sep,
+				struct avdtp_stream *stream,
+				struct avdtp_error *err, void *user_data)
+{
+	struct many_seps *test = user_data;
+
+	g_assert(err == NULL);
+
+	g_idle_add(many_seps_done, test);
+}
+
+static struct avdtp_sep_cfm many_seps_cfm = {
+	.set_configuration	= many_seps_setconf_cfm,
+};
+
+static void many_seps_discover_cb(struct avdtp *session, GSList *seps,
+				struct avdtp_error *err, void *user_data)
+{
+	struct many_seps *test = user_data;
+	struct avdtp_stream *stream;
+	struct avdtp_remote_sep *rsep;
+	struct avdtp_service_capability *media_transport, *media_codec;
+	struct avdtp_media_codec_capability *cap;
+	GSList *caps;
+	uint8_t data[4] = { 0x21, 0x02, 2, 32 };
+	int ret;
+
+	g_assert(err == NULL);
+
+	/* Every SEP with its fragmented capabilities reassembled */
+	g_assert_cmpint(g_slist_length(seps), ==, MANY_SEPS);
+
+	rsep = avdtp_find_remote_sep(session, test->sep);
+	g_assert(rsep != NULL);
+
+	media_transport = avdtp_service_cap_new(AVDTP_MEDIA_TRANSPORT,
+						NULL, 0);
+
+	caps = g_slist_append(NULL, media_transport);
+
+	cap = g_malloc0(sizeof(*cap) + sizeof(data));
+	cap->media_type = AVDTP_MEDIA_TYPE_AUDIO;
+	cap->media_codec_type = 0x00;
+	memcpy(cap->data, data, sizeof(data));
+
+	media_codec = avdtp_service_cap_new(AVDTP_MEDIA_CODEC, cap,
+						sizeof(*cap) + sizeof(data));
+
+	caps = g_slist_append(caps, media_codec);
+	g_free(cap);
+
+	ret = avdtp_set_configuration(session, rsep, test->sep, caps,
+								&stream);
+	g_assert_cmpint(ret, ==, 0);
+
+	g_slist_free_full(caps, g_free);
+}
+
+static void test_many_seps(gconstpointer data)
+{
+	struct many_seps *test = g_new0(struct many_seps, 1);
+	struct avdtp_local_sep *sep;
+	unsigned int i;
+	int err, sv[2];
+
+	test->lseps = queue_new();
+	test->rseps = queue_new();
+
+	test->sep = avdtp_register_sep(test->lseps, AVDTP_SEP_TYPE_SINK,
+					AVDTP_MEDIA_TYPE_AUDIO,
+					0x00, TRUE, NULL, &many_seps_cfm, test);
+	g_assert(test->sep);
+
+	for (i = 0; i < MANY_SEPS; i++) {
+		sep = avdtp_register_sep(test->rseps, AVDTP_SEP_TYPE_SOURCE,
+						AVDTP_MEDIA_TYPE_AUDIO,
+						0x00, TRUE, &many_seps_ind,
+						NULL, test);
+		g_assert(sep);
+	}
+
+	err = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
+	g_assert(err == 0);
+
+	/* Small MTU so the capabilities of each SEP are fragmented */
+	test->session = avdtp_new(sv[0], 48, 48, 0x0103, test->lseps);
+	g_assert(test->session != NULL);
+
+	test->remote = avdtp_new(sv[1], 48, 48, 0x0103, test->rseps);
+	g_assert(test->remote != NULL);
+
+	/* Sessions use their own copy of the fds */
+	close(sv[0]);
+	close(sv[1]);
+
+	err = avdtp_discover(test->session, many_seps_discover_cb, test);
+	g_assert_cmpint(err, ==, 0);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -1373,5 +1529,13 @@ int main(int argc, char *argv[])
 			raw_pdu(0x50, 0x0d, 0x04, 0x00, 0x00),
 			raw_pdu(0x52, 0x0d));
 
+	/*
+	 * Many SEPs
+	 *
+	 * discover and configure a remote exposing many SEPs, with
+	 * capabilities replies that need fragmentation.
+	 */
+	tester_add("/TP/SIG/FRA/MANY-SEPS", NULL, NULL, test_many_seps, NULL);
+
 	return tester_run();
 }
@@ -46,6 +46,7 @@ struct test_config {
 	bool snk;
 	bool src;
 	bool vs;
+	bool pipeline;
 	uint8_t state;
 	bt_bap_state_func_t state_func;
 	uint8_t streams;
@@ -76,6 +77,7 @@ struct test_data {
 	size_t iovcnt;
 	struct iovec *iov;
 	int fds[8][2];
+	unsigned int qos_done;
 };
 
 struct notify {
@@ -7806,6 +7808,121 @@ static void test_bsrc_scc(void)
 	test_bsrc_scc_release();
 }
 
+#define BIG_NUM_BIS	3
+
+/* Handles below the one pointed by user_data are in use */
+static bool big_in_use(uint8_t big, void *user_data)
+{
+	const uint8_t *free_big = user_data;
+
+	return big < *free_big;
+}
+
+static void big_qos_init(struct bt_bap_qos *qos,
+				struct bt_bap_bcast_qos **group)
+{
+	const struct bt_bap_qos lc3_qos = LC3_QOS_16_2_1_B;
+	unsigned int i;
+
+	for (i = 0; i < BIG_NUM_BIS; i++) {
+		qos[i] = lc3_qos;
+		qos[i].bcast.big = BT_ISO_QOS_BIG_UNSET;
+		group[i] = &qos[i].bcast;
+	}
+}
+
+static void test_big_alloc(const void *user_data)
+{
+	struct bt_bap_qos qos[BIG_NUM_BIS];
+	struct bt_bap_bcast_qos *group[BIG_NUM_BIS];
+	uint8_t free_big = 0x02;
+	unsigned int i;
+
+	big_qos_init(qos, group);
+
+	g_assert_cmpint(bt_bap_bcast_qos_group(group, BIG_NUM_BIS,
+					big_in_use, &free_big), ==, 0);
+
+	for (i = 0; i < BIG_NUM_BIS; i++)
+		g_assert_cmpint(qos[i].bcast.big, ==, free_big);
+
+	/* A BIG already set by one of the BISes is kept for all of them */
+	big_qos_init(qos, group);
+	qos[1].bcast.big = 0x05;
+
+	g_assert_cmpint(bt_bap_bcast_qos_group(group, BIG_NUM_BIS,
+					big_in_use, &free_big), ==, 0);
+
+	for (i = 0; i < BIG_NUM_BIS; i++)
+		g_assert_cmpint(qos[i].bcast.big, ==, 0x05);
+
+	tester_test_passed();
+}
+
+static void test_big_mismatch_qos(const void *user_data)
+{
+	struct bt_bap_qos qos[BIG_NUM_BIS];
+	struct bt_bap_bcast_qos *group[BIG_NUM_BIS];
+	uint8_t free_big = 0x00;
+	unsigned int i;
+
+	big_qos_init(qos, group);
+	qos[2].bcast.io_qos.sdu++;
+
+	g_assert_cmpint(bt_bap_bcast_qos_group(group, BIG_NUM_BIS,
+					big_in_use, &free_big), ==, -EINVAL);
+
+	for (i = 0; i < BIG_NUM_BIS; i++)
+		g_assert_cmpint(qos[i].bcast.big, ==, BT_ISO_QOS_BIG_UNSET);
+
+	tester_test_passed();
+}
+
+static void test_big_mismatch_big(const void *user_data)
+{
+	struct bt_bap_qos qos[BIG_NUM_BIS];
+	struct bt_bap_bcast_qos *group[BIG_NUM_BIS];
+	uint8_t free_big = 0x00;
+
+	big_qos_init(qos, group);
+	qos[0].bcast.big = 0x01;
+	qos[2].bcast.big = 0x02;
+
+	g_assert_cmpint(bt_bap_bcast_qos_group(group, BIG_NUM_BIS,
+					big_in_use, &free_big), ==, -EINVAL);
+	g_assert_cmpint(qos[1].bcast.big, ==, BT_ISO_QOS_BIG_UNSET);
+
+	tester_test_passed();
+}
+
+static void test_big_exhausted(const void *user_data)
+{
+	struct bt_bap_qos qos[BIG_NUM_BIS];
+	struct bt_bap_bcast_qos *group[BIG_NUM_BIS];
+	uint8_t free_big = 0xf0;
+
+	big_qos_init(qos, group);
+
+	g_assert_cmpint(bt_bap_bcast_qos_group(group, BIG_NUM_BIS,
+					big_in_use, &free_big), ==, -EBUSY);
+	g_assert_cmpint(qos[0].bcast.big, ==, BT_ISO_QOS_BIG_UNSET);
+
+	tester_test_passed();
+}
+
+/* Grouping of the BISes configured at once by SetConfigurations */
+static void test_bsrc_big(void)
+{
+	define_test("BAP/BSRC/BIG/BLUEZ-1 [BSRC, Allocate BIG]",
+		NULL, test_big_alloc, NULL, IOV_NULL);
+	define_test("BAP/BSRC/BIG/BLUEZ-2 [BSRC, Mismatched QoS]",
+		NULL, test_big_mismatch_qos, NULL, IOV_NULL);
+	define_test("BAP/BSRC/BIG/BLUEZ-3 [BSRC, Mismatched BIG]",
+		NULL, test_big_mismatch_big, NULL, IOV_NULL);
+	define_test("BAP/BSRC/BIG/BLUEZ-4 [BSRC, No BIG available]",
+		NULL, test_big_exhausted, NULL, IOV_NULL);
+}
+
 static struct test_config cfg_bsnk_8_1 = {
 	.cc = LC3_CONFIG_8_1,
 	.qos = QOS_BCAST,
@@ -9113,7 +9230,7 @@ static void test_bsrc_str(void)
 #define ENABLE_ASE4(id1, id2, id3, id4) \
 	IOV_DATA(ENABLE_PDU(4), ENABLE_PDU_ASE(id1), ENABLE_PDU_ASE(id2), \
 		ENABLE_PDU_ASE(id3), ENABLE_PDU_ASE(id4)), \
-	IOV_DATA(0x1b, CP_HND, 0x03, 0x03, id1, 0x00, 0x00, id2, 0x00, 0x00, \
+	IOV_DATA(0x1b, CP_HND, 0x03, 0x04, id1, 0x00, 0x00, id2, 0x00, 0x00, \
 		id3, 0x00, 0x00, id4, 0x00, 0x00)
 
 #define START_ASE2(id1, id2) \
@@ -9572,6 +9689,15 @@ static struct test_config cfg_str_ac6i = {
 	.qos = LC3_QOS_8_1_1,
 };
 
+static struct test_config cfg_str_ac6i_pipeline = {
+	.snk = true,
+	.src = true,
+	.snk_locations = { 0x1, 0x10, -1 },
+	.src_locations = { -1 },
+	.qos = LC3_QOS_8_1_1,
+	.pipeline = true,
+};
+
 static struct test_config cfg_str_vs_ac6i = {
 	.snk = true,
 	.src = true,
@@ -9785,8 +9911,17 @@ static void streaming_ucl_do_stream(struct bt_bap_stream *stream,
 	}
 
 	/* All streams handled */
-	if (data->id == 0)
-		tester_test_passed();
+	if (data->id)
+		return;
+
+	/* Each pipelined QoS got its own response */
+	if (data->cfg->pipeline &&
+			data->qos_done != queue_length(data->streams)) {
+		FAIL_TEST();
+		return;
+	}
+
+	tester_test_passed();
 }
 
 static void streaming_ucl_connect(struct bt_bap_stream *stream)
@@ -9874,6 +10009,11 @@ static void streaming_ucl_state(struct bt_bap_stream *stream,
 	case BT_BAP_STREAM_STATE_CONFIG:
 		qos.ucast.cig_id = 0;
 		qos.ucast.cis_id = streaming_ucl_create_io(stream, data);
+
+		/* QoS already queued together with Config */
+		if (data->cfg->pipeline)
+			break;
+
 		id = bt_bap_stream_qos(stream, &qos, NULL, NULL);
 		g_assert(id);
 		break;
@@ -9911,6 +10051,22 @@ static void streaming_ucl_state(struct bt_bap_stream *stream,
 	}
 }
 
+static void pipeline_qos_cb(struct bt_bap_stream *stream, uint8_t code,
+					uint8_t reason, void *user_data)
+{
+	struct test_data *data = user_data;
+
+	tester_debug("stream %p QoS code 0x%02x reason 0x%02x", stream, code,
+								reason);
+
+	if (code) {
+		FAIL_TEST();
+		return;
+	}
+
+	data->qos_done++;
+}
+
 static void test_select_cb(struct bt_bap_pac *pac, int err,
 			struct iovec *caps, struct iovec *metadata,
 			struct bt_bap_qos *qos, void *user_data)
@@ -9952,6 +10108,22 @@ static void test_select_cb(struct bt_bap_pac *pac, int err,
 		return;
 	}
 
+	/* Queue QoS without waiting for Config to complete, it shall still
+	 * be sent for all the streams in a single write after Config.
+	 */
+	if (data->cfg->pipeline) {
+		unsigned int id;
+
+		qos->ucast.cig_id = 0;
+		qos->ucast.cis_id = sdata->stream_idx;
+
+		id = bt_bap_stream_qos(stream, qos, pipeline_qos_cb, data);
+		if (!id) {
+			FAIL_TEST();
+			return;
+		}
+	}
+
 	bt_bap_stream_set_user_data(stream, UINT_TO_PTR(sdata->stream_idx));
 	sdata->stream_idx++;
 }
@@ -10252,6 +10424,8 @@ static void test_ucl_str(void)
 	define_test("BAP/UCL/STR/BLUEZ-2 [UCL, Custom AC, 8 -> 4+4 Ch, "
 					"Generic]",
 		test_setup, test_select, &cfg_str_many_8, DISC_MANY);
+	define_test("BAP/UCL/STR/BLUEZ-3 [UCL, AC 6(i), Generic, Pipelined]",
+		test_setup, test_select, &cfg_str_ac6i_pipeline, STR_AC6i);
 }
 
 int main(int argc, char *argv[])
@@ -10261,6 +10435,7 @@ int main(int argc, char *argv[])
 	test_disc();
 	test_scc();
 	test_bsrc_scc();
+	test_bsrc_big();
 	test_bsnk_scc();
 	test_bsnk_str();
 	test_bsrc_str();
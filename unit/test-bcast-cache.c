@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "bluetooth/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/tester.h"
+#include "src/shared/bcast-cache.h"
+
+static const bdaddr_t addr_a = { { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 } };
+static const bdaddr_t addr_b = { { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 } };
+
+static uint8_t base_data[] = { 0x28, 0x00, 0x00, 0x01, 0x01, 0x06 };
+static const struct iovec base = { base_data, sizeof(base_data) };
+
+static void store(struct bcast_cache *cache, const bdaddr_t *bdaddr,
+						uint32_t bid, uint8_t sid)
+{
+	struct bt_iso_qos qos;
+
+	memset(&qos, 0, sizeof(qos));
+	qos.bcast.big = 0x01;
+
+	g_assert_true(bcast_cache_store(cache, bdaddr, BDADDR_LE_PUBLIC, bid,
+							sid, &base, &qos));
+}
+
+static struct bcast_cache_entry *lookup(struct bcast_cache *cache,
+				const bdaddr_t *bdaddr, uint32_t bid,
+				uint8_t sid)
+{
+	return bcast_cache_lookup(cache, bdaddr, BDADDR_LE_PUBLIC, bid, sid);
+}
+
+static void test_lookup(const void *data)
+{
+	struct bcast_cache *cache = bcast_cache_new(4, 0);
+	struct bcast_cache_entry *entry;
+
+	store(cache, &addr_a, 0x123456, 0x02);
+
+	entry = lookup(cache, &addr_a, 0x123456, 0x02);
+	g_assert_nonnull(entry);
+	g_assert_cmpint(entry->sid, ==, 0x02);
+	g_assert_cmpint(entry->base->iov_len, ==, base.iov_len);
+	g_assert_true(!memcmp(entry->base->iov_base, base.iov_base,
+							base.iov_len));
+	g_assert_cmpint(entry->qos.bcast.big, ==, 0x01);
+
+	/* The SID is only known once synced, 0xff matches any */
+	g_assert_true(lookup(cache, &addr_a, 0x123456, 0xff) == entry);
+	g_assert_null(lookup(cache, &addr_a, 0x123456, 0x03));
+
+	g_assert_null(lookup(cache, &addr_a, 0x654321, 0xff));
+	g_assert_null(lookup(cache, &addr_b, 0x123456, 0xff));
+	g_assert_null(bcast_cache_lookup(cache, &addr_a, BDADDR_LE_RANDOM,
+							0x123456, 0xff));
+
+	/* 0xff is only a wildcard, entries are stored with the actual SID */
+	g_assert_false(bcast_cache_store(cache, &addr_a, BDADDR_LE_PUBLIC,
+					0x123456, 0xff, &base, &entry->qos));
+
+	bcast_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_sid(const void *data)
+{
+	struct bcast_cache *cache = bcast_cache_new(4, 0);
+	struct bcast_cache_entry *entry;
+
+	store(cache, &addr_a, 0x123456, 0x02);
+
+	/* Advertising set restarted with another SID replaces the entry */
+	store(cache, &addr_a, 0x123456, 0x05);
+	g_assert_cmpint(bcast_cache_get_count(cache), ==, 1);
+	g_assert_null(lookup(cache, &addr_a, 0x123456, 0x02));
+
+	entry = lookup(cache, &addr_a, 0x123456, 0xff);
+	g_assert_nonnull(entry);
+	g_assert_cmpint(entry->sid, ==, 0x05);
+
+	bcast_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_ttl(const void *data)
+{
+	struct bcast_cache *cache = bcast_cache_new(4, 10);
+
+	store(cache, &addr_a, 0x123456, 0x02);
+	g_assert_nonnull(lookup(cache, &addr_a, 0x123456, 0xff));
+
+	/* Stale entries are kept until refreshed but no longer returned */
+	usleep(20 * 1000);
+	g_assert_null(lookup(cache, &addr_a, 0x123456, 0xff));
+	g_assert_cmpint(bcast_cache_get_count(cache), ==, 1);
+
+	store(cache, &addr_a, 0x123456, 0x02);
+	g_assert_nonnull(lookup(cache, &addr_a, 0x123456, 0xff));
+	g_assert_cmpint(bcast_cache_get_count(cache), ==, 1);
+
+	bcast_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_evict(const void *data)
+{
+	struct bcast_cache *cache = bcast_cache_new(4, 0);
+	uint32_t bid;
+
+	for (bid = 0; bid < 4; bid++)
+		store(cache, &addr_a, bid, 0x01);
+
+	/* Refreshing an entry makes it the last one to be evicted */
+	store(cache, &addr_a, 0, 0x01);
+
+	store(cache, &addr_b, 0, 0x01);
+	g_assert_cmpint(bcast_cache_get_count(cache), ==, 4);
+
+	g_assert_null(lookup(cache, &addr_a, 1, 0xff));
+	g_assert_nonnull(lookup(cache, &addr_a, 0, 0xff));
+	g_assert_nonnull(lookup(cache, &addr_a, 2, 0xff));
+	g_assert_nonnull(lookup(cache, &addr_a, 3, 0xff));
+	g_assert_nonnull(lookup(cache, &addr_b, 0, 0xff));
+
+	bcast_cache_free(cache);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/bcast-cache/lookup", NULL, NULL, test_lookup, NULL);
+	tester_add("/bcast-cache/sid", NULL, NULL, test_sid, NULL);
+	tester_add("/bcast-cache/ttl", NULL, NULL, test_ttl, NULL);
+	tester_add("/bcast-cache/evict", NULL, NULL, test_evict, NULL);
+
+	return tester_run();
+}
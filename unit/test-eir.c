@@ -13,6 +13,7 @@
 #endif
 
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include <glib.h>
 
@@ -21,6 +22,7 @@
 #include "bluetooth/sdp.h"
 #include "src/shared/tester.h"
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 #include "src/shared/ad.h"
 #include "src/eir.h"
 
@@ -632,6 +634,39 @@ static void test_ad(const struct test_data *test, struct eir_data *eir)
 	bt_ad_unref(ad);
 }
 
+static void test_view(const struct test_data *test, struct eir_data *eir)
+{
+	struct eir_view view;
+	GSList *list;
+
+	eir_parse_view(&view, test->eir_data, test->eir_size);
+
+	g_assert_cmpint(view.flags, ==, eir->flags);
+	g_assert_cmpstr(view.name, ==, eir->name);
+	g_assert(view.name_complete == eir->name_complete);
+	g_assert(view.rsi == eir->rsi);
+	g_assert(view.tx_power == eir->tx_power);
+
+	for (list = eir->sd_list; list; list = list->next) {
+		struct eir_sd *sd = list->data;
+		const uint8_t *sd_data;
+		uint8_t sd_len;
+
+		/* Only 16-bit UUIDs can be looked up in place */
+		if (strncmp(sd->uuid, "0000", 4) ||
+			strcmp(sd->uuid + 8, "-0000-1000-8000-00805f9b34fb"))
+			continue;
+
+		sd_data = eir_get_service_data16(test->eir_data,
+					test->eir_size,
+					strtol(sd->uuid + 4, NULL, 16) & 0xffff,
+					&sd_len);
+		g_assert(sd_data);
+		g_assert_cmpint(sd_len, ==, sd->data_len);
+		g_assert(!memcmp(sd_data, sd->data, sd_len));
+	}
+}
+
 static void test_parsing(gconstpointer data)
 {
 	const struct test_data *test = data;
@@ -694,6 +729,8 @@ static void test_parsing(gconstpointer data)
 
 	test_ad(data, &eir);
 
+	test_view(data, &eir);
+
 	eir_data_free(&eir);
 
 	tester_test_passed();
@@ -736,6 +773,171 @@ static const struct test_data uri_beacon_test = {
 	.uuid = uri_beacon_uuid,
 };
 
+static const struct test_data *corpus_tests[] = {
+	&macbookair_test,
+	&iphone5_test,
+	&ipadmini_test,
+	&gigaset_sl400h_test,
+	&gigaset_sl910_test,
+	&nokia_bh907_test,
+	&fuelband_test,
+	&bluesc_test,
+	&wahoo_scale_test,
+	&mio_alpha_test,
+	&cookoo_test,
+	&citizen_adv_test,
+	&citizen_scan_test,
+	&gigaset_gtag_test,
+	&uri_beacon_test,
+};
+
+#define MATCHER_PATTERNS 1000
+
+/* Derives a pattern from the given report, every other one is altered so
+ * that it doesn't match.
+ */
+static struct bt_ad_pattern *matcher_pattern(const struct test_data *test,
+							unsigned int n)
+{
+	struct eir_iter iter;
+	const uint8_t *data;
+	uint8_t type, len, offset, pattern_len;
+	uint8_t value[3];
+	unsigned int fields = 0, field;
+
+	eir_iter_init(&iter, test->eir_data, test->eir_size);
+	while (eir_iter_next(&iter, &type, &data, &len))
+		fields++;
+
+	if (!fields)
+		return NULL;
+
+	eir_iter_init(&iter, test->eir_data, test->eir_size);
+	for (field = 0; field <= (n / 2) % fields; field++)
+		eir_iter_next(&iter, &type, &data, &len);
+
+	/* Service data patterns apply past the UUID */
+	switch (type) {
+	case EIR_SVC_DATA16:
+		data += 2;
+		len = len > 2 ? len - 2 : 0;
+		break;
+	case EIR_SVC_DATA32:
+		data += 4;
+		len = len > 4 ? len - 4 : 0;
+		break;
+	case EIR_SVC_DATA128:
+		data += 16;
+		len = len > 16 ? len - 16 : 0;
+		break;
+	}
+
+	if (!len)
+		return NULL;
+
+	offset = n % len;
+	pattern_len = MIN(len - offset, 1 + n % sizeof(value));
+	memcpy(value, data + offset, pattern_len);
+
+	if (n % 2)
+		value[pattern_len - 1] ^= 0xff;
+
+	return bt_ad_pattern_new(type, offset, pattern_len, value);
+}
+
+static void matcher_count(void *match_data, void *user_data)
+{
+	unsigned int *matched = user_data;
+
+	matched[PTR_TO_UINT(match_data)]++;
+}
+
+/*
+ * Check that the compiled matcher finds the same monitors as running
+ * bt_ad_pattern_match() for each of them, each matched monitor being
+ * reported exactly once per advertisement.
+ */
+static void test_matcher(const void *data)
+{
+	struct queue *patterns[MATCHER_PATTERNS];
+	unsigned int matched[MATCHER_PATTERNS];
+	struct bt_ad *ads[G_N_ELEMENTS(corpus_tests)];
+	struct bt_ad_matcher *matcher;
+	unsigned int i, j, total = 0, missed = 0;
+
+	matcher = bt_ad_matcher_new();
+
+	for (i = 0; i < MATCHER_PATTERNS; i++) {
+		const struct test_data *test;
+		struct bt_ad_pattern *pattern;
+
+		test = corpus_tests[i % G_N_ELEMENTS(corpus_tests)];
+		pattern = matcher_pattern(test, i);
+
+		patterns[i] = queue_new();
+		if (pattern)
+			queue_push_tail(patterns[i], pattern);
+
+		/* Monitors with the OR of two patterns */
+		pattern = matcher_pattern(test, i / 3);
+		if (pattern && i % 3 == 0)
+			queue_push_tail(patterns[i], pattern);
+		else
+			free(pattern);
+
+		if (!queue_isempty(patterns[i]))
+			g_assert(bt_ad_matcher_add(matcher, patterns[i],
+							UINT_TO_PTR(i)));
+	}
+
+	for (j = 0; j < G_N_ELEMENTS(corpus_tests); j++) {
+		const struct test_data *test = corpus_tests[j];
+
+		ads[j] = bt_ad_new_with_data(test->eir_size, test->eir_data);
+		g_assert(ads[j]);
+
+		memset(matched, 0, sizeof(matched));
+
+		bt_ad_matcher_match(matcher, ads[j], matcher_count, matched);
+
+		for (i = 0; i < MATCHER_PATTERNS; i++) {
+			bool match = bt_ad_pattern_match(ads[j], patterns[i]);
+
+			g_assert_cmpuint(matched[i], ==, match);
+
+			if (match)
+				total++;
+			else if (!queue_isempty(patterns[i]))
+				missed++;
+		}
+	}
+
+	/* The corpus has to exercise both outcomes */
+	g_assert(total);
+	g_assert(missed);
+
+	/* Removed patterns must no longer match */
+	for (i = 0; i < MATCHER_PATTERNS; i++)
+		bt_ad_matcher_remove(matcher, UINT_TO_PTR(i));
+
+	for (j = 0; j < G_N_ELEMENTS(corpus_tests); j++) {
+		memset(matched, 0, sizeof(matched));
+		bt_ad_matcher_match(matcher, ads[j], matcher_count, matched);
+
+		for (i = 0; i < MATCHER_PATTERNS; i++)
+			g_assert_cmpuint(matched[i], ==, 0);
+
+		bt_ad_unref(ads[j]);
+	}
+
+	for (i = 0; i < MATCHER_PATTERNS; i++)
+		queue_destroy(patterns[i], free);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -767,6 +969,7 @@ int main(int argc, char *argv[])
 									NULL);
 	tester_add("ad/g-tag", &gigaset_gtag_test, NULL, test_parsing, NULL);
 	tester_add("ad/uri-beacon", &uri_beacon_test, NULL, test_parsing, NULL);
+	tester_add("/eir/ad-matcher", NULL, NULL, test_matcher, NULL);
 
 	return tester_run();
 }
@@ -19,10 +19,12 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 
 #include "bluetooth/bluetooth.h"
+#include "bluetooth/l2cap.h"
 #include "bluetooth/uuid.h"
 #include "src/shared/util.h"
 #include "src/shared/att.h"
@@ -45,6 +47,15 @@ enum context_type {
 	SERVER
 };
 
+#define NOTIFY_HANDLES		64
+#define NOTIFY_HANDLERS		4
+
+struct notify_handler {
+	struct context *context;
+	uint16_t value_handle;
+	unsigned int received;
+};
+
 struct test_data {
 	char *test_name;
 	struct test_pdu *pdu_list;
@@ -66,6 +77,16 @@ struct context {
 	unsigned int pdu_offset;
 	const struct test_data *data;
 	struct bt_gatt_request *req;
+	struct queue *server_chans;
+	unsigned int pending_reads;
+	unsigned int writes_queued;
+	unsigned int writes_inflight;
+	unsigned int writes_received;
+	unsigned int notifications;
+	unsigned int notifications_expected;
+	uint16_t notify_handles[NOTIFY_HANDLES];
+	unsigned int notify_handle_count;
+	struct notify_handler notify_handlers[NOTIFY_HANDLES][NOTIFY_HANDLERS];
 };
 
 #define data(args...) ((const unsigned char[]) { args })
@@ -328,6 +349,8 @@ struct test_step {
 	uint8_t expected_att_ecode;
 	const uint8_t *value;
 	uint16_t length;
+	uint16_t mtu;
+	uint8_t features;
 };
 
 static void destroy_context(struct context *context)
@@ -342,6 +365,7 @@ static void destroy_context(struct context *context)
 	bt_gatt_server_unref(context->server);
 	gatt_db_unref(context->client_db);
 	gatt_db_unref(context->server_db);
+	queue_destroy(context->server_chans, NULL);
 
 	if (context->att)
 		bt_att_unref(context->att);
@@ -765,6 +789,48 @@ static const struct test_step test_read_1 = {
 	.length = 0x03
 };
 
+static void test_cached_value(struct context *context)
+{
+	const struct test_step *step = context->data->step;
+	const uint8_t *value;
+	uint16_t length;
+
+	g_assert(bt_gatt_client_get_cached_value(context->client,
+						step->handle, &value, &length));
+	g_assert_cmpint(length, ==, step->length);
+	g_assert(!memcmp(value, step->value, length));
+	g_assert(bt_gatt_client_get_cache_dirty(context->client));
+}
+
+static void test_not_cached_value(struct context *context)
+{
+	const struct test_step *step = context->data->step;
+	const uint8_t *value;
+	uint16_t length;
+
+	g_assert(!bt_gatt_client_get_cached_value(context->client,
+						step->handle, &value, &length));
+	g_assert(!bt_gatt_client_get_cache_dirty(context->client));
+}
+
+/* Manufacturer Name String is a Device Information value */
+static const struct test_step test_cached_value_1 = {
+	.handle = 0x0007,
+	.func = test_read,
+	.post_func = test_cached_value,
+	.value = read_data_1,
+	.length = 0x03
+};
+
+/* Device Name may change at any time */
+static const struct test_step test_cached_value_2 = {
+	.handle = 0x0003,
+	.func = test_read,
+	.post_func = test_not_cached_value,
+	.value = read_data_1,
+	.length = 0x03
+};
+
 static const struct test_step test_read_2 = {
 	.handle = 0x0000,
 	.func = test_read,
@@ -1422,6 +1488,73 @@ static struct gatt_db *make_db(const struct att_handle_spec *spec)
 	return db;
 }
 
+#define ASYNC_READ_COUNT	6
+
+static struct async_read {
+	struct gatt_db_attribute *attrib;
+	unsigned int id;
+} async_reads[ASYNC_READ_COUNT];
+static unsigned int async_read_count;
+
+static gboolean async_read_complete(gpointer user_data)
+{
+	unsigned int i = async_read_count;
+
+	/* Complete in reverse order, the response shall keep request order */
+	while (i--) {
+		uint8_t value[2];
+
+		put_le16(gatt_db_attribute_get_handle(async_reads[i].attrib),
+								value);
+		gatt_db_attribute_read_result(async_reads[i].attrib,
+						async_reads[i].id, 0, value,
+						sizeof(value));
+	}
+
+	async_read_count = 0;
+
+	return FALSE;
+}
+
+static void async_read_cb(struct gatt_db_attribute *attrib,
+					unsigned int id, uint16_t offset,
+					uint8_t opcode, struct bt_att *att,
+					void *user_data)
+{
+	g_assert_cmpint(async_read_count, <, ASYNC_READ_COUNT);
+
+	async_reads[async_read_count].attrib = attrib;
+	async_reads[async_read_count].id = id;
+
+	/* Only answer once every read of the request is in flight */
+	if (++async_read_count == ASYNC_READ_COUNT)
+		g_idle_add(async_read_complete, NULL);
+}
+
+static struct gatt_db *make_async_read_db(void)
+{
+	struct gatt_db *db = gatt_db_new();
+	struct gatt_db_attribute *service;
+	bt_uuid_t uuid;
+	unsigned int i;
+
+	bt_uuid16_create(&uuid, 0xa00c);
+	service = gatt_db_add_service(db, &uuid, true,
+						1 + ASYNC_READ_COUNT * 2);
+
+	for (i = 0; i < ASYNC_READ_COUNT; i++) {
+		bt_uuid16_create(&uuid, 0xb00c + i);
+		gatt_db_service_add_characteristic(service, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ,
+						async_read_cb, NULL, NULL);
+	}
+
+	gatt_db_service_set_active(service, true);
+
+	return db;
+}
+
 static struct gatt_db *make_service_data_1_db(void)
 {
 	const struct att_handle_spec specs[] = {
@@ -1983,6 +2116,560 @@ static void test_server(gconstpointer data)
 	g_free(pdu.data);
 }
 
+/*
+ * Channels added with bt_att_attach_fd() are EATT bearers, which take their
+ * MTU and security level from the L2CAP socket. Answer those for the
+ * socketpairs standing in for them, anything else goes to the kernel.
+ */
+int getsockopt(int fd, int level, int optname, void *optval,
+							socklen_t *optlen)
+{
+	if (level == SOL_L2CAP && optname == L2CAP_OPTIONS &&
+				*optlen >= sizeof(struct l2cap_options)) {
+		struct l2cap_options *l2o = optval;
+
+		memset(l2o, 0, sizeof(*l2o));
+		l2o->imtu = BT_ATT_DEFAULT_LE_MTU;
+		l2o->omtu = BT_ATT_DEFAULT_LE_MTU;
+		*optlen = sizeof(*l2o);
+
+		return 0;
+	}
+
+	if (level == SOL_BLUETOOTH && optname == BT_SECURITY &&
+				*optlen >= sizeof(struct bt_security)) {
+		struct bt_security *sec = optval;
+
+		memset(sec, 0, sizeof(*sec));
+		sec->level = BT_SECURITY_LOW;
+		*optlen = sizeof(*sec);
+
+		return 0;
+	}
+
+	return syscall(SYS_getsockopt, fd, level, optname, optval, optlen);
+}
+
+static void eatt_request_cb(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct context *context = user_data;
+
+	if (!queue_find(context->server_chans, NULL, chan))
+		queue_push_tail(context->server_chans, chan);
+}
+
+#define WRITE_CMD_COUNT		2000
+#define WRITE_CMD_CREDITS	8
+
+static void write_cmd_cb(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct context *context = user_data;
+	const struct test_step *step = context->data->step;
+
+	/* Handle followed by the value, nothing dropped or merged */
+	g_assert_cmpint(length, ==, 2 + 20);
+	g_assert_cmpint(get_le16(pdu), ==, step->handle);
+
+	if (++context->writes_received < WRITE_CMD_COUNT)
+		return;
+
+	/* Never more commands queued than credits were handed out */
+	g_assert_cmpint(context->writes_queued, ==, WRITE_CMD_COUNT);
+	g_assert_cmpint(context->writes_inflight, <=, WRITE_CMD_CREDITS);
+
+	/* Don't free the server bearer from within its own callback */
+	g_idle_add(context_quit, context);
+}
+
+/*
+ * Client and server connected over two bearers, the first socketpair stands
+ * in for the LE fixed channel and the second for an EATT channel. The server
+ * records which bearers the requests being spread out arrive on.
+ */
+static void test_eatt(gconstpointer data)
+{
+	struct context *context = g_new0(struct context, 1);
+	const struct test_data *test_data = data;
+	const struct test_step *step = test_data->step;
+	struct bt_att *server_att;
+	int sv[2], ev[2];
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv));
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ev));
+
+	context->data = data;
+	context->server_chans = queue_new();
+
+	server_att = bt_att_new(sv[1], false);
+	g_assert(server_att);
+	bt_att_set_close_on_unref(server_att, true);
+	g_assert_cmpint(bt_att_attach_fd(server_att, ev[1]), ==, 0);
+
+	bt_att_register(server_att, BT_ATT_OP_READ_BY_TYPE_REQ,
+					eatt_request_cb, context, NULL);
+	bt_att_register(server_att, BT_ATT_OP_FIND_INFO_REQ,
+					eatt_request_cb, context, NULL);
+	bt_att_register(server_att, BT_ATT_OP_READ_BLOB_REQ,
+					eatt_request_cb, context, NULL);
+	bt_att_register(server_att, BT_ATT_OP_PREP_WRITE_REQ,
+					eatt_request_cb, context, NULL);
+	bt_att_register(server_att, BT_ATT_OP_WRITE_CMD,
+					write_cmd_cb, context, NULL);
+
+	context->server_db = gatt_db_ref(test_data->source_db);
+	context->server = bt_gatt_server_new(context->server_db, server_att,
+								step->mtu, 0);
+	g_assert(context->server);
+	bt_att_unref(server_att);
+
+	context->att = bt_att_new(sv[0], false);
+	g_assert(context->att);
+	bt_att_set_close_on_unref(context->att, true);
+	g_assert_cmpint(bt_att_attach_fd(context->att, ev[0]), ==, 0);
+	g_assert_cmpint(bt_att_get_channels(context->att), ==, 2);
+
+	context->client_db = gatt_db_new();
+	context->client = bt_gatt_client_new(context->client_db, context->att,
+						step->mtu, step->features);
+	g_assert(context->client);
+
+	bt_gatt_client_set_debug(context->client, print_debug,
+						"bt_gatt_client:", NULL);
+	bt_gatt_client_ready_register(context->client, client_ready_cb,
+								context, NULL);
+}
+
+static void test_eatt_discovery(struct context *context)
+{
+	/* Discovery requests shall have been spread over both bearers */
+	g_assert_cmpint(queue_length(context->server_chans), ==, 2);
+
+	context_quit(context);
+}
+
+static const struct test_step test_eatt_discovery_1 = {
+	.func = test_eatt_discovery,
+	.mtu = 512,
+};
+
+struct batch_read {
+	struct context *context;
+	uint16_t handle;
+};
+
+static void batch_value_cb(struct gatt_db_attribute *attrib, int err,
+				const uint8_t *value, size_t length,
+				void *user_data)
+{
+	struct iovec *iov = user_data;
+
+	g_assert(!err);
+
+	iov->iov_base = (void *) value;
+	iov->iov_len = length;
+}
+
+static void batch_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct batch_read *read = user_data;
+	struct context *context = read->context;
+	struct bt_gatt_client_read_stats stats;
+	struct gatt_db_attribute *attr;
+	struct iovec iov = { NULL, 0 };
+
+	g_assert(success);
+
+	attr = gatt_db_get_attribute(context->server_db, read->handle);
+	g_assert(attr);
+	g_assert(gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+							batch_value_cb, &iov));
+	g_assert_cmpint(length, ==, iov.iov_len);
+	g_assert(!memcmp(value, iov.iov_base, length));
+
+	if (--context->pending_reads)
+		return;
+
+	g_assert(bt_gatt_client_get_read_stats(context->client, &stats));
+
+	/* Reads were merged and every held back read was sent once */
+	g_assert_cmpint(stats.pdus, >, 0);
+	g_assert_cmpint(stats.batched, >, stats.pdus);
+	g_assert_cmpint(stats.batched + stats.fallbacks, ==, stats.reads);
+
+	context_quit(context);
+}
+
+static void batch_read_char(struct gatt_db_attribute *attrib, void *user_data)
+{
+	struct context *context = user_data;
+	struct batch_read *read;
+	struct gatt_db_attribute *attr;
+	struct iovec iov = { NULL, 0 };
+	uint16_t value_handle;
+	uint8_t properties;
+
+	g_assert(gatt_db_attribute_get_char_data(attrib, NULL, &value_handle,
+						&properties, NULL, NULL));
+
+	if (!(properties & BT_GATT_CHRC_PROP_READ))
+		return;
+
+	/*
+	 * Skip long values since the second bearer uses the default MTU and
+	 * reading them is not what is being tested here.
+	 */
+	attr = gatt_db_get_attribute(context->server_db, value_handle);
+	g_assert(attr);
+	g_assert(gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+							batch_value_cb, &iov));
+	if (iov.iov_len > BT_ATT_DEFAULT_LE_MTU - 3)
+		return;
+
+	read = g_new0(struct batch_read, 1);
+	read->context = context;
+	read->handle = value_handle;
+
+	g_assert(bt_gatt_client_read_value(context->client, value_handle,
+						batch_read_cb, read, g_free));
+
+	context->pending_reads++;
+}
+
+static void batch_read_service(struct gatt_db_attribute *attrib,
+							void *user_data)
+{
+	gatt_db_service_foreach_char(attrib, batch_read_char, user_data);
+}
+
+static void test_eatt_read_batch(struct context *context)
+{
+	gatt_db_foreach_service(context->client_db, NULL, batch_read_service,
+								context);
+	g_assert_cmpint(context->pending_reads, >, 1);
+}
+
+static const struct test_step test_eatt_read_batch_1 = {
+	.func = test_eatt_read_batch,
+	.mtu = 512,
+	.features = BT_GATT_CHRC_CLI_FEAT_EATT,
+};
+
+static void write_cmds_send(struct context *context);
+
+static void write_cmd_sent(void *user_data)
+{
+	struct context *context = user_data;
+
+	g_assert(context->writes_inflight);
+	context->writes_inflight--;
+
+	write_cmds_send(context);
+}
+
+static void write_cmds_send(struct context *context)
+{
+	const struct test_step *step = context->data->step;
+	uint8_t value[20];
+
+	memset(value, 0xaa, sizeof(value));
+
+	/* Only keep as many commands queued as there are credits */
+	while (context->writes_inflight < WRITE_CMD_CREDITS &&
+				context->writes_queued < WRITE_CMD_COUNT) {
+		g_assert(bt_gatt_client_write_without_response_full(
+						context->client,
+						step->handle, false,
+						value, sizeof(value),
+						write_cmd_sent, context));
+		context->writes_inflight++;
+		context->writes_queued++;
+	}
+}
+
+static const struct test_step test_write_cmd_credits_1 = {
+	.handle = 0x0025,
+	.func = write_cmds_send,
+	.mtu = 512,
+};
+
+static uint8_t long_value[BT_ATT_MAX_VALUE_LEN];
+
+static void long_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct context *context = user_data;
+
+	g_assert(success);
+	g_assert_cmpint(length, ==, sizeof(long_value));
+	g_assert(!memcmp(value, long_value, length));
+
+	/* Read Blob requests shall have been spread over both bearers */
+	g_assert_cmpint(queue_length(context->server_chans), ==, 2);
+
+	context_quit(context);
+}
+
+static void long_write_cb(bool success, bool reliable_error,
+					uint8_t att_ecode, void *user_data)
+{
+	struct context *context = user_data;
+	const struct test_step *step = context->data->step;
+
+	g_assert(success);
+	g_assert(!reliable_error);
+
+	/* Prepare Write requests shall have been spread over both bearers */
+	g_assert_cmpint(queue_length(context->server_chans), ==, 2);
+	queue_remove_all(context->server_chans, NULL, NULL, NULL);
+
+	g_assert(bt_gatt_client_read_long_value(context->client,
+						step->handle, 0,
+						long_read_cb, context, NULL));
+}
+
+static void test_eatt_long_value(struct context *context)
+{
+	const struct test_step *step = context->data->step;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(long_value); i++)
+		long_value[i] = i;
+
+	queue_remove_all(context->server_chans, NULL, NULL, NULL);
+
+	g_assert(bt_gatt_client_write_long_value(context->client, true,
+						step->handle, 0,
+						long_value, sizeof(long_value),
+						long_write_cb, context, NULL));
+}
+
+/* Same MTU on both bearers so the value is split over them */
+static const struct test_step test_eatt_long_value_1 = {
+	.handle = 0x0025,
+	.func = test_eatt_long_value,
+	.mtu = BT_ATT_DEFAULT_LE_MTU,
+};
+
+#define NOTIFY_COUNT		2000
+
+static gboolean notify_dispatch_done(gpointer user_data)
+{
+	struct context *context = user_data;
+	unsigned int count = context->notify_handle_count;
+	unsigned int i, j, expected;
+
+	/* Each handler got every notification of its own handle once */
+	for (i = 0; i < count; i++) {
+		expected = NOTIFY_COUNT / count;
+		if (i < NOTIFY_COUNT % count)
+			expected++;
+
+		for (j = 0; j < NOTIFY_HANDLERS; j++)
+			g_assert_cmpint(context->notify_handlers[i][j].received,
+								==, expected);
+	}
+
+	return context_quit(context);
+}
+
+static void notify_dispatch_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct notify_handler *handler = user_data;
+	struct context *context = handler->context;
+
+	/* Handlers shall only see their own characteristic */
+	g_assert_cmpint(value_handle, ==, handler->value_handle);
+	g_assert_cmpint(length, ==, 2);
+	g_assert_cmpint(get_le16(value), ==, value_handle);
+
+	handler->received++;
+
+	if (++context->notifications < context->notifications_expected)
+		return;
+
+	g_idle_add(notify_dispatch_done, context);
+}
+
+static void notify_find_char(struct gatt_db_attribute *attrib, void *user_data)
+{
+	struct context *context = user_data;
+	uint16_t value_handle;
+
+	g_assert(gatt_db_attribute_get_char_data(attrib, NULL, &value_handle,
+						NULL, NULL, NULL));
+
+	if (context->notify_handle_count < NOTIFY_HANDLES)
+		context->notify_handles[context->notify_handle_count++] =
+								value_handle;
+}
+
+static void notify_find_service(struct gatt_db_attribute *attrib,
+							void *user_data)
+{
+	gatt_db_service_foreach_char(attrib, notify_find_char, user_data);
+}
+
+static void test_notify_dispatch(struct context *context)
+{
+	uint16_t *handles = context->notify_handles;
+	unsigned int i, j;
+
+	gatt_db_foreach_service(context->client_db, NULL, notify_find_service,
+								context);
+	g_assert_cmpint(context->notify_handle_count, >, 1);
+
+	for (i = 0; i < context->notify_handle_count; i++) {
+		for (j = 0; j < NOTIFY_HANDLERS; j++) {
+			struct notify_handler *handler;
+
+			handler = &context->notify_handlers[i][j];
+			handler->context = context;
+			handler->value_handle = handles[i];
+
+			g_assert(bt_gatt_client_register_notify(
+						context->client,
+						handles[i], NULL,
+						notify_dispatch_cb, handler,
+						NULL));
+		}
+	}
+
+	context->notifications_expected = NOTIFY_COUNT * NOTIFY_HANDLERS;
+
+	/* Half of them are coalesced into Multiple Handle Notifications */
+	for (i = 0; i < NOTIFY_COUNT; i++) {
+		uint16_t handle = handles[i % context->notify_handle_count];
+		uint8_t value[2];
+
+		put_le16(handle, value);
+		g_assert(bt_gatt_server_send_notification(context->server,
+							handle, value,
+							sizeof(value), i & 1));
+	}
+}
+
+static const struct test_step test_notify_dispatch_1 = {
+	.func = test_notify_dispatch,
+	.mtu = 512,
+	.features = BT_GATT_CHRC_CLI_FEAT_NFY_MULTI,
+};
+
+#define SHARED_NOTIFY_PEERS	32
+#define SHARED_NOTIFY_COUNT	100
+
+struct shared_notify;
+
+struct shared_notify_peer {
+	struct shared_notify *shared;
+	struct bt_att *server;
+	struct bt_att *client;
+	unsigned int received;
+};
+
+struct shared_notify {
+	struct context *context;
+	struct shared_notify_peer peers[SHARED_NOTIFY_PEERS];
+	unsigned int received;
+};
+
+static const uint8_t shared_notify_pdu[] = { 0x03, 0x00, 0x01, 0x02, 0x03 };
+
+static gboolean shared_notify_done(gpointer user_data)
+{
+	struct shared_notify *shared = user_data;
+	unsigned int i;
+
+	for (i = 0; i < SHARED_NOTIFY_PEERS; i++) {
+		struct shared_notify_peer *peer = &shared->peers[i];
+
+		/* Every peer got each notification exactly once */
+		g_assert_cmpint(peer->received, ==, SHARED_NOTIFY_COUNT);
+
+		bt_att_unref(peer->server);
+		bt_att_unref(peer->client);
+	}
+
+	context_quit(shared->context);
+	free(shared);
+
+	return FALSE;
+}
+
+static void shared_notify_cb(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct shared_notify_peer *peer = user_data;
+	struct shared_notify *shared = peer->shared;
+
+	g_assert_cmpint(opcode, ==, BT_ATT_OP_HANDLE_NFY);
+	g_assert_cmpint(length, ==, sizeof(shared_notify_pdu));
+	g_assert(!memcmp(pdu, shared_notify_pdu, length));
+
+	g_assert_cmpint(++peer->received, <=, SHARED_NOTIFY_COUNT);
+
+	if (++shared->received < SHARED_NOTIFY_PEERS * SHARED_NOTIFY_COUNT)
+		return;
+
+	/* Not from within the callback of one of the bearers */
+	g_idle_add(shared_notify_done, shared);
+}
+
+static void test_shared_notify(gconstpointer data)
+{
+	struct context *context = g_new0(struct context, 1);
+	struct shared_notify *shared = new0(struct shared_notify, 1);
+	struct bt_att_pdu *pdu;
+	unsigned int i, j;
+
+	context->data = data;
+	shared->context = context;
+
+	for (i = 0; i < SHARED_NOTIFY_PEERS; i++) {
+		struct shared_notify_peer *peer = &shared->peers[i];
+		int sv[2];
+
+		g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC,
+								0, sv));
+
+		peer->shared = shared;
+
+		peer->server = bt_att_new(sv[1], false);
+		g_assert(peer->server);
+		bt_att_set_close_on_unref(peer->server, true);
+
+		peer->client = bt_att_new(sv[0], false);
+		g_assert(peer->client);
+		bt_att_set_close_on_unref(peer->client, true);
+
+		bt_att_register(peer->client, BT_ATT_OP_HANDLE_NFY,
+					shared_notify_cb, peer, NULL);
+	}
+
+	pdu = bt_att_pdu_new(BT_ATT_OP_HANDLE_NFY, shared_notify_pdu,
+						sizeof(shared_notify_pdu));
+	g_assert(pdu);
+
+	/* Only PDUs not expecting a response can be shared */
+	g_assert(!bt_att_pdu_new(BT_ATT_OP_HANDLE_IND, shared_notify_pdu,
+						sizeof(shared_notify_pdu)));
+
+	/* Encoded once, queued on every peer */
+	for (j = 0; j < SHARED_NOTIFY_COUNT; j++)
+		for (i = 0; i < SHARED_NOTIFY_PEERS; i++)
+			g_assert(bt_att_send_pdu(shared->peers[i].server, pdu));
+
+	bt_att_pdu_unref(pdu);
+}
+
 static void test_search_primary(gconstpointer data)
 {
 	struct context *context = create_context(512, data);
@@ -2416,6 +3103,7 @@ int main(int argc, char *argv[])
 {
 	struct gatt_db *service_db_1, *service_db_2, *service_db_3;
 	struct gatt_db *ts_small_db, *ts_large_db_1, *ts_tail_db;
+	struct gatt_db *async_read_db;
 
 	tester_init(&argc, &argv);
 
@@ -2425,6 +3113,7 @@ int main(int argc, char *argv[])
 	ts_small_db = make_test_spec_small_db();
 	ts_large_db_1 = make_test_spec_large_db_1();
 	ts_tail_db = make_test_tail_db();
+	async_read_db = make_async_read_db();
 
 	/*
 	 * Server Configuration
@@ -4559,5 +5248,49 @@ int main(int argc, char *argv[])
 			test_hash_db, ts_tail_db, NULL,
 			{});
 
+	define_test_client("/robustness/eatt-discovery",
+			test_eatt, ts_large_db_1, &test_eatt_discovery_1,
+			{});
+
+	define_test_client("/robustness/eatt-read-batch",
+			test_eatt, ts_large_db_1, &test_eatt_read_batch_1,
+			{});
+
+	define_test_client("/robustness/eatt-long-value",
+			test_eatt, ts_large_db_1, &test_eatt_long_value_1,
+			{});
+
+	define_test_client("/robustness/cached-value",
+			test_client, service_db_1, &test_cached_value_1,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x0a, 0x07, 0x00),
+			raw_pdu(0x0b, 0x01, 0x02, 0x03));
+
+	define_test_client("/robustness/not-cached-value",
+			test_client, service_db_1, &test_cached_value_2,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x0a, 0x03, 0x00),
+			raw_pdu(0x0b, 0x01, 0x02, 0x03));
+
+	define_test_client("/robustness/notify-dispatch",
+			test_eatt, ts_large_db_1, &test_notify_dispatch_1,
+			{});
+
+	define_test_server("/robustness/read-multiple-async",
+			test_server, async_read_db, NULL,
+			raw_pdu(0x03, 0x00, 0x02),
+			raw_pdu(0x0e, 0x03, 0x00, 0x05, 0x00, 0x07, 0x00,
+					0x09, 0x00, 0x0b, 0x00, 0x0d, 0x00),
+			raw_pdu(0x0f, 0x03, 0x00, 0x05, 0x00, 0x07, 0x00,
+					0x09, 0x00, 0x0b, 0x00, 0x0d, 0x00));
+
+	define_test_client("/robustness/shared-notify",
+			test_shared_notify, NULL, NULL,
+			{});
+
+	define_test_client("/robustness/write-cmd-credits",
+			test_eatt, ts_large_db_1, &test_write_cmd_credits_1,
+			{});
+
 	return tester_run();
 }
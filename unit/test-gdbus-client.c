@@ -12,6 +12,8 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
+
 #include <glib.h>
 
 #include "gdbus/gdbus.h"
@@ -22,6 +24,12 @@
 #define SERVICE_NAME1 "org.bluez.unit.test_gdbus_client1"
 #define SERVICE_PATH "/org/bluez/unit/test_gdbus_client"
 
+#define CACHED_OBJECTS 1000
+#define BURST_OBJECTS 2000
+
+/* Most objects gdbus processes from a single idle callback */
+#define BURST_MAX 128
+
 struct context {
 	DBusConnection *dbus_conn;
 	GDBusClient *dbus_client;
@@ -29,6 +37,14 @@ struct context {
 	void *data;
 	gboolean client_ready;
 	guint timeout_source;
+	unsigned int get_count;
+	unsigned int uncached_count;
+	gboolean hidden;
+	unsigned int step;
+	unsigned int flushes;
+	unsigned int flush_signals;
+	unsigned int added_count;
+	unsigned int changed_count;
 };
 
 static const GDBusMethodTable methods[] = {
@@ -904,6 +920,275 @@ static void client_ready(const void *data)
 						proxy_added, NULL, NULL, context);
 }
 
+static gboolean get_counted_string(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct context *context = data;
+
+	context->get_count++;
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &context->data);
+
+	return TRUE;
+}
+
+static gboolean counted_string_exists(const GDBusPropertyTable *property,
+								void *data)
+{
+	struct context *context = data;
+
+	return !context->hidden;
+}
+
+static gboolean get_uncached_string(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct context *context = data;
+
+	context->uncached_count++;
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &context->data);
+
+	return TRUE;
+}
+
+static const GDBusPropertyTable counted_properties[] = {
+	{ "String", "s", get_counted_string, NULL, counted_string_exists,
+					G_DBUS_PROPERTY_FLAG_CACHE },
+	{ "Uncached", "s", get_uncached_string },
+	{ },
+};
+
+static void cached_objects_foreach(struct context *context, gboolean add)
+{
+	char path[64];
+	int i;
+
+	for (i = 0; i < CACHED_OBJECTS; i++) {
+		snprintf(path, sizeof(path), SERVICE_PATH "/obj%d", i);
+
+		if (add)
+			g_dbus_register_interface(context->dbus_conn, path,
+						SERVICE_NAME, methods, signals,
+						counted_properties, context,
+						NULL);
+		else
+			g_dbus_unregister_interface(context->dbus_conn, path,
+							SERVICE_NAME);
+	}
+}
+
+static void cached_objects_ready(GDBusClient *client, void *user_data);
+
+static void cached_objects_proxy_added(GDBusProxy *proxy, void *user_data)
+{
+}
+
+static void cached_objects_connect(struct context *context)
+{
+	context->get_count = 0;
+	context->uncached_count = 0;
+
+	context->dbus_client = g_dbus_client_new(context->dbus_conn,
+						SERVICE_NAME, SERVICE_PATH);
+
+	/* GetManagedObjects is only requested when proxies are tracked */
+	g_dbus_client_set_proxy_handlers(context->dbus_client,
+					cached_objects_proxy_added, NULL, NULL,
+					context);
+	g_dbus_client_set_ready_watch(context->dbus_client,
+						cached_objects_ready, context);
+}
+
+static void cached_objects_ready(GDBusClient *client, void *user_data)
+{
+	struct context *context = user_data;
+
+	tester_debug("step %u: %u property reads", context->step,
+							context->get_count);
+
+	g_dbus_client_unref(context->dbus_client);
+	context->dbus_client = NULL;
+
+	switch (context->step++) {
+	case 0:
+		/* First request populates the cache */
+		cached_objects_connect(context);
+		return;
+	case 1:
+		/* Nothing changed so the reply shall come from the cache */
+		g_assert_cmpuint(context->get_count, ==, 0);
+
+		/* Properties not flagged for caching are always read */
+		g_assert_cmpuint(context->uncached_count, ==, CACHED_OBJECTS);
+
+		g_free(context->data);
+		context->data = g_strdup("changed");
+
+		g_dbus_emit_property_changed_full(context->dbus_conn,
+					SERVICE_PATH "/obj0", SERVICE_NAME,
+					"String",
+					G_DBUS_PROPERTY_CHANGED_FLAG_FLUSH);
+
+		cached_objects_connect(context);
+		return;
+	case 2:
+		/* Only the changed object shall be read again */
+		g_assert_cmpuint(context->get_count, ==, 1);
+
+		context->hidden = TRUE;
+		cached_objects_connect(context);
+		return;
+	case 3:
+		/* Properties that don't exist are not read */
+		g_assert_cmpuint(context->get_count, ==, 0);
+
+		context->hidden = FALSE;
+		cached_objects_connect(context);
+		return;
+	case 4:
+		/* Values cached before disappearing shall be read again */
+		g_assert_cmpuint(context->get_count, ==, CACHED_OBJECTS);
+		break;
+	}
+
+	cached_objects_foreach(context, FALSE);
+
+	destroy_context(context);
+}
+
+static void client_cached_objects(const void *data)
+{
+	struct context *context = create_context();
+
+	if (context == NULL)
+		return;
+
+	context->data = g_strdup("value");
+	cached_objects_foreach(context, TRUE);
+
+	cached_objects_connect(context);
+}
+
+static void burst_objects_foreach(struct context *context, gboolean add)
+{
+	char path[64];
+	int i;
+
+	for (i = 0; i < BURST_OBJECTS; i++) {
+		snprintf(path, sizeof(path), SERVICE_PATH "/obj%d", i);
+
+		if (!add) {
+			g_dbus_unregister_interface(context->dbus_conn, path,
+							SERVICE_NAME);
+			g_dbus_unregister_interface(context->dbus_conn, path,
+							SERVICE_NAME1);
+			continue;
+		}
+
+		g_dbus_register_interface(context->dbus_conn, path,
+						SERVICE_NAME, methods, signals,
+						counted_properties, context,
+						NULL);
+		g_dbus_register_interface(context->dbus_conn, path,
+						SERVICE_NAME1, methods, signals,
+						counted_properties, context,
+						NULL);
+	}
+}
+
+static gboolean burst_objects_step(gpointer user_data)
+{
+	struct context *context = user_data;
+	char path[64];
+	int i, j;
+
+	switch (context->step++) {
+	case 0:
+		/* Both interfaces of an object go in a single signal */
+		g_assert_cmpuint(context->added_count, ==, BURST_OBJECTS);
+		g_assert_cmpuint(context->changed_count, ==, 0);
+		g_assert_cmpuint(context->flushes, >=,
+					BURST_OBJECTS / BURST_MAX);
+
+		context->flushes = 0;
+
+		/* Changes made before a flush are sent once */
+		for (i = 0; i < BURST_OBJECTS; i++) {
+			snprintf(path, sizeof(path), SERVICE_PATH "/obj%d", i);
+
+			for (j = 0; j < 3; j++)
+				g_dbus_emit_property_changed(context->dbus_conn,
+							path, SERVICE_NAME,
+							"String");
+		}
+
+		return FALSE;
+	case 1:
+		g_assert_cmpuint(context->added_count, ==, BURST_OBJECTS);
+		g_assert_cmpuint(context->changed_count, ==, BURST_OBJECTS);
+		g_assert_cmpuint(context->flushes, >=,
+					BURST_OBJECTS / BURST_MAX);
+		break;
+	}
+
+	g_dbus_set_debug(NULL, NULL, NULL);
+
+	burst_objects_foreach(context, FALSE);
+
+	destroy_context(context);
+
+	return FALSE;
+}
+
+static void burst_objects_debug(const char *str, void *user_data)
+{
+	struct context *context = user_data;
+	unsigned int objects, left;
+
+	if (g_str_has_prefix(str, "[signal] org.freedesktop.DBus."
+					"ObjectManager.InterfacesAdded")) {
+		context->added_count++;
+		context->flush_signals++;
+		return;
+	}
+
+	if (g_str_has_prefix(str, "[signal] " DBUS_INTERFACE_PROPERTIES
+							".PropertiesChanged")) {
+		context->changed_count++;
+		context->flush_signals++;
+		return;
+	}
+
+	if (sscanf(str, "processed %u objects in %*d us (%u pending)",
+						&objects, &left) != 2)
+		return;
+
+	/* Each flush is bounded and sends one signal per object at most */
+	g_assert_cmpuint(objects, <=, BURST_MAX);
+	g_assert_cmpuint(context->flush_signals, <=, objects);
+
+	context->flushes++;
+	context->flush_signals = 0;
+
+	if (!left)
+		g_idle_add(burst_objects_step, context);
+}
+
+static void pending_bursts(const void *data)
+{
+	struct context *context = create_context();
+
+	if (context == NULL)
+		return;
+
+	context->data = g_strdup("value");
+
+	g_dbus_set_debug(burst_objects_debug, context, NULL);
+
+	burst_objects_foreach(context, TRUE);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -948,5 +1233,10 @@ int main(int argc, char *argv[])
 
 	tester_add("/gdbus/client_ready", NULL, NULL, client_ready, NULL);
 
+	tester_add("/gdbus/client_cached_objects", NULL, NULL,
+					client_cached_objects, NULL);
+
+	tester_add("/gdbus/pending_bursts", NULL, NULL, pending_bursts, NULL);
+
 	return tester_run();
 }
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/tester.h"
+#include "src/shared/iso-rx.h"
+
+#define SDU		4
+#define DEPTH		2
+#define MAX_FRAMES	16
+
+struct test_frame {
+	uint16_t seq;
+	unsigned int count;
+	uint8_t data[2][SDU];
+	size_t len[2];
+};
+
+struct test_data {
+	int sk[2][2];
+	struct iso_rx *rx;
+	struct test_frame frames[MAX_FRAMES];
+	unsigned int num_frames;
+};
+
+static void frame_cb(uint16_t seq, const struct iovec *iov,
+				unsigned int count, void *user_data)
+{
+	struct test_data *data = user_data;
+	struct test_frame *frame = &data->frames[data->num_frames++];
+	unsigned int i;
+
+	g_assert_cmpint(data->num_frames, <=, MAX_FRAMES);
+	g_assert_cmpint(count, ==, 2);
+
+	frame->seq = seq;
+	frame->count = count;
+
+	for (i = 0; i < count; i++) {
+		g_assert_cmpint(iov[i].iov_len, <=, SDU);
+		memcpy(frame->data[i], iov[i].iov_base, iov[i].iov_len);
+		frame->len[i] = iov[i].iov_len;
+	}
+}
+
+static struct test_data *test_setup(void)
+{
+	struct test_data *data;
+	unsigned int i;
+
+	data = new0(struct test_data, 1);
+
+	/* No interval, SDUs are aligned by their order on each socket */
+	data->rx = iso_rx_new(0, DEPTH);
+	g_assert_nonnull(data->rx);
+
+	for (i = 0; i < 2; i++) {
+		g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0,
+						data->sk[i]), ==, 0);
+		g_assert_cmpint(iso_rx_add_stream(data->rx, data->sk[i][1],
+							SDU), ==, 0);
+	}
+
+	g_assert_true(iso_rx_set_frame_handler(data->rx, frame_cb, data,
+								NULL));
+
+	return data;
+}
+
+static void test_teardown(struct test_data *data)
+{
+	unsigned int i;
+
+	iso_rx_free(data->rx);
+
+	for (i = 0; i < 2; i++) {
+		close(data->sk[i][0]);
+		close(data->sk[i][1]);
+	}
+
+	free(data);
+}
+
+static void send_sdu(struct test_data *data, unsigned int stream,
+							uint8_t value)
+{
+	uint8_t sdu[SDU];
+
+	memset(sdu, value, sizeof(sdu));
+	g_assert_cmpint(write(data->sk[stream][0], sdu, sizeof(sdu)), ==,
+								sizeof(sdu));
+}
+
+static void assert_sdu(struct test_frame *frame, unsigned int stream,
+							uint8_t value)
+{
+	unsigned int i;
+
+	g_assert_cmpint(frame->len[stream], ==, SDU);
+
+	for (i = 0; i < SDU; i++)
+		g_assert_cmpint(frame->data[stream][i], ==, value);
+}
+
+static void test_interleave(const void *user_data)
+{
+	struct test_data *data = test_setup();
+	unsigned int i;
+
+	for (i = 0; i < DEPTH; i++) {
+		send_sdu(data, 0, 0x10 + i);
+		send_sdu(data, 1, 0x20 + i);
+	}
+
+	/* Nothing is output until every stream has the SDU of the frame,
+	 * as long as no stream gets depth SDUs ahead.
+	 */
+	g_assert_cmpint(iso_rx_read(data->rx, data->sk[0][1]), ==, DEPTH);
+	g_assert_cmpint(data->num_frames, ==, 0);
+
+	g_assert_cmpint(iso_rx_read(data->rx, data->sk[1][1]), ==, DEPTH);
+	g_assert_cmpint(data->num_frames, ==, DEPTH);
+
+	for (i = 0; i < DEPTH; i++) {
+		g_assert_cmpint(data->frames[i].seq, ==, i);
+		assert_sdu(&data->frames[i], 0, 0x10 + i);
+		assert_sdu(&data->frames[i], 1, 0x20 + i);
+	}
+
+	test_teardown(data);
+
+	tester_test_passed();
+}
+
+static void test_not_started(const void *user_data)
+{
+	struct test_data *data = test_setup();
+	struct iso_rx_stats stats;
+	unsigned int i;
+
+	/* Second stream has not delivered anything yet, once the first one
+	 * is depth SDUs ahead frames are output with silence in its place
+	 * that has the size of a full SDU.
+	 */
+	for (i = 0; i < DEPTH + 2; i++)
+		send_sdu(data, 0, 0x10 + i);
+
+	g_assert_cmpint(iso_rx_read(data->rx, data->sk[0][1]), ==, DEPTH + 2);
+	g_assert_cmpint(data->num_frames, ==, 2);
+
+	for (i = 0; i < data->num_frames; i++) {
+		assert_sdu(&data->frames[i], 0, 0x10 + i);
+		assert_sdu(&data->frames[i], 1, 0x00);
+	}
+
+	/* Not yet started is not lost */
+	g_assert_true(iso_rx_get_stats(data->rx, data->sk[1][1], &stats));
+	g_assert_cmpint(stats.lost, ==, 0);
+
+	test_teardown(data);
+
+	tester_test_passed();
+}
+
+static void test_lost(const void *user_data)
+{
+	struct test_data *data = test_setup();
+	struct iso_rx_stats stats;
+	unsigned int i;
+
+	send_sdu(data, 1, 0x20);
+
+	for (i = 0; i < 4; i++)
+		send_sdu(data, 0, 0x10 + i);
+
+	g_assert_cmpint(iso_rx_read(data->rx, data->sk[1][1]), ==, 1);
+	g_assert_cmpint(iso_rx_read(data->rx, data->sk[0][1]), ==, 4);
+
+	/* Remaining frames are output on flush */
+	iso_rx_flush(data->rx);
+	g_assert_cmpint(data->num_frames, ==, 4);
+
+	assert_sdu(&data->frames[0], 1, 0x20);
+
+	for (i = 0; i < 4; i++) {
+		assert_sdu(&data->frames[i], 0, 0x10 + i);
+		if (i)
+			assert_sdu(&data->frames[i], 1, 0x00);
+	}
+
+	g_assert_true(iso_rx_get_stats(data->rx, data->sk[1][1], &stats));
+	g_assert_cmpint(stats.sdus, ==, 1);
+	g_assert_cmpint(stats.lost, ==, 3);
+
+	g_assert_true(iso_rx_get_stats(data->rx, data->sk[0][1], &stats));
+	g_assert_cmpint(stats.sdus, ==, 4);
+	g_assert_cmpint(stats.lost, ==, 0);
+
+	test_teardown(data);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/iso-rx/interleave", NULL, NULL, test_interleave, NULL);
+	tester_add("/iso-rx/not-started", NULL, NULL, test_not_started,
+									NULL);
+	tester_add("/iso-rx/lost", NULL, NULL, test_lost, NULL);
+
+	return tester_run();
+}
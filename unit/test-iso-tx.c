@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/tester.h"
+#include "src/shared/iso-tx.h"
+
+#define INTERVAL	1000	/* us */
+#define SDU		40
+#define NUM_SDUS	5
+
+struct test_stream {
+	int sk[2];
+	uint8_t data[NUM_SDUS * SDU - SDU / 2];
+	unsigned int pulled;
+	unsigned int eagain;
+};
+
+static void stream_init(struct test_stream *stream, uint8_t seed)
+{
+	size_t i;
+
+	g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK,
+						0, stream->sk), ==, 0);
+
+	for (i = 0; i < sizeof(stream->data); i++)
+		stream->data[i] = seed + i;
+
+	stream->pulled = 0;
+	stream->eagain = 0;
+}
+
+static void stream_cleanup(struct test_stream *stream)
+{
+	close(stream->sk[0]);
+	close(stream->sk[1]);
+}
+
+/* Checks the next SDU received matches the source at the given offset */
+static void stream_recv(struct test_stream *stream, size_t offset)
+{
+	uint8_t buf[SDU * 2];
+	ssize_t len;
+
+	len = read(stream->sk[1], buf, sizeof(buf));
+	g_assert_cmpint(len, ==, MIN(SDU, sizeof(stream->data) - offset));
+	g_assert_true(!memcmp(buf, stream->data + offset, len));
+}
+
+static void stream_recv_none(struct test_stream *stream)
+{
+	uint8_t buf[SDU];
+
+	g_assert_cmpint(read(stream->sk[1], buf, sizeof(buf)), <, 0);
+	g_assert_cmpint(errno, ==, EAGAIN);
+}
+
+static void run(struct iso_tx *tx)
+{
+	int ret;
+
+	while ((ret = iso_tx_process(tx)) > 0)
+		;
+
+	g_assert_cmpint(ret, ==, 0);
+}
+
+static void test_buffer(const void *data)
+{
+	struct test_stream streams[2];
+	struct iso_tx_stats stats;
+	struct iso_tx *tx;
+	unsigned int i, j;
+
+	tx = iso_tx_new(INTERVAL, 1);
+	g_assert_nonnull(tx);
+
+	for (i = 0; i < 2; i++) {
+		stream_init(&streams[i], i * 0x80);
+		g_assert_cmpint(iso_tx_add_buffer(tx, streams[i].sk[0], SDU,
+						streams[i].data,
+						sizeof(streams[i].data),
+						false), ==, 0);
+	}
+
+	/* Same socket cannot be added twice */
+	g_assert_cmpint(iso_tx_add_buffer(tx, streams[0].sk[0], SDU,
+					streams[0].data, SDU, false), <, 0);
+	g_assert_cmpint(iso_tx_get_stream_count(tx), ==, 2);
+
+	g_assert_cmpint(iso_tx_start(tx, 0), ==, 2);
+	run(tx);
+
+	/* Every stream got all of its SDUs in order, the last one short */
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < NUM_SDUS; j++)
+			stream_recv(&streams[i], j * SDU);
+
+		stream_recv_none(&streams[i]);
+		stream_cleanup(&streams[i]);
+	}
+
+	g_assert_true(iso_tx_get_stats(tx, &stats));
+	g_assert_cmpint(stats.sdus, ==, 2 * NUM_SDUS);
+	g_assert_cmpint(stats.overruns, ==, 0);
+	g_assert_cmpint(stats.ticks, >=, NUM_SDUS);
+
+	iso_tx_free(tx);
+
+	tester_test_passed();
+}
+
+static void test_burst(const void *data)
+{
+	struct test_stream stream;
+	struct iso_tx_stats stats;
+	struct iso_tx *tx;
+	unsigned int j;
+
+	tx = iso_tx_new(INTERVAL, 2);
+	g_assert_nonnull(tx);
+
+	stream_init(&stream, 0);
+	g_assert_cmpint(iso_tx_add_buffer(tx, stream.sk[0], SDU, stream.data,
+					sizeof(stream.data), false), ==, 0);
+
+	/* Prefilled SDUs are sent right away, before the first tick */
+	g_assert_cmpint(iso_tx_start(tx, 1), ==, 1);
+	stream_recv(&stream, 0);
+	stream_recv_none(&stream);
+
+	/* Then two SDUs go out on every tick */
+	g_assert_cmpint(iso_tx_process(tx), ==, 1);
+	stream_recv(&stream, SDU);
+	stream_recv(&stream, 2 * SDU);
+	stream_recv_none(&stream);
+
+	run(tx);
+
+	for (j = 3; j < NUM_SDUS; j++)
+		stream_recv(&stream, j * SDU);
+
+	g_assert_true(iso_tx_get_stats(tx, &stats));
+	g_assert_cmpint(stats.sdus, ==, NUM_SDUS);
+
+	stream_cleanup(&stream);
+	iso_tx_free(tx);
+
+	tester_test_passed();
+}
+
+static void test_overrun(const void *data)
+{
+	struct test_stream stream;
+	struct iso_tx_stats stats;
+	struct iso_tx *tx;
+	unsigned int i, received = 0;
+	uint8_t buf[SDU];
+
+	tx = iso_tx_new(INTERVAL, 1);
+	g_assert_nonnull(tx);
+
+	stream_init(&stream, 0);
+	g_assert_cmpint(iso_tx_add_buffer(tx, stream.sk[0], SDU, stream.data,
+					sizeof(stream.data), true), ==, 0);
+
+	/* The peer never reads, so the socket eventually fills up and the
+	 * SDUs it does not take are accounted instead of blocking.
+	 */
+	g_assert_cmpint(iso_tx_start(tx, 0), ==, 1);
+
+	for (i = 0; i < 1000; i++) {
+		g_assert_cmpint(iso_tx_process(tx), ==, 1);
+
+		g_assert_true(iso_tx_get_stats(tx, &stats));
+		if (stats.overruns)
+			break;
+	}
+
+	g_assert_cmpint(stats.overruns, >, 0);
+
+	while (read(stream.sk[1], buf, sizeof(buf)) > 0)
+		received++;
+
+	g_assert_cmpint(received, ==, stats.sdus);
+
+	stream_cleanup(&stream);
+	iso_tx_free(tx);
+
+	tester_test_passed();
+}
+
+static ssize_t pull_cb(void *buf, size_t len, void *user_data)
+{
+	struct test_stream *stream = user_data;
+	size_t offset = stream->pulled * SDU;
+
+	/* Second SDU is not ready on time the first time it is asked for */
+	if (stream->pulled == 1 && !stream->eagain++)
+		return -EAGAIN;
+
+	if (offset >= sizeof(stream->data))
+		return 0;
+
+	len = MIN(len, sizeof(stream->data) - offset);
+	memcpy(buf, stream->data + offset, len);
+	stream->pulled++;
+
+	return len;
+}
+
+static void test_pull(const void *data)
+{
+	struct test_stream stream;
+	struct iso_tx_stats stats;
+	struct iso_tx *tx;
+	unsigned int j;
+
+	tx = iso_tx_new(INTERVAL, 1);
+	g_assert_nonnull(tx);
+
+	stream_init(&stream, 0x10);
+	g_assert_cmpint(iso_tx_add_pull(tx, stream.sk[0], SDU, pull_cb,
+							&stream), ==, 0);
+
+	g_assert_cmpint(iso_tx_start(tx, 0), ==, 1);
+	run(tx);
+
+	for (j = 0; j < NUM_SDUS; j++)
+		stream_recv(&stream, j * SDU);
+
+	stream_recv_none(&stream);
+
+	g_assert_true(iso_tx_get_stats(tx, &stats));
+	g_assert_cmpint(stats.sdus, ==, NUM_SDUS);
+	g_assert_cmpint(stats.starved, ==, 1);
+
+	stream_cleanup(&stream);
+	iso_tx_free(tx);
+
+	tester_test_passed();
+}
+
+static ssize_t pull_count_cb(void *buf, size_t len, void *user_data)
+{
+	struct test_stream *stream = user_data;
+
+	memset(buf, stream->pulled++, len);
+
+	return len;
+}
+
+/* Reads every SDU queued so far checking they arrive in sequence */
+static unsigned int stream_drain(struct test_stream *stream, uint8_t *seq)
+{
+	uint8_t buf[SDU];
+	unsigned int count = 0;
+
+	while (read(stream->sk[1], buf, sizeof(buf)) > 0) {
+		g_assert_cmpint(buf[0], ==, (*seq)++);
+		count++;
+	}
+
+	return count;
+}
+
+static void test_pull_prefill(const void *data)
+{
+	struct test_stream stream;
+	struct iso_tx_stats stats;
+	struct iso_tx *tx;
+	unsigned int i, received;
+	uint8_t seq = 0;
+	int sndbuf = 1;
+
+	tx = iso_tx_new(INTERVAL, 1);
+	g_assert_nonnull(tx);
+
+	stream_init(&stream, 0);
+
+	/* Shrink the socket so it cannot take the whole prefill at once */
+	g_assert_cmpint(setsockopt(stream.sk[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+						sizeof(sndbuf)), ==, 0);
+
+	g_assert_cmpint(iso_tx_add_pull(tx, stream.sk[0], SDU, pull_count_cb,
+							&stream), ==, 0);
+
+	/* What the socket does not take of the prefill stays staged and must
+	 * still go out only one burst per interval.
+	 */
+	g_assert_cmpint(iso_tx_start(tx, 16), ==, 1);
+	received = stream_drain(&stream, &seq);
+	g_assert_cmpint(received, >, 0);
+	g_assert_cmpint(received, <, 16);
+
+	for (i = 0; i < 8; i++) {
+		g_assert_cmpint(iso_tx_process(tx), ==, 1);
+		g_assert_cmpint(stream_drain(&stream, &seq), ==, 1);
+		received++;
+	}
+
+	g_assert_true(iso_tx_get_stats(tx, &stats));
+	g_assert_cmpint(stats.sdus, ==, received);
+
+	stream_cleanup(&stream);
+	iso_tx_free(tx);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/iso-tx/buffer", NULL, NULL, test_buffer, NULL);
+	tester_add("/iso-tx/burst", NULL, NULL, test_burst, NULL);
+	tester_add("/iso-tx/overrun", NULL, NULL, test_overrun, NULL);
+	tester_add("/iso-tx/pull", NULL, NULL, test_pull, NULL);
+	tester_add("/iso-tx/pull-prefill", NULL, NULL, test_pull_prefill,
+									NULL);
+
+	return tester_run();
+}
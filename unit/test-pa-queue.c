@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "src/shared/tester.h"
+#include "src/shared/pa-queue.h"
+
+#define NUM_SOURCES	4
+
+struct test_data {
+	struct pa_queue *queue;
+	int sources[NUM_SOURCES];
+	unsigned int started[NUM_SOURCES];
+	unsigned int num_started;
+	unsigned int expired[NUM_SOURCES];
+	unsigned int num_expired;
+	int fail;			/* Index of a source failing to start */
+};
+
+static unsigned int source_index(struct test_data *data, void *source)
+{
+	return (int *) source - data->sources;
+}
+
+static bool start_cb(void *source, void *user_data)
+{
+	struct test_data *data = user_data;
+	unsigned int idx = source_index(data, source);
+
+	if ((int) idx == data->fail)
+		return false;
+
+	data->started[data->num_started++] = idx;
+
+	return true;
+}
+
+static void expired_cb(void *source, void *user_data)
+{
+	struct test_data *data = user_data;
+	unsigned int i;
+
+	data->expired[data->num_expired++] = source_index(data, source);
+
+	if (data->num_expired < NUM_SOURCES)
+		return;
+
+	/* Every source got a slot in turn and then timed out */
+	g_assert_cmpint(data->num_started, ==, NUM_SOURCES);
+
+	for (i = 0; i < NUM_SOURCES; i++) {
+		g_assert_cmpint(data->started[i], ==, i);
+		g_assert_cmpint(data->expired[i], ==, i);
+	}
+
+	tester_test_passed();
+}
+
+static void test_data_init(struct test_data *data, unsigned int max,
+						unsigned int timeout)
+{
+	memset(data, 0, sizeof(*data));
+	data->fail = -1;
+	data->queue = pa_queue_new(max, timeout, start_cb, expired_cb, data);
+	g_assert_nonnull(data->queue);
+}
+
+static void test_teardown(const void *user_data)
+{
+	struct test_data *data = (void *) user_data;
+
+	pa_queue_free(data->queue);
+	data->queue = NULL;
+
+	tester_teardown_complete();
+}
+
+static void push_all(struct test_data *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_SOURCES; i++)
+		g_assert_true(pa_queue_push(data->queue, &data->sources[i]));
+}
+
+static void test_max(const void *user_data)
+{
+	struct test_data *data = (void *) user_data;
+
+	test_data_init(data, 2, 0);
+	push_all(data);
+
+	/* Only max syncs run at once, the others wait for a slot */
+	g_assert_cmpint(data->num_started, ==, 2);
+	g_assert_cmpint(data->started[0], ==, 0);
+	g_assert_cmpint(data->started[1], ==, 1);
+	g_assert_cmpint(pa_queue_get_active(data->queue), ==, 2);
+	g_assert_cmpint(pa_queue_get_pending(data->queue), ==, 2);
+
+	/* Sources already queued or syncing are not added twice */
+	g_assert_false(pa_queue_push(data->queue, &data->sources[0]));
+	g_assert_false(pa_queue_push(data->queue, &data->sources[3]));
+	g_assert_true(pa_queue_has(data->queue, &data->sources[3]));
+
+	/* A pending source removed never gets a slot */
+	g_assert_true(pa_queue_remove(data->queue, &data->sources[2]));
+	g_assert_cmpint(data->num_started, ==, 2);
+
+	/* A finished sync gives its slot to the next source pending */
+	g_assert_true(pa_queue_remove(data->queue, &data->sources[0]));
+	g_assert_cmpint(data->num_started, ==, 3);
+	g_assert_cmpint(data->started[2], ==, 3);
+	g_assert_cmpint(pa_queue_get_pending(data->queue), ==, 0);
+
+	g_assert_false(pa_queue_remove(data->queue, &data->sources[0]));
+	g_assert_false(pa_queue_has(data->queue, &data->sources[0]));
+
+	g_assert_cmpint(data->num_expired, ==, 0);
+
+	tester_test_passed();
+}
+
+static void test_start_failed(const void *user_data)
+{
+	struct test_data *data = (void *) user_data;
+
+	/* A source that cannot be synced to does not hold a slot */
+	test_data_init(data, 2, 0);
+	data->fail = 1;
+	push_all(data);
+
+	g_assert_cmpint(data->num_started, ==, 2);
+	g_assert_cmpint(data->started[0], ==, 0);
+	g_assert_cmpint(data->started[1], ==, 2);
+	g_assert_false(pa_queue_has(data->queue, &data->sources[1]));
+	g_assert_cmpint(pa_queue_get_pending(data->queue), ==, 1);
+
+	tester_test_passed();
+}
+
+static void test_timeout(const void *user_data)
+{
+	struct test_data *data = (void *) user_data;
+
+	/* Syncs timing out release their slot to the next source, expired_cb
+	 * completes the test once all of them went through it.
+	 */
+	test_data_init(data, 1, 10);
+	push_all(data);
+
+	g_assert_cmpint(data->num_started, ==, 1);
+	g_assert_cmpint(pa_queue_get_pending(data->queue), ==,
+							NUM_SOURCES - 1);
+}
+
+#define define_test(name, function)					\
+	do {								\
+		static struct test_data data;				\
+		tester_add(name, &data, NULL, function, test_teardown);	\
+	} while (0)
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	define_test("/pa-queue/max", test_max);
+	define_test("/pa-queue/start-failed", test_start_failed);
+	define_test("/pa-queue/timeout", test_timeout);
+
+	return tester_run();
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "bluetooth/bluetooth.h"
+
+#include "src/shared/tester.h"
+#include "src/shared/value-cache.h"
+
+static const bdaddr_t addr_a = { { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 } };
+static const bdaddr_t addr_b = { { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 } };
+
+static const uint8_t value_1[] = { 0x01, 0x02, 0x03 };
+static const uint8_t value_2[] = { 0x04, 0x05 };
+
+static void assert_value(struct value_cache *cache, const bdaddr_t *bdaddr,
+				const uint8_t *expected, uint16_t expected_len)
+{
+	const uint8_t *value;
+	uint16_t len;
+
+	g_assert_true(value_cache_get(cache, bdaddr, BDADDR_LE_PUBLIC,
+							&value, &len));
+	g_assert_cmpint(len, ==, expected_len);
+	g_assert_true(!memcmp(value, expected, len));
+}
+
+static void assert_no_value(struct value_cache *cache, const bdaddr_t *bdaddr)
+{
+	const uint8_t *value;
+	uint16_t len;
+
+	g_assert_false(value_cache_get(cache, bdaddr, BDADDR_LE_PUBLIC,
+							&value, &len));
+}
+
+static void test_per_device(const void *data)
+{
+	struct value_cache *cache = value_cache_new(0);
+	unsigned int token;
+
+	token = value_cache_begin(cache);
+	g_assert_true(value_cache_store(cache, &addr_a, BDADDR_LE_PUBLIC,
+					token, value_1, sizeof(value_1)));
+
+	/* A reply to a read made for a device is only reused for it */
+	assert_value(cache, &addr_a, value_1, sizeof(value_1));
+	assert_no_value(cache, &addr_b);
+
+	g_assert_true(value_cache_store(cache, &addr_b, BDADDR_LE_PUBLIC,
+					token, value_2, sizeof(value_2)));
+	assert_value(cache, &addr_a, value_1, sizeof(value_1));
+	assert_value(cache, &addr_b, value_2, sizeof(value_2));
+
+	value_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_common(const void *data)
+{
+	struct value_cache *cache = value_cache_new(0);
+	unsigned int token;
+
+	/* Values set by the application are valid for every device */
+	value_cache_set(cache, value_1, sizeof(value_1));
+	assert_value(cache, &addr_a, value_1, sizeof(value_1));
+	assert_value(cache, &addr_b, value_1, sizeof(value_1));
+
+	token = value_cache_begin(cache);
+	g_assert_true(value_cache_store(cache, &addr_a, BDADDR_LE_PUBLIC,
+					token, value_2, sizeof(value_2)));
+	assert_value(cache, &addr_a, value_2, sizeof(value_2));
+	assert_value(cache, &addr_b, value_1, sizeof(value_1));
+
+	/* A new common value replaces what was read for each device */
+	value_cache_set(cache, value_1, sizeof(value_1));
+	assert_value(cache, &addr_a, value_1, sizeof(value_1));
+
+	value_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_write(const void *data)
+{
+	struct value_cache *cache = value_cache_new(0);
+	unsigned int token;
+
+	value_cache_set(cache, value_1, sizeof(value_1));
+
+	/* Read started, then a write from another device lands */
+	token = value_cache_begin(cache);
+	value_cache_invalidate(cache);
+	assert_no_value(cache, &addr_a);
+	assert_no_value(cache, &addr_b);
+
+	/* The reply may carry the value from before the write */
+	g_assert_false(value_cache_store(cache, &addr_a, BDADDR_LE_PUBLIC,
+					token, value_1, sizeof(value_1)));
+	assert_no_value(cache, &addr_a);
+
+	token = value_cache_begin(cache);
+	g_assert_true(value_cache_store(cache, &addr_a, BDADDR_LE_PUBLIC,
+					token, value_2, sizeof(value_2)));
+	assert_value(cache, &addr_a, value_2, sizeof(value_2));
+
+	value_cache_free(cache);
+
+	tester_test_passed();
+}
+
+static void test_timeout(const void *data)
+{
+	struct value_cache *cache = value_cache_new(10);
+
+	value_cache_set(cache, value_1, sizeof(value_1));
+	assert_value(cache, &addr_a, value_1, sizeof(value_1));
+
+	usleep(20 * 1000);
+	assert_no_value(cache, &addr_a);
+
+	/* Timeout updated through PropertiesChanged */
+	value_cache_set_timeout(cache, 0);
+	value_cache_set(cache, value_2, sizeof(value_2));
+
+	usleep(20 * 1000);
+	assert_value(cache, &addr_a, value_2, sizeof(value_2));
+
+	value_cache_free(cache);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/value-cache/per-device", NULL, NULL, test_per_device,
+									NULL);
+	tester_add("/value-cache/common", NULL, NULL, test_common, NULL);
+	tester_add("/value-cache/write", NULL, NULL, test_write, NULL);
+	tester_add("/value-cache/timeout", NULL, NULL, test_timeout, NULL);
+
+	return tester_run();
+}